@@ -28,6 +28,16 @@
 #define SSDP_SUPPORT                0           // SSDP support requires web support
 #endif
 
+#if not SPIFFS_SUPPORT
+#undef MQTT_OFFLINE_QUEUE_SPILL
+#define MQTT_OFFLINE_QUEUE_SPILL    0           // Spilling MQTT offline queue requires SPIFFS
+#endif
+
+#if MQTT_LIBRARY != MQTT_LIBRARY_ASYNCMQTTCLIENT
+#undef MQTT_MIRROR_SUPPORT
+#define MQTT_MIRROR_SUPPORT         0           // Mirror broker connection is only implemented with the AsyncMqttClient
+#endif
+
 #if UART_MQTT_SUPPORT
 #undef MQTT_SUPPORT
 #define MQTT_SUPPORT                1           // UART<->MQTT requires MQTT and no serial debug & terminal
@@ -40,6 +40,24 @@
 #define HEARTBEAT_INTERVAL          300     // Default time (in seconds) for heartbeat messages
 #endif
 
+// When only the changed values are reported (see MQTT_HEARTBEAT_DELTA and WS_UPDATE_DELTA),
+// value is considered to be changed when the difference is larger than the threshold
+#ifndef HEARTBEAT_DELTA_RSSI
+#define HEARTBEAT_DELTA_RSSI        5       // dBm
+#endif
+
+#ifndef HEARTBEAT_DELTA_FREEHEAP
+#define HEARTBEAT_DELTA_FREEHEAP    1024    // bytes
+#endif
+
+#ifndef HEARTBEAT_DELTA_LOADAVG
+#define HEARTBEAT_DELTA_LOADAVG     5       // %
+#endif
+
+#ifndef HEARTBEAT_DELTA_VCC
+#define HEARTBEAT_DELTA_VCC         50      // mV
+#endif
+
 //------------------------------------------------------------------------------
 // DEBUG
 //------------------------------------------------------------------------------
@@ -215,6 +233,16 @@
                                                 // If not defined the firmware will use a number based
                                                 // on the number of available sectors
 
+#ifndef EEPROM_COMMIT_INTERVAL
+#define EEPROM_COMMIT_INTERVAL      5           // (seconds) Minimum time between two consecutive EEPROM commits
+                                                // Every change requested in the meantime is written at once
+#endif
+
+#ifndef EEPROM_COMMIT_BUDGET
+#define EEPROM_COMMIT_BUDGET        60          // Maximum number of EEPROM commits per hour (0 to disable)
+                                                // Pending changes are always written before reset or deep sleep
+#endif
+
 #ifndef SAVE_CRASH_ENABLED
 #define SAVE_CRASH_ENABLED          1           // Save stack trace to EEPROM by default
                                                 // Depends on DEBUG_SUPPORT == 1
@@ -351,6 +379,10 @@
 #define HEARTBEAT_REPORT_BSSID       0
 #endif
 
+#ifndef HEARTBEAT_REPORT_MQTT
+#define HEARTBEAT_REPORT_MQTT        0          // Outgoing messages and connection counters, see MQTT.STATS
+#endif
+
 //------------------------------------------------------------------------------
 // Load average
 //------------------------------------------------------------------------------
@@ -710,6 +742,14 @@
 #define WS_UPDATE_INTERVAL          30          // Time (in seconds) between periodic status updates sent out to every client
 #endif
 
+#ifndef WS_UPDATE_DELTA
+#define WS_UPDATE_DELTA             1           // Only send changed values with periodic status updates...
+#endif
+
+#ifndef WS_UPDATE_RESYNC
+#define WS_UPDATE_RESYNC            300         // ...and everything once every N seconds (or, when new client connects)
+#endif
+
 // -----------------------------------------------------------------------------
 // API
 // -----------------------------------------------------------------------------
@@ -827,6 +867,11 @@
 #define OTA_MQTT_SUPPORT            0           // Listen for HTTP(s) URLs at '<root topic>/ota'. Depends on OTA_CLIENT
 #endif
 
+#ifndef OTA_MQTT_BINARY_SUPPORT
+#define OTA_MQTT_BINARY_SUPPORT     0           // Accept firmware image published to '<root topic>/ota/bin'. Depends on MQTT client
+                                                // delivering large messages in parts (i.e. MQTT_LIBRARY_ASYNCMQTTCLIENT)
+#endif
+
 #ifndef OTA_ARDUINOOTA_SUPPORT
 #define OTA_ARDUINOOTA_SUPPORT      1           // Support ArduinoOTA by default (4.2Kb)
                                                 // Implicitly depends on ESP8266mDNS library, thus increasing firmware size
@@ -951,6 +996,7 @@
 #define MQTT_LIBRARY                MQTT_LIBRARY_ASYNCMQTTCLIENT       // MQTT_LIBRARY_ASYNCMQTTCLIENT (default, https://github.com/marvinroger/async-mqtt-client)
                                                                        // MQTT_LIBRARY_PUBSUBCLIENT (https://github.com/knolleary/pubsubclient)
                                                                        // MQTT_LIBRARY_ARDUINOMQTT (https://github.com/256dpi/arduino-mqtt)
+                                                                       // MQTT_LIBRARY_MQTT5 (built-in MQTT 5 client, see mqtt_v5.h)
 #endif
 
 // -----------------------------------------------------------------------------
@@ -1043,15 +1089,36 @@
 #define MQTT_RECONNECT_DELAY_MIN    5000            // Try to reconnect in 5 seconds upon disconnection
 #endif
 
-#ifndef MQTT_RECONNECT_DELAY_STEP
-#define MQTT_RECONNECT_DELAY_STEP   5000            // Increase the reconnect delay in 5 seconds after each failed attempt
+#ifndef MQTT_RECONNECT_DELAY_MAX
+#define MQTT_RECONNECT_DELAY_MAX    120000          // Reconnect delay of the broker is doubled after each failed attempt, up to 2 minutes
 #endif
 
-#ifndef MQTT_RECONNECT_DELAY_MAX
-#define MQTT_RECONNECT_DELAY_MAX    120000          // Set reconnect time to 2 minutes at most
+#ifndef MQTT_CONNECT_TIMEOUT
+#define MQTT_CONNECT_TIMEOUT        10000           // Give up on the broker when connection is not established in 10 seconds
+#endif
+
+#ifndef MQTT_FAILOVER_MAX
+#define MQTT_FAILOVER_MAX           2               // Up to N `mqttFailover<N>` brokers tried in order when `mqttServer` is not reachable
+#endif
+
+#ifndef MQTT_FAILBACK_INTERVAL
+#define MQTT_FAILBACK_INTERVAL      600             // Try to go back to a preferred broker after N seconds of using the failover one. 0 to disable
+#endif
+
+#ifndef MQTT_MIRROR_SUPPORT
+#define MQTT_MIRROR_SUPPORT         0               // Also publish the `mqttMirrorTopic<N>` topics to the `mqttMirror` broker. Disabled by default
+                                                    // Only available with MQTT_LIBRARY_ASYNCMQTTCLIENT
+#endif
+
+#ifndef MQTT_MIRROR_TOPICS_MAX
+#define MQTT_MIRROR_TOPICS_MAX      4               // Up to N `mqttMirrorTopic<N>` prefixes of the mirrored topics
 #endif
 
 
+#ifndef MQTT_SETTINGS_RESTORE_SUPPORT
+#define MQTT_SETTINGS_RESTORE_SUPPORT 0             // Apply binary settings backup published to '<root topic>/restore'. Disabled by default
+#endif
+
 #ifndef MQTT_SKIP_TIME
 #define MQTT_SKIP_TIME              0               // Skip messages for N ms after connection. Disabled by default
 #endif
@@ -1069,10 +1136,81 @@
 #endif
 
 #ifndef MQTT_BUFFER_MAX_SIZE
-#define MQTT_BUFFER_MAX_SIZE        1024            // Size of the MQTT payload buffer for MQTT_MESSAGE_EVENT. Large messages will only be available via MQTT_MESSAGE_RAW_EVENT.
+#define MQTT_BUFFER_MAX_SIZE        1024            // Size of the MQTT payload buffer for MQTT_MESSAGE_EVENT. Large messages will only be available to the stream handlers (see mqttRegisterStream)
                                                     // Note: When using MQTT_LIBRARY_PUBSUBCLIENT, MQTT_MAX_PACKET_SIZE should not be more than this value.
 #endif
 
+#ifndef MQTT_OFFLINE_QUEUE_SIZE
+#define MQTT_OFFLINE_QUEUE_SIZE     16              // Keep up to N messages published while disconnected, sent after (re)connecting. 0 to disable
+#endif
+
+#ifndef MQTT_OFFLINE_QUEUE_BYTES
+#define MQTT_OFFLINE_QUEUE_BYTES    2048            // ...but only up to N bytes of topics and payloads in total
+#endif
+
+#ifndef MQTT_OFFLINE_QUEUE_RATE
+#define MQTT_OFFLINE_QUEUE_RATE     4               // Send at most N queued messages...
+#endif
+
+#ifndef MQTT_OFFLINE_QUEUE_INTERVAL
+#define MQTT_OFFLINE_QUEUE_INTERVAL 100             // ...every N ms after connecting
+#endif
+
+#ifndef MQTT_OFFLINE_QUEUE_SPILL
+#define MQTT_OFFLINE_QUEUE_SPILL    0               // Store retained and QoS>0 messages that do not fit into the queue on the SPIFFS
+                                                    // Depends on SPIFFS_SUPPORT
+#endif
+
+#ifndef MQTT_OFFLINE_QUEUE_SPILL_SIZE
+#define MQTT_OFFLINE_QUEUE_SPILL_SIZE   4096        // Maximum size of the SPIFFS file (bytes)
+#endif
+
+#ifndef MQTT_TOPIC_CACHE_SIZE
+#define MQTT_TOPIC_CACHE_SIZE       64              // Up to N published topic strings are built once and kept in memory (until settings are reloaded)
+#endif
+
+#ifndef MQTT_RATE_RULES_MAX
+#define MQTT_RATE_RULES_MAX         4               // Up to N `mqttRateTopic<N>` rules limiting how often the matching topics are published
+#endif
+
+#ifndef MQTT_RATE_BUCKETS
+#define MQTT_RATE_BUCKETS           16              // Number of topics that could be limited at the same time
+#endif
+
+#ifndef MQTT_RATE_INTERVAL
+#define MQTT_RATE_INTERVAL          1000            // Default `mqttRate<N>`, send at most one message every N ms...
+#endif
+
+#ifndef MQTT_RATE_BURST
+#define MQTT_RATE_BURST             1               // Default `mqttRateBurst<N>`, ...or up to N messages at once after being idle
+#endif
+
+#ifndef MQTT_HEARTBEAT_DELTA
+#define MQTT_HEARTBEAT_DELTA        0               // Send static heartbeat data (app, version, board, etc.) once after connecting as retained messages,
+                                                    // and only the dynamic data that changed more than HEARTBEAT_DELTA_... with every heartbeat after that
+#endif
+
+#ifndef MQTT_HEARTBEAT_RESYNC
+#define MQTT_HEARTBEAT_RESYNC       3600            // ...but, still send everything once every N seconds
+#endif
+
+// These are only used by the MQTT_LIBRARY_MQTT5
+#ifndef MQTT_SESSION_EXPIRY
+#define MQTT_SESSION_EXPIRY         0               // Broker keeps the session for N seconds after disconnecting. 0 to start with a clean session every time
+#endif
+
+#ifndef MQTT_TOPIC_ALIASES
+#define MQTT_TOPIC_ALIASES          16              // Replace up to N published topics with a 2-byte alias (still limited by the broker). 0 to disable
+#endif
+
+#ifndef MQTT_RECEIVE_MAXIMUM
+#define MQTT_RECEIVE_MAXIMUM        8               // Broker is allowed to send up to N unacknowledged QoS>0 messages
+#endif
+
+#ifndef MQTT_MESSAGE_ID_PROPERTY
+#define MQTT_MESSAGE_ID_PROPERTY    0               // Attach sequential `id` user property to every published message
+#endif
+
 // These are the properties that will be sent when useJson is true
 #ifndef MQTT_ENQUEUE_IP
 #define MQTT_ENQUEUE_IP             1
@@ -1123,6 +1261,15 @@
 #define SETTINGS_AUTOSAVE       1           // Autosave settings or force manual commit
 #endif
 
+#ifndef SETTINGS_INDEX_SUPPORT
+#define SETTINGS_INDEX_SUPPORT  1           // Keep in-memory hash index of the stored keys (~4 to 8 bytes of heap per key)
+                                            // Avoids walking the whole storage on every getSetting() call
+#endif
+
+#ifndef SETTINGS_GC_SLICE
+#define SETTINGS_GC_SLICE       8           // Number of key-values checked by the settings GC on every loop
+#endif
+
 // -----------------------------------------------------------------------------
 // LIGHT
 // -----------------------------------------------------------------------------
@@ -1620,6 +1767,10 @@
 #define IR_TX_RAW_MQTT_TOPIC        "irraw"         // (string) MQTT topic subscription to transmit the RAW timings
 #endif
 
+#ifndef IR_TX_RAW_MQTT_SIZE_MAX
+#define IR_TX_RAW_MQTT_SIZE_MAX     4096            // (bytes) Largest RAW timings payload accepted, independent of the MQTT_BUFFER_MAX_SIZE
+#endif
+
 #ifndef IR_RX_STATE_MQTT_TOPIC
 #define IR_RX_STATE_MQTT_TOPIC      "irstate"       // (string) MQTT topic to publish messages with 'state'
                                                     // (commonly, HVAC with payload size >=64bit, but this depends on the protocol)
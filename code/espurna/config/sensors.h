@@ -57,6 +57,26 @@
                                                             // Warning: this might wear out flash fast!
 #endif
 
+#ifndef SENSOR_HISTORY_SUPPORT
+#define SENSOR_HISTORY_SUPPORT              0               // Keep recent values of every magnitude in RAM
+#endif
+
+#ifndef SENSOR_HISTORY_BUDGET
+#define SENSOR_HISTORY_BUDGET               2048            // Maximum amount of RAM (in bytes) shared by every magnitude history
+#endif                                                      // Number of values kept is reduced when it does not fit
+
+#ifndef SENSOR_HISTORY_RAW
+#define SENSOR_HISTORY_RAW                  32              // Number of raw values
+#endif
+
+#ifndef SENSOR_HISTORY_MINUTES
+#define SENSOR_HISTORY_MINUTES              60              // Number of 1 minute min / avg / max values (last hour)
+#endif
+
+#ifndef SENSOR_HISTORY_QUARTERS
+#define SENSOR_HISTORY_QUARTERS             96              // Number of 15 minute min / avg / max values (last day)
+#endif
+
 #ifndef SENSOR_PUBLISH_ADDRESSES
 #define SENSOR_PUBLISH_ADDRESSES            0               // Publish sensor addresses
 #endif
@@ -443,6 +463,10 @@
 #define EMON_MAX_TIME                   250         // Max time in ms to sample
 #endif
 
+#ifndef EMON_SLICE_TIME
+#define EMON_SLICE_TIME                 5           // Max time in ms to sample at once, sampling continues in the next loop()
+#endif
+
 #ifndef EMON_FILTER_SPEED
 #define EMON_FILTER_SPEED               512         // Mobile average filter speed
 #endif
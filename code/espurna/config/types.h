@@ -186,6 +186,7 @@
 #define MQTT_LIBRARY_ASYNCMQTTCLIENT        0
 #define MQTT_LIBRARY_ARDUINOMQTT            1
 #define MQTT_LIBRARY_PUBSUBCLIENT           2
+#define MQTT_LIBRARY_MQTT5                  3
 
 
 //------------------------------------------------------------------------------
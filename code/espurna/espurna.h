@@ -30,6 +30,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "types.h"
 #include "debug.h"
 #include "gpio.h"
+#include "latency.h"
 #include "storage_eeprom.h"
 #include "settings.h"
 #include "system.h"
@@ -68,4 +69,7 @@ void espurnaRegisterOnceUnique(espurna::Callback::Type);
 espurna::duration::Milliseconds espurnaLoopDelay();
 void espurnaLoopDelay(espurna::duration::Milliseconds);
 
+const espurna::LatencyHistogram& espurnaLoopLatency();
+void espurnaLoopLatencyReset();
+
 void extraSetup();
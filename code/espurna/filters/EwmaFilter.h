@@ -0,0 +1,62 @@
+// -----------------------------------------------------------------------------
+// Exponentially Weighted Moving Average Filter
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+#include "BaseFilter.h"
+
+// Every value is weighted by 2 / (size + 1), the same smoothing factor as with the
+// `size`-period moving average. Does not store anything besides the current value
+class EwmaFilter : public BaseFilter {
+public:
+    void update(double value) override {
+        if (!_size) {
+            return;
+        }
+
+        if (!_count) {
+            _value = value;
+        } else {
+            _value += _alpha * (value - _value);
+        }
+
+        if (_count < _size) {
+            ++_count;
+        }
+    }
+
+    bool available() const override {
+        return _count > 0;
+    }
+
+    bool ready() const override {
+        return (_size > 0)
+            && (_count == _size);
+    }
+
+    double value() const override {
+        return _value;
+    }
+
+    void resize(size_t size) override {
+        _size = size;
+        _alpha = 2.0 / (static_cast<double>(size) + 1.0);
+
+        if (!_size) {
+            _count = 0;
+        } else if (_count > _size) {
+            _count = _size;
+        }
+    }
+
+    void reset() override {
+        _count = 0;
+    }
+
+private:
+    double _value { 0.0 };
+    double _alpha { 1.0 };
+    size_t _size { 0 };
+    size_t _count { 0 };
+};
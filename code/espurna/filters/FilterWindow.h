@@ -0,0 +1,84 @@
+// -----------------------------------------------------------------------------
+// Fixed capacity window of the most recent filter values
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Storage is only allocated in resize(), push() overwrites the oldest value when full
+template <typename T>
+class FilterWindow {
+public:
+    // Most recent values that still fit are preserved
+    void resize(size_t capacity) {
+        std::vector<T> values;
+        values.reserve(capacity);
+
+        const auto keep = (_size > capacity) ? capacity : _size;
+        for (size_t index = _size - keep; index < _size; ++index) {
+            values.push_back((*this)[index]);
+        }
+
+        _size = values.size();
+        _head = 0;
+
+        values.resize(capacity);
+        _values = std::move(values);
+    }
+
+    void clear() {
+        _size = 0;
+        _head = 0;
+    }
+
+    // Returns true when the oldest value had to be removed
+    bool push(T value, T& removed) {
+        if (!_values.size()) {
+            return false;
+        }
+
+        const auto tail = _position(_size);
+        if (_size < _values.size()) {
+            _values[tail] = value;
+            ++_size;
+            return false;
+        }
+
+        removed = _values[tail];
+        _values[tail] = value;
+        _head = _position(1);
+
+        return true;
+    }
+
+    // Index 0 is the oldest value
+    const T& operator[](size_t index) const {
+        return _values[_position(index)];
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+    size_t capacity() const {
+        return _values.size();
+    }
+
+    bool full() const {
+        return (_size > 0) && (_size == _values.size());
+    }
+
+private:
+    size_t _position(size_t index) const {
+        const auto out = _head + index;
+        return (out >= _values.size())
+            ? (out - _values.size())
+            : out;
+    }
+
+    std::vector<T> _values;
+    size_t _head { 0 };
+    size_t _size { 0 };
+};
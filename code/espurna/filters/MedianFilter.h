@@ -8,140 +8,250 @@
 
 #include "BaseFilter.h"
 
-#include <algorithm>
+#include <cstdint>
+#include <utility>
 #include <vector>
 
+// Window values are split between two heaps - lower half in the max-heap and upper half in the min-heap,
+// median is at the top of either one. Every value remembers its heap position, so the oldest one can be
+// removed in O(log n) without searching for it. Storage is only allocated in resize()
 class MedianFilter : public BaseFilter {
 public:
     void update(double value) override {
-        // Inserted value is always with the last index
-        if (!_size) {
+        if (!_slots.size()) {
             return;
         }
 
-        const auto size = _values.size();
-        auto pending =
-            Value{
-                .value = value,
-                .index = size,
-            };
-
-        // Special case for initial state
-        if (!_values.size()) {
-            _values.push_back(pending);
+        // When window is full, oldest value is replaced with the new one
+        const auto slot = _position(_count);
+        if (_count == _slots.size()) {
+            _replace(slot, value);
+            _head = _position(1);
             return;
         }
 
-        // Pop first element by index, shift everything else down
-        if (_values.size() == _size) {
-            const auto it = std::find_if(
-                _values.begin(),
-                _values.end(),
-                [&](const Value& value) {
-                    return value.index == 0;
-                });
-
-            _values.erase(it);
-            for (auto& entry : _values) {
-                --entry.index;
-            }
-
-            pending.index -= 1;
-        }
-
-        // Defensively sort the values vector
-        const auto upper = std::upper_bound(
-            _values.begin(), _values.end(), pending,
-            [](const Value& lhs, const Value& rhs) {
-                return lhs.value < rhs.value;
-            });
-        _values.insert(upper, pending);
+        ++_count;
+        _insert(slot, value);
     }
 
     double value() const override {
-        // Special case when early report triggers value read
-        if (_values.size() == 1) {
-            return _values.front().value;
-        } else if (_values.size() == 2) {
-            return (_values.front().value + _values.back().value) / 2.0;
-        // Otherwise, pick out the middle section and average it
-        } else if (0 == (_values.size() % 2)) {
-            const auto lhs = _values.begin() + ((_values.size() / 2) - 1);
-            const auto rhs = std::next(lhs);
-
-            return ((*lhs).value + (*rhs).value) / 2.0;
+        if (!_count) {
+            return 0.0;
+        }
+
+        if (_lower.size() > _upper.size()) {
+            return _top(Lower);
         }
 
-        // ...or, use the middle element as-is
-        const auto it = _values.begin() + (_values.size() / 2);
-        return (*it).value;
+        return (_top(Lower) + _top(Upper)) / 2.0;
     }
 
     bool available() const override {
-        return _values.size() > 0;
+        return _count > 0;
     }
 
     bool ready() const override {
-        return (_size > 0)
-            && (_values.size() == _size);
+        return (_slots.size() > 0)
+            && (_count == _slots.size());
     }
 
+    // Most recent values that still fit are preserved
     void resize(size_t size) override {
-        _resize(size);
+        std::vector<double> values;
+        values.reserve(size);
+
+        const auto keep = (_count > size) ? size : _count;
+        for (size_t index = _count - keep; index < _count; ++index) {
+            values.push_back(_slots[_position(index)].value);
+        }
+
+        _slots.clear();
+        _slots.shrink_to_fit();
+        _slots.resize(size);
+
+        for (auto* heap : {&_lower, &_upper}) {
+            heap->clear();
+            heap->shrink_to_fit();
+            heap->reserve(size);
+        }
+
+        _head = 0;
+        _count = 0;
+
+        for (const auto& value : values) {
+            update(value);
+        }
     }
 
     void reset() override {
-        _values.clear();
+        _lower.clear();
+        _upper.clear();
+        _head = 0;
+        _count = 0;
     }
 
 private:
-    void _resize(size_t size) {
-        if (!size) {
-            _values.clear();
-            _values.shrink_to_fit();
-        } else if ((size < _size) && _values.size()) {
-            _reset_offset(_size - size);
-        } else if (size > _size) {
-            _values.reserve(size);
+    using Heap = std::vector<uint16_t>;
+
+    enum Side : uint8_t {
+        Lower,
+        Upper,
+    };
+
+    struct Slot {
+        double value;
+        uint16_t position;
+        Side side;
+    };
+
+    size_t _position(size_t index) const {
+        const auto out = _head + index;
+        return (out >= _slots.size())
+            ? (out - _slots.size())
+            : out;
+    }
+
+    Heap& _heap(Side side) {
+        return (side == Lower) ? _lower : _upper;
+    }
+
+    const Heap& _heap(Side side) const {
+        return (side == Lower) ? _lower : _upper;
+    }
+
+    double _top(Side side) const {
+        return _slots[_heap(side).front()].value;
+    }
+
+    // Lower half keeps the largest value at the top, upper half keeps the smallest one
+    bool _before(Side side, uint16_t lhs, uint16_t rhs) const {
+        return (side == Lower)
+            ? (_slots[lhs].value > _slots[rhs].value)
+            : (_slots[lhs].value < _slots[rhs].value);
+    }
+
+    void _swap(Heap& heap, size_t lhs, size_t rhs) {
+        std::swap(heap[lhs], heap[rhs]);
+        _slots[heap[lhs]].position = lhs;
+        _slots[heap[rhs]].position = rhs;
+    }
+
+    void _sift_up(Side side, size_t position) {
+        auto& heap = _heap(side);
+        while (position > 0) {
+            const auto parent = (position - 1) / 2;
+            if (!_before(side, heap[position], heap[parent])) {
+                break;
+            }
+
+            _swap(heap, position, parent);
+            position = parent;
+        }
+    }
+
+    void _sift_down(Side side, size_t position) {
+        auto& heap = _heap(side);
+        for (;;) {
+            auto next = position;
+
+            const auto left = (2 * position) + 1;
+            if ((left < heap.size()) && _before(side, heap[left], heap[next])) {
+                next = left;
+            }
+
+            const auto right = left + 1;
+            if ((right < heap.size()) && _before(side, heap[right], heap[next])) {
+                next = right;
+            }
+
+            if (next == position) {
+                break;
+            }
+
+            _swap(heap, position, next);
+            position = next;
         }
+    }
+
+    void _push(Side side, uint16_t slot) {
+        auto& heap = _heap(side);
+
+        _slots[slot].side = side;
+        _slots[slot].position = heap.size();
+        heap.push_back(slot);
 
-        _size = size;
+        _sift_up(side, heap.size() - 1);
     }
 
-    void _reset_offset(size_t offset) {
-        const auto it = std::remove_if(
-            _values.begin(),
-            _values.end(),
-            [&](Value& value) {
-                const auto remove = value.index < offset;
-                if (!remove) {
-                    value.index -= offset;
-                }
+    void _erase(Side side, size_t position) {
+        auto& heap = _heap(side);
 
-                return remove;
-            });
+        const auto last = heap.size() - 1;
+        if (position != last) {
+            _swap(heap, position, last);
+        }
+
+        heap.pop_back();
 
-        if (it != _values.end()) {
-            _values.erase(it, _values.end());
-            _values.shrink_to_fit();
+        // Moved value could belong either higher or lower in the heap
+        if (position < heap.size()) {
+            _sift_up(side, position);
+            _sift_down(side, position);
         }
     }
 
-    void _reset(size_t size) {
-        _values.clear();
-        _resize(size);
+    // Lower half has either the same amount of values as the upper half or a single extra one
+    void _balance() {
+        while (_lower.size() > (_upper.size() + 1)) {
+            const auto slot = _lower.front();
+            _erase(Lower, 0);
+            _push(Upper, slot);
+        }
+
+        while (_upper.size() > _lower.size()) {
+            const auto slot = _upper.front();
+            _erase(Upper, 0);
+            _push(Lower, slot);
+        }
     }
 
-    void _reset() {
-        _reset(_size);
+    void _insert(size_t slot, double value) {
+        _slots[slot].value = value;
+
+        const auto side = (!_lower.size() || (value <= _top(Lower)))
+            ? Lower
+            : Upper;
+        _push(side, slot);
+
+        _balance();
     }
 
-    // Track input index, since '_values' is sorted by 'value'
-    struct Value {
-        double value;
-        size_t index;
-    };
+    // Heap sizes stay the same. Only the replaced value could end up on the wrong side,
+    // and it would be at the top of its heap after sifting - exchange it with the other top
+    void _replace(size_t slot, double value) {
+        auto& current = _slots[slot];
+        current.value = value;
+
+        _sift_up(current.side, current.position);
+        _sift_down(current.side, current.position);
+
+        if (_upper.size() && (_top(Lower) > _top(Upper))) {
+            std::swap(_lower.front(), _upper.front());
+
+            _slots[_lower.front()].side = Lower;
+            _slots[_lower.front()].position = 0;
+            _slots[_upper.front()].side = Upper;
+            _slots[_upper.front()].position = 0;
+
+            _sift_down(Lower, 0);
+            _sift_down(Upper, 0);
+        }
+    }
+
+    std::vector<Slot> _slots;
+    Heap _lower;
+    Heap _upper;
 
-    std::vector<Value> _values {};
-    size_t _size { 0 };
+    size_t _head { 0 };
+    size_t _count { 0 };
 };
@@ -7,23 +7,22 @@
 #pragma once
 
 #include "BaseFilter.h"
-
-#include <cstdio>
-#include <vector>
-#include <numeric>
+#include "FilterWindow.h"
 
 class MovingAverageFilter : public BaseFilter {
 public:
     void update(double value) override {
-        if (!_size) {
-            return;
+        double removed;
+        if (_values.push(value, removed)) {
+            _sum -= removed;
         }
 
-        if (_size == _values.size()) {
-            _values.erase(_values.begin());
-        }
+        _sum += value;
 
-        _values.push_back(value);
+        // Rounding errors of the running sum accumulate over time, start over every full window
+        if (++_updates >= _values.capacity()) {
+            _recalculate();
+        }
     }
 
     bool available() const override {
@@ -31,8 +30,7 @@ public:
     }
 
     bool ready() const override {
-        return (_size > 0)
-            && (_values.size() == _size);
+        return _values.full();
     }
 
     double value() const override {
@@ -40,31 +38,30 @@ public:
             return 0.0;
         }
 
-        return std::accumulate(_values.begin(), _values.end(), 0.0)
-             / _values.size();
+        return _sum / _values.size();
     }
 
     void resize(size_t size) override {
-        if (!size) {
-            _values.clear();
-            _values.shrink_to_fit();
-        } else if (size < _size) {
-            _values.erase(
-                _values.begin(),
-                _values.begin() + (_size - size));
-            _values.shrink_to_fit();
-        } else if (size > _size) {
-            _values.reserve(size);
-        }
-
-        _size = size;
+        _values.resize(size);
+        _recalculate();
     }
 
     void reset() override {
         _values.clear();
+        _recalculate();
     }
 
 private:
-    std::vector<double> _values {};
-    size_t _size { 0 };
+    void _recalculate() {
+        _sum = 0.0;
+        for (size_t index = 0; index < _values.size(); ++index) {
+            _sum += _values[index];
+        }
+
+        _updates = 0;
+    }
+
+    FilterWindow<double> _values;
+    double _sum { 0.0 };
+    size_t _updates { 0 };
 };
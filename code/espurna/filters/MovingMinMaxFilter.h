@@ -0,0 +1,120 @@
+// -----------------------------------------------------------------------------
+// Moving Min & Max Filters
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+#include "BaseFilter.h"
+#include "FilterWindow.h"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Unlike Min and Max filters, value is only ever picked from the last `size` values and nothing is reset
+// after reporting. Candidates are kept in a monotonic deque - every new value removes the ones it overrides
+// from the back, expired value is removed from the front, so the current one is always at the front.
+template <typename Compare>
+class MovingExtremumFilter : public BaseFilter {
+public:
+    void update(double value) override {
+        double removed;
+        _values.push(value, removed);
+        _push(value);
+    }
+
+    bool available() const override {
+        return _values.size() > 0;
+    }
+
+    bool ready() const override {
+        return _values.full();
+    }
+
+    double value() const override {
+        if (!_deque_size) {
+            return 0.0;
+        }
+
+        return _deque[_deque_front].value;
+    }
+
+    // Most recent values that still fit are preserved
+    void resize(size_t size) override {
+        _values.resize(size);
+
+        _deque.clear();
+        _deque.shrink_to_fit();
+        _deque.resize(size);
+
+        _rebuild();
+    }
+
+    void reset() override {
+        _values.clear();
+        _rebuild();
+    }
+
+private:
+    struct Entry {
+        uint32_t sequence;
+        double value;
+    };
+
+    size_t _deque_position(size_t index) const {
+        const auto out = _deque_front + index;
+        return (out >= _deque.size())
+            ? (out - _deque.size())
+            : out;
+    }
+
+    Entry& _deque_back() {
+        return _deque[_deque_position(_deque_size - 1)];
+    }
+
+    void _push(double value) {
+        const auto capacity = _deque.size();
+        if (!capacity) {
+            return;
+        }
+
+        ++_sequence;
+
+        // Unsigned difference, sequence is allowed to overflow
+        if (_deque_size && ((_sequence - _deque[_deque_front].sequence) >= capacity)) {
+            _deque_front = _deque_position(1);
+            --_deque_size;
+        }
+
+        while (_deque_size && !Compare{}(_deque_back().value, value)) {
+            --_deque_size;
+        }
+
+        ++_deque_size;
+        _deque_back() = Entry{
+            .sequence = _sequence,
+            .value = value,
+        };
+    }
+
+    void _rebuild() {
+        _deque_front = 0;
+        _deque_size = 0;
+
+        for (size_t index = 0; index < _values.size(); ++index) {
+            _push(_values[index]);
+        }
+    }
+
+    // Only needed to rebuild the deque when resized
+    FilterWindow<double> _values;
+
+    std::vector<Entry> _deque;
+    size_t _deque_front { 0 };
+    size_t _deque_size { 0 };
+
+    uint32_t _sequence { 0 };
+};
+
+using MovingMinFilter = MovingExtremumFilter<std::less<double>>;
+using MovingMaxFilter = MovingExtremumFilter<std::greater<double>>;
@@ -0,0 +1,85 @@
+// -----------------------------------------------------------------------------
+// Trimmed Mean Filter
+// -----------------------------------------------------------------------------
+
+#pragma once
+
+#include "BaseFilter.h"
+#include "FilterWindow.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Average of the last `size` values, without the lowest and the highest quarter of them.
+// Sorted copy of the window is updated in place, storage is only allocated in resize()
+class TrimmedMeanFilter : public BaseFilter {
+public:
+    void update(double value) override {
+        // Sorted order does not exist for NaN, it would never be found again
+        if (!_values.capacity() || std::isnan(value)) {
+            return;
+        }
+
+        double removed;
+        if (_values.push(value, removed)) {
+            const auto it = std::lower_bound(
+                _sorted.begin(), _sorted.end(), removed);
+            _sorted.erase(it);
+        }
+
+        const auto it = std::upper_bound(
+            _sorted.begin(), _sorted.end(), value);
+        _sorted.insert(it, value);
+    }
+
+    bool available() const override {
+        return _values.size() > 0;
+    }
+
+    bool ready() const override {
+        return _values.full();
+    }
+
+    double value() const override {
+        if (!_sorted.size()) {
+            return 0.0;
+        }
+
+        const auto trim = _sorted.size() / 4;
+
+        const auto begin = _sorted.begin() + trim;
+        const auto end = _sorted.end() - trim;
+
+        double sum { 0.0 };
+        for (auto it = begin; it != end; ++it) {
+            sum += *it;
+        }
+
+        return sum / std::distance(begin, end);
+    }
+
+    // Most recent values that still fit are preserved
+    void resize(size_t size) override {
+        _values.resize(size);
+
+        _sorted.clear();
+        _sorted.shrink_to_fit();
+        _sorted.reserve(size);
+
+        for (size_t index = 0; index < _values.size(); ++index) {
+            _sorted.push_back(_values[index]);
+        }
+
+        std::sort(_sorted.begin(), _sorted.end());
+    }
+
+    void reset() override {
+        _values.clear();
+        _sorted.clear();
+    }
+
+private:
+    FilterWindow<double> _values;
+    std::vector<double> _sorted;
+};
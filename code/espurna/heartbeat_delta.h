@@ -0,0 +1,98 @@
+/*
+
+Part of the SYSTEM MODULE
+
+Remembers values sent with the last heartbeat, so that only the changed ones are sent again
+
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+#include "types.h"
+
+namespace espurna {
+namespace heartbeat {
+
+// Every field is identified by its index, e.g. bit position of the Report
+template <size_t Size>
+class Delta {
+public:
+    static_assert(Size <= 32, "");
+
+    // Numeric values are only reported when the difference is larger than the threshold
+    bool changed(size_t index, double value, double threshold) {
+        auto& last = _values[index];
+        if (known(index) && (std::fabs(value - last.number) <= threshold)) {
+            return false;
+        }
+
+        last.number = value;
+        _known |= (1ul << index);
+        ++_changes;
+
+        return true;
+    }
+
+    // Everything else is only compared by its hash
+    bool changed(size_t index, StringView value) {
+        const auto hash = fnv1a(value);
+
+        auto& last = _values[index];
+        if (known(index) && (last.hash == hash)) {
+            return false;
+        }
+
+        last.hash = hash;
+        _known |= (1ul << index);
+        ++_changes;
+
+        return true;
+    }
+
+    bool changed(size_t index, const String& value) {
+        return changed(index, StringView(value));
+    }
+
+    // Next check of every field will pass
+    void reset() {
+        _known = 0;
+    }
+
+    bool known(size_t index) const {
+        return (_known & (1ul << index)) > 0;
+    }
+
+    // Number of values that passed the check since boot
+    uint32_t changes() const {
+        return _changes;
+    }
+
+private:
+    static uint32_t fnv1a(StringView value) {
+        uint32_t out { 2166136261ul };
+        for (auto it = value.begin(); it != value.end(); ++it) {
+            out ^= static_cast<uint8_t>(*it);
+            out *= 16777619ul;
+        }
+
+        return out;
+    }
+
+    union Value {
+        double number;
+        uint32_t hash;
+    };
+
+    std::array<Value, Size> _values{};
+    uint32_t _known { 0 };
+    uint32_t _changes { 0 };
+};
+
+} // namespace heartbeat
+} // namespace espurna
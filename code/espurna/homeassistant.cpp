@@ -1278,7 +1278,7 @@ void send(DiscoveryPtr discovery, FlagPtr flag_ptr) {
             return pid > 0;
         });
 
-#if MQTT_LIBRARY == MQTT_LIBRARY_ASYNCMQTTCLIENT
+#if (MQTT_LIBRARY == MQTT_LIBRARY_ASYNCMQTTCLIENT) || (MQTT_LIBRARY == MQTT_LIBRARY_MQTT5)
     // Receive acknowledgement from the broker before continuing.
     // Usually a good idea in general, to avoid filling network buffers too quickly.
     //
@@ -1402,15 +1402,15 @@ void onConnected() {
     }
 }
 
-void onMessage(StringView topic, StringView payload) {
 #if LIGHT_PROVIDER != LIGHT_PROVIDER_NONE
-    auto t = ::mqttMagnitude(topic);
-    if (t.equals(Topic)) {
-        receiveLightJson(payload);
-        return;
-    }
+void onLightJson(const ::espurna::mqtt::Match&, StringView payload) {
+    receiveLightJson(payload);
+}
 #endif
 
+// Birth topic is an absolute one, outside of the root topic. Which is why
+// it is not registered as a pattern and is matched here instead
+void onMessage(StringView topic, StringView payload) {
     if ((topic == internal::birthTopic)
      && (payload == settings::birthPayload()))
     {
@@ -1519,6 +1519,7 @@ void setup() {
 #if LIGHT_PROVIDER != LIGHT_PROVIDER_NONE
     lightOnReport(publishLightJson);
     mqttHeartbeat(heartbeat);
+    mqttRegister(StringView(Topic), mqtt::onLightJson);
 #endif
     mqttRegister(mqtt::callback);
 
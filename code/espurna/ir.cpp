@@ -1223,6 +1223,12 @@ const char* topicTxRaw() {
     return IR_TX_RAW_MQTT_TOPIC;
 }
 
+// RAW timings payload is allowed to be larger than the MQTT buffer,
+// memory is only used while the message is being received
+constexpr size_t txRawSizeMax() {
+    return IR_TX_RAW_MQTT_SIZE_MAX;
+}
+
 const char* topicRxState() {
     return IR_RX_STATE_MQTT_TOPIC;
 }
@@ -1255,7 +1261,7 @@ bool publish_raw { build::rxRaw() };
 bool publish_simple { build::rxSimple() };
 bool publish_state { build::rxState() };
 
-void callback(unsigned int type, StringView topic, StringView payload) {
+void callback(unsigned int type, StringView, StringView) {
     switch (type) {
 
     case MQTT_CONNECT_EVENT:
@@ -1264,20 +1270,41 @@ void callback(unsigned int type, StringView topic, StringView payload) {
         mqttSubscribe(build::topicTxRaw());
         break;
 
-    case MQTT_MESSAGE_EVENT: {
-        auto t = mqttMagnitude(topic);
-        if (t.equals(build::topicTxSimple())) {
-            ir::tx::enqueue(ir::simple::parse(payload));
-        } else if (t.equals(build::topicTxState())) {
-            ir::tx::enqueue(ir::state::parse(payload));
-        } else if (t.equals(build::topicTxRaw())) {
-            ir::tx::enqueue(ir::raw::parse(payload));
-        }
+    }
+}
+
+void tx_simple(const espurna::mqtt::Match&, StringView payload) {
+    ir::tx::enqueue(ir::simple::parse(payload));
+}
+
+void tx_state(const espurna::mqtt::Match&, StringView payload) {
+    ir::tx::enqueue(ir::state::parse(payload));
+}
 
+// Only reached when the stream handler could not be registered,
+// payload is then limited by the MQTT_BUFFER_MAX_SIZE
+void tx_raw(const espurna::mqtt::Match&, StringView payload) {
+    ir::tx::enqueue(ir::raw::parse(payload));
+}
+
+espurna::mqtt::Accumulator raw_accumulator(build::txRawSizeMax());
+
+bool raw_stream(const espurna::mqtt::Fragment& fragment) {
+    using Result = espurna::mqtt::Accumulator::Result;
+
+    switch (raw_accumulator.feed(fragment)) {
+    case Result::Pending:
+        return true;
+    case Result::Done:
+        ir::tx::enqueue(ir::raw::parse(raw_accumulator.data()));
+        break;
+    case Result::Error:
+        DEBUG_MSG_P(PSTR("[IR] Discarding RAW payload (%u bytes)\n"), fragment.total);
         break;
     }
 
-    }
+    raw_accumulator.reset();
+    return false;
 }
 
 } // namespace internal
@@ -1302,6 +1329,11 @@ void configure() {
 
 void setup() {
     mqttRegister(internal::callback);
+    mqttRegister(build::topicTxSimple(), internal::tx_simple);
+    mqttRegister(build::topicTxState(), internal::tx_state);
+    if (!mqttRegisterStream(build::topicTxRaw(), internal::raw_stream)) {
+        mqttRegister(build::topicTxRaw(), internal::tx_raw);
+    }
 }
 
 } // namespace mqtt
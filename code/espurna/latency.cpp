@@ -0,0 +1,31 @@
+/*
+
+Part of the MAIN MODULE
+
+*/
+
+#include "latency.h"
+
+namespace espurna {
+namespace latency {
+
+size_t index(duration::Microseconds value, size_t buckets) {
+    auto ms = std::chrono::duration_cast<duration::Milliseconds>(value).count();
+
+    size_t out { 0 };
+    while (ms && (out < (buckets - 1))) {
+        ms >>= 1;
+        ++out;
+    }
+
+    return out;
+}
+
+duration::Milliseconds lower(size_t index) {
+    return index
+        ? duration::Milliseconds(1ul << (index - 1))
+        : duration::Milliseconds::zero();
+}
+
+} // namespace latency
+} // namespace espurna
@@ -0,0 +1,100 @@
+/*
+
+Part of the MAIN MODULE
+
+Histogram of the time spent somewhere, e.g. running every loop() callback once.
+Buckets are power-of-two milliseconds - [0, 1), [1, 2), [2, 4), ..., [2^(Buckets - 2), inf)
+
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+
+#include "types.h"
+
+namespace espurna {
+namespace latency {
+
+// Bucket that the value would be counted in
+size_t index(duration::Microseconds, size_t buckets);
+
+// Lower bound of the bucket values
+duration::Milliseconds lower(size_t index);
+
+} // namespace latency
+
+template <size_t Size>
+class BasicLatencyHistogram {
+public:
+    static_assert(Size > 1, "");
+    static constexpr size_t Buckets { Size };
+
+    void add(duration::Microseconds value) {
+        // avoid wrapping the counters, start over instead
+        if (_count == std::numeric_limits<decltype(_count)>::max()) {
+            reset();
+        }
+
+        ++_buckets[index(value)];
+        ++_count;
+
+        _max = std::max(_max, value);
+        _total += value;
+    }
+
+    void reset() {
+        _buckets.fill(0);
+        _count = 0;
+
+        _max = duration::Microseconds::zero();
+        _total = duration::Microseconds::zero();
+    }
+
+    static size_t index(duration::Microseconds value) {
+        return latency::index(value, Buckets);
+    }
+
+    static duration::Milliseconds lower(size_t index) {
+        return latency::lower(index);
+    }
+
+    uint32_t bucket(size_t index) const {
+        return _buckets[index];
+    }
+
+    uint32_t count() const {
+        return _count;
+    }
+
+    duration::Microseconds max() const {
+        return _max;
+    }
+
+    duration::Microseconds total() const {
+        return _total;
+    }
+
+    duration::Microseconds average() const {
+        return _count
+            ? duration::Microseconds(_total.count() / _count)
+            : duration::Microseconds::zero();
+    }
+
+private:
+    std::array<uint32_t, Buckets> _buckets{};
+    uint32_t _count { 0 };
+
+    duration::Microseconds _max{};
+    duration::Microseconds _total{};
+};
+
+// Last bucket starts at 512ms
+using LatencyHistogram = BasicLatencyHistogram<11>;
+
+} // namespace espurna
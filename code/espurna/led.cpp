@@ -960,29 +960,27 @@ void loop() {
 #if MQTT_SUPPORT
 namespace mqtt {
 
-void callback(unsigned int type, StringView topic, StringView payload) {
+void callback(unsigned int type, StringView, StringView) {
     if (type == MQTT_CONNECT_EVENT) {
         mqttSubscribe(MQTT_TOPIC_LED "/+");
         return;
     }
+}
 
-    // Only want `led/+/<MQTT_SETTER>`
-    // We get the led ID from the `+`
-    if (type == MQTT_MESSAGE_EVENT) {
-        const auto magnitude = mqttMagnitude(topic);
-        if (!magnitude.startsWith(MQTT_TOPIC_LED)) {
-            return;
-        }
-
-        size_t ledID;
-        if (tryParseIdPath(magnitude, ledCount(), ledID)) {
-            payload_status(internal::leds[ledID], payload);
-        }
+// Only want `led/+/<MQTT_SETTER>`, led ID is the `+`
+PROGMEM_STRING(Pattern, MQTT_TOPIC_LED "/{index}");
 
-        return;
+void message(const ::espurna::mqtt::Match& match, StringView payload) {
+    if (match.index < ledCount()) {
+        payload_status(internal::leds[match.index], payload);
     }
 }
 
+void setup() {
+    ::mqttRegister(callback);
+    ::mqttRegister(Pattern, message);
+}
+
 } // namespace mqtt
 #endif // MQTT_SUPPORT
 
@@ -1071,7 +1069,7 @@ void setup() {
     if (leds) {
         espurna::led::settings::query::setup();
 #if MQTT_SUPPORT
-        ::mqttRegister(mqtt::callback);
+        mqtt::setup();
 #endif
 #if WEB_SUPPORT
         ::wsRegister()
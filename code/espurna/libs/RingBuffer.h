@@ -0,0 +1,94 @@
+/*
+
+Fixed-size byte ring buffer. Storage is allocated once, in the constructor.
+Writer and reader are expected to run in the same context (e.g. CONT and the
+SYS callback that is only ever called while CONT yields)
+
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+class RingBuffer {
+public:
+    RingBuffer() = delete;
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer(RingBuffer&&) = default;
+
+    explicit RingBuffer(size_t capacity) :
+        _buffer(new uint8_t[capacity]),
+        _capacity(capacity)
+    {}
+
+    size_t capacity() const {
+        return _capacity;
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+    size_t space() const {
+        return _capacity - _size;
+    }
+
+    bool empty() const {
+        return _size == 0;
+    }
+
+    bool full() const {
+        return _size == _capacity;
+    }
+
+    void clear() {
+        _head = 0;
+        _size = 0;
+    }
+
+    // Copies as much as possible, returns the number of bytes actually written
+    size_t write(const uint8_t* data, size_t size) {
+        size = std::min(size, space());
+        if (!size) {
+            return 0;
+        }
+
+        const auto tail = (_head + _size) % _capacity;
+        const auto first = std::min(size, _capacity - tail);
+
+        std::copy(data, data + first, _buffer.get() + tail);
+        std::copy(data + first, data + size, _buffer.get());
+
+        _size += size;
+        return size;
+    }
+
+    // Copies as much as possible, returns the number of bytes actually read
+    size_t read(uint8_t* out, size_t size) {
+        size = std::min(size, _size);
+        if (!size) {
+            return 0;
+        }
+
+        const auto first = std::min(size, _capacity - _head);
+
+        std::copy(_buffer.get() + _head, _buffer.get() + _head + first, out);
+        std::copy(_buffer.get(), _buffer.get() + (size - first), out + first);
+
+        _size -= size;
+        _head = _size
+            ? (_head + size) % _capacity
+            : 0;
+
+        return size;
+    }
+
+private:
+    std::unique_ptr<uint8_t[]> _buffer;
+    size_t _capacity;
+    size_t _head { 0 };
+    size_t _size { 0 };
+};
@@ -2287,80 +2287,75 @@ void _lightMqttCallback(unsigned int type, espurna::StringView topic, espurna::S
         }
     }
 
+    // Base topics are handled through mqttRegister(pattern, ...)
     if (type == MQTT_MESSAGE_EVENT) {
-        // Group color
         if ((mqtt_group_color.length() > 0) && (topic == mqtt_group_color)) {
             _lightFromCommaSeparatedPayload(payload);
             _lightUpdateFromMqttGroup();
-            return;
-        }
-
-        // Match topic
-        auto t = mqttMagnitude(topic);
-
-        // Color temperature in mireds
-        if (t.equals(MQTT_TOPIC_MIRED)) {
-            _lightAdjustMireds(payload);
-            _lightUpdateFromMqtt();
-            return;
-        }
-
-        // Color temperature in kelvins
-        if (t.equals(MQTT_TOPIC_KELVIN)) {
-            _lightAdjustKelvin(payload);
-            _lightUpdateFromMqtt();
-            return;
         }
+    }
 
-        // Color
-        if (t.equals(MQTT_TOPIC_COLOR_RGB) || t.equals(MQTT_TOPIC_COLOR_HEX)) {
-            _lightFromRgbPayload(payload);
-            _lightUpdateFromMqtt();
-            return;
-        }
+}
 
-        if (t.equals(MQTT_TOPIC_COLOR_HSV)) {
-            _lightFromHsvPayload(payload);
-            _lightUpdateFromMqtt();
-            return;
-        }
+using LightMqttPayloadHandler = void(*)(espurna::StringView);
 
-        // Transition setting (persist)
-        if (t.equals(MQTT_TOPIC_TRANSITION)) {
-            _lightApiTransition(payload);
-            return;
-        }
+template <LightMqttPayloadHandler Handler>
+void _lightMqttHandleMessage(const espurna::mqtt::Match&, espurna::StringView payload) {
+    Handler(payload);
+    _lightUpdateFromMqtt();
+}
 
-        // Brightness
-        if (t.equals(MQTT_TOPIC_BRIGHTNESS)) {
-            _lightAdjustBrightness(payload);
-            _lightUpdateFromMqtt();
-            return;
-        }
+void _lightMqttHandleChannel(const espurna::mqtt::Match& match, espurna::StringView payload) {
+    if (match.index < _light_channels.size()) {
+        _lightAdjustChannel(match.index, payload);
+        _lightUpdateFromMqtt();
+    }
+}
 
-        // Channel
-        if (t.startsWith(MQTT_TOPIC_CHANNEL)) {
-            size_t id;
-            if (_lightTryParseChannel(t, id)) {
-                _lightAdjustChannel(id, payload);
-                _lightUpdateFromMqtt();
-            }
-            return;
-        }
+void _lightMqttHandleLight(const espurna::mqtt::Match&, espurna::StringView payload) {
+    _lightParsePayload(payload);
+    _lightUpdateFromMqtt();
+}
 
-        // Global
-        if (t.equals(MQTT_TOPIC_LIGHT)) {
-            _lightParsePayload(payload);
-            _lightUpdateFromMqtt();
-        }
+// Transition setting (persist)
+void _lightMqttHandleTransition(const espurna::mqtt::Match&, espurna::StringView payload) {
+    _lightApiTransition(payload);
+}
 
-    }
+struct LightMqttTopicHandler {
+    espurna::StringView pattern;
+    espurna::mqtt::MessageCallback callback;
+};
 
-}
+PROGMEM_STRING(MqttTopicMired, MQTT_TOPIC_MIRED);
+PROGMEM_STRING(MqttTopicKelvin, MQTT_TOPIC_KELVIN);
+PROGMEM_STRING(MqttTopicRgb, MQTT_TOPIC_COLOR_RGB);
+PROGMEM_STRING(MqttTopicHex, MQTT_TOPIC_COLOR_HEX);
+PROGMEM_STRING(MqttTopicHsv, MQTT_TOPIC_COLOR_HSV);
+PROGMEM_STRING(MqttTopicTransition, MQTT_TOPIC_TRANSITION);
+PROGMEM_STRING(MqttTopicBrightness, MQTT_TOPIC_BRIGHTNESS);
+PROGMEM_STRING(MqttTopicChannel, MQTT_TOPIC_CHANNEL "/{index}");
+PROGMEM_STRING(MqttTopicLight, MQTT_TOPIC_LIGHT);
+
+static constexpr LightMqttTopicHandler LightMqttTopicHandlers[] PROGMEM {
+    {MqttTopicMired, _lightMqttHandleMessage<_lightAdjustMireds>},
+    {MqttTopicKelvin, _lightMqttHandleMessage<_lightAdjustKelvin>},
+    {MqttTopicRgb, _lightMqttHandleMessage<_lightFromRgbPayload>},
+    {MqttTopicHex, _lightMqttHandleMessage<_lightFromRgbPayload>},
+    {MqttTopicHsv, _lightMqttHandleMessage<_lightFromHsvPayload>},
+    {MqttTopicTransition, _lightMqttHandleTransition},
+    {MqttTopicBrightness, _lightMqttHandleMessage<_lightAdjustBrightness>},
+    {MqttTopicChannel, _lightMqttHandleChannel},
+    {MqttTopicLight, _lightMqttHandleLight},
+};
 
 void _lightMqttSetup() {
     mqttHeartbeat(_lightMqttHeartbeat);
     mqttRegister(_lightMqttCallback);
+
+    for (const auto handler : LightMqttTopicHandlers) {
+        mqttRegister(handler.pattern, handler.callback);
+    }
 }
 
 } // namespace
@@ -2799,8 +2794,8 @@ static void _lightCommandNotify(::terminal::CommandContext&& ctx) {
 PROGMEM_STRING(LightCommand, "LIGHT");
 
 static void _lightCommand(::terminal::CommandContext&& ctx) {
-    if (ctx.argv.size() > 1) {
-        if (!_lightParsePayload(ctx.argv[1])) {
+    if (ctx.views.size() > 1) {
+        if (!_lightParsePayload(ctx.views[1])) {
             terminalError(ctx, F("Invalid payload"));
             return;
         }
@@ -2815,8 +2810,8 @@ static void _lightCommand(::terminal::CommandContext&& ctx) {
 PROGMEM_STRING(LightCommandBrightness, "BRIGHTNESS");
 
 static void _lightCommandBrightness(::terminal::CommandContext&& ctx) {
-    if (ctx.argv.size() > 1) {
-        _lightAdjustBrightness(ctx.argv[1]);
+    if (ctx.views.size() > 1) {
+        _lightAdjustBrightness(ctx.views[1]);
         lightUpdate();
     }
     ctx.output.printf_P(PSTR("%ld\n"), _light_brightness);
@@ -2842,14 +2837,14 @@ static void _lightCommandChannel(::terminal::CommandContext&& ctx) {
                 String(_light_channels[channel].current, 2).c_str());
     };
 
-    if (ctx.argv.size() > 2) {
+    if (ctx.views.size() > 2) {
         size_t id;
-        if (!_lightTryParseChannel(ctx.argv[1], id)) {
+        if (!_lightTryParseChannel(ctx.views[1], id)) {
             terminalError(ctx, F("Invalid channel ID"));
             return;
         }
 
-        _lightAdjustChannel(id, ctx.argv[2]);
+        _lightAdjustChannel(id, ctx.views[2]);
         lightUpdate();
         description(id);
     } else {
@@ -2874,8 +2869,8 @@ static void _lightCommandColors(const ::terminal::CommandContext& ctx) {
 }
 
 static void _lightCommandRgb(::terminal::CommandContext&& ctx) {
-    if (ctx.argv.size() > 1) {
-        _lightFromRgbPayload(ctx.argv[1]);
+    if (ctx.views.size() > 1) {
+        _lightFromRgbPayload(ctx.views[1]);
         lightUpdate();
     }
 
@@ -2885,8 +2880,8 @@ static void _lightCommandRgb(::terminal::CommandContext&& ctx) {
 PROGMEM_STRING(LightCommandHsv, "HSV");
 
 static void _lightCommandHsv(::terminal::CommandContext&& ctx) {
-    if (ctx.argv.size() > 1) {
-        _lightFromHsvPayload(ctx.argv[1]);
+    if (ctx.views.size() > 1) {
+        _lightFromHsvPayload(ctx.views[1]);
         lightUpdate();
     }
 
@@ -2896,8 +2891,8 @@ static void _lightCommandHsv(::terminal::CommandContext&& ctx) {
 PROGMEM_STRING(LightCommandKelvin, "KELVIN");
 
 static void _lightCommandKelvin(::terminal::CommandContext&& ctx) {
-    if (ctx.argv.size() > 1) {
-        _lightAdjustKelvin(ctx.argv[1]);
+    if (ctx.views.size() > 1) {
+        _lightAdjustKelvin(ctx.views[1]);
         lightUpdate();
     }
 
@@ -2909,8 +2904,8 @@ static void _lightCommandKelvin(::terminal::CommandContext&& ctx) {
 PROGMEM_STRING(LightCommandMired, "MIRED");
 
 static void _lightCommandMired(::terminal::CommandContext&& ctx) {
-    if (ctx.argv.size() > 1) {
-        _lightAdjustMireds(ctx.argv[1]);
+    if (ctx.views.size() > 1) {
+        _lightAdjustMireds(ctx.views[1]);
         lightUpdate();
     }
 
@@ -2925,13 +2920,13 @@ static void _lightCommandMired(::terminal::CommandContext&& ctx) {
 
 static constexpr ::terminal::Command Commands[] PROGMEM {
     {LightCommandNotify, _lightCommandNotify},
-    {LightCommand, _lightCommand},
-    {LightCommandBrightness, _lightCommandBrightness},
-    {LightCommandChannel, _lightCommandChannel},
-    {LightCommandRgb, _lightCommandRgb},
-    {LightCommandHsv, _lightCommandHsv},
-    {LightCommandKelvin, _lightCommandKelvin},
-    {LightCommandMired, _lightCommandMired},
+    {LightCommand, _lightCommand, ::terminal::CommandViews},
+    {LightCommandBrightness, _lightCommandBrightness, ::terminal::CommandViews},
+    {LightCommandChannel, _lightCommandChannel, ::terminal::CommandViews},
+    {LightCommandRgb, _lightCommandRgb, ::terminal::CommandViews},
+    {LightCommandHsv, _lightCommandHsv, ::terminal::CommandViews},
+    {LightCommandKelvin, _lightCommandKelvin, ::terminal::CommandViews},
+    {LightCommandMired, _lightCommandMired, ::terminal::CommandViews},
 };
 
 void _lightInitCommands() {
@@ -71,6 +71,9 @@ bool reload_flag { false };
 std::vector<LoopCallback> loop_callbacks;
 espurna::duration::Milliseconds loop_delay { build::LoopDelayMin };
 
+// Time spent in the loop() itself, excluding the delay
+LatencyHistogram loop_latency;
+
 std::forward_list<Callback> once_callbacks;
 
 } // namespace internal
@@ -104,6 +107,14 @@ void loop_delay(duration::Milliseconds value) {
     internal::loop_delay = value;
 }
 
+const LatencyHistogram& loop_latency() {
+    return internal::loop_latency;
+}
+
+void loop_latency_reset() {
+    internal::loop_latency.reset();
+}
+
 void push_once(Callback callback) {
     internal::once_callbacks.push_front(std::move(callback));
 }
@@ -127,6 +138,8 @@ void push_once_unique(Callback::Type callback) {
 }
 
 void loop() {
+    const auto start = espurna::time::SystemClock::now();
+
     // Reload config before running any callbacks
     if (check_reload()) {
         for (const auto& callback : internal::reload_callbacks) {
@@ -152,6 +165,8 @@ void loop() {
         }
     }
 
+    internal::loop_latency.add(espurna::time::SystemClock::now() - start);
+
     espurna::time::delay(internal::loop_delay);
 }
 
@@ -413,6 +428,14 @@ void espurnaLoopDelay(espurna::duration::Milliseconds value) {
     espurna::main::loop_delay(value);
 }
 
+const espurna::LatencyHistogram& espurnaLoopLatency() {
+    return espurna::main::loop_latency();
+}
+
+void espurnaLoopLatencyReset() {
+    espurna::main::loop_latency_reset();
+}
+
 void setup() {
     espurna::main::setup();
 }
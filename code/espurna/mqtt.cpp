@@ -12,6 +12,7 @@ Updated secure client support by Niek van der Maas < mail at niekvandermaas dot
 #if MQTT_SUPPORT
 
 #include <forward_list>
+#include <memory>
 #include <utility>
 
 #include "system.h"
@@ -25,6 +26,22 @@ Updated secure client support by Niek van der Maas < mail at niekvandermaas dot
 #include "libs/AsyncClientHelpers.h"
 #include "libs/SecureClientHelpers.h"
 
+#include "heartbeat_delta.h"
+#include "mqtt_brokers.h"
+#include "mqtt_json.h"
+#include "mqtt_queue.h"
+#include "mqtt_rate.h"
+#include "mqtt_stats.h"
+#include "mqtt_topics.h"
+
+#if MQTT_LIBRARY == MQTT_LIBRARY_MQTT5
+#include "mqtt_v5.h"
+#endif
+
+#if MQTT_OFFLINE_QUEUE_SPILL
+#include <FS.h>
+#endif
+
 #if MQTT_LIBRARY == MQTT_LIBRARY_ASYNCMQTTCLIENT
 #include <ESPAsyncTCP.h>
 #include <AsyncMqttClient.h>
@@ -42,7 +59,7 @@ namespace {
 
     AsyncMqttClient _mqtt;
 
-#else // MQTT_LIBRARY_ARDUINOMQTT / MQTT_LIBRARY_PUBSUBCLIENT
+#else // MQTT_LIBRARY_ARDUINOMQTT / MQTT_LIBRARY_PUBSUBCLIENT / MQTT_LIBRARY_MQTT5
 
     WiFiClient _mqtt_client;
 
@@ -66,11 +83,44 @@ namespace {
 
     PubSubClient _mqtt;
 
+#elif MQTT_LIBRARY == MQTT_LIBRARY_MQTT5
+
+    // Client only handles the protocol, connection is still managed by the WiFiClient
+    struct MqttTransport : public espurna::mqtt::v5::Transport {
+        bool connected() override {
+            return client && client->connected();
+        }
+
+        size_t read(uint8_t* data, size_t size) override {
+            const auto available = client->available();
+            if (available <= 0) {
+                return 0;
+            }
+
+            const auto result = client->read(data,
+                std::min(size, static_cast<size_t>(available)));
+            return (result > 0) ? result : 0;
+        }
+
+        size_t write(const uint8_t* data, size_t size) override {
+            return client->write(data, size);
+        }
+
+        void stop() override {
+            client->stop();
+        }
+
+        WiFiClient* client { nullptr };
+    };
+
+    MqttTransport _mqtt_transport;
+    espurna::mqtt::v5::Client _mqtt(MQTT_BUFFER_MAX_SIZE);
+
 #endif
 
 #endif // MQTT_LIBRARY == MQTT_ASYNCMQTTCLIENT
 
-#if MQTT_LIBRARY == MQTT_LIBRARY_ASYNCMQTTCLIENT
+#if (MQTT_LIBRARY == MQTT_LIBRARY_ASYNCMQTTCLIENT) || (MQTT_LIBRARY == MQTT_LIBRARY_MQTT5)
 
 struct MqttPidCallbackHandler {
     uint16_t pid;
@@ -87,11 +137,22 @@ MqttPidCallbacks _mqtt_subscribe_callbacks;
 std::forward_list<espurna::heartbeat::Callback> _mqtt_heartbeat_callbacks;
 espurna::heartbeat::Mode _mqtt_heartbeat_mode;
 espurna::duration::Seconds _mqtt_heartbeat_interval;
+espurna::heartbeat::Mask _mqtt_heartbeat_report;
+
+// Values sent with the last heartbeat, when only the changed ones are sent
+bool _mqtt_heartbeat_delta_enabled { false };
+espurna::heartbeat::Delta<32> _mqtt_heartbeat_delta;
+espurna::duration::Seconds _mqtt_heartbeat_resync;
+espurna::time::CoreClock::time_point _mqtt_heartbeat_last_resync;
+bool _mqtt_heartbeat_static { false };
 
 String _mqtt_payload_online;
 String _mqtt_payload_offline;
 
 std::forward_list<MqttCallback> _mqtt_callbacks;
+espurna::mqtt::Dispatcher _mqtt_dispatcher;
+espurna::mqtt::Streams _mqtt_streams;
+espurna::mqtt::Stats _mqtt_stats;
 
 } // namespace
 
@@ -128,7 +189,17 @@ static constexpr espurna::duration::Milliseconds SkipTime { MQTT_SKIP_TIME };
 
 static constexpr espurna::duration::Milliseconds ReconnectDelayMin { MQTT_RECONNECT_DELAY_MIN };
 static constexpr espurna::duration::Milliseconds ReconnectDelayMax { MQTT_RECONNECT_DELAY_MAX };
-static constexpr espurna::duration::Milliseconds ReconnectStep { MQTT_RECONNECT_DELAY_STEP };
+static constexpr espurna::duration::Milliseconds ConnectTimeout { MQTT_CONNECT_TIMEOUT };
+
+static constexpr size_t FailoverMax { MQTT_FAILOVER_MAX };
+
+constexpr espurna::duration::Seconds failback() {
+    return espurna::duration::Seconds(MQTT_FAILBACK_INTERVAL);
+}
+
+#if MQTT_MIRROR_SUPPORT
+static constexpr size_t MirrorTopicsMax { MQTT_MIRROR_TOPICS_MAX };
+#endif
 
 static constexpr size_t MessageLogMax { 128ul };
 
@@ -201,6 +272,59 @@ constexpr uint16_t mfln() {
     return MQTT_SECURE_CLIENT_MFLN;
 }
 
+constexpr size_t offlineSize() {
+    return MQTT_OFFLINE_QUEUE_SIZE;
+}
+
+constexpr size_t offlineRate() {
+    return MQTT_OFFLINE_QUEUE_RATE;
+}
+
+static constexpr size_t OfflineQueueBytes { MQTT_OFFLINE_QUEUE_BYTES };
+static constexpr espurna::duration::Milliseconds OfflineQueueInterval { MQTT_OFFLINE_QUEUE_INTERVAL };
+
+#if MQTT_OFFLINE_QUEUE_SPILL
+static constexpr size_t OfflineSpillSize { MQTT_OFFLINE_QUEUE_SPILL_SIZE };
+#endif
+
+static constexpr size_t RateRulesMax { MQTT_RATE_RULES_MAX };
+static constexpr size_t TopicCacheSize { MQTT_TOPIC_CACHE_SIZE };
+static constexpr size_t RateBuckets { MQTT_RATE_BUCKETS };
+
+constexpr espurna::duration::Milliseconds rate() {
+    return espurna::duration::Milliseconds(MQTT_RATE_INTERVAL);
+}
+
+constexpr uint32_t rateBurst() {
+    return MQTT_RATE_BURST;
+}
+
+constexpr bool heartbeatDelta() {
+    return 1 == MQTT_HEARTBEAT_DELTA;
+}
+
+constexpr espurna::duration::Seconds heartbeatResync() {
+    return espurna::duration::Seconds(MQTT_HEARTBEAT_RESYNC);
+}
+
+#if MQTT_LIBRARY == MQTT_LIBRARY_MQTT5
+constexpr espurna::duration::Seconds sessionExpiry() {
+    return espurna::duration::Seconds(MQTT_SESSION_EXPIRY);
+}
+
+constexpr uint16_t topicAliases() {
+    return MQTT_TOPIC_ALIASES;
+}
+
+constexpr uint16_t receiveMaximum() {
+    return MQTT_RECEIVE_MAXIMUM;
+}
+
+constexpr bool messageId() {
+    return 1 == MQTT_MESSAGE_ID_PROPERTY;
+}
+#endif
+
 } // namespace
 } // namespace build
 
@@ -214,6 +338,12 @@ namespace {
 PROGMEM_STRING(Server, "mqttServer");
 PROGMEM_STRING(Port, "mqttPort");
 
+PROGMEM_STRING(Failover, "mqttFailover");
+PROGMEM_STRING(Failback, "mqttFailback");
+
+PROGMEM_STRING(Mirror, "mqttMirror");
+PROGMEM_STRING(MirrorTopic, "mqttMirrorTopic");
+
 PROGMEM_STRING(Enabled, "mqttEnabled");
 PROGMEM_STRING(Autoconnect, "mqttAutoconnect");
 
@@ -234,6 +364,9 @@ PROGMEM_STRING(TopicJson, "mqttJson");
 
 PROGMEM_STRING(HeartbeatMode, "mqttHbMode");
 PROGMEM_STRING(HeartbeatInterval, "mqttHbIntvl");
+PROGMEM_STRING(HeartbeatReport, "mqttHbReport");
+PROGMEM_STRING(HeartbeatDelta, "mqttHbDelta");
+PROGMEM_STRING(HeartbeatResync, "mqttHbResync");
 PROGMEM_STRING(SkipTime, "mqttSkipTime");
 
 PROGMEM_STRING(PayloadOnline, "mqttPayloadOnline");
@@ -244,6 +377,18 @@ PROGMEM_STRING(Fingerprint, "mqttFP");
 PROGMEM_STRING(SecureClientCheck, "mqttScCheck");
 PROGMEM_STRING(SecureClientMfln, "mqttScMFLN");
 
+PROGMEM_STRING(OfflineSize, "mqttOfflineSize");
+PROGMEM_STRING(OfflineRate, "mqttOfflineRate");
+
+PROGMEM_STRING(RateTopic, "mqttRateTopic");
+PROGMEM_STRING(Rate, "mqttRate");
+PROGMEM_STRING(RateBurst, "mqttRateBurst");
+
+PROGMEM_STRING(SessionExpiry, "mqttSessExpiry");
+PROGMEM_STRING(TopicAliases, "mqttTopicAliases");
+PROGMEM_STRING(ReceiveMaximum, "mqttRecvMax");
+PROGMEM_STRING(MessageId, "mqttMsgId");
+
 } // namespace
 } // namespace keys
 
@@ -257,6 +402,25 @@ uint16_t port() {
     return getSetting(keys::Port, build::port());
 }
 
+// Either 'host' or 'host:port', port is the same as the `mqttPort` when it is not specified
+String failover(size_t index) {
+    return getSetting({keys::Failover, index});
+}
+
+espurna::duration::Seconds failback() {
+    return getSetting(keys::Failback, build::failback());
+}
+
+#if MQTT_MIRROR_SUPPORT
+String mirror() {
+    return getSetting(keys::Mirror);
+}
+
+String mirrorTopic(size_t index) {
+    return getSetting({keys::MirrorTopic, index});
+}
+#endif
+
 bool enabled() {
     return getSetting(keys::Enabled, build::enabled());
 }
@@ -323,6 +487,26 @@ espurna::duration::Seconds heartbeatInterval() {
     return getSetting(keys::HeartbeatInterval, espurna::heartbeat::currentInterval());
 }
 
+// Same as the `hbReport`, 1 enables every report
+espurna::heartbeat::Mask heartbeatReport() {
+    static constexpr espurna::heartbeat::Mask MaskAll { 1 };
+
+    auto value = getSetting(keys::HeartbeatReport, espurna::heartbeat::currentValue());
+    if (value == MaskAll) {
+        value = std::numeric_limits<espurna::heartbeat::Mask>::max();
+    }
+
+    return value;
+}
+
+bool heartbeatDelta() {
+    return getSetting(keys::HeartbeatDelta, build::heartbeatDelta());
+}
+
+espurna::duration::Seconds heartbeatResync() {
+    return getSetting(keys::HeartbeatResync, build::heartbeatResync());
+}
+
 espurna::duration::Milliseconds skipTime() {
     return getSetting(keys::SkipTime, build::skipTime());
 }
@@ -355,6 +539,44 @@ uint16_t mfln() {
     return getSetting(keys::SecureClientMfln, build::mfln());
 }
 
+size_t offlineSize() {
+    return getSetting(keys::OfflineSize, build::offlineSize());
+}
+
+size_t offlineRate() {
+    return std::max(getSetting(keys::OfflineRate, build::offlineRate()), size_t{ 1 });
+}
+
+String rateTopic(size_t index) {
+    return getSetting({keys::RateTopic, index});
+}
+
+espurna::duration::Milliseconds rate(size_t index) {
+    return getSetting({keys::Rate, index}, build::rate());
+}
+
+uint32_t rateBurst(size_t index) {
+    return std::max(getSetting({keys::RateBurst, index}, build::rateBurst()), uint32_t{ 1 });
+}
+
+#if MQTT_LIBRARY == MQTT_LIBRARY_MQTT5
+espurna::duration::Seconds sessionExpiry() {
+    return getSetting(keys::SessionExpiry, build::sessionExpiry());
+}
+
+uint16_t topicAliases() {
+    return getSetting(keys::TopicAliases, build::topicAliases());
+}
+
+uint16_t receiveMaximum() {
+    return std::max(getSetting(keys::ReceiveMaximum, build::receiveMaximum()), uint16_t{ 1 });
+}
+
+bool messageId() {
+    return getSetting(keys::MessageId, build::messageId());
+}
+#endif
+
 } // namespace
 
 namespace query {
@@ -368,6 +590,7 @@ String NAME () {\
 }
 
 EXACT_VALUE(port, settings::port)
+EXACT_VALUE(failback, settings::failback)
 EXACT_VALUE(enabled, settings::enabled)
 EXACT_VALUE(autoconnect, settings::autoconnect)
 EXACT_VALUE(qos, settings::qos)
@@ -376,7 +599,18 @@ EXACT_VALUE(keepalive, settings::keepalive)
 EXACT_VALUE(json, settings::json)
 EXACT_VALUE(heartbeatMode, settings::heartbeatMode)
 EXACT_VALUE(heartbeatInterval, settings::heartbeatInterval)
+EXACT_VALUE(heartbeatReport, settings::heartbeatReport)
+EXACT_VALUE(heartbeatDelta, settings::heartbeatDelta)
+EXACT_VALUE(heartbeatResync, settings::heartbeatResync)
 EXACT_VALUE(skipTime, settings::skipTime)
+EXACT_VALUE(offlineSize, settings::offlineSize)
+EXACT_VALUE(offlineRate, settings::offlineRate)
+#if MQTT_LIBRARY == MQTT_LIBRARY_MQTT5
+EXACT_VALUE(sessionExpiry, settings::sessionExpiry)
+EXACT_VALUE(topicAliases, settings::topicAliases)
+EXACT_VALUE(receiveMaximum, settings::receiveMaximum)
+EXACT_VALUE(messageId, settings::messageId)
+#endif
 
 #undef EXACT_VALUE
 
@@ -385,6 +619,10 @@ EXACT_VALUE(skipTime, settings::skipTime)
 static constexpr espurna::settings::query::Setting Settings[] PROGMEM {
     {keys::Server, settings::server},
     {keys::Port, internal::port},
+    {keys::Failback, internal::failback},
+#if MQTT_MIRROR_SUPPORT
+    {keys::Mirror, settings::mirror},
+#endif
     {keys::Enabled, internal::enabled},
     {keys::Autoconnect, internal::autoconnect},
     {keys::Topic, settings::topic},
@@ -401,9 +639,20 @@ static constexpr espurna::settings::query::Setting Settings[] PROGMEM {
     {keys::TopicJson, settings::topicJson},
     {keys::HeartbeatMode, internal::heartbeatMode},
     {keys::HeartbeatInterval, internal::heartbeatInterval},
+    {keys::HeartbeatReport, internal::heartbeatReport},
+    {keys::HeartbeatDelta, internal::heartbeatDelta},
+    {keys::HeartbeatResync, internal::heartbeatResync},
     {keys::SkipTime, internal::skipTime},
     {keys::PayloadOnline, settings::payloadOnline},
     {keys::PayloadOffline, settings::payloadOffline},
+    {keys::OfflineSize, internal::offlineSize},
+    {keys::OfflineRate, internal::offlineRate},
+#if MQTT_LIBRARY == MQTT_LIBRARY_MQTT5
+    {keys::SessionExpiry, internal::sessionExpiry},
+    {keys::TopicAliases, internal::topicAliases},
+    {keys::ReceiveMaximum, internal::receiveMaximum},
+    {keys::MessageId, internal::messageId},
+#endif
 };
 
 bool checkSamePrefix(espurna::StringView key) {
@@ -431,7 +680,15 @@ namespace {
 using MqttTimeSource = espurna::time::CoreClock;
 MqttTimeSource::time_point _mqtt_last_connection{};
 MqttTimeSource::duration _mqtt_skip_time { mqtt::build::SkipTime };
-MqttTimeSource::duration _mqtt_reconnect_delay { mqtt::build::ReconnectDelayMin };
+
+// Topics of the published {magnitude}s, rebuilt every time settings are changed
+espurna::mqtt::TopicCache _mqtt_topics(mqtt::build::TopicCacheSize);
+
+// `mqttServer` followed by the `mqttFailover<N>` brokers, each one with its own reconnect delay
+espurna::mqtt::Brokers _mqtt_brokers;
+size_t _mqtt_broker { espurna::mqtt::Brokers::NoIndex };
+MqttTimeSource::time_point _mqtt_connect_start{};
+bool _mqtt_disconnect_requested { false };
 
 AsyncClientState _mqtt_state { AsyncClientState::Disconnected };
 bool _mqtt_skip_messages { false };
@@ -457,6 +714,50 @@ struct MqttConnectionSettings {
 
 static MqttConnectionSettings _mqtt_settings;
 
+// Broker of the current connection attempt. Index could be NoIndex, or out of range after the list was
+// reconfigured; primary broker is used instead. Reference is kept by the client, so it is never a temporary
+const espurna::mqtt::Endpoint& _mqttEndpoint() {
+    if (_mqtt_broker < _mqtt_brokers.size()) {
+        return _mqtt_brokers.endpoint(_mqtt_broker);
+    }
+
+    if (_mqtt_brokers.size()) {
+        return _mqtt_brokers.endpoint(0);
+    }
+
+    static espurna::mqtt::Endpoint primary;
+    primary = espurna::mqtt::Endpoint{
+        .host = _mqtt_settings.server,
+        .port = _mqtt_settings.port,
+    };
+
+    return primary;
+}
+
+// Parts of the `<topic><setter>` surrounding the {magnitude}
+// (only updated when either one changes, instead of on every received message)
+struct MqttMagnitudeParts {
+    String prefix;
+    String suffix;
+    bool valid { false };
+};
+
+static MqttMagnitudeParts _mqtt_magnitude_parts;
+
+void _mqttUpdateMagnitudeParts() {
+    const auto pattern = _mqtt_settings.topic + _mqtt_settings.setter;
+
+    const auto it = std::find(pattern.begin(), pattern.end(), '#');
+    if (it == pattern.end()) {
+        _mqtt_magnitude_parts = MqttMagnitudeParts{};
+        return;
+    }
+
+    _mqtt_magnitude_parts.prefix = espurna::StringView(pattern.begin(), it).toString();
+    _mqtt_magnitude_parts.suffix = espurna::StringView(it + 1, pattern.end()).toString();
+    _mqtt_magnitude_parts.valid = true;
+}
+
 template <typename Lhs, typename Rhs>
 static void _mqttApplySetting(Lhs& lhs, Rhs&& rhs) {
     if (lhs != rhs) {
@@ -501,39 +802,211 @@ bool _mqttApplyValidTopicString(String& lhs, String&& rhs) {
 
 namespace {
 
-struct MqttPayload {
-    MqttPayload() = delete;
-    MqttPayload(const MqttPayload&) = default;
+// Entries are limited by the MQTT_QUEUE_MAX_SIZE and the total size of the resulting payload
+// Additional space is reserved for the device info, which is added to every message
+constexpr size_t MqttJsonPayloadBufferSize { 1024ul };
+constexpr size_t MqttJsonPayloadInfoSize { 192ul };
 
-    // TODO: replace String implementation with Core v3 (or just use newer Core)
-    //       2.7.x still has basic Arduino String move ctor that is not noexcept
-    MqttPayload(MqttPayload&& other) noexcept :
-        _topic(std::move(other._topic)),
-        _message(std::move(other._message))
-    {}
+espurna::mqtt::JsonBatch _mqtt_json_payload;
+std::unique_ptr<char[]> _mqtt_json_payload_buffer;
+espurna::timer::SystemTimer _mqtt_json_payload_flush;
 
-    template <typename Topic, typename Message>
-    MqttPayload(Topic&& topic, Message&& message) :
-        _topic(std::forward<Topic>(topic)),
-        _message(std::forward<Message>(message))
-    {}
+#if MQTT_ENQUEUE_HOSTNAME
+String _mqtt_json_hostname;
+#endif
 
-    const String& topic() const {
-        return _topic;
+// Storage is only allocated when grouping is enabled
+void _mqttJsonConfigure() {
+    if (!_mqtt_use_json) {
+        _mqtt_json_payload.reset(0, 0);
+        _mqtt_json_payload_buffer.reset();
+        return;
     }
 
-    const String& message() const {
-        return _message;
+    if (!_mqtt_json_payload_buffer) {
+        _mqtt_json_payload.reset(MQTT_QUEUE_MAX_SIZE, MqttJsonPayloadBufferSize);
+        _mqtt_json_payload_buffer.reset(
+            new char[MqttJsonPayloadBufferSize + MqttJsonPayloadInfoSize]);
     }
 
-private:
-    String _topic;
-    String _message;
-};
+#if MQTT_ENQUEUE_HOSTNAME
+    _mqtt_json_hostname = systemHostname();
+#endif
+}
 
-size_t _mqtt_json_payload_count { 0ul };
-std::forward_list<MqttPayload> _mqtt_json_payload;
-espurna::timer::SystemTimer _mqtt_json_payload_flush;
+} // namespace
+
+// -----------------------------------------------------------------------------
+// Offline queue
+// -----------------------------------------------------------------------------
+
+namespace {
+
+espurna::mqtt::OfflineQueue _mqtt_offline_queue;
+size_t _mqtt_offline_rate { mqtt::build::offlineRate() };
+MqttTimeSource::time_point _mqtt_offline_last{};
+
+bool _mqttOfflineEnqueue(const char* topic, const char* message, bool retain, int qos) {
+    if (!_mqtt_enabled || !_mqtt_offline_queue.capacity()) {
+        return false;
+    }
+
+    return _mqtt_offline_queue.push(
+        espurna::mqtt::Message{
+            .topic = topic,
+            .payload = message,
+            .retain = retain,
+            .qos = qos,
+            .timestamp = MqttTimeSource::now().time_since_epoch(),
+        });
+}
+
+void _mqttOfflineConfigure() {
+    const auto size = mqtt::settings::offlineSize();
+    if (size != _mqtt_offline_queue.capacity()) {
+        _mqtt_offline_queue.reset(size, mqtt::build::OfflineQueueBytes);
+    }
+
+    _mqtt_offline_rate = mqtt::settings::offlineRate();
+}
+
+#if MQTT_OFFLINE_QUEUE_SPILL
+
+// Every record is `<flags><topic length><payload length><topic><payload>`
+// Flags are the `retain` bit followed by the 2 bits of QoS, lengths are u16 LE
+PROGMEM_STRING(MqttOfflineSpillPath, "/mqtt.queue");
+constexpr size_t MqttOfflineSpillHeader { 5 };
+
+bool _mqtt_offline_restore { false };
+
+void _mqttOfflineSpill(espurna::mqtt::Message&& message) {
+    const auto topic = message.topic.length();
+    const auto payload = message.payload.length();
+    if ((topic > UINT16_MAX) || (payload > UINT16_MAX)) {
+        return;
+    }
+
+    auto file = SPIFFS.open(FPSTR(MqttOfflineSpillPath), "a");
+    if (!file) {
+        return;
+    }
+
+    if (file.size() + MqttOfflineSpillHeader + topic + payload > mqtt::build::OfflineSpillSize) {
+        DEBUG_MSG_P(PSTR("[MQTT] Offline queue file is full, dropping %s\n"), message.topic.c_str());
+        return;
+    }
+
+    const uint8_t header[MqttOfflineSpillHeader] {
+        static_cast<uint8_t>((message.retain ? 1 : 0) | ((message.qos & 0b11) << 1)),
+        static_cast<uint8_t>(topic & 0xff),
+        static_cast<uint8_t>((topic >> 8) & 0xff),
+        static_cast<uint8_t>(payload & 0xff),
+        static_cast<uint8_t>((payload >> 8) & 0xff),
+    };
+
+    file.write(header, sizeof(header));
+    file.write(reinterpret_cast<const uint8_t*>(message.topic.c_str()), topic);
+    file.write(reinterpret_cast<const uint8_t*>(message.payload.c_str()), payload);
+
+    _mqtt_offline_restore = true;
+}
+
+bool _mqttOfflineReadString(File& file, size_t length, String& out) {
+    out = String();
+    if (!out.reserve(length)) {
+        return false;
+    }
+
+    for (; length; --length) {
+        const auto c = file.read();
+        if (c < 0) {
+            return false;
+        }
+
+        out += static_cast<char>(c);
+    }
+
+    return true;
+}
+
+// Spilled messages go back into the queue first, before anything is sent.
+// Everything that no longer fits is dropped, file is only ever read once
+void _mqttOfflineRestore() {
+    auto file = SPIFFS.open(FPSTR(MqttOfflineSpillPath), "r");
+    if (!file) {
+        return;
+    }
+
+    _mqtt_offline_queue.spill(nullptr);
+
+    uint8_t header[MqttOfflineSpillHeader];
+    while (file.read(header, sizeof(header)) == sizeof(header)) {
+        espurna::mqtt::Message message;
+        message.retain = header[0] & 1;
+        message.qos = (header[0] >> 1) & 0b11;
+        message.timestamp = MqttTimeSource::now().time_since_epoch();
+
+        if (!_mqttOfflineReadString(file, header[1] | (header[2] << 8), message.topic)
+         || !_mqttOfflineReadString(file, header[3] | (header[4] << 8), message.payload))
+        {
+            break;
+        }
+
+        _mqtt_offline_queue.push(std::move(message));
+    }
+
+    file.close();
+    SPIFFS.remove(FPSTR(MqttOfflineSpillPath));
+
+    _mqtt_offline_queue.spill(_mqttOfflineSpill);
+}
+
+void _mqttOfflineSpillSetup() {
+    if (SPIFFS.begin()) {
+        _mqtt_offline_queue.spill(_mqttOfflineSpill);
+        _mqtt_offline_restore = SPIFFS.exists(FPSTR(MqttOfflineSpillPath));
+    }
+}
+
+#endif
+
+} // namespace
+
+// -----------------------------------------------------------------------------
+// Rate limiting
+// -----------------------------------------------------------------------------
+
+namespace {
+
+espurna::mqtt::RateLimiter _mqtt_rate;
+
+constexpr uint8_t MqttRateRetain { 1 };
+constexpr uint8_t MqttRateForce { 1 << 1 };
+
+// Pending messages are only lost when rules actually change
+void _mqttRateConfigure() {
+    std::vector<espurna::mqtt::RateRule> rules;
+    for (size_t index = 0; index < mqtt::build::RateRulesMax; ++index) {
+        auto prefix = mqtt::settings::rateTopic(index);
+        if (!prefix.length()) {
+            break;
+        }
+
+        rules.push_back(
+            espurna::mqtt::RateRule{
+                .prefix = std::move(prefix),
+                .interval = mqtt::settings::rate(index),
+                .burst = mqtt::settings::rateBurst(index),
+            });
+    }
+
+    if (rules == _mqtt_rate.rules()) {
+        return;
+    }
+
+    _mqtt_rate.reset(rules.empty() ? 0 : mqtt::build::RateBuckets);
+    _mqtt_rate.rules(std::move(rules));
+}
 
 } // namespace
 
@@ -548,7 +1021,7 @@ SecureClientConfig _mqtt_sc_config {
     .tag = "MQTT",
 #if SECURE_CLIENT == SECURE_CLIENT_AXTLS
     .on_host = []() -> String {
-        return _mqtt_server;
+        return _mqttEndpoint().host;
     },
 #endif
     .on_check = mqtt::settings::secureClientCheck,
@@ -585,12 +1058,14 @@ namespace {
 //   there is no middle-ground, where previous session is removed but the current one is preserved
 //   so, turning it ON <-> OFF during runtime is not very useful :/
 //
-// Pending MQTT v5 client
+// MQTT v5 client replaces this with the session expiry interval (ref. 3.1.2.11.2), see `mqttSessExpiry`.
+// Session is started clean when it is 0, otherwise the broker forgets about us after the specified time
 
 #if MQTT_LIBRARY == MQTT_LIBRARY_ASYNCMQTTCLIENT
 
 void _mqttSetupAsyncClient(bool secure = false) {
-    _mqtt.setServer(_mqtt_settings.server.c_str(), _mqtt_settings.port);
+    const auto& endpoint = _mqttEndpoint();
+    _mqtt.setServer(endpoint.host.c_str(), endpoint.port);
     _mqtt.setClientId(_mqtt_settings.clientId.c_str());
     _mqtt.setKeepAlive(_mqtt_settings.keepalive.count());
     _mqtt.setCleanSession(false);
@@ -620,7 +1095,7 @@ void _mqttSetupAsyncClient(bool secure = false) {
 
 #endif // MQTT_LIBRARY == MQTT_LIBRARY_ASYNCMQTTCLIENT
 
-#if (MQTT_LIBRARY == MQTT_LIBRARY_ARDUINOMQTT) || (MQTT_LIBRARY == MQTT_LIBRARY_PUBSUBCLIENT)
+#if (MQTT_LIBRARY == MQTT_LIBRARY_ARDUINOMQTT) || (MQTT_LIBRARY == MQTT_LIBRARY_PUBSUBCLIENT) || (MQTT_LIBRARY == MQTT_LIBRARY_MQTT5)
 
 WiFiClient& _mqttGetClient(bool secure) {
     #if SECURE_CLIENT != SECURE_CLIENT_NONE
@@ -645,10 +1120,11 @@ bool _mqttSetupSyncClient(bool secure = false) {
 
 bool _mqttConnectSyncClient(bool secure = false) {
     bool result = false;
+    const auto& endpoint = _mqttEndpoint();
 
     #if MQTT_LIBRARY == MQTT_LIBRARY_ARDUINOMQTT
-        _mqtt.begin(_mqtt_settings.server.c_str(),
-            _mqtt_settings.port,
+        _mqtt.begin(endpoint.host.c_str(),
+            endpoint.port,
             _mqttGetClient(secure));
         _mqtt.setWill(_mqtt_settings.will.c_str(),
             _mqtt_payload_offline.c_str(),
@@ -658,9 +1134,17 @@ bool _mqttConnectSyncClient(bool secure = false) {
             _mqtt_settings.clientId.c_str(),
             _mqtt_settings.user.c_str(),
             _mqtt_settings.pass.c_str());
+    #elif MQTT_LIBRARY == MQTT_LIBRARY_MQTT5
+        // TCP connection is blocking, same as with other sync clients. MQTT handshake is not,
+        // client reports back via onConnect() / onDisconnect() when CONNACK is received (or not)
+        auto& client = _mqttGetClient(secure);
+        result = client.connect(endpoint.host.c_str(), endpoint.port);
+        if (result) {
+            _mqtt_transport.client = &client;
+        }
     #elif MQTT_LIBRARY == MQTT_LIBRARY_PUBSUBCLIENT
         _mqtt.setClient(_mqttGetClient(secure));
-        _mqtt.setServer(_mqtt_settings.server.c_str(), _mqtt_port);
+        _mqtt.setServer(endpoint.host.c_str(), endpoint.port);
 
         if (_mqtt_settings.user.length() && _mqtt_settings.pass.length()) {
             DEBUG_MSG_P(PSTR("[MQTT] Connecting as user %s\n"), _mqtt_settings.user.c_str());
@@ -691,7 +1175,39 @@ bool _mqttConnectSyncClient(bool secure = false) {
     return result;
 }
 
-#endif // (MQTT_LIBRARY == MQTT_LIBRARY_ARDUINOMQTT) || (MQTT_LIBRARY == MQTT_LIBRARY_PUBSUBCLIENT)
+#endif // (MQTT_LIBRARY == MQTT_LIBRARY_ARDUINOMQTT) || (MQTT_LIBRARY == MQTT_LIBRARY_PUBSUBCLIENT) || (MQTT_LIBRARY == MQTT_LIBRARY_MQTT5)
+
+#if MQTT_LIBRARY == MQTT_LIBRARY_MQTT5
+
+bool _mqttConnectV5Client() {
+    if (_mqtt_settings.user.length() && _mqtt_settings.pass.length()) {
+        DEBUG_MSG_P(PSTR("[MQTT] Connecting as user %s\n"), _mqtt_settings.user.c_str());
+    }
+
+    using espurna::mqtt::v5::Options;
+    using espurna::mqtt::v5::Will;
+
+    return _mqtt.connect(_mqtt_transport,
+        Options{
+            .client_id = _mqtt_settings.clientId,
+            .user = _mqtt_settings.user,
+            .password = _mqtt_settings.pass,
+            .will = Will{
+                .topic = _mqtt_settings.will,
+                .payload = _mqtt_payload_offline,
+                .retain = _mqtt_settings.retain,
+                .qos = _mqtt_settings.qos,
+            },
+            .keepalive = espurna::duration::Seconds(_mqtt_settings.keepalive.count()),
+            .session_expiry = mqtt::settings::sessionExpiry(),
+            .topic_aliases = mqtt::settings::topicAliases(),
+            .receive_maximum = mqtt::settings::receiveMaximum(),
+            .message_id = mqtt::settings::messageId(),
+        },
+        MqttTimeSource::now().time_since_epoch());
+}
+
+#endif // MQTT_LIBRARY == MQTT_LIBRARY_MQTT5
 
 String _mqttPlaceholders(String text) {
     static const String mac = String(systemChipId());
@@ -710,49 +1226,240 @@ void _mqttMdnsStop();
 
 #endif
 
-void _mqttConfigure() {
+espurna::mqtt::Brokers::Options _mqttBrokersOptions() {
+    return espurna::mqtt::Brokers::Options{
+        .backoff_min = mqtt::build::ReconnectDelayMin,
+        .backoff_max = mqtt::build::ReconnectDelayMax,
+        .failback = mqtt::settings::failback(),
+    };
+}
 
-    // Make sure we have both the server to connect to things are enabled
-    {
-        _mqttApplySetting(_mqtt_settings.server, mqtt::settings::server());
-        _mqttApplySetting(_mqtt_settings.port, mqtt::settings::port());
-        _mqttApplySetting(_mqtt_enabled, mqtt::settings::enabled());
+// Existing connection is only dropped when the list of brokers changes
+void _mqttBrokersConfigure() {
+    std::vector<espurna::mqtt::Endpoint> endpoints;
 
-#if MDNS_SERVER_SUPPORT
-        if (!_mqtt_enabled) {
-            _mqttMdnsStop();
-        }
-#endif
+    if (_mqtt_settings.server.length()) {
+        endpoints.push_back(
+            espurna::mqtt::Endpoint{
+                .host = _mqtt_settings.server,
+                .port = _mqtt_settings.port,
+            });
 
-        if (!_mqtt_settings.server.length()) {
-#if MDNS_SERVER_SUPPORT
-            // But, start mdns discovery when it would've been enabled
-            if (_mqtt_enabled && mqtt::settings::autoconnect()) {
-                _mqttMdnsSchedule();
+        for (size_t index = 0; index < mqtt::build::FailoverMax; ++index) {
+            const auto value = mqtt::settings::failover(index);
+            if (!value.length()) {
+                break;
             }
-#endif
-            return;
+
+            espurna::mqtt::Endpoint endpoint;
+            if (!espurna::mqtt::parse_endpoint(value, _mqtt_settings.port, endpoint)) {
+                DEBUG_MSG_P(PSTR("[MQTT] Invalid failover broker #%zu %s\n"),
+                    index, value.c_str());
+                continue;
+            }
+
+            endpoints.push_back(std::move(endpoint));
         }
     }
 
-    // Get base topic and apply placeholders
-    {
-        // Replace things inside curly braces (like {hostname}, {mac} etc.)
-        auto topic = _mqttPlaceholders(mqtt::settings::topic());
-        if (!_mqttValidTopicString(topic)) {
-            mqttDisconnect();
-            return;
-        }
+    if (_mqtt_brokers.reset(std::move(endpoints), _mqttBrokersOptions())) {
+        _mqtt_broker = espurna::mqtt::Brokers::NoIndex;
+        mqttDisconnect();
+    }
+}
 
-        // Topic **must** end with some kind of word
-        if (topic.endsWith("/")) {
-            topic.remove(topic.length() - 1);
-        }
+#if MQTT_MIRROR_SUPPORT
 
-        // For simple topics, sssume right-hand side contains magnitude
-        if (topic.indexOf("#") == -1) {
-            topic.concat("/#");
-        }
+// Secondary connection that only receives copies of the matching topics.
+// Nothing is subscribed to, and nothing is queued while it is not connected
+AsyncMqttClient _mqtt_mirror;
+espurna::mqtt::Brokers _mqtt_mirror_broker;
+AsyncClientState _mqtt_mirror_state { AsyncClientState::Disconnected };
+MqttTimeSource::time_point _mqtt_mirror_connect_start{};
+bool _mqtt_mirror_disconnect_requested { false };
+
+String _mqtt_mirror_client_id;
+std::vector<String> _mqtt_mirror_topics;
+
+void _mqttMirrorDisconnect() {
+    if (_mqtt_mirror.connected()) {
+        _mqtt_mirror_disconnect_requested = true;
+        _mqtt_mirror.disconnect();
+    }
+}
+
+void _mqttMirrorConfigure() {
+    std::vector<espurna::mqtt::Endpoint> endpoints;
+
+    const auto value = mqtt::settings::mirror();
+    if (value.length()) {
+        espurna::mqtt::Endpoint endpoint;
+        if (espurna::mqtt::parse_endpoint(value, _mqtt_settings.port, endpoint)) {
+            endpoints.push_back(std::move(endpoint));
+        } else {
+            DEBUG_MSG_P(PSTR("[MQTT] Invalid mirror broker %s\n"), value.c_str());
+        }
+    }
+
+    auto options = _mqttBrokersOptions();
+    options.failback = espurna::duration::Milliseconds::zero();
+
+    if (_mqtt_mirror_broker.reset(std::move(endpoints), options) || !_mqtt_enabled) {
+        _mqttMirrorDisconnect();
+    }
+
+    // Topic prefixes, '#' mirrors everything
+    _mqtt_mirror_topics.clear();
+    for (size_t index = 0; index < mqtt::build::MirrorTopicsMax; ++index) {
+        auto prefix = mqtt::settings::mirrorTopic(index);
+        if (!prefix.length()) {
+            break;
+        }
+
+        _mqtt_mirror_topics.push_back(std::move(prefix));
+    }
+}
+
+bool _mqttMirrorMatch(espurna::StringView topic) {
+    for (const auto& prefix : _mqtt_mirror_topics) {
+        if ((prefix == "#") || topic.startsWith(prefix)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void _mqttMirrorPublish(const char* topic, const char* message, bool retain, int qos) {
+    if (_mqtt_mirror.connected() && _mqttMirrorMatch(topic)) {
+        _mqtt_mirror.publish(topic, qos, retain, message);
+    }
+}
+
+void _mqttMirrorConnect() {
+    if ((_mqtt_mirror_state == AsyncClientState::Connecting)
+        && (MqttTimeSource::now() - _mqtt_mirror_connect_start > mqtt::build::ConnectTimeout))
+    {
+        DEBUG_MSG_P(PSTR("[MQTT] Mirror broker connection timed out\n"));
+        _mqtt_mirror.disconnect(true);
+
+        // in case TCP client did not report back
+        if (_mqtt_mirror_state == AsyncClientState::Connecting) {
+            _mqtt_mirror_broker.failed(0, MqttTimeSource::now().time_since_epoch());
+            _mqtt_mirror_state = AsyncClientState::Disconnected;
+        }
+
+        return;
+    }
+
+    if (_mqtt_mirror.connected() || (_mqtt_mirror_state != AsyncClientState::Disconnected)) {
+        return;
+    }
+
+    if (!_mqtt_enabled || !wifiConnected() || _mqtt_mirror_topics.empty()) {
+        return;
+    }
+
+    const auto index = _mqtt_mirror_broker.select(
+        MqttTimeSource::now().time_since_epoch());
+    if (index == espurna::mqtt::Brokers::NoIndex) {
+        return;
+    }
+
+    const auto& endpoint = _mqtt_mirror_broker.endpoint(index);
+    DEBUG_MSG_P(PSTR("[MQTT] Connecting to mirror broker at %s:%hu\n"),
+        endpoint.host.c_str(), endpoint.port);
+
+    _mqtt_mirror_client_id = _mqtt_settings.clientId + F("_mirror");
+
+    _mqtt_mirror.setServer(endpoint.host.c_str(), endpoint.port);
+    _mqtt_mirror.setClientId(_mqtt_mirror_client_id.c_str());
+    _mqtt_mirror.setKeepAlive(_mqtt_settings.keepalive.count());
+    _mqtt_mirror.setCleanSession(true);
+
+    if (_mqtt_settings.user.length() && _mqtt_settings.pass.length()) {
+        _mqtt_mirror.setCredentials(
+            _mqtt_settings.user.c_str(),
+            _mqtt_settings.pass.c_str());
+    }
+
+    _mqtt_mirror_state = AsyncClientState::Connecting;
+    _mqtt_mirror_connect_start = MqttTimeSource::now();
+    _mqtt_mirror_broker.connecting(index);
+    _mqtt_mirror.connect();
+}
+
+void _mqttMirrorSetup() {
+    _mqtt_mirror.onConnect([](bool) {
+        _mqtt_mirror_state = AsyncClientState::Connected;
+        _mqtt_mirror_broker.connected(0, MqttTimeSource::now().time_since_epoch());
+        DEBUG_MSG_P(PSTR("[MQTT] Connected to mirror broker\n"));
+    });
+
+    _mqtt_mirror.onDisconnect([](AsyncMqttClientDisconnectReason) {
+        if (_mqtt_mirror_state == AsyncClientState::Disconnected) {
+            _mqtt_mirror_disconnect_requested = false;
+            return;
+        }
+
+        if (_mqtt_mirror_disconnect_requested || !_mqtt_mirror_broker.size()) {
+            _mqtt_mirror_broker.disconnected();
+        } else {
+            _mqtt_mirror_broker.failed(0, MqttTimeSource::now().time_since_epoch());
+        }
+
+        _mqtt_mirror_state = AsyncClientState::Disconnected;
+        _mqtt_mirror_disconnect_requested = false;
+        DEBUG_MSG_P(PSTR("[MQTT] Disconnected from mirror broker\n"));
+    });
+}
+
+#endif
+
+void _mqttConfigure() {
+
+    // Make sure we have both the server to connect to things are enabled
+    {
+        _mqttApplySetting(_mqtt_settings.server, mqtt::settings::server());
+        _mqttApplySetting(_mqtt_settings.port, mqtt::settings::port());
+        _mqttApplySetting(_mqtt_enabled, mqtt::settings::enabled());
+        _mqttBrokersConfigure();
+
+#if MDNS_SERVER_SUPPORT
+        if (!_mqtt_enabled) {
+            _mqttMdnsStop();
+        }
+#endif
+
+        if (!_mqtt_settings.server.length()) {
+#if MDNS_SERVER_SUPPORT
+            // But, start mdns discovery when it would've been enabled
+            if (_mqtt_enabled && mqtt::settings::autoconnect()) {
+                _mqttMdnsSchedule();
+            }
+#endif
+            return;
+        }
+    }
+
+    // Get base topic and apply placeholders
+    {
+        // Replace things inside curly braces (like {hostname}, {mac} etc.)
+        auto topic = _mqttPlaceholders(mqtt::settings::topic());
+        if (!_mqttValidTopicString(topic)) {
+            mqttDisconnect();
+            return;
+        }
+
+        // Topic **must** end with some kind of word
+        if (topic.endsWith("/")) {
+            topic.remove(topic.length() - 1);
+        }
+
+        // For simple topics, sssume right-hand side contains magnitude
+        if (topic.indexOf("#") == -1) {
+            topic.concat("/#");
+        }
 
         _mqttApplySetting(_mqtt_settings.topic, std::move(topic));
     }
@@ -762,6 +1469,9 @@ void _mqttConfigure() {
     _mqttApplyValidTopicString(_mqtt_settings.setter, mqtt::settings::setter());
     _mqttApplySetting(_mqtt_forward,
         !_mqtt_settings.setter.equals(_mqtt_settings.getter));
+    _mqttUpdateMagnitudeParts();
+    _mqtt_topics.configure(_mqtt_settings.topic,
+        _mqtt_settings.getter, _mqtt_settings.setter);
 
     // Last will aka status topic
     // (note that *must* be after topic updates)
@@ -780,20 +1490,31 @@ void _mqttConfigure() {
 
     // MQTT JSON
     _mqttApplySetting(_mqtt_use_json, mqtt::settings::json());
+    _mqttJsonConfigure();
     _mqttApplyValidTopicString(_mqtt_settings.topic_json,
         mqttTopic(mqtt::settings::topicJson()));
 
+    // Messages published while disconnected
+    _mqttOfflineConfigure();
+
+    // Messages published too often
+    _mqttRateConfigure();
+
     // Heartbeat messages
     _mqttApplySetting(_mqtt_heartbeat_mode, mqtt::settings::heartbeatMode());
     _mqttApplySetting(_mqtt_heartbeat_interval, mqtt::settings::heartbeatInterval());
+    _mqtt_heartbeat_report = mqtt::settings::heartbeatReport();
+    _mqtt_heartbeat_delta_enabled = mqtt::settings::heartbeatDelta();
+    _mqtt_heartbeat_resync = mqtt::settings::heartbeatResync();
     _mqtt_skip_time = mqtt::settings::skipTime();
 
     // Custom payload strings
     _mqtt_payload_online = mqtt::settings::payloadOnline();
     _mqtt_payload_offline = mqtt::settings::payloadOffline();
 
-    // Reset reconnect delay to reconnect sooner
-    _mqtt_reconnect_delay = mqtt::build::ReconnectDelayMin;
+#if MQTT_MIRROR_SUPPORT
+    _mqttMirrorConfigure();
+#endif
 
 }
 
@@ -850,6 +1571,8 @@ alignas(4) static constexpr char MqttBuild[] PROGMEM_STRING_ATTR {
     "Arduino-MQTT"
 #elif MQTT_LIBRARY == MQTT_LIBRARY_PUBSUBCLIENT
     "PubSubClient"
+#elif MQTT_LIBRARY == MQTT_LIBRARY_MQTT5
+    "MQTT v5"
 #endif
 #if SECURE_CLIENT != SEURE_CLIENT_NONE
     " (w/ SECURE CLIENT)"
@@ -912,10 +1635,10 @@ void _mqttInfo() {
     DEBUG_MSG_P(PSTR("[MQTT] Client %.*s\n"), client.length(), client.c_str());
 
     if (_mqtt_enabled && (_mqtt_state != AsyncClientState::Connected)) {
-        DEBUG_MSG_P(PSTR("[MQTT] Retrying, Last %u with Delay %u (Step %u)\n"),
+        DEBUG_MSG_P(PSTR("[MQTT] Retrying, Last %u with Delay %u (%zu brokers)\n"),
             _mqtt_last_connection.time_since_epoch().count(),
-            _mqtt_reconnect_delay.count(),
-            mqtt::build::ReconnectStep.count());
+            _mqtt_brokers.wait(MqttTimeSource::now().time_since_epoch()).count(),
+            _mqtt_brokers.size());
     }
 }
 
@@ -985,10 +1708,147 @@ static void _mqttCommand(::terminal::CommandContext&& ctx) {
     const auto client = _mqttClientInfo();
     ctx.output.printf_P(PSTR("client %.*s\n"), client.length(), client.c_str());
 
+    for (const auto& pattern : _mqtt_dispatcher.subscriptions()) {
+        ctx.output.printf_P(PSTR("handler %s\n"), pattern.c_str());
+    }
+
+#if MQTT_LIBRARY == MQTT_LIBRARY_MQTT5
+    if (_mqtt.connected()) {
+        const auto& limits = _mqtt.limits();
+        ctx.output.printf_P(PSTR("broker receive maximum %hu topic aliases %hu keepalive %u (s)\n"),
+            limits.receive_maximum, limits.topic_alias_maximum, limits.keepalive.count());
+
+        const auto& stats = _mqtt.stats();
+        ctx.output.printf_P(PSTR("inflight %zu throttled %u aliased %u (%u bytes saved)\n"),
+            _mqtt.inflight(), stats.throttled, stats.aliased, stats.alias_bytes_saved);
+    }
+#endif
+
     settingsDump(ctx, mqtt::settings::query::Settings);
     terminalOK(ctx);
 }
 
+PROGMEM_STRING(MqttCommandQueue, "MQTT.QUEUE");
+
+static void _mqttCommandQueue(::terminal::CommandContext&& ctx) {
+    const auto stats = _mqtt_offline_queue.stats();
+
+    ctx.output.printf_P(PSTR("capacity %zu (%zu bytes)\n"),
+        _mqtt_offline_queue.capacity(), mqtt::build::OfflineQueueBytes);
+    ctx.output.printf_P(PSTR("depth %zu (%zu bytes)\n"),
+        stats.depth, stats.bytes);
+    ctx.output.printf_P(PSTR("queued %u replaced %u dropped %u spilled %u drained %u\n"),
+        stats.queued, stats.replaced, stats.dropped, stats.spilled, stats.drained);
+    ctx.output.printf_P(PSTR("latency last %u (ms) max %u (ms)\n"),
+        stats.latency_last.count(), stats.latency_max.count());
+
+    terminalOK(ctx);
+}
+
+PROGMEM_STRING(MqttCommandRate, "MQTT.RATE");
+
+static void _mqttCommandRate(::terminal::CommandContext&& ctx) {
+    const auto& rules = _mqtt_rate.rules();
+    for (size_t index = 0; index < rules.size(); ++index) {
+        const auto& rule = rules[index];
+        const auto& stats = _mqtt_rate.stats(index);
+        ctx.output.printf_P(
+            PSTR("%s every %u (ms) burst %u: sent %u delayed %u suppressed %u\n"),
+            rule.prefix.c_str(), rule.interval.count(), rule.burst,
+            stats.sent, stats.delayed, stats.suppressed);
+    }
+
+    ctx.output.printf_P(PSTR("pending %zu\n"), _mqtt_rate.pending());
+    terminalOK(ctx);
+}
+
+PROGMEM_STRING(MqttCommandStats, "MQTT.STATS");
+
+static void _mqttPrintHistogram(Print& out, const char* name, const espurna::mqtt::Histogram& histogram) {
+    out.printf_P(PSTR("%s count %u avg %u (ms) max %u (ms)\n"),
+        name, histogram.count(),
+        static_cast<uint32_t>(histogram.average().count() / 1000),
+        static_cast<uint32_t>(histogram.max().count() / 1000));
+
+    for (size_t index = 0; index < histogram.Buckets; ++index) {
+        const auto count = histogram.bucket(index);
+        if (!count) {
+            continue;
+        }
+
+        if (index + 1 < histogram.Buckets) {
+            out.printf_P(PSTR("    %u..%u (ms) %u\n"),
+                histogram.lower(index).count(),
+                histogram.lower(index + 1).count(),
+                count);
+        } else {
+            out.printf_P(PSTR("    %u+ (ms) %u\n"),
+                histogram.lower(index).count(),
+                count);
+        }
+    }
+}
+
+static void _mqttCommandStats(::terminal::CommandContext&& ctx) {
+    const auto& publishes = _mqtt_stats.publishes();
+    ctx.output.printf_P(PSTR("publish attempted %u accepted %u failed %u (%u bytes)\n"),
+        publishes.attempted, publishes.accepted, publishes.failed, publishes.bytes);
+
+    const auto& acks = _mqtt_stats.acks();
+    ctx.output.printf_P(PSTR("inflight %zu peak %u acked %u untracked %u\n"),
+        _mqtt_stats.inflight(), acks.peak, acks.acked, acks.untracked);
+
+    const auto& send_buffer = _mqtt_stats.send_buffer();
+    if (send_buffer.samples) {
+        ctx.output.printf_P(PSTR("send buffer free %u low %u full %u (bytes, of %u samples)\n"),
+            send_buffer.last, send_buffer.low, send_buffer.full, send_buffer.samples);
+    }
+    _mqttPrintHistogram(ctx.output, PSTR("ack latency"), _mqtt_stats.ack_latency());
+
+    const auto& connections = _mqtt_stats.connections();
+    ctx.output.printf_P(PSTR("connect attempts %u connected %u failed %u disconnected %u\n"),
+        connections.attempts, connections.connected, connections.failed, connections.disconnected);
+    ctx.output.printf_P(PSTR("downtime last %u (ms) max %u (ms)\n"),
+        connections.downtime_last.count(), connections.downtime_max.count());
+    _mqttPrintHistogram(ctx.output, PSTR("connect time"), _mqtt_stats.connect_time());
+
+    terminalOK(ctx);
+}
+
+PROGMEM_STRING(MqttCommandBrokers, "MQTT.BROKERS");
+
+static void _mqttPrintBrokers(Print& out, const char* name, const espurna::mqtt::Brokers& brokers) {
+    const auto now = MqttTimeSource::now().time_since_epoch();
+    for (size_t index = 0; index < brokers.size(); ++index) {
+        const auto& endpoint = brokers.endpoint(index);
+        const auto& stats = brokers.stats(index);
+        out.printf_P(PSTR("%s #%zu %s:%hu%s attempts %u failures %u connections %u backoff %u (ms)\n"),
+            name, index, endpoint.host.c_str(), endpoint.port,
+            (brokers.current() == index) ? PSTR(" (current)") : PSTR(""),
+            stats.attempts, stats.failures, stats.connections,
+            brokers.backoff(index).count());
+    }
+
+    out.printf_P(PSTR("%s switches %u retry in %u (ms)\n"),
+        name, brokers.switches(), brokers.wait(now).count());
+}
+
+static void _mqttCommandBrokers(::terminal::CommandContext&& ctx) {
+    _mqttPrintBrokers(ctx.output, PSTR("broker"), _mqtt_brokers);
+#if MQTT_MIRROR_SUPPORT
+    _mqttPrintBrokers(ctx.output, PSTR("mirror"), _mqtt_mirror_broker);
+    for (const auto& prefix : _mqtt_mirror_topics) {
+        ctx.output.printf_P(PSTR("mirror topic %s\n"), prefix.c_str());
+    }
+#endif
+
+    const auto& connections = _mqtt_stats.connections();
+    ctx.output.printf_P(PSTR("downtime last %u (ms) max %u (ms)\n"),
+        connections.downtime_last.count(), connections.downtime_max.count());
+
+    terminalOK(ctx);
+}
+
 PROGMEM_STRING(MqttCommandReset, "MQTT.RESET");
 
 static void _mqttCommandReset(::terminal::CommandContext&& ctx) {
@@ -1014,6 +1874,10 @@ static void _mqttCommandSend(::terminal::CommandContext&& ctx) {
 
 static constexpr ::terminal::Command MqttCommands[] PROGMEM {
     {MqttCommand, _mqttCommand},
+    {MqttCommandQueue, _mqttCommandQueue},
+    {MqttCommandRate, _mqttCommandRate},
+    {MqttCommandStats, _mqttCommandStats},
+    {MqttCommandBrokers, _mqttCommandBrokers},
     {MqttCommandReset, _mqttCommandReset},
     {MqttCommandSend, _mqttCommandSend},
 };
@@ -1031,11 +1895,59 @@ void _mqttCommandsSetup() {
 
 namespace {
 
+#if MQTT_SETTINGS_RESTORE_SUPPORT
+std::unique_ptr<espurna::settings::snapshot::Restore> _mqtt_settings_restore;
+
+// Same as the binary backup upload through the web, records are applied only after the whole message is verified
+bool _mqttSettingsRestore(const espurna::mqtt::Fragment& fragment) {
+    const auto* data = reinterpret_cast<const uint8_t*>(fragment.data.data());
+    if (fragment.first()) {
+        _mqtt_settings_restore.reset();
+        if (data[0] != espurna::settings::snapshot::Magic[0]) {
+            DEBUG_MSG_P(PSTR("[MQTT] Settings restore expects binary backup\n"));
+            return false;
+        }
+
+        _mqtt_settings_restore = std::make_unique<espurna::settings::snapshot::Restore>();
+    }
+
+    if (!_mqtt_settings_restore) {
+        return false;
+    }
+
+    if (!_mqtt_settings_restore->feed(data, fragment.data.length())) {
+        DEBUG_MSG_P(PSTR("[MQTT] Settings restore failed\n"));
+        _mqtt_settings_restore.reset();
+        return false;
+    }
+
+    if (fragment.last()) {
+        const auto result = _mqtt_settings_restore->finish();
+        _mqtt_settings_restore.reset();
+
+        DEBUG_MSG_P(PSTR("[MQTT] Settings restore %s\n"),
+            result ? PSTR("done") : PSTR("failed"));
+        return false;
+    }
+
+    return true;
+}
+#endif
+
 void _mqttCallback(unsigned int type, espurna::StringView topic, espurna::StringView payload) {
     if (type == MQTT_CONNECT_EVENT) {
         mqttSubscribe(MQTT_TOPIC_ACTION);
+#if MQTT_SETTINGS_RESTORE_SUPPORT
+        mqttSubscribe(MQTT_TOPIC_SETTINGS_RESTORE);
+#endif
     }
 
+#if MQTT_SETTINGS_RESTORE_SUPPORT
+    if (type == MQTT_DISCONNECT_EVENT) {
+        _mqtt_settings_restore.reset();
+    }
+#endif
+
     if (type == MQTT_MESSAGE_EVENT) {
         auto t = mqttMagnitude(topic);
         if (t.equals(MQTT_TOPIC_ACTION)) {
@@ -1044,68 +1956,138 @@ void _mqttCallback(unsigned int type, espurna::StringView topic, espurna::String
     }
 }
 
-bool _mqttHeartbeat(espurna::heartbeat::Mask mask) {
-    // No point retrying, since we will be re-scheduled on connection
-    if (!mqttConnected()) {
-        return true;
-    }
+constexpr size_t _mqttHeartbeatIndex(espurna::heartbeat::Report report) {
+    return __builtin_ctz(static_cast<espurna::heartbeat::Mask>(report));
+}
 
-#if NTP_SUPPORT
-    // Backported from the older utils implementation.
-    // Wait until the time is synced to avoid sending partial report *and*
-    // as a result, wait until the next interval to actually send the datetime string.
-    if ((mask & espurna::heartbeat::Report::Datetime) && !ntpSynced()) {
-        return false;
-    }
-#endif
+// Without delta mode, every value is always sent
+bool _mqttHeartbeatChanged(espurna::heartbeat::Report report, double value, double threshold) {
+    return !_mqtt_heartbeat_delta_enabled
+        || _mqtt_heartbeat_delta.changed(_mqttHeartbeatIndex(report), value, threshold);
+}
+
+bool _mqttHeartbeatChanged(espurna::heartbeat::Report report, const String& value) {
+    return !_mqtt_heartbeat_delta_enabled
+        || _mqtt_heartbeat_delta.changed(_mqttHeartbeatIndex(report), value);
+}
 
-    // TODO: rework old HEARTBEAT_REPEAT_STATUS?
-    // for example: send full report once, send only the dynamic data after that
-    // (interval, hostname, description, ssid, bssid, ip, mac, rssi, uptime, datetime, heap, loadavg, vcc)
-    // otherwise, it is still possible by setting everything to 0 *but* the Report::Status bit
-    // TODO: per-module mask?
-    // TODO: simply send static data with onConnected, and the rest from here?
+// Short summary of the outgoing messages and of the connection
+String _mqttStatsPayload() {
+    const auto& publishes = _mqtt_stats.publishes();
+    const auto& connections = _mqtt_stats.connections();
+    const auto& acks = _mqtt_stats.ack_latency();
 
-    if (mask & espurna::heartbeat::Report::Status)
-        mqttSendStatus();
+    char buffer[256];
+    snprintf_P(buffer, sizeof(buffer),
+        PSTR("{\"attempted\":%u,\"accepted\":%u,\"failed\":%u,\"bytes\":%u,"
+             "\"inflight\":%zu,\"ack\":%u,\"ackMax\":%u,"
+             "\"reconnects\":%u,\"downtime\":%u,\"broker\":%d,\"switches\":%u}"),
+        publishes.attempted, publishes.accepted, publishes.failed, publishes.bytes,
+        _mqtt_stats.inflight(),
+        static_cast<uint32_t>(acks.average().count() / 1000),
+        static_cast<uint32_t>(acks.max().count() / 1000),
+        connections.disconnected, connections.downtime_last.count(),
+        (_mqtt_brokers.current() != espurna::mqtt::Brokers::NoIndex)
+            ? static_cast<int>(_mqtt_brokers.current()) : -1,
+        _mqtt_brokers.switches());
 
+    return buffer;
+}
+
+// Data that is not expected to change while the device is running
+// (JSON payload is never retained, `force` is needed for the retained messages to keep the flag)
+void _mqttHeartbeatStatic(espurna::heartbeat::Mask mask, bool force, bool retain) {
     if (mask & espurna::heartbeat::Report::Interval)
-        mqttSend(MQTT_TOPIC_INTERVAL, String(_mqtt_heartbeat_interval.count()).c_str());
+        mqttSend(MQTT_TOPIC_INTERVAL, String(_mqtt_heartbeat_interval.count()).c_str(), force, retain);
 
     const auto app = buildApp();
     if (mask & espurna::heartbeat::Report::App)
-        mqttSend(MQTT_TOPIC_APP, String(app.name).c_str());
+        mqttSend(MQTT_TOPIC_APP, String(app.name).c_str(), force, retain);
 
     if (mask & espurna::heartbeat::Report::Version)
-        mqttSend(MQTT_TOPIC_VERSION, String(app.version).c_str());
+        mqttSend(MQTT_TOPIC_VERSION, String(app.version).c_str(), force, retain);
 
     if (mask & espurna::heartbeat::Report::Board)
-        mqttSend(MQTT_TOPIC_BOARD, systemDevice().c_str());
+        mqttSend(MQTT_TOPIC_BOARD, systemDevice().c_str(), force, retain);
 
     if (mask & espurna::heartbeat::Report::Hostname)
-        mqttSend(MQTT_TOPIC_HOSTNAME, systemHostname().c_str());
+        mqttSend(MQTT_TOPIC_HOSTNAME, systemHostname().c_str(), force, retain);
 
     if (mask & espurna::heartbeat::Report::Description) {
         const auto value = systemDescription();
         if (value.length()) {
-            mqttSend(MQTT_TOPIC_DESCRIPTION, value.c_str());
+            mqttSend(MQTT_TOPIC_DESCRIPTION, value.c_str(), force, retain);
         }
     }
 
-    if (mask & espurna::heartbeat::Report::Ssid)
-        mqttSend(MQTT_TOPIC_SSID, WiFi.SSID().c_str());
+    if (mask & espurna::heartbeat::Report::Mac)
+        mqttSend(MQTT_TOPIC_MAC, WiFi.macAddress().c_str(), force, retain);
+}
+
+// In delta mode, static data is retained and only sent after connecting and then once every resync interval.
+// Every dynamic value is also forgotten, so the next heartbeat sends all of them
+void _mqttHeartbeatResync() {
+    _mqtt_heartbeat_last_resync = espurna::time::CoreClock::now();
+    _mqtt_heartbeat_delta.reset();
+    _mqtt_heartbeat_static = true;
+    _mqttHeartbeatStatic(_mqtt_heartbeat_report, true, true);
+}
+
+bool _mqttHeartbeat(espurna::heartbeat::Mask) {
+    // No point retrying, since we will be re-scheduled on connection
+    if (!mqttConnected()) {
+        return true;
+    }
+
+    // Module has its own mask, defaulting to the system one
+    const auto mask = _mqtt_heartbeat_report;
 
-    if (mask & espurna::heartbeat::Report::Bssid)
-        mqttSend(MQTT_TOPIC_BSSID, WiFi.BSSIDstr().c_str());
+#if NTP_SUPPORT
+    // Backported from the older utils implementation.
+    // Wait until the time is synced to avoid sending partial report *and*
+    // as a result, wait until the next interval to actually send the datetime string.
+    if ((mask & espurna::heartbeat::Report::Datetime) && !ntpSynced()) {
+        return false;
+    }
+#endif
 
-    if (mask & espurna::heartbeat::Report::Ip)
-        mqttSend(MQTT_TOPIC_IP, wifiStaIp().toString().c_str());
+    if (!_mqtt_heartbeat_delta_enabled) {
+        _mqttHeartbeatStatic(mask, false, _mqtt_settings.retain);
+    } else if (espurna::time::CoreClock::now() - _mqtt_heartbeat_last_resync >= _mqtt_heartbeat_resync) {
+        _mqttHeartbeatResync();
+    }
 
-    if (mask & espurna::heartbeat::Report::Mac)
-        mqttSend(MQTT_TOPIC_MAC, WiFi.macAddress().c_str());
+    // Status, uptime and datetime are always sent, since these are the heartbeat itself
+    if (mask & espurna::heartbeat::Report::Status)
+        mqttSendStatus();
+
+    if (mask & espurna::heartbeat::Report::Ssid) {
+        const auto value = WiFi.SSID();
+        if (_mqttHeartbeatChanged(espurna::heartbeat::Report::Ssid, value)) {
+            mqttSend(MQTT_TOPIC_SSID, value.c_str());
+        }
+    }
 
-    if (mask & espurna::heartbeat::Report::Rssi)
-        mqttSend(MQTT_TOPIC_RSSI, String(WiFi.RSSI()).c_str());
+    if (mask & espurna::heartbeat::Report::Bssid) {
+        const auto value = WiFi.BSSIDstr();
+        if (_mqttHeartbeatChanged(espurna::heartbeat::Report::Bssid, value)) {
+            mqttSend(MQTT_TOPIC_BSSID, value.c_str());
+        }
+    }
+
+    if (mask & espurna::heartbeat::Report::Ip) {
+        const auto value = wifiStaIp().toString();
+        if (_mqttHeartbeatChanged(espurna::heartbeat::Report::Ip, value)) {
+            mqttSend(MQTT_TOPIC_IP, value.c_str());
+        }
+    }
+
+    if (mask & espurna::heartbeat::Report::Rssi) {
+        const auto value = WiFi.RSSI();
+        if (_mqttHeartbeatChanged(espurna::heartbeat::Report::Rssi, value, HEARTBEAT_DELTA_RSSI)) {
+            mqttSend(MQTT_TOPIC_RSSI, String(value).c_str());
+        }
+    }
 
     if (mask & espurna::heartbeat::Report::Uptime)
         mqttSend(MQTT_TOPIC_UPTIME, String(systemUptime().count()).c_str());
@@ -1117,27 +2099,60 @@ bool _mqttHeartbeat(espurna::heartbeat::Mask mask) {
 
     if (mask & espurna::heartbeat::Report::Freeheap) {
         const auto stats = systemHeapStats();
-        mqttSend(MQTT_TOPIC_FREEHEAP, String(stats.available).c_str());
+        if (_mqttHeartbeatChanged(espurna::heartbeat::Report::Freeheap, stats.available, HEARTBEAT_DELTA_FREEHEAP)) {
+            mqttSend(MQTT_TOPIC_FREEHEAP, String(stats.available).c_str());
+        }
     }
 
-    if (mask & espurna::heartbeat::Report::Loadavg)
-        mqttSend(MQTT_TOPIC_LOADAVG, String(systemLoadAverage()).c_str());
+    if (mask & espurna::heartbeat::Report::Loadavg) {
+        const auto value = systemLoadAverage();
+        if (_mqttHeartbeatChanged(espurna::heartbeat::Report::Loadavg, value, HEARTBEAT_DELTA_LOADAVG)) {
+            mqttSend(MQTT_TOPIC_LOADAVG, String(value).c_str());
+        }
+    }
 
-    if ((mask & espurna::heartbeat::Report::Vcc) && (ADC_MODE_VALUE == ADC_VCC))
-        mqttSend(MQTT_TOPIC_VCC, String(ESP.getVcc()).c_str());
+    if ((mask & espurna::heartbeat::Report::Vcc) && (ADC_MODE_VALUE == ADC_VCC)) {
+        const auto value = ESP.getVcc();
+        if (_mqttHeartbeatChanged(espurna::heartbeat::Report::Vcc, value, HEARTBEAT_DELTA_VCC)) {
+            mqttSend(MQTT_TOPIC_VCC, String(value).c_str());
+        }
+    }
+
+    // Counters are always changing, delta mode does not apply
+    if (mask & espurna::heartbeat::Report::Mqtt) {
+        mqttSend(MQTT_TOPIC_MQTT_STATS, _mqttStatsPayload().c_str());
+    }
+
+    // Other modules are also expected to only send their static data after resync
+    auto modules = mask;
+    if (_mqtt_heartbeat_delta_enabled && !_mqtt_heartbeat_static) {
+        modules &= ~espurna::heartbeat::StaticReports;
+    }
 
     auto status = mqttConnected();
     for (auto& cb : _mqtt_heartbeat_callbacks) {
-        status = status && cb(mask);
+        status = status && cb(modules);
+    }
+
+    if (status) {
+        _mqtt_heartbeat_static = false;
     }
 
     return status;
 }
 
 void _mqttOnConnect() {
-    _mqtt_reconnect_delay = mqtt::build::ReconnectDelayMin;
     _mqtt_last_connection = MqttTimeSource::now();
     _mqtt_state = AsyncClientState::Connected;
+    _mqtt_stats.connected(_mqtt_last_connection.time_since_epoch());
+
+    if (_mqtt_broker < _mqtt_brokers.size()) {
+        _mqtt_brokers.connected(_mqtt_broker, _mqtt_last_connection.time_since_epoch());
+    }
+
+    if (_mqtt_heartbeat_delta_enabled) {
+        _mqttHeartbeatResync();
+    }
 
     systemHeartbeat(_mqttHeartbeat, _mqtt_heartbeat_mode, _mqtt_heartbeat_interval);
 
@@ -1152,13 +2167,32 @@ void _mqttOnConnect() {
 }
 
 void _mqttOnDisconnect() {
-#if MQTT_LIBRARY == MQTT_LIBRARY_ASYNCMQTTCLIENT
+#if (MQTT_LIBRARY == MQTT_LIBRARY_ASYNCMQTTCLIENT) || (MQTT_LIBRARY == MQTT_LIBRARY_MQTT5)
     _mqtt_publish_callbacks.clear();
     _mqtt_subscribe_callbacks.clear();
 #endif
 
     _mqtt_last_connection = MqttTimeSource::now();
+
+    // Remaining fragments of the current message are never going to arrive
+    _mqtt_streams.reset();
+
+    // Unless it was requested, next attempt goes to the next broker in the list
+    // (and this one is only retried after its reconnect delay expires)
+    if ((_mqtt_state != AsyncClientState::Disconnected)
+        && (_mqtt_broker < _mqtt_brokers.size()))
+    {
+        if (_mqtt_disconnect_requested) {
+            _mqtt_brokers.disconnected();
+        } else {
+            _mqtt_brokers.failed(_mqtt_broker,
+                _mqtt_last_connection.time_since_epoch());
+        }
+    }
+
+    _mqtt_disconnect_requested = false;
     _mqtt_state = AsyncClientState::Disconnected;
+    _mqtt_stats.disconnected(_mqtt_last_connection.time_since_epoch());
 
     systemStopHeartbeat(_mqttHeartbeat);
 
@@ -1172,7 +2206,7 @@ void _mqttOnDisconnect() {
     DEBUG_MSG_P(PSTR("[MQTT] Disconnected!\n"));
 }
 
-#if MQTT_LIBRARY == MQTT_LIBRARY_ASYNCMQTTCLIENT
+#if (MQTT_LIBRARY == MQTT_LIBRARY_ASYNCMQTTCLIENT) || (MQTT_LIBRARY == MQTT_LIBRARY_MQTT5)
 
 // Run the associated callback when message PID is acknowledged by the broker
 
@@ -1210,20 +2244,70 @@ bool _mqttMaybeSkipRetained(char* topic) {
     return false;
 }
 
+// Note that unlike mqttMagnitude(), topic is also expected to match the root topic and setter
+bool _mqttMagnitudeStrict(espurna::StringView topic, espurna::StringView& out) {
+    if (!_mqtt_magnitude_parts.valid) {
+        return false;
+    }
+
+    const auto& prefix = _mqtt_magnitude_parts.prefix;
+    const auto& suffix = _mqtt_magnitude_parts.suffix;
+    if ((topic.length() <= (prefix.length() + suffix.length()))
+        || !topic.startsWith(prefix)
+        || !topic.endsWith(suffix))
+    {
+        return false;
+    }
+
+    out = espurna::StringView(
+        topic.begin() + prefix.length(),
+        topic.end() - suffix.length());
+
+    return true;
+}
+
+// Magnitude is only extracted once, and only handlers matching it are called.
+void _mqttDispatch(espurna::StringView topic, espurna::StringView payload) {
+    espurna::StringView magnitude;
+    if (_mqtt_dispatcher.size() && _mqttMagnitudeStrict(topic, magnitude)) {
+        _mqtt_dispatcher.dispatch(magnitude, payload);
+    }
+}
+
+// Stream handlers receive the payload as-is, without any intermediate buffers
+bool _mqttStream(espurna::StringView topic, const espurna::mqtt::Fragment& fragment) {
+    espurna::StringView magnitude;
+    if (!_mqtt_streams.size()) {
+        return false;
+    }
+
+    // Anything left from the previous message is no longer relevant
+    if (fragment.first() && !_mqttMagnitudeStrict(topic, magnitude)) {
+        _mqtt_streams.reset();
+        return false;
+    }
+
+    const auto result = _mqtt_streams.feed(magnitude, fragment);
+    if (result && fragment.last()) {
+        DEBUG_MSG_P(PSTR("[MQTT] Received %.*s => (%u bytes, streamed)\n"),
+            topic.length(), topic.data(), fragment.total);
+    }
+
+    return result;
+}
+
 #if MQTT_LIBRARY == MQTT_LIBRARY_ASYNCMQTTCLIENT
 
 // MQTT Broker can sometimes send messages in bulk. Even when message size is less than MQTT_BUFFER_MAX_SIZE, we *could*
 // receive a message with `len != total`, this requiring buffering of the received data. Prepare a static memory to store the
 // data until `(len + index) == total`.
-// TODO: One pending issue is streaming arbitrary data (e.g. binary, for OTA). We always set '\0' and API consumer expects C-String.
-//       In that case, there could be MQTT_MESSAGE_RAW_EVENT and this callback only trigger on small messages.
-// TODO: Current callback model does not allow to pass message length. Instead, implement a topic filter and record all subscriptions. That way we don't need to filter out events and could implement per-event callbacks.
+// Stream handlers (e.g. binary data for OTA) receive every fragment directly, and their messages are not limited by the buffer size.
 
 void _mqttOnMessageAsync(char* topic, char* payload, AsyncMqttClientMessageProperties, size_t len, size_t index, size_t total) {
     static constexpr size_t BufferSize { MQTT_BUFFER_MAX_SIZE };
     static_assert(BufferSize > 0, "");
 
-    if (!len || (len > BufferSize) || (total > BufferSize)) {
+    if (!len) {
         return;
     }
 
@@ -1231,6 +2315,20 @@ void _mqttOnMessageAsync(char* topic, char* payload, AsyncMqttClientMessagePrope
         return;
     }
 
+    const auto fragment = espurna::mqtt::Fragment{
+        .data = espurna::StringView(payload, len),
+        .index = index,
+        .total = total,
+    };
+
+    if (_mqttStream(topic, fragment)) {
+        return;
+    }
+
+    if ((len > BufferSize) || (total > BufferSize)) {
+        return;
+    }
+
     alignas(4) static char buffer[((BufferSize + 3) & ~3) + 4] = {0};
     std::copy(payload, payload + len, &buffer[index]);
 
@@ -1252,18 +2350,28 @@ void _mqttOnMessageAsync(char* topic, char* payload, AsyncMqttClientMessagePrope
     for (const auto callback : _mqtt_callbacks) {
         callback(MQTT_MESSAGE_EVENT, topic_view, message_view);
     }
+
+    _mqttDispatch(topic_view, message_view);
 }
 
 #else
 
 // Sync client already implements buffering, but we still need to add '\0' because API consumer expects C-String :/
-// TODO: consider reworking this (and async counterpart), giving callback func length of the message.
+// Stream handlers receive the whole message as a single fragment, still limited by the client buffer size.
 
 void _mqttOnMessage(char* topic, char* payload, unsigned int len) {
 
     if (!len || (len > MQTT_BUFFER_MAX_SIZE)) return;
     if (_mqttMaybeSkipRetained(topic)) return;
 
+    const auto fragment = espurna::mqtt::Fragment{
+        .data = espurna::StringView(payload, len),
+        .index = 0,
+        .total = len,
+    };
+
+    if (_mqttStream(topic, fragment)) return;
+
     static char message[((MQTT_BUFFER_MAX_SIZE + 1) + 31) & -32] = {0};
     memmove(message, (char *) payload, len);
     message[len] = '\0';
@@ -1275,6 +2383,8 @@ void _mqttOnMessage(char* topic, char* payload, unsigned int len) {
         callback(MQTT_MESSAGE_EVENT, topic, message);
     }
 
+    _mqttDispatch(topic, espurna::StringView(&message[0], &message[len]));
+
 }
 
 #endif // MQTT_LIBRARY == MQTT_LIBRARY_ASYNCMQTTCLIENT
@@ -1302,23 +2412,17 @@ espurna::StringView mqttMagnitude(espurna::StringView topic) {
     using espurna::StringView;
     StringView out;
 
-    const auto pattern = _mqtt_settings.topic + _mqtt_settings.setter;
-    auto it = std::find(pattern.begin(), pattern.end(), '#');
-    if (it == pattern.end()) {
+    if (!_mqtt_magnitude_parts.valid) {
         return out;
     }
 
-    const auto start = StringView(pattern.begin(), it);
-    if (start.length()) {
-        topic = StringView(topic.begin() + start.length(), topic.end());
-    }
-
-    const auto end = StringView(it + 1, pattern.end());
-    if (end.length()) {
-        topic = StringView(topic.begin(), topic.end() - end.length());
+    const auto start = _mqtt_magnitude_parts.prefix.length();
+    const auto end = _mqtt_magnitude_parts.suffix.length();
+    if (topic.length() < (start + end)) {
+        return out;
     }
 
-    out = StringView(topic.begin(), topic.end());
+    out = StringView(topic.begin() + start, topic.end() - end);
     return out;
 }
 
@@ -1352,25 +2456,62 @@ static String _mqttTopicIndexed(String topic, size_t index) {
 }
 
 String mqttTopic(const String& magnitude) {
-    return _mqttTopicGetter(magnitude);
+    return mqttTopic(magnitude, espurna::mqtt::TopicCache::NoIndex);
 }
 
 String mqttTopic(const String& magnitude, size_t index) {
-    return _mqttTopicGetter(_mqttTopicIndexed(magnitude, index));
+    const auto out = mqttTopicView(magnitude, index);
+    if (out.length()) {
+        return out.toString();
+    }
+
+    return (index != espurna::mqtt::TopicCache::NoIndex)
+        ? _mqttTopicGetter(_mqttTopicIndexed(magnitude, index))
+        : _mqttTopicGetter(magnitude);
 }
 
 String mqttTopicSetter(const String& magnitude) {
-    return _mqttTopicSetter(magnitude);
+    return mqttTopicSetter(magnitude, espurna::mqtt::TopicCache::NoIndex);
 }
 
 String mqttTopicSetter(const String& magnitude, size_t index) {
-    return _mqttTopicSetter(_mqttTopicIndexed(magnitude, index));
+    const auto out = _mqtt_topics.get(magnitude, index,
+        espurna::mqtt::TopicCache::Kind::Setter);
+    if (out.length()) {
+        return out.toString();
+    }
+
+    return (index != espurna::mqtt::TopicCache::NoIndex)
+        ? _mqttTopicSetter(_mqttTopicIndexed(magnitude, index))
+        : _mqttTopicSetter(magnitude);
+}
+
+espurna::StringView mqttTopicView(espurna::StringView magnitude, size_t index) {
+    return _mqtt_topics.get(magnitude, index,
+        espurna::mqtt::TopicCache::Kind::Getter);
+}
+
+espurna::StringView mqttTopicView(espurna::StringView magnitude) {
+    return mqttTopicView(magnitude, espurna::mqtt::TopicCache::NoIndex);
 }
 
 // -----------------------------------------------------------------------------
 
-uint16_t mqttSendRaw(const char* topic, const char* message, bool retain, int qos) {
+namespace {
+
+uint16_t _mqttPublish(const char* topic, const char* message, bool retain, int qos) {
+#if MQTT_MIRROR_SUPPORT
+    _mqttMirrorPublish(topic, message, retain, qos);
+#endif
+
     if (_mqtt.connected()) {
+        // AsyncMqttClient keeps its AsyncClient private, send queue is only known for the v5 transport
+#if MQTT_LIBRARY == MQTT_LIBRARY_MQTT5
+        if (_mqtt_transport.client) {
+            _mqtt_stats.send_buffer(_mqtt_transport.client->availableForWrite());
+        }
+#endif
+
         const unsigned int packetId {
 #if MQTT_LIBRARY == MQTT_LIBRARY_ASYNCMQTTCLIENT
             _mqtt.publish(topic, qos, retain, message)
@@ -1378,9 +2519,21 @@ uint16_t mqttSendRaw(const char* topic, const char* message, bool retain, int qo
             _mqtt.publish(topic, message, retain, qos)
 #elif MQTT_LIBRARY == MQTT_LIBRARY_PUBSUBCLIENT
             _mqtt.publish(topic, message, retain)
+#elif MQTT_LIBRARY == MQTT_LIBRARY_MQTT5
+            _mqtt.publish(topic, message, retain, qos)
 #endif
         };
 
+        // Only async and v5 clients report back when QoS1+ message is acknowledged
+        _mqtt_stats.publish(
+            strlen(topic) + strlen(message), packetId,
+#if (MQTT_LIBRARY == MQTT_LIBRARY_ASYNCMQTTCLIENT) || (MQTT_LIBRARY == MQTT_LIBRARY_MQTT5)
+            qos,
+#else
+            0,
+#endif
+            MqttTimeSource::now().time_since_epoch());
+
 #if DEBUG_SUPPORT
         {
             const size_t len = strlen(message);
@@ -1402,6 +2555,54 @@ uint16_t mqttSendRaw(const char* topic, const char* message, bool retain, int qo
     return false;
 }
 
+// Queue is sent in small chunks, to avoid stalling the loop (and filling up the client buffer)
+// Message that could not be sent stays at the front and is retried later
+void _mqttOfflineDrain() {
+    if (!_mqtt.connected()) {
+        return;
+    }
+
+#if MQTT_OFFLINE_QUEUE_SPILL
+    if (_mqtt_offline_restore) {
+        _mqtt_offline_restore = false;
+        _mqttOfflineRestore();
+    }
+#endif
+
+    if (_mqtt_offline_queue.empty()) {
+        return;
+    }
+
+    const auto now = MqttTimeSource::now();
+    if (now - _mqtt_offline_last < mqtt::build::OfflineQueueInterval) {
+        return;
+    }
+
+    _mqtt_offline_last = now;
+
+    for (size_t count = 0; (count < _mqtt_offline_rate) && !_mqtt_offline_queue.empty(); ++count) {
+        const auto& front = _mqtt_offline_queue.front();
+        if (!_mqttPublish(front.topic.c_str(), front.payload.c_str(), front.retain, front.qos)) {
+            break;
+        }
+
+        _mqtt_offline_queue.pop(MqttTimeSource::now().time_since_epoch());
+    }
+}
+
+} // namespace
+
+uint16_t mqttSendRaw(const char* topic, const char* message, bool retain, int qos) {
+    if (_mqtt.connected()) {
+        // Queued message is no longer relevant, newer one is sent right now
+        _mqtt_offline_queue.remove(topic);
+        return _mqttPublish(topic, message, retain, qos);
+    }
+
+    _mqttOfflineEnqueue(topic, message, retain, qos);
+    return 0;
+}
+
 uint16_t mqttSendRaw(const char* topic, const char* message, bool retain) {
     return mqttSendRaw(topic, message, retain, _mqtt_settings.qos);
 }
@@ -1410,14 +2611,62 @@ uint16_t mqttSendRaw(const char* topic, const char* message) {
     return mqttSendRaw(topic, message, _mqtt_settings.retain);
 }
 
-bool mqttSend(const char* topic, const char* message, bool force, bool retain) {
+namespace {
+
+// Cached topic string is always null-terminated, fallback is only used when cache is full
+const char* _mqttTopicGetterCached(const char* magnitude, String& fallback) {
+    const auto* entry = _mqtt_topics.find(magnitude);
+    if (entry) {
+        return entry->getter.c_str();
+    }
+
+    fallback = _mqttTopicGetter(magnitude);
+    return fallback.c_str();
+}
+
+bool _mqttSendNow(const char* topic, const char* message, bool force, bool retain) {
+    String fallback;
+
+    // JSON payload is only ever built while connected, offline queue works with individual topics
+    // Queued message is not sent yet, caller still sees the same result as without the queue
+    if (!_mqtt.connected()) {
+        _mqttOfflineEnqueue(_mqttTopicGetterCached(topic, fallback),
+            message, retain, _mqtt_settings.qos);
+        return false;
+    }
+
     if (!force && _mqtt_use_json) {
         mqttEnqueue(topic, message);
         _mqtt_json_payload_flush.once(mqtt::build::JsonDelay, mqttFlush);
         return true;
     }
 
-    return mqttSendRaw(mqttTopic(topic).c_str(), message, retain) > 0;
+    return mqttSendRaw(_mqttTopicGetterCached(topic, fallback), message, retain) > 0;
+}
+
+// Held back messages are sent from the loop, regardless of the client library
+void _mqttRateFlush() {
+    _mqtt_rate.flush(MqttTimeSource::now().time_since_epoch(),
+        [](const String& topic, const String& payload, uint8_t flags) {
+            _mqttSendNow(topic.c_str(), payload.c_str(),
+                (flags & MqttRateForce) > 0,
+                (flags & MqttRateRetain) > 0);
+        });
+}
+
+} // namespace
+
+bool mqttSend(const char* topic, const char* message, bool force, bool retain) {
+    if (_mqtt.connected()) {
+        const uint8_t flags = (force ? MqttRateForce : 0) | (retain ? MqttRateRetain : 0);
+        const auto result = _mqtt_rate.offer(topic, message, flags,
+            MqttTimeSource::now().time_since_epoch());
+        if (result == espurna::mqtt::RateLimiter::Result::Hold) {
+            return true;
+        }
+    }
+
+    return _mqttSendNow(topic, message, force, retain);
 }
 
 bool mqttSend(const char* topic, const char* message, bool force) {
@@ -1429,6 +2678,12 @@ bool mqttSend(const char* topic, const char* message) {
 }
 
 bool mqttSend(const char* topic, unsigned int index, const char* message, bool force, bool retain) {
+    // Indexed {magnitude} is also stored in the cache, no need to build it every time
+    const auto* entry = _mqtt_topics.find(topic, index);
+    if (entry) {
+        return mqttSend(entry->magnitude.c_str(), message, force, retain);
+    }
+
     const size_t TopicLen { strlen(topic) };
     String out;
     out.reserve(TopicLen + 5);
@@ -1450,8 +2705,6 @@ bool mqttSend(const char* topic, unsigned int index, const char* message) {
 
 // -----------------------------------------------------------------------------
 
-constexpr size_t MqttJsonPayloadBufferSize { 1024ul };
-
 void mqttFlush() {
     if (!_mqtt.connected()) {
         return;
@@ -1461,48 +2714,59 @@ void mqttFlush() {
         return;
     }
 
-    DynamicJsonBuffer jsonBuffer(MqttJsonPayloadBufferSize);
-    JsonObject& root = jsonBuffer.createObject();
+    espurna::mqtt::JsonWriter writer(
+        _mqtt_json_payload_buffer.get(),
+        MqttJsonPayloadBufferSize + MqttJsonPayloadInfoSize);
 
 #if NTP_SUPPORT && MQTT_ENQUEUE_DATETIME
     if (ntpSynced()) {
-        root[MQTT_TOPIC_DATETIME] = ntpDateTime();
+        writer.string(MQTT_TOPIC_DATETIME, ntpDateTime());
     }
 #endif
 #if MQTT_ENQUEUE_MAC
-    root[MQTT_TOPIC_MAC] = WiFi.macAddress();
+    {
+        uint8_t mac[6];
+        WiFi.macAddress(mac);
+
+        char buffer[18];
+        const auto length = snprintf_P(buffer, sizeof(buffer),
+            PSTR("%02X:%02X:%02X:%02X:%02X:%02X"),
+            mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+        writer.string(MQTT_TOPIC_MAC, espurna::StringView(buffer, length));
+    }
 #endif
 #if MQTT_ENQUEUE_HOSTNAME
-    root[MQTT_TOPIC_HOSTNAME] = systemHostname();
+    writer.string(MQTT_TOPIC_HOSTNAME, _mqtt_json_hostname);
 #endif
 #if MQTT_ENQUEUE_IP
-    root[MQTT_TOPIC_IP] = wifiStaIp().toString();
+    {
+        const auto ip = wifiStaIp();
+
+        char buffer[16];
+        const auto length = snprintf_P(buffer, sizeof(buffer),
+            PSTR("%u.%u.%u.%u"),
+            ip[0], ip[1], ip[2], ip[3]);
+        writer.string(MQTT_TOPIC_IP, espurna::StringView(buffer, length));
+    }
 #endif
 #if MQTT_ENQUEUE_MESSAGE_ID
-    root[MQTT_TOPIC_MESSAGE_ID] = (Rtcmem->mqtt)++;
+    writer.number(MQTT_TOPIC_MESSAGE_ID, (Rtcmem->mqtt)++);
 #endif
 
     // ref. https://github.com/xoseperez/espurna/issues/2503
     // pretend that the message is already a valid json value
     // when the string looks like a number
     // ([0-9] with an optional decimal separator [.])
-    for (auto& payload : _mqtt_json_payload) {
-        const char* const topic { payload.topic().c_str() };
-        const char* const message { payload.message().c_str() };
-        if (isNumber(payload.message())) {
-            root[topic] = RawJson(message);
-        } else {
-            root[topic] = message;
-        }
-    }
-
-    String output;
-    root.printTo(output);
-
-    jsonBuffer.clear();
-    _mqtt_json_payload_count = 0;
+    _mqtt_json_payload.write(writer);
     _mqtt_json_payload.clear();
 
+    const auto output = writer.finish();
+    if (!output.length()) {
+        DEBUG_MSG_P(PSTR("[MQTT] JSON payload does not fit into %zu bytes\n"),
+            MqttJsonPayloadBufferSize + MqttJsonPayloadInfoSize);
+        return;
+    }
+
     mqttSendRaw(_mqtt_settings.topic_json.c_str(), output.c_str(), false);
 }
 
@@ -1510,24 +2774,22 @@ void mqttEnqueue(espurna::StringView topic, espurna::StringView payload) {
     // Queue is not meant to send message "offline"
     // We must prevent the queue does not get full while offline
     if (_mqtt.connected()) {
-        if (_mqtt_json_payload_count >= MQTT_QUEUE_MAX_SIZE) {
-            mqttFlush();
+        using Result = espurna::mqtt::JsonBatch::Result;
+        if (_mqtt_json_payload.add(topic, payload) != Result::Full) {
+            return;
         }
 
-        _mqtt_json_payload.remove_if(
-            [topic](const MqttPayload& payload) {
-                return topic == payload.topic();
-            });
-
-        _mqtt_json_payload.emplace_front(
-            topic.toString(), payload.toString());
-        ++_mqtt_json_payload_count;
+        mqttFlush();
+        if (_mqtt_json_payload.add(topic, payload) == Result::Full) {
+            DEBUG_MSG_P(PSTR("[MQTT] Cannot group %.*s\n"),
+                topic.length(), topic.data());
+        }
     }
 }
 
 // -----------------------------------------------------------------------------
 
-// Only async client returns resulting PID, sync libraries return either success (1) or failure (0)
+// Only async and v5 clients return resulting PID, sync libraries return either success (1) or failure (0)
 
 uint16_t mqttSubscribeRaw(const char* topic, int qos) {
     uint16_t pid { 0u };
@@ -1544,7 +2806,14 @@ uint16_t mqttSubscribeRaw(const char* topic) {
 }
 
 bool mqttSubscribe(const char* topic) {
-    return mqttSubscribeRaw(mqttTopicSetter(topic).c_str(), _mqtt_settings.qos);
+    const auto setter = _mqtt_topics.get(topic,
+        espurna::mqtt::TopicCache::NoIndex,
+        espurna::mqtt::TopicCache::Kind::Setter);
+    if (setter.length()) {
+        return mqttSubscribeRaw(setter.c_str(), _mqtt_settings.qos);
+    }
+
+    return mqttSubscribeRaw(_mqttTopicSetter(topic).c_str(), _mqtt_settings.qos);
 }
 
 uint16_t mqttUnsubscribeRaw(const char* topic) {
@@ -1578,6 +2847,7 @@ bool mqttConnected() {
 void mqttDisconnect() {
     if (_mqtt.connected()) {
         DEBUG_MSG_P(PSTR("[MQTT] Disconnecting\n"));
+        _mqtt_disconnect_requested = true;
         _mqtt.disconnect();
     }
 }
@@ -1595,7 +2865,39 @@ void mqttRegister(MqttCallback callback) {
     _mqtt_callbacks.push_front(callback);
 }
 
-#if MQTT_LIBRARY == MQTT_LIBRARY_ASYNCMQTTCLIENT
+/**
+    Register a persistent message callback for the topic pattern
+
+    @param pattern relative to the {magnitude}, see `mqtt_dispatch.h`
+    @param standalone function pointer
+*/
+bool mqttRegister(espurna::StringView pattern, espurna::mqtt::MessageCallback callback) {
+    const auto result = _mqtt_dispatcher.add(pattern, callback);
+    if (!result) {
+        DEBUG_MSG_P(PSTR("[MQTT] Invalid handler pattern %.*s\n"),
+            pattern.length(), pattern.data());
+    }
+
+    return result;
+}
+
+/**
+    Register a persistent stream callback for the exact topic {magnitude}
+
+    @param magnitude, see `mqtt_stream.h`
+    @param standalone function pointer
+*/
+bool mqttRegisterStream(espurna::StringView magnitude, espurna::mqtt::FragmentCallback callback) {
+    const auto result = _mqtt_streams.add(magnitude, callback);
+    if (!result) {
+        DEBUG_MSG_P(PSTR("[MQTT] Invalid stream handler %.*s\n"),
+            magnitude.length(), magnitude.data());
+    }
+
+    return result;
+}
+
+#if (MQTT_LIBRARY == MQTT_LIBRARY_ASYNCMQTTCLIENT) || (MQTT_LIBRARY == MQTT_LIBRARY_MQTT5)
 
 /**
     Register a temporary publish callback
@@ -1656,18 +2958,22 @@ void _mqttConnect() {
     // Do not connect if disabled or no WiFi
     if (!_mqtt_enabled || (!wifiConnected())) return;
 
-    // Check reconnect interval
-    if (MqttTimeSource::now() - _mqtt_last_connection < _mqtt_reconnect_delay) return;
+    // Check reconnect interval of every broker, preferring the ones at the start of the list
+    const auto now = MqttTimeSource::now();
 
-    // Increase the reconnect delay each attempt
-    _mqtt_reconnect_delay += mqtt::build::ReconnectStep;
-    _mqtt_reconnect_delay = std::clamp(_mqtt_reconnect_delay,
-            mqtt::build::ReconnectDelayMin, mqtt::build::ReconnectDelayMax);
+    const auto index = _mqtt_brokers.select(now.time_since_epoch());
+    if (index == espurna::mqtt::Brokers::NoIndex) return;
 
-    DEBUG_MSG_P(PSTR("[MQTT] Connecting to broker at %s:%hu\n"),
-            _mqtt_settings.server.c_str(), _mqtt_settings.port);
+    _mqtt_broker = index;
+    _mqtt_brokers.connecting(index);
+
+    const auto& endpoint = _mqttEndpoint();
+    DEBUG_MSG_P(PSTR("[MQTT] Connecting to broker #%zu at %s:%hu\n"),
+            index, endpoint.host.c_str(), endpoint.port);
 
     _mqtt_state = AsyncClientState::Connecting;
+    _mqtt_connect_start = now;
+    _mqtt_stats.connecting(now.time_since_epoch());
 
     _mqtt_skip_messages = (_mqtt_skip_time.count() > 0);
 
@@ -1679,6 +2985,19 @@ void _mqttConnect() {
 
     #if MQTT_LIBRARY == MQTT_LIBRARY_ASYNCMQTTCLIENT
         _mqttSetupAsyncClient(secure);
+    #elif MQTT_LIBRARY == MQTT_LIBRARY_MQTT5
+        if (!_mqttSetupSyncClient(secure)
+            || !_mqttConnectSyncClient(secure)
+            || !_mqttConnectV5Client())
+        {
+            DEBUG_MSG_P(PSTR("[MQTT] Connection failed\n"));
+            _mqttGetClient(secure).stop();
+
+            // client would've already reported this when CONNECT could not be sent
+            if (_mqtt_state != AsyncClientState::Disconnected) {
+                _mqttOnDisconnect();
+            }
+        }
     #elif (MQTT_LIBRARY == MQTT_LIBRARY_ARDUINOMQTT) || (MQTT_LIBRARY == MQTT_LIBRARY_PUBSUBCLIENT)
         if (_mqttSetupSyncClient(secure) && _mqttConnectSyncClient(secure)) {
             _mqttOnConnect();
@@ -1692,10 +3011,48 @@ void _mqttConnect() {
 
 }
 
+#if MQTT_LIBRARY == MQTT_LIBRARY_ASYNCMQTTCLIENT
+
+// TCP client may never report back when the broker is not responding at all
+// (v5 client handles this internally, others are blocking until connected)
+void _mqttConnectTimeout() {
+    if ((_mqtt_state != AsyncClientState::Connecting)
+        || (MqttTimeSource::now() - _mqtt_connect_start <= mqtt::build::ConnectTimeout))
+    {
+        return;
+    }
+
+    DEBUG_MSG_P(PSTR("[MQTT] Connection timed out\n"));
+    _mqtt.disconnect(true);
+
+    if (_mqtt_state == AsyncClientState::Connecting) {
+        _mqttOnDisconnect();
+    }
+}
+
+#endif
+
+// Fallback broker is used for long enough, check whether the preferred one is back.
+// When it is not, the next attempt fails and the fallback one is used again
+void _mqttFailback() {
+    if (_mqtt_state != AsyncClientState::Connected) {
+        return;
+    }
+
+    if (_mqtt_brokers.failback(MqttTimeSource::now().time_since_epoch())) {
+        DEBUG_MSG_P(PSTR("[MQTT] Reconnecting to the preferred broker\n"));
+        mqttDisconnect();
+    }
+}
+
 } // namespace
 
 void mqttLoop() {
 #if MQTT_LIBRARY == MQTT_LIBRARY_ASYNCMQTTCLIENT
+    _mqttConnectTimeout();
+    _mqttConnect();
+#elif MQTT_LIBRARY == MQTT_LIBRARY_MQTT5
+    _mqtt.loop(MqttTimeSource::now().time_since_epoch());
     _mqttConnect();
 #else
     if (_mqtt.connected()) {
@@ -1708,6 +3065,16 @@ void mqttLoop() {
         _mqttConnect();
     }
 #endif
+#if MQTT_MIRROR_SUPPORT
+    _mqttMirrorConnect();
+#endif
+    _mqttFailback();
+    _mqttOfflineDrain();
+    _mqttRateFlush();
+}
+
+const espurna::mqtt::Stats& mqttStats() {
+    return _mqtt_stats;
 }
 
 void mqttHeartbeat(espurna::heartbeat::Callback callback) {
@@ -1747,6 +3114,7 @@ void mqttSetup() {
         });
 
         _mqtt.onPublish([](uint16_t pid) {
+            _mqtt_stats.ack(pid, MqttTimeSource::now().time_since_epoch());
             _mqttPidCallback(_mqtt_publish_callbacks, pid);
         });
 
@@ -1795,6 +3163,10 @@ void mqttSetup() {
 
         });
 
+        #if MQTT_MIRROR_SUPPORT
+            _mqttMirrorSetup();
+        #endif
+
     #elif MQTT_LIBRARY == MQTT_LIBRARY_ARDUINOMQTT
 
         _mqtt.onMessageAdvanced([](MQTTClient* , char topic[], char payload[], int length) {
@@ -1807,10 +3179,46 @@ void mqttSetup() {
             _mqttOnMessage(topic, (char *) payload, length);
         });
 
+    #elif MQTT_LIBRARY == MQTT_LIBRARY_MQTT5
+
+        _mqtt.onMessage([](char* topic, char* payload, size_t length) {
+            _mqttOnMessage(topic, payload, length);
+        });
+
+        _mqtt.onConnect([](bool session_present) {
+            if (session_present) {
+                DEBUG_MSG_P(PSTR("[MQTT] Resuming existing session\n"));
+            }
+            _mqttOnConnect();
+        });
+
+        _mqtt.onSubscribe([](uint16_t pid) {
+            _mqttPidCallback(_mqtt_subscribe_callbacks, pid);
+        });
+
+        _mqtt.onPublish([](uint16_t pid) {
+            _mqtt_stats.ack(pid, MqttTimeSource::now().time_since_epoch());
+            _mqttPidCallback(_mqtt_publish_callbacks, pid);
+        });
+
+        _mqtt.onDisconnect([](uint8_t reason) {
+            if (reason != espurna::mqtt::v5::Client::ReasonNormal) {
+                DEBUG_MSG_P(PSTR("[MQTT] Disconnected with reason 0x%02hhX\n"), reason);
+            }
+            _mqttOnDisconnect();
+        });
+
     #endif // MQTT_LIBRARY == MQTT_LIBRARY_ASYNCMQTTCLIENT
 
+#if MQTT_OFFLINE_QUEUE_SPILL
+    _mqttOfflineSpillSetup();
+#endif
+
     _mqttConfigure();
     mqttRegister(_mqttCallback);
+#if MQTT_SETTINGS_RESTORE_SUPPORT
+    mqttRegisterStream(MQTT_TOPIC_SETTINGS_RESTORE, _mqttSettingsRestore);
+#endif
 
     #if WEB_SUPPORT
         wsRegister()
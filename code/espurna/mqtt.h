@@ -10,6 +10,10 @@ Updated secure client support by Niek van der Maas < mail at niekvandermaas dot
 #pragma once
 
 #include "system.h"
+#include "mqtt_dispatch.h"
+#include "mqtt_stats.h"
+#include "mqtt_stream.h"
+#include "mqtt_topics.h"
 
 #include <functional>
 
@@ -51,18 +55,32 @@ Updated secure client support by Niek van der Maas < mail at niekvandermaas dot
 #define MQTT_TOPIC_TIMER            "timer"
 #define MQTT_TOPIC_SPEED            "speed"
 #define MQTT_TOPIC_OTA              "ota"
+#define MQTT_TOPIC_OTA_BINARY       "ota/bin"
 #define MQTT_TOPIC_TELNET_REVERSE   "telnet_reverse"
 #define MQTT_TOPIC_CURTAIN          "curtain"
 #define MQTT_TOPIC_CMD              "cmd"
 #define MQTT_TOPIC_SCHEDULE         "schedule"
 #define MQTT_TOPIC_NAMED_EVENT      "named_event"
+#define MQTT_TOPIC_SETTINGS_RESTORE "restore"
+#define MQTT_TOPIC_MQTT_STATS       "mqtt"
 
 void mqttHeartbeat(espurna::heartbeat::Callback);
 
+// outgoing messages and connection counters, see mqtt_stats.h
+const espurna::mqtt::Stats& mqttStats();
+
 // stateless callback; generally, registered once per module when calling setup()
 using MqttCallback = void(*)(unsigned int type, espurna::StringView topic, espurna::StringView payload);
 void mqttRegister(MqttCallback);
 
+// stateless callback, only called for the messages matching the pattern (see mqtt_dispatch.h)
+// receives {magnitude} of the topic and the parsed {index}. subscription is still up to the caller
+bool mqttRegister(espurna::StringView pattern, espurna::mqtt::MessageCallback);
+
+// stateless callback, receiving the payload of the messages for the exact {magnitude} as it arrives (see mqtt_stream.h)
+// such messages are not limited by the MQTT_BUFFER_MAX_SIZE and are not passed to any other callback
+bool mqttRegisterStream(espurna::StringView magnitude, espurna::mqtt::FragmentCallback);
+
 // stateful callback for ACK'ed messages; should be used when waiting for certain messsage to be PUBlished
 using MqttPidCallback = std::function<void()>;
 void mqttOnPublish(uint16_t pid, MqttPidCallback);
@@ -74,8 +92,15 @@ String mqttTopic(const String& magnitude, size_t index);
 String mqttTopicSetter(const String& magnitude);
 String mqttTopicSetter(const String& magnitude, size_t index);
 
+// same as mqttTopic(), but the string is cached and only stays valid until settings are reloaded
+// empty when cache is full (see MQTT_TOPIC_CACHE_SIZE) or when MQTT is not configured yet
+espurna::StringView mqttTopicView(espurna::StringView magnitude, size_t index);
+espurna::StringView mqttTopicView(espurna::StringView magnitude);
+
 espurna::StringView mqttMagnitude(espurna::StringView topic);
 
+// While disconnected, message is kept in the offline queue and sent after connecting.
+// PID is only returned when the message is sent right away
 uint16_t mqttSendRaw(const char * topic, const char * message, bool retain, int qos);
 uint16_t mqttSendRaw(const char * topic, const char * message, bool retain);
 uint16_t mqttSendRaw(const char * topic, const char * message);
@@ -87,6 +112,7 @@ bool mqttSubscribe(const char * topic);
 uint16_t mqttUnsubscribeRaw(const char * topic);
 bool mqttUnsubscribe(const char * topic);
 
+// `false` when the message was not sent, even when it was placed in the offline queue to be sent after connecting
 bool mqttSend(const char * topic, const char * message, bool force, bool retain);
 bool mqttSend(const char * topic, const char * message, bool force);
 bool mqttSend(const char * topic, const char * message);
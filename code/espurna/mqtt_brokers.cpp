@@ -0,0 +1,169 @@
+/*
+
+Part of the MQTT MODULE
+
+*/
+
+#include "mqtt_brokers.h"
+
+#include <algorithm>
+
+namespace espurna {
+namespace mqtt {
+
+bool parse_endpoint(StringView value, uint16_t port, Endpoint& out) {
+    auto host = value;
+
+    const auto it = std::find(value.begin(), value.end(), ':');
+    if (it != value.end()) {
+        host = StringView(value.begin(), it);
+
+        const auto digits = StringView(it + 1, value.end());
+        if (!digits.length()) {
+            return false;
+        }
+
+        uint32_t parsed { 0 };
+        for (auto c : digits) {
+            if ((c < '0') || (c > '9')) {
+                return false;
+            }
+
+            parsed = (parsed * 10) + (c - '0');
+            if (parsed > std::numeric_limits<uint16_t>::max()) {
+                return false;
+            }
+        }
+
+        port = static_cast<uint16_t>(parsed);
+    }
+
+    if (!host.length() || !port) {
+        return false;
+    }
+
+    out.host = host.toString();
+    out.port = port;
+
+    return true;
+}
+
+bool Brokers::reset(std::vector<Endpoint>&& endpoints, Options options) {
+    _options = options;
+
+    bool changed = endpoints.size() != _brokers.size();
+    if (!changed) {
+        for (size_t index = 0; index < endpoints.size(); ++index) {
+            if (!(endpoints[index] == _brokers[index].endpoint)) {
+                changed = true;
+                break;
+            }
+        }
+    }
+
+    if (changed) {
+        _brokers.clear();
+        _brokers.reserve(endpoints.size());
+        for (auto& endpoint : endpoints) {
+            _brokers.push_back(Broker{std::move(endpoint), EndpointStats{}});
+        }
+
+        _current = NoIndex;
+        _last = NoIndex;
+    }
+
+    return changed;
+}
+
+void Brokers::rewind() {
+    for (auto& broker : _brokers) {
+        broker.backoff = duration::Milliseconds::zero();
+    }
+}
+
+bool Brokers::ready(const Broker& broker, duration::Milliseconds now) {
+    return !broker.backoff.count() || ((now - broker.since) >= broker.backoff);
+}
+
+size_t Brokers::select(duration::Milliseconds now) const {
+    for (size_t index = 0; index < _brokers.size(); ++index) {
+        if (ready(_brokers[index], now)) {
+            return index;
+        }
+    }
+
+    return NoIndex;
+}
+
+duration::Milliseconds Brokers::wait(duration::Milliseconds now) const {
+    auto out = duration::Milliseconds::max();
+    for (const auto& broker : _brokers) {
+        if (ready(broker, now)) {
+            return duration::Milliseconds::zero();
+        }
+
+        out = std::min(out, broker.backoff - (now - broker.since));
+    }
+
+    return _brokers.empty()
+        ? duration::Milliseconds::zero()
+        : out;
+}
+
+void Brokers::connecting(size_t index) {
+    ++_brokers[index].stats.attempts;
+}
+
+void Brokers::connected(size_t index, duration::Milliseconds now) {
+    auto& broker = _brokers[index];
+    ++broker.stats.connections;
+    broker.backoff = duration::Milliseconds::zero();
+
+    if ((_last != NoIndex) && (_last != index)) {
+        ++_switches;
+    }
+
+    _current = index;
+    _last = index;
+    _current_since = now;
+}
+
+void Brokers::failed(size_t index, duration::Milliseconds now) {
+    auto& broker = _brokers[index];
+    ++broker.stats.failures;
+
+    broker.backoff = broker.backoff.count()
+        ? std::min(broker.backoff * 2, _options.backoff_max)
+        : _options.backoff_min;
+    broker.since = now;
+
+    if (_current == index) {
+        _current = NoIndex;
+    }
+}
+
+void Brokers::disconnected() {
+    _current = NoIndex;
+}
+
+bool Brokers::failback(duration::Milliseconds now) {
+    if (!_options.failback.count() || !_current || (_current == NoIndex)) {
+        return false;
+    }
+
+    if ((now - _current_since) < _options.failback) {
+        return false;
+    }
+
+    for (size_t index = 0; index < _current; ++index) {
+        if (ready(_brokers[index], now)) {
+            _current_since = now;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+} // namespace mqtt
+} // namespace espurna
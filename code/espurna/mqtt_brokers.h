@@ -0,0 +1,132 @@
+/*
+
+Part of the MQTT MODULE
+
+Ordered list of brokers to connect to. Every broker gets its own exponential backoff,
+the first one that is not waiting for it is used for the next connection attempt
+
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "types.h"
+
+namespace espurna {
+namespace mqtt {
+
+struct Endpoint {
+    String host;
+    uint16_t port;
+};
+
+inline bool operator==(const Endpoint& lhs, const Endpoint& rhs) {
+    return (lhs.port == rhs.port) && (lhs.host == rhs.host);
+}
+
+// Either 'host' or 'host:port', using `port` when it is not specified
+bool parse_endpoint(StringView value, uint16_t port, Endpoint& out);
+
+struct EndpointStats {
+    uint32_t attempts { 0 };
+    uint32_t failures { 0 };
+    uint32_t connections { 0 };
+};
+
+class Brokers {
+public:
+    static constexpr size_t NoIndex { std::numeric_limits<size_t>::max() };
+
+    struct Options {
+        // Delay after the first failure, doubled after every consecutive one
+        duration::Milliseconds backoff_min;
+        duration::Milliseconds backoff_max;
+
+        // Connected to anything but the first broker for this long, try to go back to a preferred one
+        // (zero disables this and the broker is only switched when connection is lost)
+        duration::Milliseconds failback;
+    };
+
+    // Returns true when the list is different from the current one and was replaced.
+    // Otherwise, failover position and backoff of every broker are preserved
+    bool reset(std::vector<Endpoint>&&, Options);
+
+    // Forget about the previous failures, e.g. when connection settings were changed
+    void rewind();
+
+    // First broker that is not waiting for its backoff to expire, or NoIndex when all of them are
+    size_t select(duration::Milliseconds now) const;
+
+    // Time until select() would return something
+    duration::Milliseconds wait(duration::Milliseconds now) const;
+
+    void connecting(size_t index);
+    void connected(size_t index, duration::Milliseconds now);
+
+    // Connection attempt failed or established connection was lost
+    void failed(size_t index, duration::Milliseconds now);
+
+    // Connection was closed on request, nothing is penalized
+    void disconnected();
+
+    // Connected to the fallback broker for long enough and a preferred one may be available again.
+    // Only reported once per connection, or once per interval when the disconnect is slow to follow
+    bool failback(duration::Milliseconds now);
+
+    // Currently connected broker, NoIndex when there is none
+    size_t current() const {
+        return _current;
+    }
+
+    // Number of times connection was established with a different broker than the last time
+    uint32_t switches() const {
+        return _switches;
+    }
+
+    size_t size() const {
+        return _brokers.size();
+    }
+
+    const Endpoint& endpoint(size_t index) const {
+        return _brokers[index].endpoint;
+    }
+
+    const EndpointStats& stats(size_t index) const {
+        return _brokers[index].stats;
+    }
+
+    duration::Milliseconds backoff(size_t index) const {
+        return _brokers[index].backoff;
+    }
+
+    const Options& options() const {
+        return _options;
+    }
+
+private:
+    struct Broker {
+        Endpoint endpoint;
+        EndpointStats stats;
+
+        duration::Milliseconds backoff{};
+        duration::Milliseconds since{};
+    };
+
+    static bool ready(const Broker&, duration::Milliseconds now);
+
+    std::vector<Broker> _brokers;
+    Options _options{};
+
+    size_t _current { NoIndex };
+    size_t _last { NoIndex };
+    duration::Milliseconds _current_since{};
+    uint32_t _switches { 0 };
+};
+
+} // namespace mqtt
+} // namespace espurna
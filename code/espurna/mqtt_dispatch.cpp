@@ -0,0 +1,278 @@
+/*
+
+Part of the MQTT MODULE
+
+*/
+
+#include "mqtt_dispatch.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace espurna {
+namespace mqtt {
+namespace {
+
+STRING_VIEW_INLINE(Single, "+");
+STRING_VIEW_INLINE(Multi, "#");
+STRING_VIEW_INLINE(Index, "{index}");
+
+bool parse_index(StringView value, size_t& out) {
+    if (!value.length()) {
+        return false;
+    }
+
+    size_t result { 0 };
+    for (auto it = value.begin(); it != value.end(); ++it) {
+        if ((*it < '0') || (*it > '9')) {
+            return false;
+        }
+
+        const size_t digit = *it - '0';
+        if (result > ((std::numeric_limits<size_t>::max() - digit) / 10)) {
+            return false;
+        }
+
+        result = (result * 10) + digit;
+    }
+
+    out = result;
+    return true;
+}
+
+// Topic segments are never copied, only the view of the current one is needed
+struct Segment {
+    StringView value;
+    const char* next;
+    bool last;
+};
+
+Segment next_segment(const char* begin, const char* end) {
+    const auto slash = std::find(begin, end, '/');
+    if (slash == end) {
+        return Segment{
+            .value = StringView(begin, end),
+            .next = end,
+            .last = true,
+        };
+    }
+
+    return Segment{
+        .value = StringView(begin, slash),
+        .next = std::next(slash),
+        .last = false,
+    };
+}
+
+} // namespace
+
+size_t Dispatcher::find_or_add(size_t parent, Kind kind, StringView text) {
+    for (const auto child : _nodes[parent].children) {
+        const auto& node = _nodes[child];
+        if ((node.kind == kind) && ((kind != Kind::Text) || (text == node.text))) {
+            return child;
+        }
+    }
+
+    const auto out = _nodes.size();
+    _nodes.push_back(
+        Node{
+            .kind = kind,
+            .text = (kind == Kind::Text) ? text.toString() : String(),
+            .children = {},
+            .callbacks = {},
+        });
+    _nodes[parent].children.push_back(out);
+
+    return out;
+}
+
+bool Dispatcher::add(StringView pattern, MessageCallback callback) {
+    if (!pattern.length() || !callback) {
+        return false;
+    }
+
+    if (_nodes.empty()) {
+        _nodes.push_back(
+            Node{
+                .kind = Kind::Root,
+                .text = String(),
+                .children = {},
+                .callbacks = {},
+            });
+    }
+
+    // Validate the whole pattern first, so nothing is added on error
+    for (auto segment = next_segment(pattern.begin(), pattern.end());;
+            segment = next_segment(segment.next, pattern.end()))
+    {
+        if (!segment.value.length()) {
+            return false;
+        }
+
+        if ((segment.value == Multi) && !segment.last) {
+            return false;
+        }
+
+        const auto wildcards = std::count_if(
+            segment.value.begin(), segment.value.end(),
+            [](char c) {
+                return (c == '+') || (c == '#');
+            });
+        if (wildcards && (segment.value.length() != 1)) {
+            return false;
+        }
+
+        if (segment.last) {
+            break;
+        }
+    }
+
+    size_t node { 0 };
+    for (auto segment = next_segment(pattern.begin(), pattern.end());;
+            segment = next_segment(segment.next, pattern.end()))
+    {
+        auto kind = Kind::Text;
+        if (segment.value == Single) {
+            kind = Kind::Single;
+        } else if (segment.value == Multi) {
+            kind = Kind::Multi;
+        } else if (segment.value == Index) {
+            kind = Kind::Index;
+        }
+
+        node = find_or_add(node, kind, segment.value);
+        if (segment.last) {
+            break;
+        }
+    }
+
+    _nodes[node].callbacks.push_back(callback);
+    ++_callbacks;
+
+    return true;
+}
+
+size_t Dispatcher::call(const Node& node, Match& match, StringView payload) const {
+    for (const auto callback : node.callbacks) {
+        callback(match, payload);
+    }
+
+    return node.callbacks.size();
+}
+
+// Topic could match more than one pattern, every branch is checked
+size_t Dispatcher::match(size_t index, const char* begin, const char* end, bool done, Match& match, StringView payload) const {
+    size_t out { 0 };
+
+    const auto segment = next_segment(begin, end);
+    for (const auto child : _nodes[index].children) {
+        const auto& node = _nodes[child];
+        if (node.kind == Kind::Multi) {
+            match.wildcard = done
+                ? StringView()
+                : StringView(begin, end);
+            out += call(node, match, payload);
+            continue;
+        }
+
+        if (done) {
+            continue;
+        }
+
+        switch (node.kind) {
+        case Kind::Root:
+        case Kind::Multi:
+            continue;
+
+        case Kind::Text:
+            if (segment.value != node.text) {
+                continue;
+            }
+            break;
+
+        case Kind::Single:
+            match.wildcard = segment.value;
+            break;
+
+        case Kind::Index:
+            if (!parse_index(segment.value, match.index)) {
+                continue;
+            }
+            break;
+        }
+
+        if (segment.last) {
+            out += call(node, match, payload);
+        }
+
+        // `#` also matches the parent, so the children are checked even when nothing is left
+        if (!node.children.empty()) {
+            out += this->match(child, segment.next, end, segment.last, match, payload);
+        }
+    }
+
+    return out;
+}
+
+size_t Dispatcher::dispatch(StringView topic, StringView payload) const {
+    if (_nodes.empty() || !topic.length()) {
+        return 0;
+    }
+
+    Match match{
+        .topic = topic,
+        .wildcard = StringView(),
+        .index = 0,
+    };
+
+    return this->match(0, topic.begin(), topic.end(), false, match, payload);
+}
+
+void Dispatcher::subscriptions(size_t index, const String& prefix, std::vector<String>& out) const {
+    for (const auto child : _nodes[index].children) {
+        const auto& node = _nodes[child];
+
+        String path(prefix);
+        if (path.length()) {
+            path += '/';
+        }
+
+        switch (node.kind) {
+        case Kind::Root:
+            break;
+        case Kind::Text:
+            path += node.text;
+            break;
+        case Kind::Single:
+        case Kind::Index:
+            path += Single;
+            break;
+        case Kind::Multi:
+            path += Multi;
+            break;
+        }
+
+        if (!node.callbacks.empty()) {
+            out.push_back(path);
+        }
+
+        subscriptions(child, path, out);
+    }
+}
+
+std::vector<String> Dispatcher::subscriptions() const {
+    std::vector<String> out;
+    if (!_nodes.empty()) {
+        subscriptions(0, String(), out);
+
+        // `{index}` and `+` of the same parent are the same subscription
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+    }
+
+    return out;
+}
+
+} // namespace mqtt
+} // namespace espurna
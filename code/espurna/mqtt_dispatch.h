@@ -0,0 +1,85 @@
+/*
+
+Part of the MQTT MODULE
+
+Topic patterns that modules subscribe to, compiled into a trie. Every received
+message walks the trie once, instead of every module parsing every message
+
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "types.h"
+
+namespace espurna {
+namespace mqtt {
+
+// Patterns are '/'-separated paths relative to the {magnitude} of the root topic
+// (i.e. what mqttMagnitude() returns for the received topic), where each segment is
+// - exact text, e.g. `relay`
+// - `+`, any single segment
+// - `{index}`, any single segment that is a decimal number. Parsed value is passed to the callback
+// - `#`, any number of segments (including none). Only allowed as the last one
+// e.g. `relay/{index}` matches `relay/0` and `relay/12`, but not `relay/on` or `relay/0/set`
+struct Match {
+    StringView topic;
+    StringView wildcard;
+    size_t index;
+};
+
+using MessageCallback = void(*)(const Match&, StringView payload);
+
+class Dispatcher {
+public:
+    // Returns `false` when pattern is invalid
+    bool add(StringView pattern, MessageCallback);
+
+    // Call every callback matching the topic, returns the number of callbacks called
+    size_t dispatch(StringView topic, StringView payload) const;
+
+    // Registered patterns, with `{index}` replaced by `+` (suitable for the broker subscription)
+    std::vector<String> subscriptions() const;
+
+    size_t size() const {
+        return _callbacks;
+    }
+
+    void clear() {
+        _nodes.clear();
+        _callbacks = 0;
+    }
+
+private:
+    enum class Kind : uint8_t {
+        Root,
+        Text,
+        Single,
+        Index,
+        Multi,
+    };
+
+    struct Node {
+        Kind kind;
+        String text;
+        std::vector<uint16_t> children;
+        std::vector<MessageCallback> callbacks;
+    };
+
+    size_t find_or_add(size_t parent, Kind, StringView text);
+    size_t call(const Node&, Match&, StringView payload) const;
+    size_t match(size_t node, const char* begin, const char* end, bool done,
+            Match&, StringView payload) const;
+
+    void subscriptions(size_t node, const String& prefix, std::vector<String>&) const;
+
+    std::vector<Node> _nodes;
+    size_t _callbacks { 0 };
+};
+
+} // namespace mqtt
+} // namespace espurna
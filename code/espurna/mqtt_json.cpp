@@ -0,0 +1,270 @@
+/*
+
+Part of the MQTT MODULE
+
+*/
+
+#include "mqtt_json.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace espurna {
+namespace mqtt {
+namespace {
+
+uint32_t hash(StringView value) {
+    uint32_t out { 2166136261u };
+    for (auto it = value.begin(); it != value.end(); ++it) {
+        out ^= static_cast<uint8_t>(*it);
+        out *= 16777619u;
+    }
+
+    return out;
+}
+
+// Only what ArduinoJson would also escape, other characters are written as-is
+char escape(char c) {
+    switch (c) {
+    case '"':
+        return '"';
+    case '\\':
+        return '\\';
+    case '\b':
+        return 'b';
+    case '\f':
+        return 'f';
+    case '\n':
+        return 'n';
+    case '\r':
+        return 'r';
+    case '\t':
+        return 't';
+    }
+
+    return '\0';
+}
+
+// `"key":value,`
+size_t member_length(StringView topic, StringView payload, bool number) {
+    return json_string_length(topic) + 1
+        + (number ? payload.length() : json_string_length(payload))
+        + 1;
+}
+
+} // namespace
+
+size_t json_string_length(StringView value) {
+    size_t out { 2 };
+    for (auto it = value.begin(); it != value.end(); ++it) {
+        out += escape(*it) ? 2 : 1;
+    }
+
+    return out;
+}
+
+JsonWriter::JsonWriter(char* buffer, size_t size) :
+    _buffer(buffer),
+    _size(size)
+{
+    put('{');
+}
+
+void JsonWriter::put(char c) {
+    // always leave the space for the NUL
+    if (_length + 1 < _size) {
+        _buffer[_length++] = c;
+        return;
+    }
+
+    _overflow = true;
+}
+
+void JsonWriter::put(StringView value) {
+    if (_length + value.length() < _size) {
+        std::memcpy(&_buffer[_length], value.data(), value.length());
+        _length += value.length();
+        return;
+    }
+
+    _overflow = true;
+}
+
+void JsonWriter::escaped(StringView value) {
+    put('"');
+    for (auto it = value.begin(); it != value.end(); ++it) {
+        const auto c = escape(*it);
+        if (c) {
+            put('\\');
+            put(c);
+        } else {
+            put(*it);
+        }
+    }
+    put('"');
+}
+
+void JsonWriter::key(StringView value) {
+    if (!_first) {
+        put(',');
+    }
+
+    _first = false;
+    escaped(value);
+    put(':');
+}
+
+void JsonWriter::string(StringView key, StringView value) {
+    this->key(key);
+    escaped(value);
+}
+
+void JsonWriter::raw(StringView key, StringView value) {
+    this->key(key);
+    put(value);
+}
+
+void JsonWriter::number(StringView key, uint32_t value) {
+    char buffer[11];
+    const auto length = snprintf_P(buffer, sizeof(buffer), PSTR("%u"), value);
+
+    this->key(key);
+    put(StringView(buffer, length));
+}
+
+StringView JsonWriter::finish() {
+    put('}');
+    if (_overflow || !_size) {
+        if (_size) {
+            _buffer[0] = '\0';
+        }
+
+        return StringView();
+    }
+
+    _buffer[_length] = '\0';
+    return StringView(_buffer, _length);
+}
+
+void JsonBatch::reset(size_t capacity, size_t bytes) {
+    _capacity = std::min(capacity, size_t{ UINT16_MAX - 1 });
+    _strings_size = std::min(bytes, size_t{ UINT16_MAX });
+
+    // keep load factor at or below 1/2, probing sequences stay short
+    size_t slots { 0 };
+    if (_capacity) {
+        slots = 1;
+        while (slots < (_capacity * 2)) {
+            slots <<= 1;
+        }
+    }
+
+    _entries.reset(_capacity ? new Entry[_capacity] : nullptr);
+    _index.reset(slots ? new uint16_t[slots] : nullptr);
+    _index_mask = slots ? (slots - 1) : 0;
+    _strings.reset(_strings_size ? new char[_strings_size] : nullptr);
+
+    clear();
+}
+
+void JsonBatch::clear() {
+    _size = 0;
+    _strings_used = 0;
+    _json = 0;
+
+    if (_index) {
+        std::fill(_index.get(), _index.get() + _index_mask + 1, 0);
+    }
+}
+
+// Payload that fits into the old one is written in its place. Otherwise, it is appended,
+// and the old one is wasted until the batch is cleared
+bool JsonBatch::store(Entry& entry, StringView payload, size_t json) {
+    if ((_json - entry.json + json) > _strings_size) {
+        return false;
+    }
+
+    if (payload.length() > entry.payload_length) {
+        if (_strings_used + payload.length() > _strings_size) {
+            return false;
+        }
+
+        entry.payload = _strings_used;
+        _strings_used += payload.length();
+    }
+
+    std::memcpy(&_strings[entry.payload], payload.data(), payload.length());
+    entry.payload_length = payload.length();
+
+    _json = _json - entry.json + json;
+    entry.json = json;
+
+    return true;
+}
+
+JsonBatch::Result JsonBatch::add(StringView topic, StringView payload) {
+    if (!_capacity) {
+        return Result::Full;
+    }
+
+    const auto number = isNumber(payload);
+    const auto json = member_length(topic, payload, number);
+
+    const auto hash = mqtt::hash(topic);
+    auto slot = hash & _index_mask;
+
+    for (; _index[slot]; slot = (slot + 1) & _index_mask) {
+        auto& entry = _entries[_index[slot] - 1];
+        if ((entry.hash == hash) && (topic == this->topic(entry))) {
+            if (!store(entry, payload, json)) {
+                return Result::Full;
+            }
+
+            entry.number = number;
+            return Result::Replaced;
+        }
+    }
+
+    if ((_size == _capacity) || (_strings_used + topic.length() > _strings_size)) {
+        return Result::Full;
+    }
+
+    auto& entry = _entries[_size];
+    entry = Entry{
+        .hash = hash,
+        .topic = static_cast<uint16_t>(_strings_used),
+        .topic_length = static_cast<uint16_t>(topic.length()),
+        .payload = static_cast<uint16_t>(_strings_used + topic.length()),
+        .payload_length = 0,
+        .json = 0,
+        .number = number,
+    };
+
+    const auto used = _strings_used;
+    _strings_used += topic.length();
+
+    if (!store(entry, payload, json)) {
+        _strings_used = used;
+        return Result::Full;
+    }
+
+    std::memcpy(&_strings[entry.topic], topic.data(), topic.length());
+    _index[slot] = ++_size;
+
+    return Result::Added;
+}
+
+void JsonBatch::write(JsonWriter& writer) const {
+    for (size_t index = 0; index < _size; ++index) {
+        const auto& entry = _entries[index];
+        if (entry.number) {
+            writer.raw(topic(entry), payload(entry));
+        } else {
+            writer.string(topic(entry), payload(entry));
+        }
+    }
+}
+
+} // namespace mqtt
+} // namespace espurna
@@ -0,0 +1,138 @@
+/*
+
+Part of the MQTT MODULE
+
+Grouping of the published topics into a single JSON payload. Storage is
+allocated once, enqueue and serialization do not use any heap memory
+
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <cstdint>
+#include <memory>
+
+#include "types.h"
+
+namespace espurna {
+namespace mqtt {
+
+// JSON object is written directly into the fixed-size buffer, member by member.
+// When anything does not fit, the result is an empty view
+class JsonWriter {
+public:
+    JsonWriter(char* buffer, size_t size);
+
+    // Value is escaped and quoted
+    void string(StringView key, StringView value);
+
+    // Value is written as-is, must already be a valid JSON value
+    void raw(StringView key, StringView value);
+
+    void number(StringView key, uint32_t value);
+
+    // Closes the object, result is also NUL-terminated
+    StringView finish();
+
+    bool overflow() const {
+        return _overflow;
+    }
+
+private:
+    void put(char);
+    void put(StringView);
+    void escaped(StringView);
+    void key(StringView);
+
+    char* _buffer;
+    size_t _size;
+    size_t _length { 0 };
+    bool _first { true };
+    bool _overflow { false };
+};
+
+// Size of the JSON string value, including quotes
+size_t json_string_length(StringView);
+
+// Fixed number of topics and their payloads, with payload of the same topic being replaced.
+// Topics are found through the open-addressed hash table, strings are kept in a single buffer
+class JsonBatch {
+public:
+    enum class Result {
+        Added,
+        Replaced,
+        Full,
+    };
+
+    JsonBatch() = default;
+    JsonBatch(size_t capacity, size_t bytes) {
+        reset(capacity, bytes);
+    }
+
+    // (Re)allocate the storage. `bytes` limits both the stored strings and the serialized members
+    void reset(size_t capacity, size_t bytes);
+
+    // When `Full`, the batch is expected to be written out and cleared first
+    Result add(StringView topic, StringView payload);
+
+    // Every stored topic as the object member, in the order they were added
+    void write(JsonWriter&) const;
+
+    void clear();
+
+    size_t capacity() const {
+        return _capacity;
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+    bool empty() const {
+        return _size == 0;
+    }
+
+    // Upper bound of the number of bytes `write()` would produce
+    size_t bytes() const {
+        return _json;
+    }
+
+private:
+    struct Entry {
+        uint32_t hash;
+        uint16_t topic;
+        uint16_t topic_length;
+        uint16_t payload;
+        uint16_t payload_length;
+        uint16_t json;
+        bool number;
+    };
+
+    StringView topic(const Entry& entry) const {
+        return StringView(&_strings[entry.topic], entry.topic_length);
+    }
+
+    StringView payload(const Entry& entry) const {
+        return StringView(&_strings[entry.payload], entry.payload_length);
+    }
+
+    bool store(Entry&, StringView payload, size_t json);
+
+    std::unique_ptr<Entry[]> _entries;
+    size_t _capacity { 0 };
+    size_t _size { 0 };
+
+    std::unique_ptr<uint16_t[]> _index;
+    size_t _index_mask { 0 };
+
+    std::unique_ptr<char[]> _strings;
+    size_t _strings_size { 0 };
+    size_t _strings_used { 0 };
+
+    size_t _json { 0 };
+};
+
+} // namespace mqtt
+} // namespace espurna
@@ -0,0 +1,162 @@
+/*
+
+Part of the MQTT MODULE
+
+*/
+
+#include "mqtt_queue.h"
+
+#include <algorithm>
+
+namespace espurna {
+namespace mqtt {
+namespace {
+
+size_t size_of(const Message& message) {
+    return message.topic.length() + message.payload.length();
+}
+
+} // namespace
+
+void OfflineQueue::reset(size_t capacity, size_t bytes) {
+    _slots.clear();
+    _slots.shrink_to_fit();
+    _slots.resize(capacity);
+
+    _head = 0;
+    _size = 0;
+
+    _bytes = 0;
+    _bytes_max = bytes;
+}
+
+size_t OfflineQueue::find(StringView topic) const {
+    for (size_t index = 0; index < _size; ++index) {
+        if (topic == at(index).topic) {
+            return index;
+        }
+    }
+
+    return _size;
+}
+
+Message OfflineQueue::erase(size_t index) {
+    _bytes -= size_of(at(index));
+    Message out = std::move(at(index));
+
+    for (; index + 1 < _size; ++index) {
+        at(index) = std::move(at(index + 1));
+    }
+
+    --_size;
+    at(_size) = Message{};
+
+    return out;
+}
+
+void OfflineQueue::evict(Message&& message) {
+    if (_spill && persistent(message)) {
+        _spill(std::move(message));
+        ++_spilled;
+        return;
+    }
+
+    ++_dropped;
+}
+
+// Oldest non-persistent messages are removed first. When there are none,
+// only persistent message is allowed to replace another persistent one
+bool OfflineQueue::make_room(const Message& message) {
+    const auto size = size_of(message);
+
+    while (_size && ((_size == _slots.size()) || (_bytes + size > _bytes_max))) {
+        size_t victim = 0;
+        for (; victim < _size; ++victim) {
+            if (!persistent(at(victim))) {
+                break;
+            }
+        }
+
+        if (victim == _size) {
+            if (!persistent(message)) {
+                return false;
+            }
+
+            victim = 0;
+        }
+
+        evict(erase(victim));
+    }
+
+    return true;
+}
+
+bool OfflineQueue::push(Message&& message) {
+    if (_slots.empty() || (size_of(message) > _bytes_max)) {
+        evict(std::move(message));
+        return false;
+    }
+
+    const auto index = find(message.topic);
+    if (index != _size) {
+        erase(index);
+        ++_replaced;
+    }
+
+    if (!make_room(message)) {
+        evict(std::move(message));
+        return false;
+    }
+
+    _bytes += size_of(message);
+    at(_size) = std::move(message);
+    ++_size;
+    ++_queued;
+
+    return true;
+}
+
+bool OfflineQueue::remove(StringView topic) {
+    const auto index = find(topic);
+    if (index != _size) {
+        erase(index);
+        ++_replaced;
+        return true;
+    }
+
+    return false;
+}
+
+void OfflineQueue::pop(duration::Milliseconds now) {
+    if (!_size) {
+        return;
+    }
+
+    _latency_last = now - front().timestamp;
+    _latency_max = std::max(_latency_max, _latency_last);
+    ++_drained;
+
+    // Front is simply released, nothing is moved
+    _bytes -= size_of(front());
+    at(0) = Message{};
+
+    _head = (_head + 1) % _slots.size();
+    --_size;
+}
+
+OfflineQueueStats OfflineQueue::stats() const {
+    return OfflineQueueStats{
+        .depth = _size,
+        .bytes = _bytes,
+        .queued = _queued,
+        .replaced = _replaced,
+        .dropped = _dropped,
+        .spilled = _spilled,
+        .drained = _drained,
+        .latency_last = _latency_last,
+        .latency_max = _latency_max,
+    };
+}
+
+} // namespace mqtt
+} // namespace espurna
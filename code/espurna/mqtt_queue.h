@@ -0,0 +1,127 @@
+/*
+
+Part of the MQTT MODULE
+
+Bounded store-and-forward queue for the messages published while disconnected
+
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "types.h"
+
+namespace espurna {
+namespace mqtt {
+
+struct Message {
+    String topic;
+    String payload;
+    bool retain;
+    int qos;
+    duration::Milliseconds timestamp;
+};
+
+// Retained and QoS>0 messages are preferred when something needs to be dropped,
+// and could also be spilled elsewhere (see `OfflineQueue::Spill`)
+inline bool persistent(const Message& message) {
+    return message.retain || (message.qos > 0);
+}
+
+struct OfflineQueueStats {
+    size_t depth;
+    size_t bytes;
+    uint32_t queued;
+    uint32_t replaced;
+    uint32_t dropped;
+    uint32_t spilled;
+    uint32_t drained;
+    duration::Milliseconds latency_last;
+    duration::Milliseconds latency_max;
+};
+
+// Fixed number of slots, allocated once. Slots are used as a ring, oldest message is at the front.
+// Same topic is only ever queued once, newer message replaces the older one and goes to the back
+class OfflineQueue {
+public:
+    using Spill = void(*)(Message&&);
+
+    OfflineQueue() = default;
+    OfflineQueue(size_t capacity, size_t bytes) {
+        reset(capacity, bytes);
+    }
+
+    // Drops everything that is currently queued
+    void reset(size_t capacity, size_t bytes);
+
+    // When set, persistent messages that do not fit are passed here instead of being dropped
+    void spill(Spill spill) {
+        _spill = spill;
+    }
+
+    size_t capacity() const {
+        return _slots.size();
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+    bool empty() const {
+        return _size == 0;
+    }
+
+    // Returns `false` when message was dropped
+    bool push(Message&&);
+
+    // Remove the topic from the queue, e.g. when it was just published with a newer payload
+    bool remove(StringView topic);
+
+    const Message& front() const {
+        return at(0);
+    }
+
+    // Oldest message was published, `now` is used for latency stats
+    void pop(duration::Milliseconds now);
+
+    OfflineQueueStats stats() const;
+
+private:
+    Message& at(size_t index) {
+        return _slots[(_head + index) % _slots.size()];
+    }
+
+    const Message& at(size_t index) const {
+        return _slots[(_head + index) % _slots.size()];
+    }
+
+    size_t find(StringView topic) const;
+    Message erase(size_t index);
+    void evict(Message&&);
+    bool make_room(const Message&);
+
+    std::vector<Message> _slots;
+    size_t _head { 0 };
+    size_t _size { 0 };
+
+    size_t _bytes { 0 };
+    size_t _bytes_max { 0 };
+
+    Spill _spill { nullptr };
+
+    uint32_t _queued { 0 };
+    uint32_t _replaced { 0 };
+    uint32_t _dropped { 0 };
+    uint32_t _spilled { 0 };
+    uint32_t _drained { 0 };
+
+    duration::Milliseconds _latency_last { 0 };
+    duration::Milliseconds _latency_max { 0 };
+};
+
+} // namespace mqtt
+} // namespace espurna
@@ -0,0 +1,175 @@
+/*
+
+Part of the MQTT MODULE
+
+*/
+
+#include "mqtt_rate.h"
+
+#include <algorithm>
+
+namespace espurna {
+namespace mqtt {
+
+void RateLimiter::reset(size_t buckets) {
+    _buckets.clear();
+    _buckets.shrink_to_fit();
+    _buckets.resize(buckets, Bucket{
+        .used = false,
+        .pending = false,
+        .flags = 0,
+        .rule = 0,
+        .credit = duration::Milliseconds::zero(),
+        .last = duration::Milliseconds::zero(),
+        .topic = String(),
+        .payload = String(),
+    });
+}
+
+void RateLimiter::rules(std::vector<RateRule>&& rules) {
+    _rules = std::move(rules);
+    _stats.clear();
+    _stats.resize(_rules.size(), RateStats{
+        .sent = 0,
+        .delayed = 0,
+        .suppressed = 0,
+    });
+
+    reset(_buckets.size());
+}
+
+size_t RateLimiter::match(StringView topic) const {
+    for (size_t index = 0; index < _rules.size(); ++index) {
+        const auto& prefix = _rules[index].prefix;
+        if (!topic.startsWith(prefix)) {
+            continue;
+        }
+
+        if ((topic.length() == prefix.length()) || (topic[prefix.length()] == '/')) {
+            return index;
+        }
+    }
+
+    return _rules.size();
+}
+
+RateLimiter::Bucket* RateLimiter::find(StringView topic) {
+    for (auto& bucket : _buckets) {
+        if (bucket.used && (topic == bucket.topic)) {
+            return &bucket;
+        }
+    }
+
+    return nullptr;
+}
+
+// Idle bucket (nothing pending and the credit is fully restored) is as good as an unused one
+RateLimiter::Bucket* RateLimiter::make(StringView topic, size_t rule, duration::Milliseconds now) {
+    auto it = std::find_if(_buckets.begin(), _buckets.end(),
+        [&](const Bucket& bucket) {
+            if (!bucket.used) {
+                return true;
+            }
+
+            const auto& other = _rules[bucket.rule];
+            return !bucket.pending
+                && ((bucket.credit + (now - bucket.last)) >= (other.interval * other.burst));
+        });
+
+    if (it == _buckets.end()) {
+        return nullptr;
+    }
+
+    const auto& current = _rules[rule];
+
+    it->used = true;
+    it->pending = false;
+    it->flags = 0;
+    it->rule = rule;
+    it->credit = current.interval * current.burst;
+    it->last = now;
+    it->topic = topic.toString();
+
+    return &(*it);
+}
+
+bool RateLimiter::take(Bucket& bucket, duration::Milliseconds now) {
+    const auto& rule = _rules[bucket.rule];
+
+    bucket.credit = std::min(
+        bucket.credit + (now - bucket.last),
+        rule.interval * rule.burst);
+    bucket.last = now;
+
+    if (bucket.credit >= rule.interval) {
+        bucket.credit -= rule.interval;
+        return true;
+    }
+
+    return false;
+}
+
+RateLimiter::Result RateLimiter::offer(StringView topic, StringView payload, uint8_t flags, duration::Milliseconds now) {
+    const auto rule = match(topic);
+    if (rule == _rules.size()) {
+        return Result::Pass;
+    }
+
+    auto* bucket = find(topic);
+    if (!bucket) {
+        bucket = make(topic, rule, now);
+    }
+
+    if (!bucket) {
+        return Result::Pass;
+    }
+
+    auto& stats = _stats[bucket->rule];
+
+    // Pending message is always sent first, newer one simply replaces it
+    if (!bucket->pending && take(*bucket, now)) {
+        ++stats.sent;
+        return Result::Send;
+    }
+
+    if (bucket->pending) {
+        ++stats.suppressed;
+    }
+
+    bucket->pending = true;
+    bucket->flags = flags;
+    bucket->payload = payload.toString();
+
+    return Result::Hold;
+}
+
+size_t RateLimiter::flush(duration::Milliseconds now, Publish publish) {
+    size_t out { 0 };
+
+    for (auto& bucket : _buckets) {
+        if (!bucket.used || !bucket.pending || !take(bucket, now)) {
+            continue;
+        }
+
+        bucket.pending = false;
+
+        auto& stats = _stats[bucket.rule];
+        ++stats.sent;
+        ++stats.delayed;
+        ++out;
+
+        publish(bucket.topic, bucket.payload, bucket.flags);
+    }
+
+    return out;
+}
+
+size_t RateLimiter::pending() const {
+    return std::count_if(_buckets.begin(), _buckets.end(),
+        [](const Bucket& bucket) {
+            return bucket.used && bucket.pending;
+        });
+}
+
+} // namespace mqtt
+} // namespace espurna
@@ -0,0 +1,104 @@
+/*
+
+Part of the MQTT MODULE
+
+Per-topic publish rate limiting. Every topic matching the rule gets its own token bucket,
+messages sent faster than the bucket allows are held back and only the latest one is sent
+
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "types.h"
+
+namespace espurna {
+namespace mqtt {
+
+// Topics that are either equal to the `prefix` or start with `<prefix>/` are limited
+// to one message every `interval`, with up to `burst` messages sent right away
+struct RateRule {
+    String prefix;
+    duration::Milliseconds interval;
+    uint32_t burst;
+};
+
+inline bool operator==(const RateRule& lhs, const RateRule& rhs) {
+    return (lhs.prefix == rhs.prefix)
+        && (lhs.interval == rhs.interval)
+        && (lhs.burst == rhs.burst);
+}
+
+struct RateStats {
+    uint32_t sent;
+    uint32_t delayed;
+    uint32_t suppressed;
+};
+
+class RateLimiter {
+public:
+    enum class Result {
+        Pass,
+        Send,
+        Hold,
+    };
+
+    // Message that was held back, `flags` are passed as-is from `offer()`
+    using Publish = void(*)(const String& topic, const String& payload, uint8_t flags);
+
+    RateLimiter() = default;
+    explicit RateLimiter(size_t buckets) {
+        reset(buckets);
+    }
+
+    // Drops all buckets, including the messages that are still pending
+    void reset(size_t buckets);
+
+    // Existing buckets are re-created on demand
+    void rules(std::vector<RateRule>&&);
+
+    const std::vector<RateRule>& rules() const {
+        return _rules;
+    }
+
+    // `Pass` when the topic is not limited (or there are no free buckets left),
+    // `Send` when it should be published right away, `Hold` when the message is kept until `flush()`
+    Result offer(StringView topic, StringView payload, uint8_t flags, duration::Milliseconds now);
+
+    // Publish pending messages of the buckets that are allowed to send, returns the number of messages sent
+    size_t flush(duration::Milliseconds now, Publish);
+
+    size_t pending() const;
+
+    const RateStats& stats(size_t rule) const {
+        return _stats[rule];
+    }
+
+private:
+    struct Bucket {
+        bool used;
+        bool pending;
+        uint8_t flags;
+        size_t rule;
+        duration::Milliseconds credit;
+        duration::Milliseconds last;
+        String topic;
+        String payload;
+    };
+
+    size_t match(StringView topic) const;
+    Bucket* find(StringView topic);
+    Bucket* make(StringView topic, size_t rule, duration::Milliseconds now);
+    bool take(Bucket&, duration::Milliseconds now);
+
+    std::vector<Bucket> _buckets;
+    std::vector<RateRule> _rules;
+    std::vector<RateStats> _stats;
+};
+
+} // namespace mqtt
+} // namespace espurna
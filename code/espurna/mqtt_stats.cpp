@@ -0,0 +1,118 @@
+/*
+
+Part of the MQTT MODULE
+
+*/
+
+#include "mqtt_stats.h"
+
+#include <algorithm>
+
+namespace espurna {
+namespace mqtt {
+
+void Stats::publish(size_t bytes, uint16_t pid, int qos, duration::Milliseconds now) {
+    ++_publish.attempted;
+    if (!pid) {
+        ++_publish.failed;
+        return;
+    }
+
+    ++_publish.accepted;
+    _publish.bytes += bytes;
+
+    if (qos <= 0) {
+        return;
+    }
+
+    auto& slot = _inflight[pid % _inflight.size()];
+    if (slot.pid) {
+        ++_inflight_stats.untracked;
+    } else {
+        ++_inflight_count;
+    }
+
+    slot.pid = pid;
+    slot.time = static_cast<uint32_t>(now.count());
+
+    _inflight_stats.peak = std::max(
+        _inflight_stats.peak, static_cast<uint32_t>(_inflight_count));
+}
+
+void Stats::ack(uint16_t pid, duration::Milliseconds now) {
+    auto& slot = _inflight[pid % _inflight.size()];
+    if (!pid || (slot.pid != pid)) {
+        return;
+    }
+
+    ++_inflight_stats.acked;
+    _ack_latency.add(duration::Milliseconds(
+        static_cast<uint32_t>(now.count()) - slot.time));
+
+    slot.pid = 0;
+    --_inflight_count;
+}
+
+void Stats::send_buffer(size_t space) {
+    const auto value = static_cast<uint32_t>(space);
+
+    _send_buffer.low = _send_buffer.samples
+        ? std::min(_send_buffer.low, value)
+        : value;
+    _send_buffer.last = value;
+    ++_send_buffer.samples;
+
+    if (!value) {
+        ++_send_buffer.full;
+    }
+}
+
+void Stats::clear_inflight() {
+    for (auto& slot : _inflight) {
+        slot.pid = 0;
+    }
+
+    _inflight_count = 0;
+}
+
+void Stats::connecting(duration::Milliseconds now) {
+    ++_connection.attempts;
+    _connecting_since = now;
+    _connecting = true;
+}
+
+void Stats::connected(duration::Milliseconds now) {
+    ++_connection.connected;
+
+    if (_connecting) {
+        _connect_time.add(now - _connecting_since);
+        _connecting = false;
+    }
+
+    // first connection after boot is not an outage
+    if (_connection.disconnected) {
+        _connection.downtime_last = now - _disconnected_since;
+        _connection.downtime_max = std::max(
+            _connection.downtime_max, _connection.downtime_last);
+    }
+
+    _online = true;
+}
+
+void Stats::disconnected(duration::Milliseconds now) {
+    clear_inflight();
+
+    if (_connecting) {
+        ++_connection.failed;
+        _connecting = false;
+    }
+
+    if (_online) {
+        ++_connection.disconnected;
+        _disconnected_since = now;
+        _online = false;
+    }
+}
+
+} // namespace mqtt
+} // namespace espurna
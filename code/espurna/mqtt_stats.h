@@ -0,0 +1,130 @@
+/*
+
+Part of the MQTT MODULE
+
+Counters and histograms of the outgoing messages and of the broker connection.
+Every update is constant-time, nothing is allocated after construction
+
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <array>
+#include <cstdint>
+
+#include "latency.h"
+#include "types.h"
+
+namespace espurna {
+namespace mqtt {
+
+// Acks and connection attempts could take seconds, last bucket starts at 16s
+using Histogram = BasicLatencyHistogram<16>;
+
+struct PublishStats {
+    uint32_t attempted { 0 };
+    uint32_t accepted { 0 };
+    uint32_t failed { 0 };
+    uint32_t bytes { 0 };
+};
+
+struct ConnectionStats {
+    uint32_t attempts { 0 };
+    uint32_t connected { 0 };
+    uint32_t failed { 0 };
+    uint32_t disconnected { 0 };
+    duration::Milliseconds downtime_last{};
+    duration::Milliseconds downtime_max{};
+};
+
+struct InflightStats {
+    uint32_t acked { 0 };
+    uint32_t untracked { 0 };
+    uint32_t peak { 0 };
+};
+
+// Free space of the TCP send buffer, sampled right before the message is handed to the client
+struct SendBufferStats {
+    uint32_t samples { 0 };
+    uint32_t last { 0 };
+    uint32_t low { 0 };
+    uint32_t full { 0 };
+};
+
+class Stats {
+public:
+    // Messages waiting for the ack are tracked in a fixed table indexed by the pid
+    // Collisions replace the older entry, which is then counted as untracked
+    static constexpr size_t InflightMax { 16 };
+
+    // Message was handed to the client. Non-zero pid means it was accepted (or, for QoS0, at least queued)
+    void publish(size_t bytes, uint16_t pid, int qos, duration::Milliseconds now);
+
+    // Broker acknowledged the QoS1+ message
+    void ack(uint16_t pid, duration::Milliseconds now);
+
+    // Only available when the client exposes its connection (not the case with AsyncMqttClient)
+    void send_buffer(size_t space);
+
+    void connecting(duration::Milliseconds now);
+    void connected(duration::Milliseconds now);
+    void disconnected(duration::Milliseconds now);
+
+    // Anything not acked until now is lost with the connection
+    void clear_inflight();
+
+    size_t inflight() const {
+        return _inflight_count;
+    }
+
+    const PublishStats& publishes() const {
+        return _publish;
+    }
+
+    const ConnectionStats& connections() const {
+        return _connection;
+    }
+
+    const InflightStats& acks() const {
+        return _inflight_stats;
+    }
+
+    const SendBufferStats& send_buffer() const {
+        return _send_buffer;
+    }
+
+    const Histogram& ack_latency() const {
+        return _ack_latency;
+    }
+
+    const Histogram& connect_time() const {
+        return _connect_time;
+    }
+
+private:
+    struct Inflight {
+        uint16_t pid;
+        uint32_t time;
+    };
+
+    PublishStats _publish;
+    ConnectionStats _connection;
+    InflightStats _inflight_stats;
+    SendBufferStats _send_buffer;
+
+    std::array<Inflight, InflightMax> _inflight{};
+    size_t _inflight_count { 0 };
+
+    Histogram _ack_latency;
+    Histogram _connect_time;
+
+    duration::Milliseconds _connecting_since{};
+    duration::Milliseconds _disconnected_since{};
+    bool _connecting { false };
+    bool _online { false };
+};
+
+} // namespace mqtt
+} // namespace espurna
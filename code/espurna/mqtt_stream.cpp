@@ -0,0 +1,102 @@
+/*
+
+Part of the MQTT MODULE
+
+*/
+
+#include "mqtt_stream.h"
+
+#include <algorithm>
+#include <new>
+
+namespace espurna {
+namespace mqtt {
+
+bool Streams::add(StringView magnitude, FragmentCallback callback) {
+    if (!magnitude.length() || !callback) {
+        return false;
+    }
+
+    for (const auto& handler : _handlers) {
+        if (magnitude.equals(handler.magnitude)) {
+            return false;
+        }
+    }
+
+    _handlers.push_back(Handler{magnitude.toString(), callback});
+
+    return true;
+}
+
+void Streams::reset() {
+    _current = nullptr;
+    _expected = 0;
+    _drop = false;
+}
+
+bool Streams::feed(StringView magnitude, const Fragment& fragment) {
+    if (fragment.first()) {
+        reset();
+        for (const auto& handler : _handlers) {
+            if (magnitude.equals(handler.magnitude)) {
+                _current = handler.callback;
+                break;
+            }
+        }
+    }
+
+    if (!_current) {
+        return false;
+    }
+
+    // Lost the start of the message, or something else was received in-between
+    if (fragment.index != _expected) {
+        _drop = true;
+    }
+
+    if (!_drop) {
+        _drop = !_current(fragment);
+        _expected = fragment.index + fragment.data.length();
+    }
+
+    if (fragment.last()) {
+        reset();
+    }
+
+    return true;
+}
+
+Accumulator::Result Accumulator::feed(const Fragment& fragment) {
+    if (fragment.first()) {
+        reset();
+        if (!fragment.total || (fragment.total > _limit)) {
+            return Result::Error;
+        }
+
+        _buffer.reset(new (std::nothrow) char[fragment.total + 1]);
+        if (!_buffer) {
+            return Result::Error;
+        }
+    }
+
+    if (!_buffer
+        || (fragment.index != _size)
+        || ((fragment.index + fragment.data.length()) > fragment.total))
+    {
+        reset();
+        return Result::Error;
+    }
+
+    std::copy(fragment.data.begin(), fragment.data.end(), _buffer.get() + _size);
+    _size += fragment.data.length();
+
+    if (_size != fragment.total) {
+        return Result::Pending;
+    }
+
+    _buffer[_size] = '\0';
+    return Result::Done;
+}
+
+} // namespace mqtt
+} // namespace espurna
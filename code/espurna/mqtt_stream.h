@@ -0,0 +1,116 @@
+/*
+
+Part of the MQTT MODULE
+
+Handlers receiving the message payload as it arrives, one fragment at a time,
+instead of waiting for the whole message to be buffered first
+
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "types.h"
+
+namespace espurna {
+namespace mqtt {
+
+// Part of the payload, starting at `index` of the `total` message length
+// Fragments of a single message always arrive in order, with no gaps in-between
+struct Fragment {
+    StringView data;
+    size_t index;
+    size_t total;
+
+    bool first() const {
+        return index == 0;
+    }
+
+    bool last() const {
+        return (index + data.length()) == total;
+    }
+};
+
+// Returning `false` drops every remaining fragment of the current message
+using FragmentCallback = bool(*)(const Fragment&);
+
+// Handlers are matched by the exact {magnitude} of the topic (see mqttMagnitude())
+// Unlike the usual callbacks, payload is never copied and is *not* null-terminated
+class Streams {
+public:
+    // Returns `false` when {magnitude} already has a handler
+    bool add(StringView magnitude, FragmentCallback);
+
+    // Returns `true` when fragment was consumed by one of the handlers, and must not be processed any further
+    // (even when handler dropped the message or it arrived out-of-order)
+    bool feed(StringView magnitude, const Fragment&);
+
+    size_t size() const {
+        return _handlers.size();
+    }
+
+    void clear() {
+        _handlers.clear();
+        reset();
+    }
+
+    // Forget about the message in progress, e.g. when the connection is lost
+    void reset();
+
+private:
+
+    struct Handler {
+        String magnitude;
+        FragmentCallback callback;
+    };
+
+    std::vector<Handler> _handlers;
+
+    FragmentCallback _current { nullptr };
+    size_t _expected { 0 };
+    bool _drop { false };
+};
+
+// For handlers that still need the whole message at once, but only for the duration of the callback
+// Memory is allocated when the first fragment arrives and is released as soon as the message is consumed
+class Accumulator {
+public:
+    enum class Result {
+        Pending,
+        Done,
+        Error,
+    };
+
+    explicit Accumulator(size_t limit) :
+        _limit(limit)
+    {}
+
+    Result feed(const Fragment&);
+
+    // Null-terminated message, only available after feed() returns Done
+    StringView data() const {
+        return StringView(_buffer.get(), _size);
+    }
+
+    void reset() {
+        _buffer.reset();
+        _size = 0;
+    }
+
+    size_t limit() const {
+        return _limit;
+    }
+
+private:
+    std::unique_ptr<char[]> _buffer;
+    size_t _size { 0 };
+    size_t _limit;
+};
+
+} // namespace mqtt
+} // namespace espurna
@@ -0,0 +1,154 @@
+/*
+
+Part of the MQTT MODULE
+
+*/
+
+#include "mqtt_topics.h"
+
+#include <cstring>
+
+namespace espurna {
+namespace mqtt {
+namespace {
+
+struct Key {
+    Key(StringView magnitude, size_t index) :
+        magnitude(magnitude)
+    {
+        if (index != TopicCache::NoIndex) {
+            // digits are written right-to-left, starting from the end of the buffer
+            auto* ptr = std::end(buffer);
+            do {
+                *(--ptr) = '0' + (index % 10);
+                index /= 10;
+            } while (index);
+
+            suffix = StringView(ptr, std::end(buffer));
+        }
+
+        hash = fnv1a(2166136261ul, magnitude);
+        if (suffix.length()) {
+            hash = fnv1a(hash, StringView("/"));
+            hash = fnv1a(hash, suffix);
+        }
+    }
+
+    size_t length() const {
+        return magnitude.length()
+            + (suffix.length() ? (1 + suffix.length()) : 0);
+    }
+
+    bool equals(const TopicCache::Entry& entry) const {
+        if ((entry.hash != hash) || (entry.magnitude.length() != length())) {
+            return false;
+        }
+
+        const auto* ptr = entry.magnitude.c_str();
+        if (std::memcmp(ptr, magnitude.data(), magnitude.length()) != 0) {
+            return false;
+        }
+
+        if (!suffix.length()) {
+            return true;
+        }
+
+        ptr += magnitude.length();
+        return (*ptr == '/')
+            && (std::memcmp(ptr + 1, suffix.data(), suffix.length()) == 0);
+    }
+
+    String toString() const {
+        String out;
+        out.reserve(length());
+        out.concat(magnitude.data(), magnitude.length());
+        if (suffix.length()) {
+            out += '/';
+            out.concat(suffix.data(), suffix.length());
+        }
+
+        return out;
+    }
+
+    static uint32_t fnv1a(uint32_t out, StringView value) {
+        for (auto it = value.begin(); it != value.end(); ++it) {
+            out ^= static_cast<uint8_t>(*it);
+            out *= 16777619ul;
+        }
+
+        return out;
+    }
+
+    StringView magnitude;
+    StringView suffix;
+    uint32_t hash;
+    char buffer[20];
+};
+
+} // namespace
+
+void TopicCache::configure(StringView topic, StringView getter, StringView setter) {
+    clear();
+
+    _topic = topic.toString();
+    _getter = getter.toString();
+    _setter = setter.toString();
+}
+
+String TopicCache::build(const String& magnitude, const String& suffix) const {
+    String out;
+    out.reserve(_topic.length() + magnitude.length() + suffix.length());
+
+    out += _topic;
+    out.replace("#", magnitude);
+    out += suffix;
+
+    return out;
+}
+
+const TopicCache::Entry* TopicCache::find(StringView magnitude, size_t index, Kind kind) {
+    if (!_topic.length() || !magnitude.length()) {
+        return nullptr;
+    }
+
+    const Key key(magnitude, index);
+    for (auto& entry : _entries) {
+        if (key.equals(entry)) {
+            if ((kind == Kind::Setter) && !entry.setter.length()) {
+                entry.setter = build(entry.magnitude, _setter);
+            }
+
+            return &entry;
+        }
+    }
+
+    if (_size >= _limit) {
+        return nullptr;
+    }
+
+    auto name = key.toString();
+    auto getter = build(name, _getter);
+    auto setter = (kind == Kind::Setter)
+        ? build(name, _setter)
+        : String();
+
+    _entries.push_front(
+        Entry{key.hash, std::move(name), std::move(getter), std::move(setter)});
+    ++_size;
+
+    return &_entries.front();
+}
+
+StringView TopicCache::get(StringView magnitude, size_t index, Kind kind) {
+    const auto* entry = find(magnitude, index, kind);
+    if (!entry) {
+        return StringView();
+    }
+
+    return (kind == Kind::Setter)
+        ? StringView(entry->setter)
+        : StringView(entry->getter);
+}
+
+} // namespace mqtt
+} // namespace espurna
@@ -0,0 +1,92 @@
+/*
+
+Part of the MQTT MODULE
+
+Full topic strings of the {magnitude}s that are published repeatedly, built once
+instead of on every publish
+
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <cstdint>
+#include <forward_list>
+#include <limits>
+
+#include "types.h"
+
+namespace espurna {
+namespace mqtt {
+
+class TopicCache {
+public:
+    static constexpr size_t NoIndex { std::numeric_limits<size_t>::max() };
+
+    enum class Kind {
+        Getter,
+        Setter,
+    };
+
+    struct Entry {
+        uint32_t hash;
+
+        // {magnitude}, with the '/<index>' when it is indexed
+        String magnitude;
+
+        // Full topic strings, setter is only built when requested
+        String getter;
+        String setter;
+    };
+
+    explicit TopicCache(size_t limit) :
+        _limit(limit)
+    {}
+
+    // Topic is expected to contain the '#' placeholder for the {magnitude}
+    // Every entry is invalidated, any views of the previous ones must not be used after this
+    void configure(StringView topic, StringView getter, StringView setter);
+
+    // Entry is created on the first use, returns nullptr when cache is full or not configured yet
+    // Returned entry (and its strings) stay valid until the next configure() or clear()
+    const Entry* find(StringView magnitude, size_t index, Kind);
+
+    const Entry* find(StringView magnitude, size_t index) {
+        return find(magnitude, index, Kind::Getter);
+    }
+
+    const Entry* find(StringView magnitude) {
+        return find(magnitude, NoIndex, Kind::Getter);
+    }
+
+    // Same as find(), but only returns the requested topic
+    StringView get(StringView magnitude, size_t index, Kind);
+
+    size_t size() const {
+        return _size;
+    }
+
+    size_t limit() const {
+        return _limit;
+    }
+
+    void clear() {
+        _entries.clear();
+        _size = 0;
+    }
+
+private:
+    String build(const String& magnitude, const String& suffix) const;
+
+    std::forward_list<Entry> _entries;
+    size_t _size { 0 };
+    size_t _limit;
+
+    String _topic;
+    String _getter;
+    String _setter;
+};
+
+} // namespace mqtt
+} // namespace espurna
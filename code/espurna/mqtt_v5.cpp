@@ -0,0 +1,863 @@
+/*
+
+Part of the MQTT MODULE
+
+*/
+
+#include "mqtt_v5.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace espurna {
+namespace mqtt {
+namespace v5 {
+namespace {
+
+namespace property {
+
+constexpr uint8_t PayloadFormat { 0x01 };
+constexpr uint8_t MessageExpiry { 0x02 };
+constexpr uint8_t ContentType { 0x03 };
+constexpr uint8_t ResponseTopic { 0x08 };
+constexpr uint8_t CorrelationData { 0x09 };
+constexpr uint8_t SubscriptionIdentifier { 0x0b };
+constexpr uint8_t SessionExpiry { 0x11 };
+constexpr uint8_t AssignedClientIdentifier { 0x12 };
+constexpr uint8_t ServerKeepAlive { 0x13 };
+constexpr uint8_t AuthenticationMethod { 0x15 };
+constexpr uint8_t AuthenticationData { 0x16 };
+constexpr uint8_t RequestProblemInformation { 0x17 };
+constexpr uint8_t WillDelay { 0x18 };
+constexpr uint8_t RequestResponseInformation { 0x19 };
+constexpr uint8_t ResponseInformation { 0x1a };
+constexpr uint8_t ServerReference { 0x1c };
+constexpr uint8_t ReasonString { 0x1f };
+constexpr uint8_t ReceiveMaximum { 0x21 };
+constexpr uint8_t TopicAliasMaximum { 0x22 };
+constexpr uint8_t TopicAlias { 0x23 };
+constexpr uint8_t MaximumQos { 0x24 };
+constexpr uint8_t RetainAvailable { 0x25 };
+constexpr uint8_t UserProperty { 0x26 };
+constexpr uint8_t MaximumPacketSize { 0x27 };
+constexpr uint8_t WildcardSubscriptionAvailable { 0x28 };
+constexpr uint8_t SubscriptionIdentifierAvailable { 0x29 };
+constexpr uint8_t SharedSubscriptionAvailable { 0x2a };
+
+} // namespace property
+
+STRING_VIEW_INLINE(ProtocolName, "MQTT");
+STRING_VIEW_INLINE(MessageId, "id");
+
+constexpr uint8_t ProtocolLevel { 5 };
+constexpr duration::Milliseconds ConnectTimeout { 10000 };
+
+void put_u8(std::vector<uint8_t>& out, uint8_t value) {
+    out.push_back(value);
+}
+
+void put_u16(std::vector<uint8_t>& out, uint16_t value) {
+    out.push_back((value >> 8) & 0xff);
+    out.push_back(value & 0xff);
+}
+
+void put_u32(std::vector<uint8_t>& out, uint32_t value) {
+    put_u16(out, (value >> 16) & 0xffff);
+    put_u16(out, value & 0xffff);
+}
+
+void put_varint(std::vector<uint8_t>& out, uint32_t value) {
+    do {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        if (value) {
+            byte |= 0x80;
+        }
+        out.push_back(byte);
+    } while (value);
+}
+
+void put_bytes(std::vector<uint8_t>& out, const char* data, size_t size) {
+    out.insert(out.end(), data, data + size);
+}
+
+void put_string(std::vector<uint8_t>& out, StringView value) {
+    put_u16(out, value.length());
+    put_bytes(out, value.data(), value.length());
+}
+
+void put_string(std::vector<uint8_t>& out, const String& value) {
+    put_u16(out, value.length());
+    put_bytes(out, value.c_str(), value.length());
+}
+
+// Any read past the end is an error, and every read after that fails as well
+struct Reader {
+    Reader(const uint8_t* data, size_t size) :
+        _data(data),
+        _size(size)
+    {}
+
+    bool ok() const {
+        return _ok;
+    }
+
+    size_t offset() const {
+        return _offset;
+    }
+
+    size_t left() const {
+        return _size - _offset;
+    }
+
+    bool skip(size_t size) {
+        if (!_ok || (left() < size)) {
+            _ok = false;
+            return false;
+        }
+
+        _offset += size;
+        return true;
+    }
+
+    uint8_t u8() {
+        if (!skip(1)) {
+            return 0;
+        }
+
+        return _data[_offset - 1];
+    }
+
+    uint16_t u16() {
+        if (!skip(2)) {
+            return 0;
+        }
+
+        return (_data[_offset - 2] << 8) | _data[_offset - 1];
+    }
+
+    uint32_t u32() {
+        const uint32_t high = u16();
+        const uint32_t low = u16();
+        return (high << 16) | low;
+    }
+
+    uint32_t varint() {
+        uint32_t out { 0 };
+        for (uint8_t shift = 0; shift < 28; shift += 7) {
+            const auto byte = u8();
+            out |= static_cast<uint32_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return out;
+            }
+        }
+
+        _ok = false;
+        return 0;
+    }
+
+    StringView string() {
+        const auto length = u16();
+        if (!skip(length)) {
+            return StringView();
+        }
+
+        return StringView(
+            reinterpret_cast<const char*>(&_data[_offset - length]), length);
+    }
+
+private:
+    const uint8_t* _data;
+    size_t _size;
+    size_t _offset { 0 };
+    bool _ok { true };
+};
+
+// Properties we don't need are simply skipped. Unknown ones are treated as an error
+bool skip_property(Reader& reader, uint8_t id) {
+    switch (id) {
+    case property::PayloadFormat:
+    case property::RequestProblemInformation:
+    case property::RequestResponseInformation:
+    case property::MaximumQos:
+    case property::RetainAvailable:
+    case property::WildcardSubscriptionAvailable:
+    case property::SubscriptionIdentifierAvailable:
+    case property::SharedSubscriptionAvailable:
+        reader.u8();
+        break;
+
+    case property::ServerKeepAlive:
+    case property::ReceiveMaximum:
+    case property::TopicAliasMaximum:
+    case property::TopicAlias:
+        reader.u16();
+        break;
+
+    case property::MessageExpiry:
+    case property::SessionExpiry:
+    case property::WillDelay:
+    case property::MaximumPacketSize:
+        reader.u32();
+        break;
+
+    case property::SubscriptionIdentifier:
+        reader.varint();
+        break;
+
+    case property::ContentType:
+    case property::ResponseTopic:
+    case property::CorrelationData:
+    case property::AssignedClientIdentifier:
+    case property::AuthenticationMethod:
+    case property::AuthenticationData:
+    case property::ResponseInformation:
+    case property::ServerReference:
+    case property::ReasonString:
+        reader.string();
+        break;
+
+    case property::UserProperty:
+        reader.string();
+        reader.string();
+        break;
+
+    default:
+        return false;
+    }
+
+    return reader.ok();
+}
+
+bool skip_properties(Reader& reader) {
+    const auto length = reader.varint();
+    if (!reader.ok() || (reader.left() < length)) {
+        return false;
+    }
+
+    const auto end = reader.offset() + length;
+    while (reader.ok() && (reader.offset() < end)) {
+        if (!skip_property(reader, reader.u8())) {
+            return false;
+        }
+    }
+
+    return reader.ok() && (reader.offset() == end);
+}
+
+constexpr uint8_t header(PacketType type, uint8_t flags = 0) {
+    return (static_cast<uint8_t>(type) << 4) | (flags & 0x0f);
+}
+
+ServerLimits default_limits(duration::Seconds keepalive) {
+    return ServerLimits{
+        .receive_maximum = 65535,
+        .topic_alias_maximum = 0,
+        .maximum_packet_size = 0,
+        .maximum_qos = 2,
+        .retain_available = true,
+        .keepalive = keepalive,
+    };
+}
+
+} // namespace
+
+Client::Client(size_t buffer_size) :
+    _limits(default_limits(duration::Seconds(0))),
+    _buffer(new uint8_t[buffer_size + 1]),
+    _buffer_size(buffer_size)
+{}
+
+uint16_t Client::next_pid() {
+    ++_pid;
+    if (!_pid) {
+        ++_pid;
+    }
+
+    return _pid;
+}
+
+// Aliases are assigned on the first use and are never replaced. Topics that did not get one
+// (when the table is full) are always sent as-is. New alias is only reserved here, publish()
+// remembers it after the packet is actually sent (otherwise, broker would never know about it)
+uint16_t Client::alias(StringView topic, bool& known) {
+    known = false;
+
+    const auto it = std::find_if(_aliases.begin(), _aliases.end(),
+        [&](const String& alias) {
+            return topic == alias;
+        });
+    if (it != _aliases.end()) {
+        known = true;
+        return std::distance(_aliases.begin(), it) + 1;
+    }
+
+    const auto maximum = std::min(_options.topic_aliases, _limits.topic_alias_maximum);
+    if (_aliases.size() < maximum) {
+        return _aliases.size() + 1;
+    }
+
+    return 0;
+}
+
+bool Client::send(const uint8_t* data, size_t size) {
+    if (!size) {
+        return true;
+    }
+
+    if (_transport->write(data, size) != size) {
+        close(ReasonTransport);
+        return false;
+    }
+
+    _last_sent = _now;
+    return true;
+}
+
+bool Client::send_packet(uint8_t header) {
+    uint8_t fixed[5];
+    fixed[0] = header;
+
+    size_t length { 1 };
+    uint32_t remaining = _body.size();
+    do {
+        uint8_t byte = remaining & 0x7f;
+        remaining >>= 7;
+        if (remaining) {
+            byte |= 0x80;
+        }
+        fixed[length++] = byte;
+    } while (remaining);
+
+    return send(fixed, length) && send(_body.data(), _body.size());
+}
+
+bool Client::send_ack(PacketType type, uint16_t pid) {
+    const uint8_t packet[] {
+        header(type, (type == PacketType::Pubrel) ? 0b0010 : 0),
+        2,
+        static_cast<uint8_t>((pid >> 8) & 0xff),
+        static_cast<uint8_t>(pid & 0xff),
+    };
+
+    return send(packet, sizeof(packet));
+}
+
+void Client::close(uint8_t reason) {
+    if (_state == State::Disconnected) {
+        return;
+    }
+
+    _state = State::Disconnected;
+    _transport->stop();
+    _inflight.clear();
+    _aliases.clear();
+
+    if (_on_disconnect) {
+        _on_disconnect(reason);
+    }
+}
+
+bool Client::connect(Transport& transport, const Options& options, duration::Milliseconds now) {
+    if (_state != State::Disconnected) {
+        return false;
+    }
+
+    _transport = &transport;
+    _options = options;
+    _limits = default_limits(options.keepalive);
+    _now = now;
+    _connect_start = now;
+    _last_received = now;
+
+    _parser = Parser::Header;
+    _inflight.clear();
+    _aliases.clear();
+
+    uint8_t flags { 0 };
+    if (!_options.session_expiry.count()) {
+        flags |= 0x02;
+    }
+
+    const auto& will = _options.will;
+    if (will.topic.length()) {
+        flags |= 0x04;
+        flags |= (std::clamp(will.qos, 0, 1) & 0b11) << 3;
+        if (will.retain) {
+            flags |= 0x20;
+        }
+    }
+
+    if (_options.password.length()) {
+        flags |= 0x40;
+    }
+
+    if (_options.user.length()) {
+        flags |= 0x80;
+    }
+
+    _body.clear();
+    put_string(_body, ProtocolName);
+    put_u8(_body, ProtocolLevel);
+    put_u8(_body, flags);
+    put_u16(_body, _options.keepalive.count());
+
+    _properties.clear();
+    if (_options.session_expiry.count()) {
+        put_u8(_properties, property::SessionExpiry);
+        put_u32(_properties, _options.session_expiry.count());
+    }
+
+    if (_options.receive_maximum) {
+        put_u8(_properties, property::ReceiveMaximum);
+        put_u16(_properties, _options.receive_maximum);
+    }
+
+    put_u8(_properties, property::MaximumPacketSize);
+    put_u32(_properties, _buffer_size);
+
+    put_varint(_body, _properties.size());
+    _body.insert(_body.end(), _properties.begin(), _properties.end());
+
+    put_string(_body, _options.client_id);
+
+    if (will.topic.length()) {
+        put_varint(_body, 0);
+        put_string(_body, will.topic);
+        put_string(_body, will.payload);
+    }
+
+    if (_options.user.length()) {
+        put_string(_body, _options.user);
+    }
+
+    if (_options.password.length()) {
+        put_string(_body, _options.password);
+    }
+
+    _state = State::Connecting;
+    return send_packet(header(PacketType::Connect));
+}
+
+void Client::disconnect() {
+    if (_state == State::Disconnected) {
+        return;
+    }
+
+    const uint8_t packet[] {
+        header(PacketType::Disconnect),
+        0,
+    };
+
+    send(packet, sizeof(packet));
+    close(ReasonNormal);
+}
+
+uint16_t Client::publish(const char* topic, const char* payload, bool retain, int qos) {
+    if (_state != State::Connected) {
+        return 0;
+    }
+
+    qos = std::clamp(qos, 0, std::min(1, static_cast<int>(_limits.maximum_qos)));
+    retain = retain && _limits.retain_available;
+
+    if (qos && (_inflight.size() >= _limits.receive_maximum)) {
+        ++_stats.throttled;
+        return 0;
+    }
+
+    const auto topic_view = StringView(topic);
+    const auto payload_length = strlen(payload);
+
+    bool known { false };
+    const auto alias = this->alias(topic_view, known);
+
+    _properties.clear();
+    if (alias) {
+        put_u8(_properties, property::TopicAlias);
+        put_u16(_properties, alias);
+    }
+
+    if (_options.message_id) {
+        char buffer[11];
+        const auto length = snprintf_P(buffer, sizeof(buffer),
+            PSTR("%u"), ++_message_id);
+
+        put_u8(_properties, property::UserProperty);
+        put_string(_properties, MessageId);
+        put_string(_properties, StringView(buffer, length));
+    }
+
+    _body.clear();
+    put_string(_body, known ? StringView() : topic_view);
+
+    uint16_t pid { 0 };
+    if (qos) {
+        pid = next_pid();
+        put_u16(_body, pid);
+    }
+
+    put_varint(_body, _properties.size());
+    _body.insert(_body.end(), _properties.begin(), _properties.end());
+    put_bytes(_body, payload, payload_length);
+
+    if (_limits.maximum_packet_size && (_body.size() + 5 > _limits.maximum_packet_size)) {
+        return 0;
+    }
+
+    const uint8_t flags = (qos << 1) | (retain ? 1 : 0);
+    if (!send_packet(header(PacketType::Publish, flags))) {
+        return 0;
+    }
+
+    if (known) {
+        ++_stats.aliased;
+        _stats.alias_bytes_saved += topic_view.length();
+    } else if (alias) {
+        _aliases.push_back(topic_view.toString());
+    }
+
+    if (qos) {
+        _inflight.push_back(pid);
+        return pid;
+    }
+
+    return 1;
+}
+
+uint16_t Client::subscribe(const char* topic, int qos) {
+    if (_state != State::Connected) {
+        return 0;
+    }
+
+    const auto pid = next_pid();
+
+    _body.clear();
+    put_u16(_body, pid);
+    put_varint(_body, 0);
+    put_string(_body, StringView(topic));
+    put_u8(_body, std::clamp(qos, 0, 1));
+
+    if (!send_packet(header(PacketType::Subscribe, 0b0010))) {
+        return 0;
+    }
+
+    return pid;
+}
+
+uint16_t Client::unsubscribe(const char* topic) {
+    if (_state != State::Connected) {
+        return 0;
+    }
+
+    const auto pid = next_pid();
+
+    _body.clear();
+    put_u16(_body, pid);
+    put_varint(_body, 0);
+    put_string(_body, StringView(topic));
+
+    if (!send_packet(header(PacketType::Unsubscribe, 0b0010))) {
+        return 0;
+    }
+
+    return pid;
+}
+
+void Client::loop(duration::Milliseconds now) {
+    if (_state == State::Disconnected) {
+        return;
+    }
+
+    _now = now;
+
+    uint8_t chunk[64];
+    for (;;) {
+        const auto size = _transport->read(chunk, sizeof(chunk));
+        if (!size) {
+            break;
+        }
+
+        _last_received = now;
+        for (size_t index = 0; index < size; ++index) {
+            feed(chunk[index]);
+            if (_state == State::Disconnected) {
+                return;
+            }
+        }
+    }
+
+    if (!_transport->connected()) {
+        close(ReasonTransport);
+        return;
+    }
+
+    if (_state == State::Connecting) {
+        if (now - _connect_start > ConnectTimeout) {
+            close(ReasonTimeout);
+        }
+        return;
+    }
+
+    const duration::Milliseconds keepalive = _limits.keepalive;
+    if (!keepalive.count()) {
+        return;
+    }
+
+    // Broker does the same check, using the keep-alive interval * 1.5
+    if (now - _last_received > (keepalive + (keepalive / 2))) {
+        close(ReasonTimeout);
+        return;
+    }
+
+    if (now - _last_sent >= keepalive) {
+        const uint8_t packet[] {
+            header(PacketType::Pingreq),
+            0,
+        };
+        send(packet, sizeof(packet));
+    }
+}
+
+void Client::feed(uint8_t byte) {
+    switch (_parser) {
+    case Parser::Header:
+        _header = byte;
+        _length = 0;
+        _length_shift = 0;
+        _parser = Parser::Length;
+        break;
+
+    case Parser::Length:
+        _length |= static_cast<uint32_t>(byte & 0x7f) << _length_shift;
+        _length_shift += 7;
+        if (byte & 0x80) {
+            if (_length_shift > 21) {
+                close(ReasonProtocolError);
+            }
+            break;
+        }
+
+        _received = 0;
+        if (!_length) {
+            _parser = Parser::Header;
+            process();
+        } else if (_length > _buffer_size) {
+            _parser = Parser::Skip;
+        } else {
+            _parser = Parser::Body;
+        }
+        break;
+
+    case Parser::Body:
+        _buffer[_received++] = byte;
+        if (_received == _length) {
+            _parser = Parser::Header;
+            process();
+        }
+        break;
+
+    case Parser::Skip:
+        if (++_received == _length) {
+            _parser = Parser::Header;
+        }
+        break;
+    }
+}
+
+void Client::process() {
+    const auto type = static_cast<PacketType>(_header >> 4);
+    if ((_state == State::Connecting) && (type != PacketType::Connack)) {
+        close(ReasonProtocolError);
+        return;
+    }
+
+    switch (type) {
+    case PacketType::Connack:
+        process_connack(_buffer.get(), _length);
+        break;
+
+    case PacketType::Publish:
+        process_publish(_header & 0x0f, _buffer.get(), _length);
+        break;
+
+    case PacketType::Puback:
+    case PacketType::Pubrec:
+    case PacketType::Pubrel:
+    case PacketType::Pubcomp:
+    case PacketType::Suback:
+    case PacketType::Unsuback:
+        process_ack(type, _buffer.get(), _length);
+        break;
+
+    case PacketType::Pingresp:
+        break;
+
+    case PacketType::Disconnect:
+        close(_length ? _buffer[0] : ReasonNormal);
+        break;
+
+    default:
+        close(ReasonProtocolError);
+        break;
+    }
+}
+
+void Client::process_connack(const uint8_t* data, size_t size) {
+    if (_state != State::Connecting) {
+        close(ReasonProtocolError);
+        return;
+    }
+
+    Reader reader(data, size);
+
+    const auto session_present = (reader.u8() & 1) > 0;
+    const auto reason = reader.u8();
+    if (!reader.ok()) {
+        close(ReasonProtocolError);
+        return;
+    }
+
+    if (reason >= 0x80) {
+        close(reason);
+        return;
+    }
+
+    const auto length = reader.varint();
+    const auto end = reader.offset() + length;
+    if (!reader.ok() || (reader.left() < length)) {
+        close(ReasonProtocolError);
+        return;
+    }
+
+    while (reader.ok() && (reader.offset() < end)) {
+        const auto id = reader.u8();
+        switch (id) {
+        case property::ReceiveMaximum:
+            _limits.receive_maximum = std::max(reader.u16(), uint16_t{ 1 });
+            break;
+        case property::TopicAliasMaximum:
+            _limits.topic_alias_maximum = reader.u16();
+            break;
+        case property::MaximumPacketSize:
+            _limits.maximum_packet_size = reader.u32();
+            break;
+        case property::MaximumQos:
+            _limits.maximum_qos = reader.u8();
+            break;
+        case property::RetainAvailable:
+            _limits.retain_available = reader.u8() > 0;
+            break;
+        case property::ServerKeepAlive:
+            _limits.keepalive = duration::Seconds(reader.u16());
+            break;
+        default:
+            if (!skip_property(reader, id)) {
+                close(ReasonProtocolError);
+                return;
+            }
+            break;
+        }
+    }
+
+    if (!reader.ok()) {
+        close(ReasonProtocolError);
+        return;
+    }
+
+    _state = State::Connected;
+    if (_on_connect) {
+        _on_connect(session_present);
+    }
+}
+
+void Client::process_publish(uint8_t flags, uint8_t* data, size_t size) {
+    const auto qos = (flags >> 1) & 0b11;
+
+    Reader reader(data, size);
+
+    const auto topic = reader.string();
+
+    uint16_t pid { 0 };
+    if (qos) {
+        pid = reader.u16();
+    }
+
+    if (!reader.ok() || !topic.length() || (qos > 2) || !skip_properties(reader)) {
+        close(ReasonProtocolError);
+        return;
+    }
+
+    // Everything after the topic was already parsed, it is safe to overwrite the next byte.
+    // Payload is always at the end, and the buffer has one extra byte for the NUL
+    auto* topic_ptr = reinterpret_cast<char*>(data) + 2;
+    topic_ptr[topic.length()] = '\0';
+
+    auto* payload_ptr = reinterpret_cast<char*>(data) + reader.offset();
+    const auto payload_length = reader.left();
+    payload_ptr[payload_length] = '\0';
+
+    if (_on_message) {
+        _on_message(topic_ptr, payload_ptr, payload_length);
+    }
+
+    if (_state != State::Connected) {
+        return;
+    }
+
+    switch (qos) {
+    case 1:
+        send_ack(PacketType::Puback, pid);
+        break;
+    case 2:
+        send_ack(PacketType::Pubrec, pid);
+        break;
+    }
+}
+
+void Client::process_ack(PacketType type, const uint8_t* data, size_t size) {
+    Reader reader(data, size);
+
+    const auto pid = reader.u16();
+    if (!reader.ok()) {
+        close(ReasonProtocolError);
+        return;
+    }
+
+    switch (type) {
+    case PacketType::Puback:
+    {
+        const auto it = std::find(_inflight.begin(), _inflight.end(), pid);
+        if (it != _inflight.end()) {
+            _inflight.erase(it);
+        }
+
+        if (_on_publish) {
+            _on_publish(pid);
+        }
+        break;
+    }
+
+    // Second half of the incoming QoS 2 message
+    case PacketType::Pubrel:
+        send_ack(PacketType::Pubcomp, pid);
+        break;
+
+    case PacketType::Suback:
+        if (_on_subscribe) {
+            _on_subscribe(pid);
+        }
+        break;
+
+    // Outgoing QoS is never 2
+    case PacketType::Pubrec:
+    case PacketType::Pubcomp:
+    case PacketType::Unsuback:
+    default:
+        break;
+    }
+}
+
+} // namespace v5
+} // namespace mqtt
+} // namespace espurna
@@ -0,0 +1,240 @@
+/*
+
+Part of the MQTT MODULE
+
+Minimal MQTT 5 client. Only what the rest of the MQTT module needs is implemented:
+- CONNECT with session expiry interval and receive maximum, CONNACK server limits
+- PUBLISH with QoS 0 and 1, outgoing topic aliases and optional `id` user property
+- SUBSCRIBE, UNSUBSCRIBE, PINGREQ and DISCONNECT
+Incoming QoS 2 is acknowledged, but outgoing QoS is limited to 1
+
+Network connection itself is established elsewhere, client only reads and writes the bytes
+
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "types.h"
+
+namespace espurna {
+namespace mqtt {
+namespace v5 {
+
+// Both are expected to be non-blocking, `read()` returns 0 when there is nothing to read
+class Transport {
+public:
+    virtual ~Transport() = default;
+
+    virtual bool connected() = 0;
+    virtual size_t read(uint8_t* data, size_t size) = 0;
+    virtual size_t write(const uint8_t* data, size_t size) = 0;
+    virtual void stop() = 0;
+};
+
+struct Will {
+    String topic;
+    String payload;
+    bool retain;
+    int qos;
+};
+
+struct Options {
+    String client_id;
+    String user;
+    String password;
+    Will will;
+
+    duration::Seconds keepalive;
+
+    // When not zero, broker keeps the session (and QoS>0 messages) for this long after disconnecting.
+    // Clean start is requested when it is zero, so nothing is kept between connections
+    duration::Seconds session_expiry;
+
+    // Number of outgoing topic aliases (limited by the broker)
+    uint16_t topic_aliases;
+
+    // Number of incoming QoS>0 messages broker is allowed to send before receiving PUBACK
+    uint16_t receive_maximum;
+
+    // Attach `id` user property to every published message
+    bool message_id;
+};
+
+enum class PacketType : uint8_t {
+    Connect = 1,
+    Connack = 2,
+    Publish = 3,
+    Puback = 4,
+    Pubrec = 5,
+    Pubrel = 6,
+    Pubcomp = 7,
+    Subscribe = 8,
+    Suback = 9,
+    Unsubscribe = 10,
+    Unsuback = 11,
+    Pingreq = 12,
+    Pingresp = 13,
+    Disconnect = 14,
+};
+
+// Limits received in CONNACK
+struct ServerLimits {
+    uint16_t receive_maximum;
+    uint16_t topic_alias_maximum;
+    uint32_t maximum_packet_size;
+    uint8_t maximum_qos;
+    bool retain_available;
+    duration::Seconds keepalive;
+};
+
+struct ClientStats {
+    uint32_t aliased;
+    uint32_t alias_bytes_saved;
+    uint32_t throttled;
+};
+
+class Client {
+public:
+    using ConnectCallback = void(*)(bool session_present);
+    using DisconnectCallback = void(*)(uint8_t reason);
+    using MessageCallback = void(*)(char* topic, char* payload, size_t length);
+    using PidCallback = void(*)(uint16_t pid);
+
+    static constexpr uint8_t ReasonNormal { 0x00 };
+    static constexpr uint8_t ReasonTimeout { 0x8d };
+    static constexpr uint8_t ReasonProtocolError { 0x82 };
+    static constexpr uint8_t ReasonPacketTooLarge { 0x95 };
+    static constexpr uint8_t ReasonTransport { 0xff };
+
+    // Incoming packets larger than the buffer are skipped
+    explicit Client(size_t buffer_size);
+
+    void onConnect(ConnectCallback callback) {
+        _on_connect = callback;
+    }
+
+    void onDisconnect(DisconnectCallback callback) {
+        _on_disconnect = callback;
+    }
+
+    void onMessage(MessageCallback callback) {
+        _on_message = callback;
+    }
+
+    void onPublish(PidCallback callback) {
+        _on_publish = callback;
+    }
+
+    void onSubscribe(PidCallback callback) {
+        _on_subscribe = callback;
+    }
+
+    // Transport must already be connected. Connection is done when CONNACK is received in `loop()`
+    bool connect(Transport&, const Options&, duration::Milliseconds now);
+
+    // Parse incoming data, send keep-alive pings and check timeouts
+    void loop(duration::Milliseconds now);
+
+    void disconnect();
+
+    bool connected() const {
+        return _state == State::Connected;
+    }
+
+    bool connecting() const {
+        return _state == State::Connecting;
+    }
+
+    // Returns 0 on failure, otherwise PID (or 1, when QoS is 0)
+    // Fails when too many QoS 1 messages are waiting for PUBACK (see ServerLimits::receive_maximum)
+    uint16_t publish(const char* topic, const char* payload, bool retain, int qos);
+    uint16_t subscribe(const char* topic, int qos);
+    uint16_t unsubscribe(const char* topic);
+
+    const ServerLimits& limits() const {
+        return _limits;
+    }
+
+    const ClientStats& stats() const {
+        return _stats;
+    }
+
+    size_t inflight() const {
+        return _inflight.size();
+    }
+
+private:
+    enum class State {
+        Disconnected,
+        Connecting,
+        Connected,
+    };
+
+    enum class Parser {
+        Header,
+        Length,
+        Body,
+        Skip,
+    };
+
+    uint16_t next_pid();
+    uint16_t alias(StringView topic, bool& known);
+
+    bool send(const uint8_t* data, size_t size);
+    bool send_packet(uint8_t header);
+    bool send_ack(PacketType, uint16_t pid);
+    void close(uint8_t reason);
+
+    void feed(uint8_t);
+    void process();
+    void process_connack(const uint8_t* data, size_t size);
+    void process_publish(uint8_t flags, uint8_t* data, size_t size);
+    void process_ack(PacketType, const uint8_t* data, size_t size);
+
+    State _state { State::Disconnected };
+    Transport* _transport { nullptr };
+
+    Options _options;
+    ServerLimits _limits;
+    ClientStats _stats {};
+
+    std::unique_ptr<uint8_t[]> _buffer;
+    size_t _buffer_size;
+
+    Parser _parser { Parser::Header };
+    uint8_t _header { 0 };
+    uint32_t _length { 0 };
+    uint8_t _length_shift { 0 };
+    size_t _received { 0 };
+
+    uint16_t _pid { 0 };
+    std::vector<uint16_t> _inflight;
+
+    std::vector<String> _aliases;
+    uint32_t _message_id { 0 };
+
+    // Outgoing packet is built here, storage is reused between packets
+    std::vector<uint8_t> _body;
+    std::vector<uint8_t> _properties;
+
+    duration::Milliseconds _now {};
+    duration::Milliseconds _last_sent {};
+    duration::Milliseconds _last_received {};
+    duration::Milliseconds _connect_start {};
+
+    ConnectCallback _on_connect { nullptr };
+    DisconnectCallback _on_disconnect { nullptr };
+    MessageCallback _on_message { nullptr };
+    PidCallback _on_publish { nullptr };
+    PidCallback _on_subscribe { nullptr };
+};
+
+} // namespace v5
+} // namespace mqtt
+} // namespace espurna
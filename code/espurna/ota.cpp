@@ -104,4 +104,8 @@ void otaSetup() {
 #if OTA_CLIENT != OTA_CLIENT_NONE
     otaClientSetup();
 #endif
+
+#if MQTT_SUPPORT && OTA_MQTT_BINARY_SUPPORT
+    otaMqttSetup();
+#endif
 }
@@ -16,6 +16,7 @@ void otaWebSetup();
 void otaArduinoSetup();
 void otaClientSetup();
 void otaClientSetup();
+void otaMqttSetup();
 
 // Helper methods from UpdaterClass that need to be called manually for async mode,
 // because we are not using Stream interface to feed it data.
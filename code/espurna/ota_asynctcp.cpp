@@ -266,19 +266,15 @@ void terminalSetup() {
 
 #if OTA_MQTT_SUPPORT
 
-void mqttCallback(unsigned int type, StringView topic, StringView payload) {
+void mqttCallback(unsigned int type, StringView, StringView) {
     if (type == MQTT_CONNECT_EVENT) {
         mqttSubscribe(MQTT_TOPIC_OTA);
         return;
     }
+}
 
-    if (type == MQTT_MESSAGE_EVENT) {
-        auto t = mqttMagnitude(topic);
-        if (t.equals(MQTT_TOPIC_OTA)) {
-            clientFromUrl(payload);
-        }
-        return;
-    }
+void mqttMessage(const espurna::mqtt::Match&, StringView payload) {
+    clientFromUrl(payload);
 }
 
 #endif // OTA_MQTT_SUPPORT
@@ -301,6 +297,7 @@ void otaClientSetup() {
 
 #if (MQTT_SUPPORT && OTA_MQTT_SUPPORT)
     mqttRegister(espurna::ota::asynctcp::mqttCallback);
+    mqttRegister(MQTT_TOPIC_OTA, espurna::ota::asynctcp::mqttMessage);
 #endif
 }
 
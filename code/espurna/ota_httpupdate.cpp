@@ -182,19 +182,16 @@ void terminalSetup() {
 
 #if (MQTT_SUPPORT && OTA_MQTT_SUPPORT)
 
-void mqttCallback(unsigned int type, StringView topic, StringView payload) {
+void mqttCallback(unsigned int type, StringView, StringView) {
     if (type == MQTT_CONNECT_EVENT) {
         mqttSubscribe(MQTT_TOPIC_OTA);
         return;
     }
+}
 
-    if (type == MQTT_MESSAGE_EVENT) {
-        const auto t = mqttMagnitude(topic);
-        if (!internal::url.length() && t.equals(MQTT_TOPIC_OTA)) {
-            clientQueueUrl(payload);
-        }
-
-        return;
+void mqttMessage(const espurna::mqtt::Match&, StringView payload) {
+    if (!internal::url.length()) {
+        clientQueueUrl(payload);
     }
 }
 
@@ -216,6 +213,7 @@ void otaClientSetup() {
 
 #if (MQTT_SUPPORT && OTA_MQTT_SUPPORT)
     mqttRegister(espurna::ota::httpupdate::mqttCallback);
+    mqttRegister(MQTT_TOPIC_OTA, espurna::ota::httpupdate::mqttMessage);
 #endif
 }
 
@@ -0,0 +1,109 @@
+/*
+
+Part of the OTA MODULE
+
+Firmware image is published directly to the '<root topic>/ota/bin/set' topic,
+and written to the flash as the message payload arrives
+
+*/
+
+#include "espurna.h"
+
+#if MQTT_SUPPORT && OTA_MQTT_BINARY_SUPPORT
+
+#include "mqtt.h"
+#include "ota.h"
+
+namespace espurna {
+namespace ota {
+namespace mqtt {
+namespace {
+
+// Only set when Update was started by us
+bool running { false };
+
+void abort() {
+    if (running) {
+        running = false;
+        Update.end();
+        eepromRotate(true);
+    }
+}
+
+// Note that the message *must not* be retained, since the device would receive it again after restarting
+bool stream(const espurna::mqtt::Fragment& fragment) {
+    auto* data = reinterpret_cast<uint8_t*>(const_cast<char*>(fragment.data.data()));
+    const auto len = fragment.data.length();
+
+    if (fragment.first()) {
+        abort();
+
+        if (Update.isRunning()) {
+            DEBUG_MSG_P(PSTR("[OTA] Upgrade in progress\n"));
+            return false;
+        }
+
+        if (!otaVerifyHeader(data, len)) {
+            DEBUG_MSG_P(PSTR("[OTA] No magic byte / invalid flash config\n"));
+            return false;
+        }
+
+        // Disabling EEPROM rotation to prevent writing to EEPROM after the upgrade
+        eepromRotate(false);
+
+        DEBUG_MSG_P(PSTR("[OTA] Start: %u bytes\n"), fragment.total);
+        Update.runAsync(true);
+
+        // Unlike web upload, image size is known beforehand
+        if (!Update.begin(fragment.total)) {
+            otaPrintError();
+            eepromRotate(true);
+            return false;
+        }
+
+        running = true;
+    }
+
+    if (!running || !Update.isRunning()) {
+        return false;
+    }
+
+    if (Update.write(data, len) != len) {
+        otaPrintError();
+        abort();
+        return false;
+    }
+
+    if (fragment.last()) {
+        running = false;
+        otaFinalize(fragment.total, CustomResetReason::Ota);
+        return false;
+    }
+
+    otaProgress(fragment.index + len);
+    return true;
+}
+
+void callback(unsigned int type, StringView, StringView) {
+    switch (type) {
+    case MQTT_CONNECT_EVENT:
+        mqttSubscribe(MQTT_TOPIC_OTA_BINARY);
+        break;
+    // Remaining part of the image would never arrive
+    case MQTT_DISCONNECT_EVENT:
+        abort();
+        break;
+    }
+}
+
+} // namespace
+} // namespace mqtt
+} // namespace ota
+} // namespace espurna
+
+void otaMqttSetup() {
+    mqttRegister(espurna::ota::mqtt::callback);
+    mqttRegisterStream(MQTT_TOPIC_OTA_BINARY, espurna::ota::mqtt::stream);
+}
+
+#endif
@@ -13,6 +13,7 @@ Copyright (C) 2020 by Maxim Prokhorov <prokhorov dot max at outlook dot com>
 #include "prometheus.h"
 
 #include "api.h"
+#include "mqtt.h"
 #include "relay.h"
 #include "sensor.h"
 #include "web.h"
@@ -39,6 +40,52 @@ static_assert(relaySupport() || sensorSupport(), "");
 
 namespace {
 
+#if MQTT_SUPPORT
+// Histogram buckets are cumulative, as expected by the exposition format
+// Bucket excludes the lower bound of the next one, while `le` is inclusive. Values are
+// measured in microseconds, so the bound is the largest one that still fits, e.g. 0.999ms
+void histogram(AsyncResponseStream* response, const char* name, const mqtt::Histogram& value) {
+    uint32_t count { 0 };
+    for (size_t index = 0; index < (value.Buckets - 1); ++index) {
+        count += value.bucket(index);
+        response->printf_P(PSTR("%s_bucket{le=\"%u.999\"} %u\n"),
+            name, value.lower(index + 1).count() - 1, count);
+    }
+
+    response->printf_P(PSTR("%s_bucket{le=\"+Inf\"} %u\n"), name, value.count());
+    response->printf_P(PSTR("%s_sum %u\n"), name,
+        static_cast<uint32_t>(value.total().count() / 1000));
+    response->printf_P(PSTR("%s_count %u\n"), name, value.count());
+}
+
+void mqttMetrics(AsyncResponseStream* response) {
+    const auto& stats = mqttStats();
+
+    const auto& publishes = stats.publishes();
+    response->printf_P(PSTR("mqtt_publish_attempted %u\n"), publishes.attempted);
+    response->printf_P(PSTR("mqtt_publish_accepted %u\n"), publishes.accepted);
+    response->printf_P(PSTR("mqtt_publish_failed %u\n"), publishes.failed);
+    response->printf_P(PSTR("mqtt_publish_bytes %u\n"), publishes.bytes);
+
+    response->printf_P(PSTR("mqtt_inflight %zu\n"), stats.inflight());
+
+    const auto& send_buffer = stats.send_buffer();
+    if (send_buffer.samples) {
+        response->printf_P(PSTR("mqtt_send_buffer_free %u\n"), send_buffer.last);
+        response->printf_P(PSTR("mqtt_send_buffer_low %u\n"), send_buffer.low);
+        response->printf_P(PSTR("mqtt_send_buffer_full %u\n"), send_buffer.full);
+    }
+    histogram(response, PSTR("mqtt_ack_latency_ms"), stats.ack_latency());
+
+    const auto& connections = stats.connections();
+    response->printf_P(PSTR("mqtt_connect_attempts %u\n"), connections.attempts);
+    response->printf_P(PSTR("mqtt_connect_failed %u\n"), connections.failed);
+    response->printf_P(PSTR("mqtt_disconnected %u\n"), connections.disconnected);
+    response->printf_P(PSTR("mqtt_downtime_ms %u\n"), connections.downtime_last.count());
+    histogram(response, PSTR("mqtt_connect_time_ms"), stats.connect_time());
+}
+#endif
+
 void handler(AsyncWebServerRequest* request) {
 
     // TODO: Add more stuff?
@@ -64,6 +111,10 @@ void handler(AsyncWebServerRequest* request) {
         }
     }
 
+#if MQTT_SUPPORT
+    mqttMetrics(response);
+#endif
+
     response->write('\n');
 
     request->send(response);
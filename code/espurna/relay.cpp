@@ -2686,6 +2686,14 @@ void _relayMqttSubscribeBaseTopics() {
 
 std::forward_list<RelayCustomTopic> _relay_custom_topics;
 
+// Custom topics are absolute and are not known until connected, so they can't use the global
+// mqttRegister(pattern, ...). Instead, local dispatcher tells whether any of them would match
+espurna::mqtt::Dispatcher _relay_custom_dispatcher;
+bool _relay_custom_unfiltered { false };
+
+void _relayMqttCustomTopicMatched(const espurna::mqtt::Match&, espurna::StringView) {
+}
+
 void _relayMqttSubscribeCustomTopics() {
     const size_t relays { _relays.size() };
     if (!relays) {
@@ -2699,6 +2707,9 @@ void _relayMqttSubscribeCustomTopics() {
     // but the tradeoff would be searching that array for each key match. this one is *much* shorter
 
     _relay_custom_topics.clear();
+    _relay_custom_dispatcher.clear();
+    _relay_custom_unfiltered = false;
+
     for (size_t id = 0; id < relays; ++id) {
         auto subscription = espurna::relay::settings::mqttTopicSub(id);
         if (!subscription.length()) {
@@ -2712,6 +2723,11 @@ void _relayMqttSubscribeCustomTopics() {
             continue;
         }
 
+        // Anything the dispatcher does not understand is always checked
+        if (!_relay_custom_dispatcher.add(topic.topic(), _relayMqttCustomTopicMatched)) {
+            _relay_custom_unfiltered = true;
+        }
+
         mqttSubscribeRaw(topic.topic().c_str());
         _relay_custom_topics.emplace_front(std::move(topic));
     }
@@ -2802,6 +2818,14 @@ bool _relayMqttHeartbeat(espurna::heartbeat::Mask mask) {
 }
 
 void _relayMqttHandleCustomTopic(espurna::StringView topic, espurna::StringView payload) {
+    if (_relay_custom_topics.empty()) {
+        return;
+    }
+
+    if (!_relay_custom_unfiltered && !_relay_custom_dispatcher.dispatch(topic, payload)) {
+        return;
+    }
+
     PathParts received(topic);
     for (auto& topic : _relay_custom_topics) {
         if (topic.match(received)) {
@@ -2855,22 +2879,33 @@ void _relayMqttHandleConnect() {
     _relay_mqtt_timer.stop();
 }
 
+using RelayMqttPayloadHandler = bool(*)(size_t, espurna::StringView);
+
+template <RelayMqttPayloadHandler Handler>
+void _relayMqttHandleMessage(const espurna::mqtt::Match& match, espurna::StringView payload) {
+    if (match.index >= _relays.size()) {
+        return;
+    }
+
+    Handler(match.index, payload);
+    _relays[match.index].report = mqttForward();
+}
+
 struct RelayMqttTopicHandler {
-    using Handler = bool(*)(size_t, espurna::StringView);
-    espurna::StringView topic;
-    Handler handler;
+    espurna::StringView pattern;
+    espurna::mqtt::MessageCallback callback;
 };
 
-PROGMEM_STRING(MqttTopicRelay, MQTT_TOPIC_RELAY);
-PROGMEM_STRING(MqttTopicPulse, MQTT_TOPIC_PULSE);
-PROGMEM_STRING(MqttTopicTimer, MQTT_TOPIC_TIMER);
-PROGMEM_STRING(MqttTopicLock, MQTT_TOPIC_LOCK);
+PROGMEM_STRING(MqttTopicRelay, MQTT_TOPIC_RELAY "/{index}");
+PROGMEM_STRING(MqttTopicPulse, MQTT_TOPIC_PULSE "/{index}");
+PROGMEM_STRING(MqttTopicTimer, MQTT_TOPIC_TIMER "/{index}");
+PROGMEM_STRING(MqttTopicLock, MQTT_TOPIC_LOCK "/{index}");
 
 static constexpr RelayMqttTopicHandler RelayMqttTopicHandlers[] PROGMEM {
-    {MqttTopicRelay, _relayHandlePayload},
-    {MqttTopicPulse, _relayHandlePulsePayload},
-    {MqttTopicTimer, _relayHandleTimerPayload},
-    {MqttTopicLock, _relayHandleLockPayload},
+    {MqttTopicRelay, _relayMqttHandleMessage<_relayHandlePayload>},
+    {MqttTopicPulse, _relayMqttHandleMessage<_relayHandlePulsePayload>},
+    {MqttTopicTimer, _relayMqttHandleMessage<_relayHandleTimerPayload>},
+    {MqttTopicLock, _relayMqttHandleMessage<_relayHandleLockPayload>},
 };
 
 } // namespace
@@ -2887,23 +2922,8 @@ void relayMQTTCallback(unsigned int type, espurna::StringView topic, espurna::St
         return;
     }
 
+    // Base topics are handled through mqttRegister(pattern, ...), only custom ones are left
     if (type == MQTT_MESSAGE_EVENT) {
-        const auto t = mqttMagnitude(topic);
-
-        for (const auto pair: RelayMqttTopicHandlers) {
-            if (t.startsWith(pair.topic)) {
-                size_t id;
-                if (!_relayTryParseIdFromPath(t, id)) {
-                    return;
-                }
-
-                pair.handler(id, payload);
-                _relays[id].report = mqttForward();
-
-                return;
-            }
-        }
-
         _relayMqttHandleCustomTopic(topic, payload);
         return;
     }
@@ -2921,6 +2941,10 @@ void relayMQTTCallback(unsigned int type, espurna::StringView topic, espurna::St
 void relaySetupMQTT() {
     mqttHeartbeat(_relayMqttHeartbeat);
     mqttRegister(relayMQTTCallback);
+
+    for (const auto handler : RelayMqttTopicHandlers) {
+        mqttRegister(handler.pattern, handler.callback);
+    }
 }
 
 #endif
@@ -2960,22 +2984,22 @@ void _relayPrint(Print& out, size_t start, size_t stop) {
 PROGMEM_STRING(RelayCommand, "RELAY");
 
 static void _relayCommand(::terminal::CommandContext&& ctx) {
-    if (ctx.argv.size() == 1) {
+    if (ctx.views.size() == 1) {
         _relayPrint(ctx.output, 0, _relays.size());
         terminalOK(ctx);
         return;
     }
 
     size_t id;
-    if (!_relayTryParseId(ctx.argv[1], id)) {
+    if (!_relayTryParseId(ctx.views[1], id)) {
         terminalError(ctx, F("Invalid relayID"));
         return;
     }
 
     ctx.output.println(id);
 
-    if (ctx.argv.size() > 2) {
-        auto status = relayParsePayload(ctx.argv[2]);
+    if (ctx.views.size() > 2) {
+        auto status = relayParsePayload(ctx.views[2]);
         if (PayloadStatus::Unknown == status) {
             terminalError(ctx, F("Invalid status"));
             return;
@@ -3146,7 +3170,7 @@ static void _relayCommandUnlock(::terminal::CommandContext&& ctx) {
 }
 
 static constexpr ::terminal::Command RelayCommands[] PROGMEM {
-    {RelayCommand, _relayCommand},
+    {RelayCommand, _relayCommand, ::terminal::CommandViews},
     {PulseCommand, _relayCommandPulse},
     {TimerCommand, _relayCommandTimer},
     {LockCommand, _relayCommandLock},
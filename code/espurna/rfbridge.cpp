@@ -1060,7 +1060,7 @@ void rfbSend(espurna::StringView code) {
 
 #if MQTT_SUPPORT
 
-void _rfbMqttCallback(unsigned int type, espurna::StringView topic, espurna::StringView payload) {
+void _rfbMqttCallback(unsigned int type, espurna::StringView, espurna::StringView) {
     if (type == MQTT_CONNECT_EVENT) {
 
 #if RELAY_SUPPORT
@@ -1076,44 +1076,45 @@ void _rfbMqttCallback(unsigned int type, espurna::StringView topic, espurna::Str
 
         return;
     }
-
-    if (type == MQTT_MESSAGE_EVENT) {
-        auto t = mqttMagnitude(topic);
+}
 
 #if RELAY_SUPPORT
-        if (t.equals(MQTT_TOPIC_RFLEARN)) {
-            _rfbLearnStartFromPayload(payload);
-            return;
-        }
+void _rfbMqttHandleLearn(const espurna::mqtt::Match&, espurna::StringView payload) {
+    _rfbLearnStartFromPayload(payload);
+}
 #endif
 
-        if (t.equals(MQTT_TOPIC_RFOUT)) {
+void _rfbMqttHandleOut(const espurna::mqtt::Match&, espurna::StringView payload) {
 #if RELAY_SUPPORT
-            // we *sometimes* want to check the code against available rfbON / rfbOFF
-            // e.g. in case we want to control some external device and have an external remote.
-            // - when remote press happens, relays stay in sync when we receive the code via the processing loop
-            // - when we send the code here, we never register it as *sent*, thus relays need to be made in sync manually
-            if (!_rfbRelayHandler(payload)) {
+    // we *sometimes* want to check the code against available rfbON / rfbOFF
+    // e.g. in case we want to control some external device and have an external remote.
+    // - when remote press happens, relays stay in sync when we receive the code via the processing loop
+    // - when we send the code here, we never register it as *sent*, thus relays need to be made in sync manually
+    if (!_rfbRelayHandler(payload)) {
 #endif
-                _rfbSendFromPayload(payload);
+        _rfbSendFromPayload(payload);
 #if RELAY_SUPPORT
-            }
+    }
 #endif
-            return;
-        }
+}
 
 #if RFB_PROVIDER == RFB_PROVIDER_EFM8BB1
-        if (t.equals(MQTT_TOPIC_RFRAW)) {
-            // in case this is RAW message, we should not match anything and just send it as-is to the serial
-            _rfbSendRawFromPayload(payload);
-            return;
-        }
+// in case this is RAW message, we should not match anything and just send it as-is to the serial
+void _rfbMqttHandleRaw(const espurna::mqtt::Match&, espurna::StringView payload) {
+    _rfbSendRawFromPayload(payload);
+}
 #endif
 
-        return;
-
-    }
+void _rfbMqttSetup() {
+    mqttRegister(_rfbMqttCallback);
 
+#if RELAY_SUPPORT
+    mqttRegister(MQTT_TOPIC_RFLEARN, _rfbMqttHandleLearn);
+#endif
+    mqttRegister(MQTT_TOPIC_RFOUT, _rfbMqttHandleOut);
+#if RFB_PROVIDER == RFB_PROVIDER_EFM8BB1
+    mqttRegister(MQTT_TOPIC_RFRAW, _rfbMqttHandleRaw);
+#endif
 }
 
 #endif // MQTT_SUPPORT
@@ -1413,7 +1414,7 @@ void rfbSetup() {
 #endif
 
 #if MQTT_SUPPORT
-    mqttRegister(_rfbMqttCallback);
+    _rfbMqttSetup();
 #endif
 
 #if API_SUPPORT
@@ -94,7 +94,17 @@ NamedEvent* find_named(StringView name) {
     return nullptr;
 }
 
+// Name is also the last segment of the MQTT topic, which is subscribed to with a single-level wildcard
+bool is_valid_name(StringView name) {
+    return name.length()
+        && (std::find(name.begin(), name.end(), '/') == name.end());
+}
+
 bool named_event(String name, datetime::Seconds seconds) {
+    if (!is_valid_name(name)) {
+        return false;
+    }
+
     auto it = find_named(name);
     if (it) {
         it->minutes = to_minutes(seconds);
@@ -1278,31 +1288,26 @@ void setup() {
 #if MQTT_SUPPORT
 namespace mqtt {
 
-void callback(unsigned int type, StringView topic, StringView payload) {
+void callback(unsigned int type, StringView, StringView) {
     if (type == MQTT_CONNECT_EVENT) {
         mqttSubscribe(MQTT_TOPIC_NAMED_EVENT "/+");
         return;
     }
+}
 
-    STRING_VIEW_INLINE(Topic, MQTT_TOPIC_NAMED_EVENT);
-    if (type == MQTT_MESSAGE_EVENT) {
-        const auto t = mqttMagnitude(topic);
-        if (!t.startsWith(Topic)) {
-            return;
-        }
-
-        const auto name = t.slice(Topic.length() + 1);
-        if (!name.length()) {
-            return;
-        }
+PROGMEM_STRING(Pattern, MQTT_TOPIC_NAMED_EVENT "/+");
 
-        named_event(name.toString(), payload);
+void message(const ::espurna::mqtt::Match& match, StringView payload) {
+    if (!match.wildcard.length()) {
         return;
     }
+
+    named_event(match.wildcard.toString(), payload);
 }
 
 void setup() {
     ::mqttRegister(callback);
+    ::mqttRegister(Pattern, message);
 }
 
 } // namespace mqtt
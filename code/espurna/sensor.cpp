@@ -22,13 +22,19 @@ Copyright (C) 2020-2022 by Maxim Prokhorov <prokhorov dot max at outlook dot com
 #include "terminal.h"
 #include "thingspeak.h"
 #include "rtcmem.h"
+#include "sensor_history.h"
+#include "sensor_policy.h"
+#include "sensor_schedule.h"
 #include "ws.h"
 
+#include <StreamString.h>
+
 #include <cfloat>
 #include <cmath>
 #include <cstring>
 
 #include <limits>
+#include <memory>
 #include <vector>
 
 //--------------------------------------------------------------------------------
@@ -222,12 +228,15 @@ Copyright (C) 2020-2022 by Maxim Prokhorov <prokhorov dot max at outlook dot com
     #include "sensors/PZEM004TV30Sensor.h"
 #endif
 
+#include "filters/EwmaFilter.h"
 #include "filters/LastFilter.h"
 #include "filters/MaxFilter.h"
 #include "filters/MedianFilter.h"
 #include "filters/MinFilter.h"
 #include "filters/MovingAverageFilter.h"
+#include "filters/MovingMinMaxFilter.h"
 #include "filters/SumFilter.h"
+#include "filters/TrimmedMeanFilter.h"
 
 //--------------------------------------------------------------------------------
 
@@ -489,6 +498,11 @@ public:
     Filter filter_type; // Instead of using raw value, filter it through a filter object
     BaseFilterPtr filter; // *cannot be empty*, instance should be created based on the type above
 
+    duration::Seconds read_interval { 0 }; // Read the value at least this often, sensor is read using the shortest interval of its magnitudes
+    size_t read_every { 1 }; // Only process every Nth sensor reading, when its interval is shorter than ours
+    size_t read_skip { 0 }; // Sensor readings since the last time this magnitude was processed
+
+    size_t report_every { 1 }; // Report every Nth processed value
     size_t read_count { 0 }; // Number of times 'last' was updated
 
     ValuePair last = DefaultValuePair; // Last 'read' value
@@ -502,6 +516,9 @@ public:
 
     double zero_threshold { Value::Unknown }; // Reset value to zero when equal or below threshold (applied when reading)
     double correction { 0.0 }; // Value correction (applied when reading)
+
+    policy::Policy report_policy; // Deadband, rate limit and heartbeat of the report value (applied after every check above)
+    policy::State report_state; // Last value allowed by the policy and report counters
 };
 
 static_assert(
@@ -899,6 +916,22 @@ constexpr bool useIndex() {
     return SENSOR_USE_INDEX == 1;
 }
 
+constexpr size_t historyBudget() {
+    return SENSOR_HISTORY_BUDGET;
+}
+
+constexpr size_t historyRaw() {
+    return SENSOR_HISTORY_RAW;
+}
+
+constexpr size_t historyMinutes() {
+    return SENSOR_HISTORY_MINUTES;
+}
+
+constexpr size_t historyQuarters() {
+    return SENSOR_HISTORY_QUARTERS;
+}
+
 } // namespace build
 
 namespace settings {
@@ -910,6 +943,10 @@ PROGMEM_STRING(Median, "median");
 PROGMEM_STRING(Min, "min");
 PROGMEM_STRING(MovingAverage, "moving-average");
 PROGMEM_STRING(Sum, "sum");
+PROGMEM_STRING(Ewma, "ewma");
+PROGMEM_STRING(MovingMin, "moving-min");
+PROGMEM_STRING(MovingMax, "moving-max");
+PROGMEM_STRING(TrimmedMean, "trimmed-mean");
 
 static constexpr espurna::settings::options::Enumeration<Filter> Options[] PROGMEM {
     {Filter::Last, Last},
@@ -918,6 +955,10 @@ static constexpr espurna::settings::options::Enumeration<Filter> Options[] PROGM
     {Filter::Min, Min},
     {Filter::MovingAverage, MovingAverage},
     {Filter::Sum, Sum},
+    {Filter::Ewma, Ewma},
+    {Filter::MovingMin, MovingMin},
+    {Filter::MovingMax, MovingMax},
+    {Filter::TrimmedMean, TrimmedMean},
 };
 
 } // namespace filters
@@ -1095,6 +1136,15 @@ PROGMEM_STRING(Total, "Total");
 
 PROGMEM_STRING(Filter, "Filter");
 
+PROGMEM_STRING(ReadInterval, "ReadInterval");
+PROGMEM_STRING(ReportEvery, "ReportEvery");
+
+PROGMEM_STRING(ReportDeadband, "ReportDeadband");
+PROGMEM_STRING(ReportDeadbandPercent, "ReportDeadbandPercent");
+PROGMEM_STRING(ReportMaxSilence, "ReportMaxSilence");
+PROGMEM_STRING(ReportMinInterval, "ReportMinInterval");
+PROGMEM_STRING(ReportSlope, "ReportSlope");
+
 } // namespace suffix
 
 namespace keys {
@@ -1105,6 +1155,11 @@ PROGMEM_STRING(ReportEvery, "snsReport");
 PROGMEM_STRING(SaveEvery, "snsSave");
 PROGMEM_STRING(RealTimeValues, "snsRealTime");
 
+PROGMEM_STRING(HistoryBudget, "snsHistBudget");
+PROGMEM_STRING(HistoryRaw, "snsHistRaw");
+PROGMEM_STRING(HistoryMinutes, "snsHistMinutes");
+PROGMEM_STRING(HistoryQuarters, "snsHistQuarters");
+
 espurna::settings::Key get(espurna::StringView prefix, espurna::StringView suffix, size_t index) {
     String key;
     key.reserve(prefix.length() + suffix.length() + 4);
@@ -1143,6 +1198,22 @@ bool realTimeValues() {
     return getSetting(FPSTR(keys::RealTimeValues), build::realTimeValues());
 }
 
+size_t historyBudget() {
+    return getSetting(FPSTR(keys::HistoryBudget), build::historyBudget());
+}
+
+size_t historyRaw() {
+    return getSetting(FPSTR(keys::HistoryRaw), build::historyRaw());
+}
+
+size_t historyMinutes() {
+    return getSetting(FPSTR(keys::HistoryMinutes), build::historyMinutes());
+}
+
+size_t historyQuarters() {
+    return getSetting(FPSTR(keys::HistoryQuarters), build::historyQuarters());
+}
+
 } // namespace settings
 
 alignas(4) static constexpr char List[] PROGMEM_STRING_ATTR =
@@ -1688,6 +1759,18 @@ BaseFilterPtr makeFilter(Filter filter) {
     case Filter::Sum:
         out = std::make_unique<SumFilter>();
         break;
+    case Filter::Ewma:
+        out = std::make_unique<EwmaFilter>();
+        break;
+    case Filter::MovingMin:
+        out = std::make_unique<MovingMinFilter>();
+        break;
+    case Filter::MovingMax:
+        out = std::make_unique<MovingMaxFilter>();
+        break;
+    case Filter::TrimmedMean:
+        out = std::make_unique<TrimmedMeanFilter>();
+        break;
     }
 
     return out;
@@ -1947,6 +2030,80 @@ std::forward_list<timer::SystemTimer> timers;
 } // namespace notifications
 } // namespace
 
+#if SENSOR_HISTORY_SUPPORT
+namespace history {
+namespace {
+namespace internal {
+
+// Same order as the magnitudes list
+std::vector<History> histories;
+size_t budget { 0 };
+
+} // namespace internal
+
+uint32_t now() {
+    return systemUptime().count();
+}
+
+size_t budget() {
+    return internal::budget;
+}
+
+size_t bytes() {
+    size_t out { 0 };
+    for (const auto& history : internal::histories) {
+        out += history.bytes();
+    }
+
+    return out;
+}
+
+const History* find(size_t index) {
+    if (index < internal::histories.size()) {
+        return &internal::histories[index];
+    }
+
+    return nullptr;
+}
+
+size_t index(const Magnitude& magnitude) {
+    return std::distance(
+        magnitude::internal::magnitudes.data(),
+        std::addressof(magnitude));
+}
+
+const History* find(const Magnitude& magnitude) {
+    return find(index(magnitude));
+}
+
+void add(size_t index, double value) {
+    if (index < internal::histories.size()) {
+        internal::histories[index].add(now(), value);
+    }
+}
+
+// Every magnitude gets the same capacity, reduced when all of them do not fit into the budget
+void configure() {
+    internal::budget = settings::historyBudget();
+
+    const auto capacity = fit(
+        Capacity{
+            .raw = settings::historyRaw(),
+            .minutes = settings::historyMinutes(),
+            .quarters = settings::historyQuarters(),
+        },
+        magnitude::count(), internal::budget);
+
+    internal::histories.resize(magnitude::count());
+    for (auto& history : internal::histories) {
+        history.configure(capacity);
+    }
+}
+
+} // namespace
+} // namespace history
+#endif
+
 void notify_after(duration::Milliseconds after, NotifyCallback callback) {
     using namespace notifications;
 
@@ -1970,6 +2127,12 @@ namespace internal {
 std::vector<BaseSensorPtr> sensors;
 size_t report_every { build::reportEvery() };
 
+// Sensors are scheduled by their index in the `sensors` list
+Scheduler schedule;
+
+// Sensors that started the measurement and are waiting for it to finish
+std::vector<size_t> pending;
+
 duration::Seconds read_interval { build::readInterval() };
 
 std::forward_list<PreInitPtr> pre_init;
@@ -3187,6 +3350,10 @@ EXACT_VALUE(initInterval, settings::initInterval);
 EXACT_VALUE(reportEvery, settings::reportEvery);
 EXACT_VALUE(saveEvery, settings::saveEvery);
 EXACT_VALUE(realTimeValues, settings::realTimeValues);
+EXACT_VALUE(historyBudget, settings::historyBudget);
+EXACT_VALUE(historyRaw, settings::historyRaw);
+EXACT_VALUE(historyMinutes, settings::historyMinutes);
+EXACT_VALUE(historyQuarters, settings::historyQuarters);
 
 static constexpr espurna::settings::query::Setting Settings[] {
     {keys::ReadInterval, readInterval},
@@ -3194,6 +3361,10 @@ static constexpr espurna::settings::query::Setting Settings[] {
     {keys::ReportEvery, reportEvery},
     {keys::SaveEvery, saveEvery},
     {keys::RealTimeValues, realTimeValues},
+    {keys::HistoryBudget, historyBudget},
+    {keys::HistoryRaw, historyRaw},
+    {keys::HistoryMinutes, historyMinutes},
+    {keys::HistoryQuarters, historyQuarters},
 };
 
 #undef EXACT_VALUE
@@ -3217,6 +3388,8 @@ struct Type {
 EXACT_VALUE(correction)
 EXACT_VALUE(decimals)
 EXACT_VALUE(filter_type)
+EXACT_VALUE(read_interval)
+EXACT_VALUE(report_every)
 
 String ratio(const Magnitude& magnitude) {
     const auto ptr = reinterpret_cast<BaseEmonSensor*>(magnitude.sensor.get());
@@ -3227,11 +3400,13 @@ EXACT_VALUE(units)
 
 #undef EXACT_VALUE
 
-static constexpr std::array<Type, 5> List PROGMEM {{
+static constexpr std::array<Type, 7> List PROGMEM {{
     {suffix::Correction, magnitude::traits::correction_supported, correction},
     {suffix::Filter, nullptr, filter_type},
     {suffix::Precision, nullptr, decimals},
     {suffix::Ratio, magnitude::traits::ratio_supported, ratio},
+    {suffix::ReadInterval, nullptr, read_interval},
+    {suffix::ReportEvery, nullptr, report_every},
     {suffix::Units, nullptr, units},
 }};
 
@@ -3601,10 +3776,52 @@ void onAction(uint32_t client_id, const char* action, JsonObject& data) {
         }
         return;
     }
+
+#if SENSOR_HISTORY_SUPPORT
+    // History is usually bigger than what the json buffer would hold, serialize it directly.
+    // Only one resolution is sent at a time, `1m` unless some other one was requested
+    if (STRING_VIEW("magnitude-history") == action) {
+        const auto id = data["id"].as<size_t>();
+
+        const auto* ptr = history::find(id);
+        if (!ptr) {
+            return;
+        }
+
+        auto resolution = history::Resolution::Minute;
+
+        const auto requested = data["resolution"].as<String>();
+        for (auto value : {history::Resolution::Raw, history::Resolution::Minute, history::Resolution::Quarter}) {
+            if (history::name(value) == requested) {
+                resolution = value;
+                break;
+            }
+        }
+
+        const auto name = history::name(resolution);
+
+        StreamString out;
+        out.print(F("{\"magnitude-history\":{\"id\":"));
+        out.print(id);
+        out.print(F(",\"resolution\":\""));
+        out.write(reinterpret_cast<const uint8_t*>(name.data()), name.length());
+        out.print(F("\",\"now\":"));
+        out.print(history::now());
+        out.print(F(",\"values\":"));
+        history::serialize_json(out, *ptr, resolution, magnitude::get(id).decimals);
+        out.print(F("}}"));
+
+        wsSend(client_id, out.c_str());
+        return;
+    }
+#endif
 }
 
 void onVisible(JsonObject& root) {
     wsPayloadModule(root, STRING_VIEW("sns"));
+#if SENSOR_HISTORY_SUPPORT
+    wsPayloadModule(root, STRING_VIEW("sns-history"));
+#endif
     for (auto sensor : internal::sensors) {
         if (isEmon(sensor)) {
             wsPayloadModule(root, STRING_VIEW("emon"));
@@ -3733,7 +3950,69 @@ void setup() {
             };
         }
 
+#if SENSOR_HISTORY_SUPPORT
+        auto history_pattern = pattern;
+        history_pattern += STRING_VIEW("/history");
+#endif
+
         apiRegister(std::move(pattern), std::move(get), std::move(put));
+
+#if SENSOR_HISTORY_SUPPORT
+        // JSON by default, `?format=binary` for the compact version
+        apiRegister(std::move(history_pattern),
+            [type](ApiRequest& request) {
+                return tryHandle(request, type,
+                    [&](const Magnitude& magnitude) {
+                        const auto* ptr = history::find(magnitude);
+                        if (!ptr) {
+                            return;
+                        }
+
+                        const auto format = (request.param(F("format")) == STRING_VIEW("binary"))
+                            ? history::Format::Binary
+                            : history::Format::Json;
+
+                        // Only one value is serialized at a time, buffer never grows larger
+                        // than the requested chunk size plus the last value
+                        auto writer = std::make_shared<history::Writer>(
+                            format, history::now(), magnitude.decimals);
+                        auto out = std::make_shared<StreamString>();
+
+                        const auto id = history::index(magnitude);
+                        request.handle([&](AsyncWebServerRequest* request) {
+                            auto* response = request->beginChunkedResponse(
+                                (format == history::Format::Json)
+                                    ? F("application/json")
+                                    : F("application/octet-stream"),
+                                [id, writer, out](uint8_t* buffer, size_t maxLen, size_t) -> size_t {
+                                    // magnitudes may be re-configured while the response is still in progress
+                                    const auto* ptr = history::find(id);
+                                    if (!ptr) {
+                                        return 0;
+                                    }
+
+                                    while ((out->length() < maxLen) && writer->next(*out, *ptr)) {
+                                    }
+
+                                    if (writer->error()) {
+                                        return 0;
+                                    }
+
+                                    const size_t have = std::min(static_cast<size_t>(out->length()), maxLen);
+                                    if (have) {
+                                        std::copy(out->c_str(), out->c_str() + have, buffer);
+                                        out->remove(0, have);
+                                    }
+
+                                    return have;
+                                });
+
+                            request->send(response);
+                        });
+                    });
+            },
+            nullptr);
+#endif
     });
 }
 
@@ -3815,11 +4094,27 @@ void magnitudes(::terminal::CommandContext&& ctx) {
 
     size_t index = 0;
     for (const auto& magnitude : magnitude::internal::magnitudes) {
-        ctx.output.printf_P(PSTR("%2zu * %s @ %s read %s reported %s\n"),
+        ctx.output.printf_P(PSTR("%2zu * %s @ %s read %s reported %s (every %us, report %zu)\n"),
             index++, magnitude::topicWithIndex(magnitude).c_str(),
             magnitude::description(magnitude).c_str(),
             magnitude::format_with_units(magnitude, magnitude.last).c_str(),
-            magnitude::format_with_units(magnitude, magnitude.reported).c_str());
+            magnitude::format_with_units(magnitude, magnitude.reported).c_str(),
+            static_cast<uint32_t>(magnitude.read_interval.count()), magnitude.report_every);
+    }
+
+    // Read schedule of the sensors, jitter is how late was the read compared to its deadline
+    const auto& schedule = internal::schedule;
+    for (size_t id = 0; id < internal::sensors.size(); ++id) {
+        if (!schedule.contains(id)) {
+            continue;
+        }
+
+        const auto& stats = schedule.stats(id);
+        ctx.output.printf_P(PSTR("%s every %u (ms) reads %u jitter avg %u (ms) max %u (ms) overruns %u\n"),
+            internal::sensors[id]->description().c_str(),
+            schedule.interval(id).count(), stats.reads,
+            stats.jitter_average(), stats.jitter_max.count(),
+            stats.overruns);
     }
 
     terminalOK(ctx);
@@ -3894,11 +4189,80 @@ void energy(::terminal::CommandContext&& ctx) {
     }
 }
 
+PROGMEM_STRING(Reports, "REPORTS");
+
+void reports(::terminal::CommandContext&& ctx) {
+    if (!magnitude::count()) {
+        terminalError(ctx, F("No magnitudes"));
+        return;
+    }
+
+    size_t index = 0;
+    for (const auto& magnitude : magnitude::internal::magnitudes) {
+        if (!policy::enabled(magnitude.report_policy)) {
+            ctx.output.printf_P(PSTR("%2zu * %s no policy\n"),
+                index++, magnitude::topicWithIndex(magnitude).c_str());
+            continue;
+        }
+
+        const auto& counters = magnitude.report_state.counters();
+        ctx.output.printf_P(PSTR("%2zu * %s sent %u (heartbeat %u, slope %u) suppressed %u (deadband %u, rate %u)\n"),
+            index++, magnitude::topicWithIndex(magnitude).c_str(),
+            counters.sent, counters.silence, counters.slope,
+            counters.suppressed(), counters.deadband, counters.rate);
+    }
+
+    terminalOK(ctx);
+}
+
+#if SENSOR_HISTORY_SUPPORT
+PROGMEM_STRING(History, "HISTORY");
+
+void history(::terminal::CommandContext&& ctx) {
+    const auto* first = history::find(0);
+    if (!first) {
+        terminalError(ctx, F("No magnitudes"));
+        return;
+    }
+
+    if (ctx.argv.size() == 1) {
+        const auto capacity = first->capacity();
+        ctx.output.printf_P(PSTR("raw %zu, 1m %zu, 15m %zu values per magnitude\n"),
+            capacity.raw, capacity.minutes, capacity.quarters);
+        ctx.output.printf_P(PSTR("using %zu out of %zu (bytes)\n"),
+            history::bytes(), history::budget());
+        terminalOK(ctx);
+        return;
+    }
+
+    if (ctx.argv.size() == 2) {
+        const auto id = espurna::settings::internal::convert<size_t>(ctx.argv[1]);
+
+        const auto* ptr = history::find(id);
+        if (!ptr) {
+            terminalError(ctx, F("Invalid magnitude ID"));
+            return;
+        }
+
+        history::serialize_json(ctx.output, *ptr, history::now(), magnitude::get(id).decimals);
+        ctx.output.print('\n');
+        terminalOK(ctx);
+        return;
+    }
+
+    terminalError(ctx, F("HISTORY [<ID>]"));
+}
+#endif
+
 static constexpr ::terminal::Command List[] PROGMEM {
     {Magnitudes, commands::magnitudes},
     {Expected, commands::expected},
     {ResetRatios, commands::reset_ratios},
     {Energy, commands::energy},
+    {Reports, commands::reports},
+#if SENSOR_HISTORY_SUPPORT
+    {History, commands::history},
+#endif
 };
 
 } // namespace commands
@@ -3919,7 +4283,10 @@ namespace internal {
 State state { State::None };
 std::unique_ptr<ReadyFlag> init_flag;
 
-ReadyFlag read_flag;
+#if WEB_SUPPORT
+// Websocket clients are notified after every sensor due at the same time is read
+bool web_post { false };
+#endif
 
 } // namespace internal
 
@@ -3934,8 +4301,22 @@ void configure_magnitude(Magnitude& magnitude) {
         magnitude.filter = magnitude::makeFilter(magnitude.filter_type);
     }
 
+    // Per-magnitude read interval and report counter. Global `snsRead` and `snsReport` are used by default
+    // - ${prefix}ReadInterval${index} in seconds, sensor itself is read using the shortest one of its magnitudes
+    // - ${prefix}ReportEvery${index} report every Nth value that was read
+    magnitude.read_interval = std::clamp(
+        getSetting(
+            settings::keys::get(magnitude, settings::suffix::ReadInterval),
+            readInterval()),
+        build::ReadIntervalMin, build::ReadIntervalMax);
+    magnitude.report_every = std::clamp(
+        getSetting(
+            settings::keys::get(magnitude, settings::suffix::ReportEvery),
+            reportEvery()),
+        build::ReportEveryMin, build::ReportEveryMax);
+
     // Everything filtered so far is reset, possibly updating total number of required readings.
-    magnitude.filter->resize(reportEvery());
+    magnitude.filter->resize(magnitude.report_every);
 
     // Reset internal readings counter as well.
     magnitude.read_count = 0;
@@ -4008,6 +4389,24 @@ void configure_magnitude(Magnitude& magnitude) {
         settings::keys::get(magnitude, settings::suffix::MaxThreshold),
         Value::Unknown);
 
+    // Per-magnitude report policy, applied to the value that passed every check above. All of them are disabled by default
+    // - ${prefix}ReportDeadband${index} and ${prefix}ReportDeadbandPercent${index} suppress value that did not change enough since the last report
+    // - ${prefix}ReportMaxSilence${index} in seconds, report value inside of the deadband anyway when the last report was this long ago
+    // - ${prefix}ReportMinInterval${index} in seconds, never report more often than this
+    // - ${prefix}ReportSlope${index} in units per minute, report value inside of the deadband when its trend changed this much
+    magnitude.report_policy = policy::Policy{
+        .deadband_absolute = getSetting(
+            settings::keys::get(magnitude, settings::suffix::ReportDeadband), 0.0),
+        .deadband_relative = getSetting(
+            settings::keys::get(magnitude, settings::suffix::ReportDeadbandPercent), 0.0) / 100.0,
+        .max_silence = getSetting(
+            settings::keys::get(magnitude, settings::suffix::ReportMaxSilence), duration::Seconds::zero()),
+        .min_interval = getSetting(
+            settings::keys::get(magnitude, settings::suffix::ReportMinInterval), duration::Seconds::zero()),
+        .slope_change = getSetting(
+            settings::keys::get(magnitude, settings::suffix::ReportSlope), 0.0),
+    };
+
     // When we don't save energy, purge existing value in both RAM & settings
     if (isEmon(magnitude.sensor) && (MAGNITUDE_ENERGY == magnitude.type) && (0 == energy::every())) {
         energy::reset(magnitude.index_global);
@@ -4019,10 +4418,51 @@ void configure_magnitudes() {
     for (auto& magnitude : magnitude::internal::magnitudes) {
         configure_magnitude(magnitude);
     }
+
+#if SENSOR_HISTORY_SUPPORT
+    history::configure();
+#endif
 }
 
+// Every sensor is read at the shortest interval of its magnitudes, first reading happens after that interval.
+// Magnitudes with longer intervals skip some of the readings (rounded to the nearest multiple of the sensor interval)
+// Measurements that were already started are abandoned, sensor would start them again when it is read next time
 void schedule_read() {
-    internal::read_flag.stop_wait(internal::read_interval);
+    const auto now = TimeSource::now().time_since_epoch();
+
+    internal::pending.clear();
+
+    internal::schedule.clear();
+    internal::schedule.reserve(internal::sensors.size());
+
+    for (size_t id = 0; id < internal::sensors.size(); ++id) {
+        const auto sensor = internal::sensors[id];
+
+        auto interval = duration::Seconds::zero();
+        magnitude::forEachInstance(
+            [&](const Magnitude& magnitude) {
+                if ((magnitude.sensor.get() == sensor.get())
+                    && (!interval.count() || (magnitude.read_interval < interval)))
+                {
+                    interval = magnitude.read_interval;
+                }
+            });
+
+        if (!interval.count()) {
+            continue;
+        }
+
+        magnitude::forEachInstance(
+            [&](Magnitude& magnitude) {
+                if (magnitude.sensor.get() == sensor.get()) {
+                    magnitude.read_every = std::max(static_cast<size_t>(
+                        (magnitude.read_interval + (interval / 2)) / interval), size_t{ 1 });
+                    magnitude.read_skip = 0;
+                }
+            });
+
+        internal::schedule.add(id, interval, now);
+    }
 }
 
 void suspend() {
@@ -4168,41 +4608,23 @@ void tick() {
     }
 }
 
-void pre() {
-    for (auto sensor : internal::sensors) {
-        sensor->pre();
-    }
-}
-
-void post() {
-    for (auto sensor : internal::sensors) {
-        sensor->post();
-    }
-}
-
-void error() {
+void error(BaseSensorPtr sensor) {
 #if DEBUG_SUPPORT
-    for (auto sensor : internal::sensors) {
-        if (SENSOR_ERROR_OK != sensor->error()) {
-            DEBUG_MSG_P(PSTR("[SENSOR] Could not read from %s - %s\n"),
-                    sensor->description().c_str(),
-                    error(sensor->error()).c_str());
-        }
+    if (SENSOR_ERROR_OK != sensor->error()) {
+        DEBUG_MSG_P(PSTR("[SENSOR] Could not read from %s - %s\n"),
+                sensor->description().c_str(),
+                error(sensor->error()).c_str());
     }
 #endif
 }
 
+// Defaults for the per-magnitude settings, applied when magnitudes are (re)configured
 void reset_report(duration::Seconds read_interval, size_t report_every) {
     internal::read_interval = read_interval;
     internal::report_every = report_every;
-    internal::read_flag.stop_wait(read_interval);
-}
-
-bool ready_to_read() {
-    return internal::read_flag.wait(internal::read_interval);
 }
 
-bool ready_to_report(ValuePair& out, const ValuePair& processed, const Magnitude& magnitude, bool report) {
+bool ready_to_report(ValuePair& out, const ValuePair& processed, Magnitude& magnitude, bool report) {
     // Ensure that reported value change is greater or equal to this delta value
     const bool compare_min_delta { magnitude.min_delta > build::DefaultMinDelta };
     report = report || compare_min_delta;
@@ -4221,12 +4643,12 @@ bool ready_to_report(ValuePair& out, const ValuePair& processed, const Magnitude
 
 
     if (report) {
-        if (magnitude.filter->ready()) {
+        const bool filtered { magnitude.filter->ready() };
+        if (filtered) {
             out = ValuePair{
                 .value = magnitude.filter->value(),
                 .units = processed.units,
             };
-            magnitude.filter->restart();
         } else {
             out = processed;
         }
@@ -4255,11 +4677,202 @@ bool ready_to_report(ValuePair& out, const ValuePair& processed, const Magnitude
         if (report && check_max_threshold) {
             report = out.value <= magnitude.max_threshold;
         }
+
+        // Last, let the report policy suppress or allow the value
+        bool suppressed { false };
+        if (report && policy::enabled(magnitude.report_policy)) {
+            report = policy::report(
+                magnitude.report_state.update(
+                    magnitude.report_policy,
+                    TimeSource::now().time_since_epoch(),
+                    out.value));
+            suppressed = !report;
+        }
+
+        // Value suppressed by the policy is not lost, filter keeps accumulating until the next report
+        // (e.g. Sum would otherwise drop everything that was read in between)
+        if (filtered && !suppressed) {
+            magnitude.filter->restart();
+        }
     }
 
     return report;
 }
 
+// Process every magnitude of the sensor, reporting them when necessary
+void process_magnitudes(BaseSensorPtr sensor) {
+    // XXX: Filter out certain magnitude types when relay is turned OFF
+#if RELAY_SUPPORT && SENSOR_POWER_CHECK_STATUS
+    const bool relay_off = (relayCount() == 1) && (relayStatus(0) == 0);
+#endif
+
+    // Current magnitude reading state
+    struct {
+        ValuePair raw;       // as the sensor returns it
+        ValuePair processed; // after applying units and decimals
+        ValuePair report;    // value to be reported (either processed, or filtered)
+    } state;
+
+    for (size_t index = 0; index < magnitude::count(); ++index) {
+        auto& magnitude = magnitude::get(index);
+        if (magnitude.sensor.get() != sensor.get()) {
+            continue;
+        }
+
+        // Do not read anything from a failed sensor
+        if (SENSOR_ERROR_OK != sensor->error()) {
+            continue;
+        }
+
+        // Sensor is read more often than this magnitude needs
+        magnitude.read_skip = (magnitude.read_skip + 1) % magnitude.read_every;
+        if (magnitude.read_skip) {
+            continue;
+        }
+
+        // Value from the sensor as-is
+        state.raw = ValuePair{
+            .value = magnitude.sensor->value(magnitude.slot),
+            .units = magnitude.sensor->units(magnitude.slot),
+        };
+
+        // Completely remove spurious values if relay is OFF
+#if RELAY_SUPPORT && SENSOR_POWER_CHECK_STATUS
+        switch (magnitude.type) {
+        case MAGNITUDE_POWER_ACTIVE:
+        case MAGNITUDE_POWER_REACTIVE:
+        case MAGNITUDE_POWER_APPARENT:
+        case MAGNITUDE_POWER_FACTOR:
+        case MAGNITUDE_CURRENT:
+        case MAGNITUDE_ENERGY_DELTA:
+            if (relay_off) {
+                state.raw.value = 0.0;
+            }
+            break;
+        default:
+            break;
+        }
+#endif
+
+        // Apply units and correct number of decimals (directly modifies the double value)
+        state.processed = magnitude::process(magnitude, state.raw);
+
+        // Absolute value correction. *Unconditional*, value is always offset by this amount
+        state.processed.value += magnitude.correction;
+
+        // In case units change occured, make sure filter receives the same unit type
+        if (magnitude.last.units != state.processed.units) {
+            magnitude.filter->reset();
+            magnitude.report_state.reset();
+        }
+
+        magnitude.filter->update(state.processed.value);
+
+#if SENSOR_HISTORY_SUPPORT
+        history::add(index, state.processed.value);
+#endif
+
+        // Making last reading available in API and for external listeners
+        magnitude.last = state.processed;
+        magnitude::read(magnitude::value(magnitude, state.processed));
+
+        // At this point, we should decide whether this value should be reported.
+        // First, increment read counter and check for overflow.
+        const auto read_count = magnitude.read_count;
+        magnitude.read_count = (read_count + 1) % magnitude.report_every;
+
+        bool report { 0 == magnitude.read_count };
+
+        // Special case for energy, save current readings to
+        // - RTC memory (always)
+        // - Internal flash (optionally, when reporting)
+        if (MAGNITUDE_ENERGY == magnitude.type) {
+            energy::update(magnitude, report);
+        }
+
+        // Prepare and verify report value before proceeding
+        report = ready_to_report(
+            state.report, state.processed,
+            magnitude, report);
+
+        // If flag was not reset by the checks above, continue and finally report the value
+        if (report) {
+            const auto value = magnitude::value(magnitude, state.report);
+
+            magnitude.reported = state.report;
+            magnitude::report(value);
+
+#if MQTT_SUPPORT
+            mqtt::report(value, magnitude);
+#endif
+#if THINGSPEAK_SUPPORT
+            tspkEnqueueMagnitude(index, value.repr);
+#endif
+#if DOMOTICZ_SUPPORT
+            domoticzSendMagnitude(index, value);
+#endif
+        }
+
+#if SENSOR_DEBUG
+        {
+            DEBUG_MSG_P(PSTR("[SENSOR] %s -> raw %s processed %s report %s\n"),
+                magnitude::topic(magnitude).c_str(),
+                magnitude::format_with_units(magnitude, state.raw).c_str(),
+                magnitude::format_with_units(magnitude, state.processed).c_str(),
+                magnitude::format_with_units(magnitude, state.report).c_str());
+        }
+#endif
+    }
+
+    sensor->post();
+}
+
+// Either read the sensor right away, or start the measurement and finish it later in poll()
+// Returns false when the measurement is still pending
+bool read(BaseSensorPtr sensor) {
+    if (sensor->start()) {
+        return false;
+    }
+
+    // Pre-read hook, called every reading
+    sensor->pre();
+
+    // Notify about sensor errors that may have been updated by pre()
+    error(sensor);
+
+    process_magnitudes(sensor);
+
+    return true;
+}
+
+// Finish pending measurements, returns true when any of them were processed
+bool poll() {
+    bool out { false };
+
+    auto& pending = internal::pending;
+    for (auto it = pending.begin(); it != pending.end();) {
+        auto sensor = internal::sensors[*it];
+        if (!sensor->poll()) {
+            ++it;
+            continue;
+        }
+
+        sensor->complete();
+        error(sensor);
+        process_magnitudes(sensor);
+
+        it = pending.erase(it);
+        out = true;
+    }
+
+    return out;
+}
+
+bool pending(size_t id) {
+    const auto& pending = internal::pending;
+    return std::find(pending.begin(), pending.end(), id) != pending.end();
+}
+
 void loop() {
     // TODO: allow to do nothing
     if (internal::state == State::Idle) {
@@ -4296,135 +4909,38 @@ void loop() {
     // Tick hook, called every loop()
     sensor::tick();
 
-    if (ready_to_read()) {
-        // XXX: Filter out certain magnitude types when relay is turned OFF
-#if RELAY_SUPPORT && SENSOR_POWER_CHECK_STATUS
-        const bool relay_off = (relayCount() == 1) && (relayStatus(0) == 0);
-#endif
-
-        // Report every Nth reading
-        const auto report_every = reportEvery();
-
-        // Pre-read hook, called every reading
-        sensor::pre();
-
-        // Notify about sensor errors that may have been updated by pre()
-        sensor::error();
-
-        // Current magnitude reading state
-        struct {
-            ValuePair raw;       // as the sensor returns it
-            ValuePair processed; // after applying units and decimals
-            ValuePair report;    // value to be reported (either processed, or filtered)
-        } state;
-
-        for (size_t index = 0; index < magnitude::count(); ++index) {
-            auto& magnitude = magnitude::get(index);
-
-            // Do not read anything from a failed sensor
-            if (SENSOR_ERROR_OK != magnitude.sensor->error()) {
-                continue;
-            }
-
-            // Value from the sensor as-is
-            state.raw = ValuePair{
-                .value = magnitude.sensor->value(magnitude.slot),
-                .units = magnitude.sensor->units(magnitude.slot),
-            };
-
-            // Completely remove spurious values if relay is OFF
-#if RELAY_SUPPORT && SENSOR_POWER_CHECK_STATUS
-            switch (magnitude.type) {
-            case MAGNITUDE_POWER_ACTIVE:
-            case MAGNITUDE_POWER_REACTIVE:
-            case MAGNITUDE_POWER_APPARENT:
-            case MAGNITUDE_POWER_FACTOR:
-            case MAGNITUDE_CURRENT:
-            case MAGNITUDE_ENERGY_DELTA:
-                if (relay_off) {
-                    state.raw.value = 0.0;
-                }
-                break;
-            default:
-                break;
-            }
+    // Measurements started in the previous loop()s
+    if (poll()) {
+#if WEB_SUPPORT
+        internal::web_post = true;
 #endif
+    }
 
-            // Apply units and correct number of decimals (directly modifies the double value)
-            state.processed = magnitude::process(magnitude, state.raw);
-
-            // Absolute value correction. *Unconditional*, value is always offset by this amount
-            state.processed.value += magnitude.correction;
-
-            // In case units change occured, make sure filter receives the same unit type
-            if (magnitude.last.units != state.processed.units) {
-                magnitude.filter->reset();
-            }
-
-            magnitude.filter->update(state.processed.value);
-
-            // Making last reading available in API and for external listeners
-            magnitude.last = state.processed;
-            magnitude::read(magnitude::value(magnitude, state.processed));
-
-            // At this point, we should decide whether this value should be reported.
-            // First, increment read counter and check for overflow.
-            const auto read_count = magnitude.read_count;
-            magnitude.read_count = (read_count + 1) % report_every;
-
-            bool report { 0 == magnitude.read_count };
-
-            // Special case for energy, save current readings to
-            // - RTC memory (always)
-            // - Internal flash (optionally, when reporting)
-            if (MAGNITUDE_ENERGY == magnitude.type) {
-                energy::update(magnitude, report);
-            }
-
-            // Prepare and verify report value before proceeding
-            report = ready_to_report(
-                state.report, state.processed,
-                magnitude, report);
-
-            // If flag was not reset by the checks above, continue and finally report the value
-            if (report) {
-                const auto value = magnitude::value(magnitude, state.report);
-
-                magnitude.reported = state.report;
-                magnitude::report(value);
-
-#if MQTT_SUPPORT
-                mqtt::report(value, magnitude);
-#endif
-#if THINGSPEAK_SUPPORT
-                tspkEnqueueMagnitude(index, value.repr);
-#endif
-#if DOMOTICZ_SUPPORT
-                domoticzSendMagnitude(index, value);
-#endif
-            }
+    // Only the sensor that is due the earliest is read, the rest are handled in the next loop()
+    // When sensor is still busy with the previous measurement, this reading is skipped
+    const auto now = TimeSource::now().time_since_epoch();
 
-#if SENSOR_DEBUG
-            {
-                DEBUG_MSG_P(PSTR("[SENSOR] %s -> raw %s processed %s report %s\n"),
-                    magnitude::topic(magnitude).c_str(),
-                    magnitude::format_with_units(magnitude, state.raw).c_str(),
-                    magnitude::format_with_units(magnitude, state.processed).c_str(),
-                    magnitude::format_with_units(magnitude, state.report).c_str());
-            }
+    const auto id = internal::schedule.next(now);
+    if ((id != Scheduler::NoId) && !pending(id)) {
+        if (read(internal::sensors[id])) {
+#if WEB_SUPPORT
+            internal::web_post = true;
 #endif
+        } else {
+            internal::pending.push_back(id);
         }
-
-        sensor::post();
+    }
 
 #if WEB_SUPPORT
+    if (internal::web_post && internal::pending.empty() && !internal::schedule.due(now)) {
+        internal::web_post = false;
         wsPost(web::onData);
-#endif
     }
+#endif
 }
 
 void configure_base() {
-    // Read counter is set for each magnitude, and equals to 0 right after this point
+    // Global defaults for the magnitude read interval and report counter
     reset_report(
         sensor::settings::readInterval(),
         sensor::settings::reportEvery());
@@ -4440,6 +4956,11 @@ void configure_base() {
 void configure() {
     configure_base();
     configure_magnitudes();
+
+    // Read intervals could've changed, restart the schedule as well
+    if (internal::state == State::Reading) {
+        schedule_read();
+    }
 }
 
 void setup() {
@@ -66,6 +66,10 @@ enum class Filter : int {
     Median,
     MovingAverage,
     Sum,
+    Ewma,
+    MovingMin,
+    MovingMax,
+    TrimmedMean,
 };
 
 struct Watts {
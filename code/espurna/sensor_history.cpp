@@ -0,0 +1,425 @@
+/*
+
+Part of the SENSOR MODULE
+
+*/
+
+#include "sensor_history.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace espurna {
+namespace sensor {
+namespace history {
+namespace {
+
+void write(Print& out, StringView value) {
+    out.write(reinterpret_cast<const uint8_t*>(value.data()), value.length());
+}
+
+void write(Print& out, uint32_t value) {
+    char buffer[12];
+    auto* ptr = std::end(buffer);
+    do {
+        *(--ptr) = '0' + (value % 10);
+        value /= 10;
+    } while (value);
+
+    write(out, StringView(ptr, std::end(buffer)));
+}
+
+void write(Print& out, float value, unsigned char decimals) {
+    if (!std::isfinite(value)) {
+        write(out, StringView("null"));
+        return;
+    }
+
+    char buffer[64];
+    dtostrf(value, 1, decimals, buffer);
+    write(out, StringView(buffer, std::strlen(buffer)));
+}
+
+template <typename T>
+void write_le(Print& out, T value) {
+    uint8_t buffer[sizeof(T)];
+    std::memcpy(buffer, &value, sizeof(T));
+    out.write(buffer, sizeof(T));
+}
+
+void write_json(Print& out, const Sample& value, unsigned char decimals) {
+    write(out, StringView("["));
+    write(out, value.time);
+    write(out, StringView(","));
+    write(out, value.value, decimals);
+    write(out, StringView("]"));
+}
+
+void write_json(Print& out, const Aggregate& value, unsigned char decimals) {
+    write(out, StringView("["));
+    write(out, value.time);
+    write(out, StringView(","));
+    write(out, value.min, decimals);
+    write(out, StringView(","));
+    write(out, value.avg, decimals);
+    write(out, StringView(","));
+    write(out, value.max, decimals);
+    write(out, StringView("]"));
+}
+
+void write_binary(Print& out, const Sample& value) {
+    write_le<uint32_t>(out, value.time);
+    write_le<float>(out, value.value);
+}
+
+void write_binary(Print& out, const Aggregate& value) {
+    write_le<uint32_t>(out, value.time);
+    write_le<float>(out, value.min);
+    write_le<float>(out, value.avg);
+    write_le<float>(out, value.max);
+}
+
+} // namespace
+
+StringView name(Resolution resolution) {
+    switch (resolution) {
+    case Resolution::Raw:
+        break;
+    case Resolution::Minute:
+        return StringView("1m");
+    case Resolution::Quarter:
+        return StringView("15m");
+    }
+
+    return StringView("raw");
+}
+
+uint32_t period(Resolution resolution) {
+    switch (resolution) {
+    case Resolution::Raw:
+        break;
+    case Resolution::Minute:
+        return 60;
+    case Resolution::Quarter:
+        return 15 * 60;
+    }
+
+    return 0;
+}
+
+size_t bytes(Capacity capacity) {
+    return (capacity.raw * sizeof(Sample))
+        + ((capacity.minutes + capacity.quarters) * sizeof(Aggregate));
+}
+
+Capacity fit(Capacity capacity, size_t count, size_t budget) {
+    const auto requested = bytes(capacity) * count;
+    if (!requested || (requested <= budget)) {
+        return capacity;
+    }
+
+    // every resolution loses the same fraction of its values
+    const auto scale = [&](size_t value) {
+        return static_cast<size_t>(
+            (static_cast<uint64_t>(value) * budget) / requested);
+    };
+
+    return Capacity{
+        .raw = scale(capacity.raw),
+        .minutes = scale(capacity.minutes),
+        .quarters = scale(capacity.quarters),
+    };
+}
+
+Aggregate History::Accumulator::aggregate() const {
+    return Aggregate{
+        .time = time,
+        .min = min,
+        .avg = static_cast<float>(sum / count),
+        .max = max,
+    };
+}
+
+void History::configure(Capacity capacity) {
+    if (capacity == _capacity) {
+        return;
+    }
+
+    _capacity = capacity;
+
+    _raw.reset(capacity.raw);
+    tier(Resolution::Minute).ring.reset(capacity.minutes);
+    tier(Resolution::Quarter).ring.reset(capacity.quarters);
+
+    clear();
+}
+
+void History::clear() {
+    _raw.clear();
+    for (auto& tier : _tiers) {
+        tier.ring.clear();
+        tier.accumulator = Accumulator{};
+    }
+}
+
+History::Tier& History::tier(Resolution resolution) {
+    return _tiers[static_cast<size_t>(resolution) - 1];
+}
+
+const History::Tier& History::tier(Resolution resolution) const {
+    return _tiers[static_cast<size_t>(resolution) - 1];
+}
+
+const Ring<Aggregate>& History::aggregates(Resolution resolution) const {
+    return tier(resolution).ring;
+}
+
+bool History::current(Resolution resolution, Aggregate& out) const {
+    const auto& accumulator = tier(resolution).accumulator;
+    if (!accumulator.count) {
+        return false;
+    }
+
+    out = accumulator.aggregate();
+    return true;
+}
+
+void History::add(Tier& tier, uint32_t period, uint32_t time, float value) {
+    if (!tier.ring.capacity()) {
+        return;
+    }
+
+    auto& accumulator = tier.accumulator;
+
+    const auto start = time - (time % period);
+    if (accumulator.count && (accumulator.time != start)) {
+        tier.ring.push(accumulator.aggregate());
+        accumulator = Accumulator{};
+    }
+
+    if (!accumulator.count) {
+        accumulator.time = start;
+        accumulator.min = value;
+        accumulator.max = value;
+    }
+
+    accumulator.min = std::min(accumulator.min, value);
+    accumulator.max = std::max(accumulator.max, value);
+    accumulator.sum += value;
+    ++accumulator.count;
+}
+
+void History::add(uint32_t time, double value) {
+    if (!std::isfinite(value)) {
+        return;
+    }
+
+    const auto sample = static_cast<float>(value);
+    _raw.push(Sample{time, sample});
+
+    add(tier(Resolution::Minute), period(Resolution::Minute), time, sample);
+    add(tier(Resolution::Quarter), period(Resolution::Quarter), time, sample);
+}
+
+bool Writer::next(Print& out, const History& history) {
+    switch (_state) {
+    case State::Done:
+    case State::Error:
+        return false;
+
+    case State::Header:
+        _capacity = history.capacity();
+        if (_format == Format::Json) {
+            write(out, StringView("{\"now\":"));
+            write(out, _now);
+        } else {
+            write_le<uint8_t>(out, 'S');
+            write_le<uint8_t>(out, 'H');
+            write_le<uint8_t>(out, 1);
+            write_le<uint8_t>(out, Resolutions);
+            write_le<uint32_t>(out, _now);
+        }
+
+        _resolution = Resolution::Raw;
+        _state = State::Begin;
+        return true;
+
+    case State::Begin:
+    case State::Values:
+    case State::Current:
+    case State::Close:
+    case State::End:
+        break;
+    }
+
+    // ring positions are only valid until the next reset
+    if (!(history.capacity() == _capacity)) {
+        _state = State::Error;
+        return false;
+    }
+
+    const bool raw = _resolution == Resolution::Raw;
+    const auto size = raw
+        ? history.raw().size()
+        : history.aggregates(_resolution).size();
+
+    switch (_state) {
+    case State::Begin:
+    {
+        Aggregate current;
+        _current = !raw && history.current(_resolution, current);
+        _values = size;
+        _index = 0;
+
+        if (_format == Format::Json) {
+            write(out, StringView(",\""));
+            write(out, name(_resolution));
+            write(out, StringView("\":["));
+        } else {
+            write_le<uint8_t>(out, static_cast<uint8_t>(_resolution));
+            write_le<uint32_t>(out, period(_resolution));
+            write_le<uint16_t>(out, _values + (_current ? 1 : 0));
+        }
+
+        _state = State::Values;
+        return true;
+    }
+
+    case State::Values:
+        if (_index >= _values) {
+            _state = _current
+                ? State::Current
+                : State::Close;
+            return true;
+        }
+
+        if ((_format == Format::Json) && _index) {
+            write(out, StringView(","));
+        }
+
+        if (raw) {
+            const auto& value = history.raw()[_index];
+            if (_format == Format::Json) {
+                write_json(out, value, _decimals);
+            } else {
+                write_binary(out, value);
+            }
+        } else {
+            const auto& value = history.aggregates(_resolution)[_index];
+            if (_format == Format::Json) {
+                write_json(out, value, _decimals);
+            } else {
+                write_binary(out, value);
+            }
+        }
+
+        ++_index;
+        return true;
+
+    case State::Current:
+    {
+        Aggregate current;
+        if (!history.current(_resolution, current)) {
+            _state = State::Error;
+            return false;
+        }
+
+        if (_format == Format::Json) {
+            if (_values) {
+                write(out, StringView(","));
+            }
+            write_json(out, current, _decimals);
+        } else {
+            write_binary(out, current);
+        }
+
+        _state = State::Close;
+        return true;
+    }
+
+    case State::Close:
+        if (_format == Format::Json) {
+            write(out, StringView("]"));
+        }
+
+        switch (_resolution) {
+        case Resolution::Raw:
+            _resolution = Resolution::Minute;
+            _state = State::Begin;
+            break;
+        case Resolution::Minute:
+            _resolution = Resolution::Quarter;
+            _state = State::Begin;
+            break;
+        case Resolution::Quarter:
+            _state = State::End;
+            break;
+        }
+
+        return true;
+
+    case State::End:
+        if (_format == Format::Json) {
+            write(out, StringView("}"));
+        }
+
+        _state = State::Done;
+        return true;
+
+    case State::Header:
+    case State::Done:
+    case State::Error:
+        break;
+    }
+
+    return false;
+}
+
+void serialize_json(Print& out, const History& history, uint32_t now, unsigned char decimals) {
+    Writer writer(Format::Json, now, decimals);
+    while (writer.next(out, history)) {
+    }
+}
+
+void serialize_binary(Print& out, const History& history, uint32_t now) {
+    Writer writer(Format::Binary, now, 0);
+    while (writer.next(out, history)) {
+    }
+}
+
+void serialize_json(Print& out, const History& history, Resolution resolution, unsigned char decimals) {
+    write(out, StringView("["));
+
+    if (resolution == Resolution::Raw) {
+        const auto& raw = history.raw();
+        for (size_t index = 0; index < raw.size(); ++index) {
+            if (index) {
+                write(out, StringView(","));
+            }
+            write_json(out, raw[index], decimals);
+        }
+    } else {
+        const auto& ring = history.aggregates(resolution);
+        for (size_t index = 0; index < ring.size(); ++index) {
+            if (index) {
+                write(out, StringView(","));
+            }
+            write_json(out, ring[index], decimals);
+        }
+
+        Aggregate current;
+        if (history.current(resolution, current)) {
+            if (ring.size()) {
+                write(out, StringView(","));
+            }
+            write_json(out, current, decimals);
+        }
+    }
+
+    write(out, StringView("]"));
+}
+
+} // namespace history
+} // namespace sensor
+} // namespace espurna
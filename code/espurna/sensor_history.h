@@ -0,0 +1,238 @@
+/*
+
+Part of the SENSOR MODULE
+
+Fixed-memory history of the magnitude values. Raw values are kept as-is,
+older values are aggregated into min / avg / max of each 1 and 15 minute period
+
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "types.h"
+
+namespace espurna {
+namespace sensor {
+namespace history {
+
+// Time is in seconds, same clock as the one used for every added value (e.g. uptime)
+struct Sample {
+    uint32_t time;
+    float value;
+};
+
+struct Aggregate {
+    uint32_t time; // beginning of the period
+    float min;
+    float avg;
+    float max;
+};
+
+// Oldest value is overwritten when the buffer is full. Memory is only allocated in reset()
+template <typename T>
+class Ring {
+public:
+    void reset(size_t capacity) {
+        _data.clear();
+        _data.shrink_to_fit();
+        _data.reserve(capacity);
+        _capacity = capacity;
+        _head = 0;
+    }
+
+    void clear() {
+        _data.clear();
+        _head = 0;
+    }
+
+    void push(const T& value) {
+        if (!_capacity) {
+            return;
+        }
+
+        if (_data.size() < _capacity) {
+            _data.push_back(value);
+            return;
+        }
+
+        _data[_head] = value;
+        _head = (_head + 1) % _capacity;
+    }
+
+    // Index 0 is the oldest value
+    const T& operator[](size_t index) const {
+        return _data[(_head + index) % _data.size()];
+    }
+
+    size_t size() const {
+        return _data.size();
+    }
+
+    size_t capacity() const {
+        return _capacity;
+    }
+
+    size_t bytes() const {
+        return _capacity * sizeof(T);
+    }
+
+private:
+    std::vector<T> _data;
+    size_t _capacity { 0 };
+    size_t _head { 0 };
+};
+
+enum class Resolution : uint8_t {
+    Raw,
+    Minute,
+    Quarter,
+};
+
+static constexpr size_t Resolutions { 3 };
+
+// Aggregated period length, in seconds
+uint32_t period(Resolution);
+
+struct Capacity {
+    size_t raw;
+    size_t minutes;
+    size_t quarters;
+};
+
+inline bool operator==(const Capacity& lhs, const Capacity& rhs) {
+    return (lhs.raw == rhs.raw)
+        && (lhs.minutes == rhs.minutes)
+        && (lhs.quarters == rhs.quarters);
+}
+
+size_t bytes(Capacity);
+
+// Shrink capacity of every resolution evenly, so that `count` of them fit into `budget` bytes
+Capacity fit(Capacity, size_t count, size_t budget);
+
+class History {
+public:
+    // Existing values are only discarded when capacity changes
+    void configure(Capacity);
+    void clear();
+
+    void add(uint32_t time, double value);
+
+    Capacity capacity() const {
+        return _capacity;
+    }
+
+    size_t bytes() const {
+        return history::bytes(_capacity);
+    }
+
+    const Ring<Sample>& raw() const {
+        return _raw;
+    }
+
+    const Ring<Aggregate>& aggregates(Resolution) const;
+
+    // Period that is still being accumulated, returns false when nothing was added to it yet
+    bool current(Resolution, Aggregate&) const;
+
+private:
+    struct Accumulator {
+        uint32_t time { 0 };
+        uint32_t count { 0 };
+        float min { 0.0f };
+        float max { 0.0f };
+        double sum { 0.0 };
+
+        Aggregate aggregate() const;
+    };
+
+    struct Tier {
+        Ring<Aggregate> ring;
+        Accumulator accumulator;
+    };
+
+    static void add(Tier&, uint32_t period, uint32_t time, float value);
+
+    Tier& tier(Resolution);
+    const Tier& tier(Resolution) const;
+
+    Capacity _capacity { 0, 0, 0 };
+
+    Ring<Sample> _raw;
+    std::array<Tier, Resolutions - 1> _tiers;
+};
+
+// `raw`, `1m` or `15m`
+StringView name(Resolution);
+
+enum class Format {
+    Json,
+    Binary,
+};
+
+// Produce the serialized history one value at a time, so the whole document never has to be kept in memory.
+// History is passed on every call, since it may be reallocated in the meantime. Values that were added
+// while the output is still in progress may shift the remaining ones; output stops with an error when
+// the capacity is changed instead
+//
+// JSON is `{"now":<time>,"raw":[[time,value],...],"1m":[[time,min,avg,max],...],"15m":[...]}`
+// Currently accumulated period is included as the last aggregate
+//
+// Binary is little-endian. Header is 'S', 'H', version (1), number of blocks (3) and u32 time.
+// Each block is u8 resolution, u32 period and u16 number of values. Raw values are
+// u32 time and f32 value, aggregates are u32 time and f32 min, avg and max
+class Writer {
+public:
+    Writer(Format format, uint32_t now, unsigned char decimals) :
+        _format(format),
+        _now(now),
+        _decimals(decimals)
+    {}
+
+    // Print the next portion of the output. Returns false when there is nothing left
+    bool next(Print&, const History&);
+
+    bool error() const {
+        return _state == State::Error;
+    }
+
+private:
+    enum class State {
+        Header,
+        Begin,
+        Values,
+        Current,
+        Close,
+        End,
+        Done,
+        Error,
+    };
+
+    Format _format;
+    uint32_t _now;
+    unsigned char _decimals;
+
+    State _state { State::Header };
+    Capacity _capacity { 0, 0, 0 };
+
+    Resolution _resolution { Resolution::Raw };
+    size_t _index { 0 };
+    size_t _values { 0 };
+    bool _current { false };
+};
+
+void serialize_json(Print&, const History&, uint32_t now, unsigned char decimals);
+void serialize_binary(Print&, const History&, uint32_t now);
+
+// Values of a single resolution only, `[[time,value],...]` or `[[time,min,avg,max],...]`
+void serialize_json(Print&, const History&, Resolution, unsigned char decimals);
+
+} // namespace history
+} // namespace sensor
+} // namespace espurna
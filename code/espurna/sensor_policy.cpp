@@ -0,0 +1,99 @@
+/*
+
+Part of the SENSOR MODULE
+
+*/
+
+#include "sensor_policy.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace espurna {
+namespace sensor {
+namespace policy {
+namespace {
+
+// Units per minute
+double slope(duration::Milliseconds elapsed, double change) {
+    return (change * 60000.0) / elapsed.count();
+}
+
+} // namespace
+
+Decision State::check(const Policy& policy, duration::Milliseconds now, double value) const {
+    if (!_reported) {
+        return Decision::Report;
+    }
+
+    const auto elapsed = now - _time;
+    if ((policy.min_interval.count() > 0) && (elapsed < policy.min_interval)) {
+        return Decision::Rate;
+    }
+
+    const auto change = value - _value;
+
+    const auto deadband = std::max(
+        policy.deadband_absolute,
+        policy.deadband_relative * std::abs(_value));
+    if ((deadband <= 0.0) || (std::abs(change) >= deadband)) {
+        return Decision::Report;
+    }
+
+    if ((policy.slope_change > 0.0) && _trend && (elapsed.count() > 0)) {
+        if (std::abs(slope(elapsed, change) - _slope) >= policy.slope_change) {
+            return Decision::Slope;
+        }
+    }
+
+    // Heartbeat only forces the value that would have been suppressed otherwise
+    if ((policy.max_silence.count() > 0) && (elapsed >= policy.max_silence)) {
+        return Decision::Silence;
+    }
+
+    return Decision::Deadband;
+}
+
+Decision State::update(const Policy& policy, duration::Milliseconds now, double value) {
+    const auto out = check(policy, now, value);
+
+    switch (out) {
+    case Decision::Report:
+        break;
+    case Decision::Silence:
+        ++_counters.silence;
+        break;
+    case Decision::Slope:
+        ++_counters.slope;
+        break;
+    case Decision::Deadband:
+        ++_counters.deadband;
+        return out;
+    case Decision::Rate:
+        ++_counters.rate;
+        return out;
+    }
+
+    ++_counters.sent;
+
+    const auto elapsed = now - _time;
+    _trend = _reported && (elapsed.count() > 0);
+    if (_trend) {
+        _slope = slope(elapsed, value - _value);
+    }
+
+    _time = now;
+    _value = value;
+    _reported = true;
+
+    return out;
+}
+
+void State::reset() {
+    _reported = false;
+    _trend = false;
+}
+
+} // namespace policy
+} // namespace sensor
+} // namespace espurna
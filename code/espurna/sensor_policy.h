@@ -0,0 +1,94 @@
+/*
+
+Part of the SENSOR MODULE
+
+Per-magnitude report policy. Value that is about to be reported can still be
+suppressed when it did not change enough or when it is reported too often
+
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <cstdint>
+
+#include "types.h"
+
+namespace espurna {
+namespace sensor {
+namespace policy {
+
+// Every option is disabled when set to zero
+struct Policy {
+    double deadband_absolute { 0.0 }; // Suppress value that differs from the last reported one by less than this
+    double deadband_relative { 0.0 }; // Same as above, fraction of the last reported value. Wider one of the two is used
+    duration::Seconds max_silence { 0 }; // Always report when the last report was this long ago, even when inside of the deadband
+    duration::Seconds min_interval { 0 }; // Never report more often than this
+    double slope_change { 0.0 }; // Report value inside of the deadband when trend changed by this much (units per minute)
+};
+
+// Report state does not have to be tracked at all without any of the options above
+inline bool enabled(const Policy& policy) {
+    return (policy.deadband_absolute > 0.0)
+        || (policy.deadband_relative > 0.0)
+        || (policy.max_silence.count() > 0)
+        || (policy.min_interval.count() > 0)
+        || (policy.slope_change > 0.0);
+}
+
+enum class Decision {
+    Report,
+    Silence, // forced by max silence
+    Slope, // forced by slope change
+    Deadband, // suppressed
+    Rate, // suppressed
+};
+
+inline bool report(Decision decision) {
+    return (decision == Decision::Report)
+        || (decision == Decision::Silence)
+        || (decision == Decision::Slope);
+}
+
+struct Counters {
+    uint32_t sent { 0 };
+    uint32_t silence { 0 };
+    uint32_t slope { 0 };
+    uint32_t deadband { 0 };
+    uint32_t rate { 0 };
+
+    uint32_t suppressed() const {
+        return deadband + rate;
+    }
+};
+
+// Last reported value and its trend. Time is a monotonic clock in milliseconds, allowed to overflow
+class State {
+public:
+    Decision check(const Policy&, duration::Milliseconds now, double value) const;
+
+    // Decision is always counted, state is only updated when value is reported
+    Decision update(const Policy&, duration::Milliseconds now, double value);
+
+    // Next value is always reported, counters are preserved
+    void reset();
+
+    const Counters& counters() const {
+        return _counters;
+    }
+
+private:
+    duration::Milliseconds _time{};
+    double _value { 0.0 };
+    double _slope { 0.0 };
+
+    bool _reported { false };
+    bool _trend { false };
+
+    Counters _counters;
+};
+
+} // namespace policy
+} // namespace sensor
+} // namespace espurna
@@ -0,0 +1,71 @@
+/*
+
+Part of the SENSOR MODULE
+
+*/
+
+#include "sensor_schedule.h"
+
+#include <algorithm>
+
+namespace espurna {
+namespace sensor {
+
+void Scheduler::add(size_t id, duration::Milliseconds interval, duration::Milliseconds now) {
+    if (!interval.count() || contains(id)) {
+        return;
+    }
+
+    if (id >= _entries.size()) {
+        _entries.resize(id + 1);
+    }
+
+    _entries[id].interval = interval;
+    _entries[id].stats = ScheduleStats{};
+
+    _heap.push_back(Deadline{now + interval, id});
+    std::push_heap(_heap.begin(), _heap.end(), later);
+}
+
+duration::Milliseconds Scheduler::wait(duration::Milliseconds now) const {
+    if (_heap.empty()) {
+        return duration::Milliseconds::max();
+    }
+
+    const auto left = static_cast<int32_t>(_heap.front().time.count() - now.count());
+    return (left > 0)
+        ? duration::Milliseconds(left)
+        : duration::Milliseconds::zero();
+}
+
+size_t Scheduler::next(duration::Milliseconds now) {
+    if (!due(now)) {
+        return NoId;
+    }
+
+    std::pop_heap(_heap.begin(), _heap.end(), later);
+    auto& deadline = _heap.back();
+    const auto id = deadline.id;
+
+    auto& entry = _entries[id];
+
+    const auto jitter = now - deadline.time;
+    entry.stats.jitter_last = jitter;
+    entry.stats.jitter_max = std::max(entry.stats.jitter_max, jitter);
+    entry.stats.jitter_sum += jitter.count();
+    ++entry.stats.reads;
+
+    // Keep the original cadence, unless we are already late for the next one
+    deadline.time += entry.interval;
+    if (jitter >= entry.interval) {
+        ++entry.stats.overruns;
+        deadline.time = now + entry.interval;
+    }
+
+    std::push_heap(_heap.begin(), _heap.end(), later);
+
+    return id;
+}
+
+} // namespace sensor
+} // namespace espurna
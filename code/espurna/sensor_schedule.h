@@ -0,0 +1,103 @@
+/*
+
+Part of the SENSOR MODULE
+
+Deadline-ordered read schedule. Every sensor is read at its own interval,
+only the one that is due the earliest is returned on each call
+
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "types.h"
+
+namespace espurna {
+namespace sensor {
+
+struct ScheduleStats {
+    uint32_t reads { 0 };
+
+    // Read was late by more than the interval, missed reads are not repeated
+    uint32_t overruns { 0 };
+
+    // How late was the read compared to its deadline
+    duration::Milliseconds jitter_last{};
+    duration::Milliseconds jitter_max{};
+    uint32_t jitter_sum { 0 };
+
+    uint32_t jitter_average() const {
+        return reads ? (jitter_sum / reads) : 0;
+    }
+};
+
+class Scheduler {
+public:
+    static constexpr size_t NoId { std::numeric_limits<size_t>::max() };
+
+    void clear() {
+        _heap.clear();
+        _entries.clear();
+    }
+
+    void reserve(size_t size) {
+        _heap.reserve(size);
+        _entries.reserve(size);
+    }
+
+    // First read of the `id` happens after the `interval`
+    void add(size_t id, duration::Milliseconds interval, duration::Milliseconds now);
+
+    // Earliest `id` that is due and schedule its next read, NoId when nothing is due yet
+    size_t next(duration::Milliseconds now);
+
+    // Time until the earliest read is due
+    duration::Milliseconds wait(duration::Milliseconds now) const;
+
+    bool due(duration::Milliseconds now) const {
+        return !_heap.empty() && (wait(now).count() == 0);
+    }
+
+    bool contains(size_t id) const {
+        return (id < _entries.size()) && _entries[id].interval.count();
+    }
+
+    duration::Milliseconds interval(size_t id) const {
+        return _entries[id].interval;
+    }
+
+    const ScheduleStats& stats(size_t id) const {
+        return _entries[id].stats;
+    }
+
+    size_t size() const {
+        return _heap.size();
+    }
+
+private:
+    struct Deadline {
+        duration::Milliseconds time;
+        size_t id;
+    };
+
+    struct Entry {
+        duration::Milliseconds interval{};
+        ScheduleStats stats;
+    };
+
+    // Time value wraps around, deadlines are compared by their distance instead
+    static bool later(const Deadline& lhs, const Deadline& rhs) {
+        return static_cast<int32_t>(lhs.time.count() - rhs.time.count()) > 0;
+    }
+
+    std::vector<Deadline> _heap;
+    std::vector<Entry> _entries;
+};
+
+} // namespace sensor
+} // namespace espurna
@@ -21,6 +21,7 @@ public:
 
     using TimeSource = espurna::time::CoreClock;
     static constexpr auto MaxTime = TimeSource::duration { EMON_MAX_TIME };
+    static constexpr auto SliceTime = TimeSource::duration { EMON_SLICE_TIME };
 
     static constexpr double IRef { EMON_CURRENT_RATIO };
 
@@ -100,7 +101,25 @@ public:
 
     void pre() override {
         updateCurrent(sampleCurrent());
+        updateEnergy();
+    }
+
+    // Sampling is spread across multiple loop()s, only taking up to SliceTime at once
+    bool start() override {
+        sampleStart();
+        return true;
+    }
+
+    bool poll() override {
+        return sampleSlice(SliceTime);
+    }
 
+    void complete() override {
+        updateCurrent(sampleResult());
+        updateEnergy();
+    }
+
+    void updateEnergy() {
         const auto now = TimeSource::now();
         if (!_initial) {
             using namespace espurna::sensor;
@@ -136,31 +155,54 @@ public:
         return 0.0;
     }
 
+    // Blocking version of the sampling below, takes up to MaxTime
     double sampleCurrent() {
-        int max = 0;
-        int min = _adc_counts;
-        double sum = 0;
+        sampleStart();
+        while (!sampleSlice(MaxTime)) {
+        }
 
-        auto pivot = getPivot();
+        return sampleResult();
+    }
 
+    void sampleStart() {
+        _sampling = Sampling{};
+        _sampling.min = _adc_counts;
+        _sampling.pivot = getPivot();
+    }
+
+    // Returns true when every sample was taken
+    bool sampleSlice(TimeSource::duration slice) {
         const auto time_span = TimeSource::now();
-        for (size_t i = 0; i < _samples; i++) {
-            int sample;
-            double filtered;
 
-            sample = this->analogRead();
-            if (sample > max) max = sample;
-            if (sample < min) min = sample;
+        for (; _sampling.count < _samples; ++_sampling.count) {
+            if (TimeSource::now() - time_span > slice) {
+                break;
+            }
+
+            const int sample = this->analogRead();
+            if (sample > _sampling.max) _sampling.max = sample;
+            if (sample < _sampling.min) _sampling.min = sample;
 
             // Digital low pass filter extracts the VDC offset
-            pivot = (pivot + (sample - pivot) / EMON_FILTER_SPEED);
-            filtered = sample - pivot;
+            _sampling.pivot = (_sampling.pivot + (sample - _sampling.pivot) / EMON_FILTER_SPEED);
+            const double filtered = sample - _sampling.pivot;
 
             // Root-mean-square method
-            sum += (filtered * filtered);
+            _sampling.sum += (filtered * filtered);
         }
 
-        const auto elapsed = TimeSource::now() - time_span;
+        // Only the time spent sampling is counted, not the time between slices
+        _sampling.elapsed += TimeSource::now() - time_span;
+
+        return _sampling.count >= _samples;
+    }
+
+    double sampleResult() {
+        const auto max = _sampling.max;
+        const auto min = _sampling.min;
+        const auto elapsed = _sampling.elapsed;
+
+        auto pivot = _sampling.pivot;
 
         // Quick fix
         if (pivot < min || max < pivot) {
@@ -170,7 +212,7 @@ public:
         setPivot(pivot);
 
         // Calculate current
-        double rms = _samples > 0 ? fs_sqrt(sum / _samples) : 0;
+        double rms = _samples > 0 ? fs_sqrt(_sampling.sum / _samples) : 0;
         double current = _current_factor * rms;
 
         current = (double) (int(current * _multiplier) - 1) / _multiplier;
@@ -214,6 +256,17 @@ public:
     }
 
 private:
+    struct Sampling {
+        int max { 0 };
+        int min { 0 };
+        double sum { 0.0 };
+        double pivot { 0.0 };
+        size_t count { 0 };
+        TimeSource::duration elapsed{};
+    };
+
+    Sampling _sampling;
+
     TimeSource::time_point _last_reading;
     bool _initial { true };
 
@@ -156,6 +156,21 @@ public:
     virtual void pre() {
     }
 
+    // Asynchronous alternative to pre(), for sensors that have to wait for the measurement.
+    // Returns false when nothing was started and pre() should be used instead.
+    virtual bool start() {
+        return false;
+    }
+
+    // Called every loop() after start(), must not block. Returns true when measurement is finished or failed
+    virtual bool poll() {
+        return true;
+    }
+
+    // Called once after poll() returns true, right before values are read (usually to convert raw data)
+    virtual void complete() {
+    }
+
     // Post-read hook (usually to reset things)
     virtual void post() {
     }
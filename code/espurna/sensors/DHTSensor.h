@@ -61,6 +61,12 @@ class DHTSensor : public BaseSensor {
         using TimeSource = espurna::time::CoreClock;
         static constexpr auto MinInterval = espurna::duration::Milliseconds { 2000 };
 
+        // Line is held HIGH for this long after too many consecutive errors
+        static constexpr auto RecoveryTime = espurna::duration::Milliseconds { 250 };
+
+        // DHT11 and DHT12 start signal, line is held LOW for at least this long
+        static constexpr auto StartTime = espurna::duration::Milliseconds { 20 };
+
         ~DHTSensor() {
             gpioUnlock(_gpio);
         }
@@ -122,10 +128,61 @@ class DHTSensor : public BaseSensor {
 
         }
 
-        // Pre-read hook (usually to populate registers with up-to-date data)
-        void pre() override {
+        // Start signal is sent here, but data is only read in poll() when the sensor is ready for it.
+        // Nothing is started when the previous reading is still fresh
+        bool start() override {
             _error = SENSOR_ERROR_OK;
+            _step = Step::Idle;
+
+            if (TimeSource::now() - _last_ok < MinInterval) {
+                if ((_temperature == DummyValue) && (_humidity == DummyValue)) {
+                    _error = SENSOR_ERROR_WARM_UP;
+                }
+                return false;
+            }
+
+            pinMode(_gpio, OUTPUT);
+            _step_start = TimeSource::now();
+
+            if (++_errors > MaxErrors) {
+                _errors = 0;
+                digitalWrite(_gpio, HIGH);
+                _step = Step::Recover;
+                return true;
+            }
+
+            _request();
+            return true;
+        }
+
+        bool poll() override {
+            const auto now = TimeSource::now();
+
+            switch (_step) {
+            case Step::Idle:
+                return true;
+
+            case Step::Recover:
+                if (now - _step_start >= RecoveryTime) {
+                    _step_start = now;
+                    _request();
+                }
+                return false;
+
+            case Step::Request:
+                if (now - _step_start < StartTime) {
+                    return false;
+                }
+                break;
+
+            case Step::Read:
+                break;
+            }
+
+            _step = Step::Idle;
             _read();
+
+            return true;
         }
 
         // Descriptive name of the sensor
@@ -161,19 +218,32 @@ class DHTSensor : public BaseSensor {
         // Protected
         // ---------------------------------------------------------------------
 
-        void _read_critical(Data& dhtData) {
-            digitalWrite(_gpio, LOW);
+        bool _long_start() const {
+            return (_type == DHT_CHIP_DHT11) || (_type == DHT_CHIP_DHT12);
+        }
 
-            if ((_type == DHT_CHIP_DHT11) || (_type == DHT_CHIP_DHT12)) {
-                espurna::time::blockingDelay(
-                    espurna::duration::Milliseconds(20));
-            } else if (_type == DHT_CHIP_SI7021) {
-                espurna::time::critical::delay(
-                    espurna::duration::critical::Microseconds(500));
+        // Longer start signal is not sent with interrupts disabled, poll() waits for it instead
+        void _request() {
+            if (_long_start()) {
+                digitalWrite(_gpio, LOW);
+                _step = Step::Request;
             } else {
-                espurna::time::critical::delay(
-                    espurna::duration::critical::Microseconds(1100));
+                _step = Step::Read;
+            }
+        }
+
+        void _read_critical(Data& dhtData) {
+            if (!_long_start()) {
+                digitalWrite(_gpio, LOW);
+                if (_type == DHT_CHIP_SI7021) {
+                    espurna::time::critical::delay(
+                        espurna::duration::critical::Microseconds(500));
+                } else {
+                    espurna::time::critical::delay(
+                        espurna::duration::critical::Microseconds(1100));
+                }
             }
+
             digitalWrite(_gpio, HIGH);
             espurna::time::critical::delay(
                 espurna::duration::critical::Microseconds(40));
@@ -225,25 +295,6 @@ class DHTSensor : public BaseSensor {
         }
 
         void _read() {
-            if (TimeSource::now() - _last_ok < MinInterval) {
-                if ((_temperature == DummyValue) && (_humidity == DummyValue)) {
-                    _error = SENSOR_ERROR_WARM_UP;
-                } else {
-                    _error = SENSOR_ERROR_OK;
-                }
-                return;
-            }
-
-            pinMode(_gpio, OUTPUT);
-
-            // Send start signal to DHT sensor
-            if (++_errors > MaxErrors) {
-                _errors = 0;
-                digitalWrite(_gpio, HIGH);
-                espurna::time::blockingDelay(
-                    espurna::duration::Milliseconds(250));
-            }
-
             Data dhtData{};
 
             noInterrupts();
@@ -314,6 +365,16 @@ class DHTSensor : public BaseSensor {
         TimeSource::time_point _last_ok;
         size_t _errors = 0;
 
+        enum class Step {
+            Idle,
+            Recover,
+            Request,
+            Read,
+        };
+
+        Step _step = Step::Idle;
+        TimeSource::time_point _step_start;
+
         bool _warmup = false;
         double _temperature = DummyValue;
         double _humidity = 0.0;
@@ -270,6 +270,11 @@ public:
         return _port->read(_channel);
     }
 
+    // Channels share the port and switching between them is slow, sample everything at once
+    bool start() override {
+        return false;
+    }
+
 private:
     static double gainToReference(uint16_t gain) {
         switch (gain) {
@@ -98,19 +98,24 @@ class SHT3XI2CSensor : public I2CSensor<> {
             return MAGNITUDE_NONE;
         }
 
-        // Pre-read hook (usually to populate registers with up-to-date data)
-        void pre() override {
+        // Measurement is started here, result is read after MeasurementTime
+        bool start() override {
             _error = SENSOR_ERROR_OK;
 
-            const auto address = lockedAddress();
-
             // Measurement High Repeatability with Clock Stretch Enabled
-            i2c_write_uint8(address, 0x2C, 0x06);
-            espurna::time::blockingDelay(
-                espurna::duration::Milliseconds(20));
+            i2c_write_uint8(lockedAddress(), 0x2C, 0x06);
+            _measurement_start = TimeSource::now();
+
+            return true;
+        }
 
+        bool poll() override {
+            return TimeSource::now() - _measurement_start >= MeasurementTime;
+        }
+
+        void complete() override {
             unsigned char buffer[6];
-            i2c_read_buffer(address, buffer, std::size(buffer));
+            i2c_read_buffer(lockedAddress(), buffer, std::size(buffer));
 
             // result bytes are as follows
             // cTemp msb, cTemp lsb, cTemp crc, humidity msb, humidity lsb, humidity crc
@@ -135,6 +140,11 @@ class SHT3XI2CSensor : public I2CSensor<> {
 
     private:
 
+        using TimeSource = espurna::time::CoreClock;
+        static constexpr auto MeasurementTime = espurna::duration::Milliseconds { 20 };
+
+        TimeSource::time_point _measurement_start;
+
         // Read the status register and output to Debug log
         void _statusRegister() {
             const auto address = lockedAddress();
@@ -74,29 +74,38 @@ class SI7021Sensor : public I2CSensor<> {
             return MAGNITUDE_NONE;
         }
 
-        // Pre-read hook (usually to populate registers with up-to-date data)
-        void pre() override {
-
+        // Temperature and humidity are measured one after another, each taking up to MeasurementTime
+        bool start() override {
             _error = SENSOR_ERROR_UNKNOWN_ID;
             if (_chip == 0) {
-                return;
+                return false;
             }
 
             _error = SENSOR_ERROR_OK;
+            _request(Step::Temperature, SI7021_CMD_TMP_NOHOLD);
 
-            double value;
+            return true;
+        }
 
-            const auto address = lockedAddress();
+        bool poll() override {
+            if (TimeSource::now() - _measurement_start < MeasurementTime) {
+                return false;
+            }
 
-            value = _read(address, SI7021_CMD_TMP_NOHOLD);
-            if (_error != SENSOR_ERROR_OK) return;
-            _temperature = (175.72 * value / 65536) - 46.85;
+            const auto value = _read(lockedAddress());
 
-            value = _read(address, SI7021_CMD_HUM_NOHOLD);
-            if (_error != SENSOR_ERROR_OK) return;
-            value = (125.0 * value / 65536) - 6;
-            _humidity = std::clamp(value, 0.0, 100.0);
+            switch (_step) {
+            case Step::Temperature:
+                _temperature = (175.72 * value / 65536) - 46.85;
+                _request(Step::Humidity, SI7021_CMD_HUM_NOHOLD);
+                return false;
 
+            case Step::Humidity:
+                _humidity = std::clamp((125.0 * value / 65536) - 6, 0.0, 100.0);
+                break;
+            }
+
+            return true;
         }
 
         // Current value for slot # index
@@ -135,28 +144,30 @@ class SI7021Sensor : public I2CSensor<> {
 
         }
 
-        unsigned int _read(uint8_t address, uint8_t command) {
-
-            // Request measurement
-            i2c_write_uint8(address, command);
+        enum class Step {
+            Temperature,
+            Humidity,
+        };
 
-            // When not using clock stretching (*_NOHOLD commands) delay here
-            // is needed to wait for the measurement.
-            // According to datasheet the max. conversion time is ~22ms
-            espurna::time::blockingDelay(
-                espurna::duration::Milliseconds(50));
+        void _request(Step step, uint8_t command) {
+            i2c_write_uint8(lockedAddress(), command);
+            _measurement_start = TimeSource::now();
+            _step = step;
+        }
 
+        unsigned int _read(uint8_t address) {
             // Clear the last to bits of LSB to 00.
             // According to datasheet LSB of RH is always xxxxxx10
-            unsigned int value = i2c_read_uint16(address) & 0xFFFC;
-
-            // We should be checking there are no pending bytes in the buffer
-            // and raise a CRC error if there are
-            _error = SENSOR_ERROR_OK;
+            return i2c_read_uint16(address) & 0xFFFC;
+        }
 
-            return value;
+        // When not using clock stretching (*_NOHOLD commands) we need to wait for the measurement.
+        // According to datasheet the max. conversion time is ~22ms
+        using TimeSource = espurna::time::CoreClock;
+        static constexpr auto MeasurementTime = espurna::duration::Milliseconds { 50 };
 
-        }
+        TimeSource::time_point _measurement_start;
+        Step _step { Step::Temperature };
 
         unsigned char _chip;
         double _temperature = 0;
@@ -11,6 +11,7 @@ Copyright (C) 2016-2019 by Xose Pérez <xose dot perez at gmail dot com>
 #include "crash.h"
 #include "terminal.h"
 #include "storage_eeprom.h"
+#include "api.h"
 
 #include <algorithm>
 #include <vector>
@@ -22,6 +23,15 @@ Copyright (C) 2016-2019 by Xose Pérez <xose dot perez at gmail dot com>
 
 namespace espurna {
 namespace settings {
+namespace build {
+
+// Number of key-values visited by the gc on every loop()
+constexpr size_t gcSlice() {
+    return SETTINGS_GC_SLICE;
+}
+
+} // namespace build
+
 namespace {
 
 // Depending on features enabled, we may end up with different left boundary
@@ -37,6 +47,23 @@ static kvs_type kv_store(
     EepromSize
 );
 
+#if SETTINGS_INDEX_SUPPORT
+// Rebuilt on demand, right after storage modification.
+// Positions are parsed directly from the storage, so the index **must** be invalidated
+// any time kv_store contents change (and not just keys, since values also shift the data)
+static embedis::KeyValueIndex kv_index;
+#endif
+
+// Any kv_store modification invalidates existing positions
+uint32_t kv_generation { 0 };
+
+void modified() {
+    ++kv_generation;
+#if SETTINGS_INDEX_SUPPORT
+    kv_index.invalidate();
+#endif
+}
+
 } // namespace
 
 namespace query {
@@ -166,19 +193,42 @@ bool EnumerationNumericHelper::check(const String& value) {
 } // namespace options
 
 ValueResult get(const String& key) {
+#if SETTINGS_INDEX_SUPPORT
+    const auto kv = kv_index.find(kv_store, key);
+    if (kv) {
+        return ValueResult(kv.value.read());
+    }
+
+    return ValueResult();
+#else
     return kv_store.get(key);
+#endif
 }
 
 bool set(const String& key, const String& value) {
-    return kv_store.set(key, value);
+    const auto result = kv_store.set(key, value);
+    if (result) {
+        modified();
+    }
+
+    return result;
 }
 
 bool del(const String& key) {
-    return kv_store.del(key);
+    const auto result = kv_store.del(key);
+    if (result) {
+        modified();
+    }
+
+    return result;
 }
 
 bool has(const String& key) {
+#if SETTINGS_INDEX_SUPPORT
+    return static_cast<bool>(kv_index.find(kv_store, key));
+#else
     return kv_store.has(key);
+#endif
 }
 
 Keys keys() {
@@ -198,6 +248,325 @@ size_t size() {
     return kv_store.size();
 }
 
+size_t moved() {
+    return kv_store.moved();
+}
+
+Transaction::~Transaction() {
+    commit();
+}
+
+kvs_type::Change& Transaction::change(String&& key) {
+    for (auto& change : _changes) {
+        if (change.key == key) {
+            return change;
+        }
+    }
+
+    _changes.push_back(kvs_type::Change{
+        .key = std::move(key),
+        .value = String(),
+        .erase = false,
+    });
+
+    return _changes.back();
+}
+
+void Transaction::set(String key, String value) {
+    auto& change = this->change(std::move(key));
+    change.value = std::move(value);
+    change.erase = false;
+}
+
+void Transaction::del(String key) {
+    auto& change = this->change(std::move(key));
+    change.value = String();
+    change.erase = true;
+}
+
+bool Transaction::commit() {
+    if (_changes.empty()) {
+        return true;
+    }
+
+    const auto total = _changes.size();
+    const auto moved = kv_store.moved();
+
+    const auto result = kv_store.apply(_changes);
+    if (result && _changes.size()) {
+        modified();
+    }
+
+    DEBUG_MSG_P(PSTR("[SETTINGS] Transaction with %u change(s) %s, %u modified, %u bytes moved\n"),
+        total, result ? PSTR("applied") : PSTR("failed"),
+        _changes.size(), kv_store.moved() - moved);
+
+    _changes.clear();
+
+    return result;
+}
+
+bool Transaction::replace() {
+    if (!kv_store.fits(_changes)) {
+        DEBUG_MSG_P(PSTR("[SETTINGS] Transaction with %u change(s) does not fit\n"),
+            _changes.size());
+        _changes.clear();
+        return false;
+    }
+
+    resetSettings();
+    return commit();
+}
+
+namespace snapshot {
+
+bool Backup::next(String& out) {
+    switch (_state) {
+    case State::Header: {
+        const auto app = buildApp();
+        if (_format == Format::Json) {
+            out += F("{\n\"app\": ");
+            json_string(out, app.name.toString());
+            out += F(",\n\"version\": ");
+            json_string(out, app.version.toString());
+            out += F(",\n\"backup\": \"1\"");
+        } else {
+            _encoder.header(out);
+            _encoder.record(out, F("app"), app.name.toString());
+            _encoder.record(out, F("version"), app.version.toString());
+        }
+
+        _generation = kv_generation;
+        _position = kv_store.end();
+        _state = State::Records;
+        return true;
+    }
+
+    case State::Records:
+        if (_generation != kv_generation) {
+            DEBUG_MSG_P(PSTR("[SETTINGS] Storage modified while backup was in progress\n"));
+            _state = State::Error;
+            return false;
+        }
+
+        _position = kv_store.foreach(_position, 1,
+            [&](kvs_type::KeyValueResult&& kv) {
+                const auto key = kv.key.read();
+                const auto value = kv.value.read();
+
+                if (_format == Format::Json) {
+                    out += F(",\n");
+                    json_string(out, key);
+                    out += F(": ");
+                    json_string(out, value);
+                } else {
+                    _encoder.record(out, key, value);
+                }
+            });
+
+        if (!_position) {
+            _state = State::End;
+        }
+        return true;
+
+    case State::End:
+        if (_format == Format::Json) {
+            out += F("\n}");
+        } else {
+            _encoder.end(out);
+        }
+
+        _state = State::Done;
+        return true;
+
+    case State::Done:
+    case State::Error:
+        break;
+    }
+
+    return false;
+}
+
+Restore::Restore() :
+    _decoder(kv_store.size())
+{}
+
+bool Restore::feed(const uint8_t* data, size_t size) {
+    _decoder.feed(data, size,
+        [&](String&& key, String&& value) {
+            // Note: we try to match what /config generates, 'app' is always the first key
+            if (!_app) {
+                _app = (key == F("app")) && (value == buildApp().name.toString());
+                if (!_app) {
+                    DEBUG_MSG_P(PSTR("[SETTINGS] Invalid 'app' key\n"));
+                }
+
+                return _app;
+            }
+
+            if (key == F("version")) {
+                return true;
+            }
+
+            _staged += embedis::estimate(key, value);
+            if (_staged > kv_store.size()) {
+                DEBUG_MSG_P(PSTR("[SETTINGS] Not enough space to restore settings\n"));
+                return false;
+            }
+
+            _transaction.set(std::move(key), std::move(value));
+            return true;
+        });
+
+    if (_decoder.error()) {
+        _transaction.rollback();
+        return false;
+    }
+
+    return true;
+}
+
+bool Restore::finish() {
+    if (!_decoder.done()) {
+        DEBUG_MSG_P(PSTR("[SETTINGS] Incomplete or corrupted backup\n"));
+        _transaction.rollback();
+        return false;
+    }
+
+    // Same as the .json backup, replaces everything that is currently stored
+    if (!_transaction.replace()) {
+        DEBUG_MSG_P(PSTR("[SETTINGS] Not enough space to restore settings\n"));
+        return false;
+    }
+
+    saveSettings();
+
+    DEBUG_MSG_P(PSTR("[SETTINGS] Settings restored successfully\n"));
+    return true;
+}
+
+} // namespace snapshot
+
+Stats stats() {
+    Stats out{};
+
+    kv_store.foreach([&](kvs_type::KeyValueResult&& kv) {
+        ++out.keys;
+        out.key_bytes += kv.key.length();
+        out.value_bytes += kv.value.length();
+    });
+
+    out.size = kv_store.size();
+    out.used = out.key_bytes + out.value_bytes + (4 * out.keys);
+    out.available = out.size - out.used;
+    out.moved = kv_store.moved();
+    out.commits = eepromCommitCount();
+    out.commit = eepromCommitDuration();
+
+    return out;
+}
+
+namespace gc {
+namespace {
+
+// Broken keys are usually a result of a partially written or corrupted storage
+// (or of some very old firmware version that wrote things differently)
+bool broken(const kvs_type::ReadResult& key) {
+    bool out = false;
+    key.visit([&](const uint8_t* data, uint16_t, uint16_t size) {
+        for (auto it = data; it != data + size; ++it) {
+            if ((*it == '\0') || !isascii(*it)) {
+                out = true;
+                return false;
+            }
+        }
+
+        return true;
+    });
+
+    return out;
+}
+
+struct State {
+    std::vector<String> broken;
+    uint16_t position { 0 };
+    uint32_t generation { 0 };
+    size_t scanned { 0 };
+    bool active { false };
+};
+
+State state;
+
+void restart() {
+    state.broken.clear();
+    state.position = kv_store.end();
+    state.generation = kv_generation;
+    state.scanned = 0;
+}
+
+} // namespace
+
+bool active() {
+    return state.active;
+}
+
+bool start() {
+    if (state.active) {
+        return false;
+    }
+
+    restart();
+    state.active = true;
+
+    return true;
+}
+
+// Only go through a small number of kvs at a time, so nothing else is blocked for too long.
+// Scan starts from scratch when storage changes in the meantime, since positions are no longer valid
+void loop() {
+    if (!state.active) {
+        return;
+    }
+
+    if (state.generation != kv_generation) {
+        restart();
+    }
+
+    state.position = kv_store.foreach(state.position, build::gcSlice(),
+        [&](kvs_type::KeyValueResult&& kv) {
+            ++state.scanned;
+            if (broken(kv.key)) {
+                state.broken.push_back(kv.key.read());
+            }
+        });
+
+    if (state.position) {
+        return;
+    }
+
+    Transaction transaction;
+    for (auto& key : state.broken) {
+        transaction.del(std::move(key));
+    }
+
+    transaction.commit();
+
+    DEBUG_MSG_P(PSTR("[SETTINGS] GC finished, scanned %u keys and removed %u broken keys\n"),
+        state.scanned, state.broken.size());
+
+    state.broken.clear();
+    state.broken.shrink_to_fit();
+    state.active = false;
+}
+
+} // namespace gc
+
+#if SETTINGS_INDEX_SUPPORT
+embedis::KeyValueIndex::Stats index_stats() {
+    return kv_index.stats();
+}
+#endif
+
 void foreach(KeyValueResultCallback&& callback) {
     kv_store.foreach(callback);
 }
@@ -226,6 +595,44 @@ std::vector<String> sorted_keys() {
     return values;
 }
 
+#if API_SUPPORT
+namespace api {
+namespace {
+
+bool get(ApiRequest&, JsonObject& root) {
+    const auto stats = settings::stats();
+
+    root[F("keys")] = stats.keys;
+    root[F("size")] = stats.size;
+    root[F("used")] = stats.used;
+    root[F("available")] = stats.available;
+    root[F("keyBytes")] = stats.key_bytes;
+    root[F("valueBytes")] = stats.value_bytes;
+    root[F("moved")] = stats.moved;
+    root[F("commits")] = stats.commits;
+    root[F("commitTime")] = stats.commit.count();
+    root[F("gc")] = gc::active();
+
+    const auto wear = eepromWear();
+    root[F("commitRequests")] = wear.requests;
+    root[F("commitsDeferred")] = wear.deferred;
+
+    JsonArray& erases = root.createNestedArray(F("erases"));
+    for (auto& value : wear.erases) {
+        erases.add(value);
+    }
+
+    return true;
+}
+
+void setup() {
+    apiRegister(F("storage"), get, nullptr);
+}
+
+} // namespace
+} // namespace api
+#endif
+
 #if TERMINAL_SUPPORT
 namespace terminal {
 namespace {
@@ -279,6 +686,8 @@ void keys(::terminal::CommandContext&& ctx) {
         ctx.output.printf_P(PSTR("Number of keys: %u\n"), keys.size());
         ctx.output.printf_P(PSTR("Available: %u bytes (%u%%)\n"),
                 available, (100 * available) / size);
+        ctx.output.printf_P(PSTR("Moved: %u bytes since boot\n"),
+                settings::moved());
     }
 
     terminalOK(ctx);
@@ -287,46 +696,35 @@ void keys(::terminal::CommandContext&& ctx) {
 PROGMEM_STRING(Gc, "GC");
 
 void gc(::terminal::CommandContext&& ctx) {
-    struct KeyRef {
-        String key;
-        size_t length;
-    };
-
-    using KeyRefs = std::vector<KeyRef>;
-    KeyRefs refs;
+    if (!settings::gc::start()) {
+        terminalError(ctx, F("gc is already running"));
+        return;
+    }
 
-    kv_store.foreach([&](kvs_type::KeyValueResult&& result) {
-        refs.push_back(
-            KeyRef{
-                .key = result.key.read(),
-                .length = result.key.length(),
-            });
-    });
+    ctx.output.print(F("gc started, see debug log for results\n"));
+    terminalOK(ctx);
+}
 
-    auto is_ascii = [](const String& value) -> bool {
-        for (const auto& c : value) {
-            if (!isascii(c)) {
-                return false;
-            }
-        }
+void stats_impl(Print& out) {
+    const auto stats = settings::stats();
 
-        return true;
-    };
+    out.printf_P(PSTR("keys: %u, size: %u bytes, used: %u bytes, available: %u bytes\n"),
+        stats.keys, stats.size, stats.used, stats.available);
 
-    std::vector<const String*> broken;
-    for (const auto& ref : refs) {
-        if ((ref.length != ref.key.length()) || !is_ascii(ref.key)) {
-            broken.push_back(&ref.key);
-        }
+    if (stats.keys) {
+        out.printf_P(PSTR("average key: %u bytes, average value: %u bytes\n"),
+            stats.key_bytes / stats.keys, stats.value_bytes / stats.keys);
     }
 
-    size_t count = 0;
-    for (const auto& key : broken) {
-        settings::del(*key);
-        ++count;
-    }
+    out.printf_P(PSTR("moved since boot: %u bytes\n"), stats.moved);
+    out.printf_P(PSTR("commits: %u, last commit took %lu us\n"),
+        stats.commits, static_cast<unsigned long>(stats.commit.count()));
+}
+
+PROGMEM_STRING(Stats, "SETTINGS.STATS");
 
-    ctx.output.printf_P("deleted %zu keys\n", count);
+void stats(::terminal::CommandContext&& ctx) {
+    stats_impl(ctx.output);
     terminalOK(ctx);
 }
 
@@ -374,6 +772,7 @@ void get(::terminal::CommandContext&& ctx) {
         return;
     }
 
+    // Not using views, since any number of keys can be requested at once
     for (auto it = (ctx.argv.cbegin() + 1); it != ctx.argv.cend(); ++it) {
         auto result = settings::get(*it);
         if (!result) {
@@ -420,6 +819,7 @@ static constexpr ::terminal::Command List[] PROGMEM {
     {Config, commands::config},
     {Keys, commands::keys},
     {Gc, commands::gc},
+    {Stats, commands::stats},
 
     {Del, commands::del},
     {Set, commands::set},
@@ -467,10 +867,11 @@ espurna::settings::query::Result settingsQuery(espurna::StringView key) {
 }
 
 void moveSetting(const String& from, const String& to) {
-    const auto result = espurna::settings::get(from);
+    auto result = espurna::settings::get(from);
     if (result) {
-        setSetting(to, result.ref());
-        delSetting(from);
+        espurna::settings::Transaction transaction;
+        transaction.set(to, std::move(result).get());
+        transaction.del(from);
     }
 }
 
@@ -485,27 +886,30 @@ void moveSetting(const String& from, const String& to, size_t index) {
         .to = {to, index}
     };
 
-    const auto result = espurna::settings::get(keys.from.value());
+    auto result = espurna::settings::get(keys.from.value());
     if (result) {
-        setSetting(keys.to, result.ref());
-        delSetting(keys.from);
+        espurna::settings::Transaction transaction;
+        transaction.set(keys.to.value(), std::move(result).get());
+        transaction.del(keys.from.value());
     }
 }
 
 void moveSettings(const String& from, const String& to) {
+    espurna::settings::Transaction transaction;
+
     for (size_t index = 0; index < 100; ++index) {
-        const auto keys = SettingsKeyPair{
+        auto keys = SettingsKeyPair{
             .from = {from, index},
             .to = {to, index},
         };
 
-        const auto result = espurna::settings::get(keys.from.value());
+        auto result = espurna::settings::get(keys.from.value());
         if (!result) {
             break;
         }
 
-        setSetting(keys.to, result.ref());
-        delSetting(keys.from);
+        transaction.set(String(std::move(keys.to)), std::move(result).get());
+        transaction.del(String(std::move(keys.from)));
     }
 }
 
@@ -641,6 +1045,7 @@ void autosaveSettings() {
 
 void resetSettings() {
     eepromClear();
+    espurna::settings::modified();
 }
 
 // -----------------------------------------------------------------------------
@@ -663,11 +1068,10 @@ bool settingsRestoreJson(JsonObject& data) {
     }
 
     // .../config will add this key, but it is optional
-    if (data[F("backup")].as<bool>()) {
-        resetSettings();
-    }
+    const bool backup = data[F("backup")].as<bool>();
 
     // These three are just metadata, no need to actually store them
+    espurna::settings::Transaction transaction;
     for (auto element : data) {
         auto key = String(element.key);
         if (key.startsWith(F("app"))
@@ -677,7 +1081,16 @@ bool settingsRestoreJson(JsonObject& data) {
             continue;
         }
 
-        setSetting(std::move(key), String(element.value.as<String>()));
+        transaction.set(std::move(key), element.value.as<String>());
+    }
+
+    // Existing settings are only removed when everything is known to fit
+    const auto result = backup
+        ? transaction.replace()
+        : transaction.commit();
+    if (!result) {
+        DEBUG_MSG_P(PSTR("[SETTINGS] Not enough space to restore settings\n"));
+        return false;
     }
 
     saveSettings();
@@ -741,4 +1154,8 @@ void settingsSetup() {
 #if TERMINAL_SUPPORT
     espurna::settings::terminal::setup();
 #endif
+#if API_SUPPORT
+    espurna::settings::api::setup();
+#endif
+    espurnaRegisterLoop(espurna::settings::gc::loop);
 }
@@ -23,6 +23,8 @@ Copyright (C) 2020-2021 by Maxim Prokhorov <prokhorov dot max at outlook dot com
 #include "settings_convert.h"
 #include "settings_helpers.h"
 #include "settings_embedis.h"
+#include "settings_snapshot.h"
+#include "settings_index.h"
 #include "terminal.h"
 
 // --------------------------------------------------------------------------
@@ -34,20 +36,24 @@ void autosaveSettings();
 namespace espurna {
 namespace settings {
 
-// TODO: multi-byte access
-// {blob} read(size_t)
-// void write(size_t, {blob})
-
 class EepromStorage {
 public:
     uint8_t read(size_t pos) const {
         return eepromRead(pos);
     }
 
+    void read(uint16_t begin, uint16_t end, uint8_t* out) const {
+        eepromRead(begin, out, end - begin);
+    }
+
     void write(size_t pos, uint8_t value) const {
         eepromWrite(pos, value);
     }
 
+    void write(uint16_t begin, const uint8_t* input_begin, const uint8_t* input_end) const {
+        eepromWrite(begin, input_begin, input_end);
+    }
+
     void commit() const {
         autosaveSettings();
     }
@@ -82,6 +88,132 @@ Keys keys();
 
 size_t available();
 size_t size();
+size_t moved();
+
+struct Stats {
+    size_t keys;
+    size_t size;
+    size_t used;
+    size_t available;
+    size_t key_bytes;
+    size_t value_bytes;
+    size_t moved;
+    uint32_t commits;
+    duration::Microseconds commit;
+};
+
+// Walks the whole storage, not meant to be called too often
+Stats stats();
+
+namespace gc {
+
+// Incrementally look for the broken keys and remove them all at once,
+// when the whole storage has been scanned (see `settingsSetup()` loop)
+bool start();
+bool active();
+
+} // namespace gc
+
+#if SETTINGS_INDEX_SUPPORT
+embedis::KeyValueIndex::Stats index_stats();
+#endif
+
+// Stage multiple set and delete operations in RAM, and apply them to the storage at once
+// (see `kvs_type::apply()`, which only shifts the existing data once and commits once)
+// Every key is staged only once, the last operation replaces the previous one
+class Transaction {
+public:
+    Transaction() = default;
+    ~Transaction();
+
+    Transaction(const Transaction&) = delete;
+    Transaction& operator=(const Transaction&) = delete;
+
+    void set(String key, String value);
+    void del(String key);
+
+    size_t size() const {
+        return _changes.size();
+    }
+
+    // When not explicitly called, changes are applied when the object is destroyed
+    bool commit();
+
+    // Same as commit(), but everything else that is currently stored is removed.
+    // Nothing is removed when staged changes would not fit into the empty storage
+    bool replace();
+
+    // Drop everything staged so far, nothing is applied
+    void rollback() {
+        _changes.clear();
+    }
+
+private:
+    kvs_type::Change& change(String&& key);
+
+    kvs_type::Changes _changes;
+};
+
+namespace snapshot {
+
+enum class Format {
+    Json,
+    Binary,
+};
+
+// Produce the backup one key-value at a time, so the whole document never has to be kept in memory.
+// Since positions are only valid until the next storage modification, backup stops with an error
+// when any setting is changed while it is still in progress
+class Backup {
+public:
+    explicit Backup(Format format) :
+        _format(format)
+    {}
+
+    // Append the next portion of the backup to the output. Returns false when there is nothing left
+    bool next(String& out);
+
+    bool error() const {
+        return _state == State::Error;
+    }
+
+private:
+    enum class State {
+        Header,
+        Records,
+        End,
+        Done,
+        Error,
+    };
+
+    Format _format;
+    Encoder _encoder;
+    State _state { State::Header };
+    uint32_t _generation { 0 };
+    uint16_t _position { 0 };
+};
+
+// Streaming restore of the binary backup. Records are staged in a Transaction and only applied after
+// the CRC is verified. Staged size is limited by the storage size, so the heap usage is bounded as well
+class Restore {
+public:
+    Restore();
+
+    bool feed(const uint8_t* data, size_t size);
+    bool finish();
+
+    ~Restore() {
+        _transaction.rollback();
+    }
+
+private:
+    Decoder _decoder;
+    Transaction _transaction;
+    size_t _staged { 0 };
+    bool _app { false };
+};
+
+} // namespace snapshot
 
 using KeyValueResultCallback = std::function<void(settings::kvs_type::KeyValueResult&&)>;
 void foreach(KeyValueResultCallback&&);
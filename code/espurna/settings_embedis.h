@@ -14,6 +14,7 @@ Reimplementation of the Embedis storage format:
 #include <Arduino.h>
 
 #include <algorithm>
+#include <cstring>
 #include <memory>
 #include <vector>
 
@@ -43,9 +44,13 @@ class KeyValueStore {
 private:
 
     // -----------------------------------------------------------------------------------
-    // TODO: storage access is one byte at a time. consider also having:
-    // - read(begin, end)
-    // - write(begin, end, input_begin, input_end)
+    // Required storage methods are one byte at a time:
+    // - read(index)
+    // - write(index, byte)
+    // - commit()
+    // Optional block-oriented methods allow to skip the per-byte access:
+    // - read(begin, end, output)
+    // - write(begin, input_begin, input_end)
     // -----------------------------------------------------------------------------------
 
     template <typename T>
@@ -71,14 +76,62 @@ private:
         "Storage class must implement read(index), write(index, byte) and commit()"
     );
 
+    template <typename T>
+    using storage_can_read_block_t = decltype(std::declval<T>().read(
+        std::declval<uint16_t>(), std::declval<uint16_t>(), std::declval<uint8_t*>()));
+    template <typename T>
+    using storage_can_read_block = is_detected<storage_can_read_block_t, T>;
+
+    template <typename T>
+    using storage_can_write_block_t = decltype(std::declval<T>().write(
+        std::declval<uint16_t>(), std::declval<const uint8_t*>(), std::declval<const uint8_t*>()));
+    template <typename T>
+    using storage_can_write_block = is_detected<storage_can_write_block_t, T>;
+
+    // Both block read and block write use an intermediate stack buffer of this size
+    // (when comparing keys or moving data around)
+    static constexpr uint16_t BlockSize { 32 };
+
+    // Dispatch block access to the storage, or fall back to byte-wise access otherwise
+    static void _storage_read(std::true_type, RawStorageBase& storage, uint16_t begin, uint16_t end, uint8_t* out) {
+        storage.read(begin, end, out);
+    }
+
+    static void _storage_read(std::false_type, RawStorageBase& storage, uint16_t begin, uint16_t end, uint8_t* out) {
+        for (auto index = begin; index != end; ++index) {
+            *(out++) = storage.read(index);
+        }
+    }
+
+    static void _storage_read(RawStorageBase& storage, uint16_t begin, uint16_t end, uint8_t* out) {
+        _storage_read(storage_can_read_block<RawStorageBase>{}, storage, begin, end, out);
+    }
+
+    static void _storage_write(std::true_type, RawStorageBase& storage, uint16_t begin, const uint8_t* input_begin, const uint8_t* input_end) {
+        storage.write(begin, input_begin, input_end);
+    }
+
+    static void _storage_write(std::false_type, RawStorageBase& storage, uint16_t begin, const uint8_t* input_begin, const uint8_t* input_end) {
+        for (auto it = input_begin; it != input_end; ++it) {
+            storage.write(begin++, *it);
+        }
+    }
+
+    static void _storage_write(RawStorageBase& storage, uint16_t begin, const uint8_t* input_begin, const uint8_t* input_end) {
+        _storage_write(storage_can_write_block<RawStorageBase>{}, storage, begin, input_begin, input_end);
+    }
+
+    static void _storage_write(RawStorageBase& storage, uint16_t begin, const String& value) {
+        const auto* ptr = reinterpret_cast<const uint8_t*>(value.c_str());
+        _storage_write(storage, begin, ptr, ptr + value.length());
+    }
+
     // -----------------------------------------------------------------------------------
 
     // Tracking state of the parser inside of _raw_read()
     enum class State {
         Begin,
         End,
-        LenByte1,
-        LenByte2,
         Value,
         Output
     };
@@ -203,6 +256,10 @@ private:
             return _end;
         }
 
+        RawStorageBase& storage() const {
+            return _storage;
+        }
+
     private:
         RawStorageBase& _storage;
         uint16_t _begin;
@@ -265,13 +322,46 @@ public:
             }
 
             out.reserve(len);
-            for (auto cursor = _cursor; cursor.offset() < len; ++cursor) {
-                out += static_cast<char>(cursor.read());
-            }
+            visit([&](const uint8_t* data, uint16_t, uint16_t size) {
+                out.concat(reinterpret_cast<const char*>(data), size);
+                return true;
+            });
 
             return out;
         }
 
+        // Same as `read() == other`, but without allocating the intermediate string
+        bool equals(const String& other) const {
+            if (length() != other.length()) {
+                return false;
+            }
+
+            const auto* ptr = reinterpret_cast<const uint8_t*>(other.c_str());
+            return visit([&](const uint8_t* data, uint16_t offset, uint16_t size) {
+                return std::memcmp(data, ptr + offset, size) == 0;
+            });
+        }
+
+        // Sequentially read stored data in small chunks, without allocating the intermediate string
+        // Callback receives (data, offset, size) and returns `false` to stop reading
+        template <typename T>
+        bool visit(T&& callback) const {
+            const auto len = length();
+
+            uint8_t buffer[BlockSize];
+            for (uint16_t offset = 0; offset < len;) {
+                const auto chunk = std::min<uint16_t>(len - offset, BlockSize);
+                const auto begin = _cursor.begin() + offset;
+                _storage_read(_cursor.storage(), begin, begin + chunk, &buffer[0]);
+                if (!callback(&buffer[0], offset, chunk)) {
+                    return false;
+                }
+                offset += chunk;
+            }
+
+            return true;
+        }
+
     private:
         Cursor _cursor;
         bool _result { false };
@@ -336,6 +426,49 @@ public:
         } while (_state != State::End);
     }
 
+    // Read key-value pair that ends at the specified position, e.g. `kv.key.end()` from the previous foreach() call
+    // XXX: be cautious that positions **will** break when underlying storage changes
+    KeyValueResult read_kv(uint16_t position) {
+        if ((position <= _cursor.begin()) || (position > _cursor.end())) {
+            return KeyValueResult { _storage };
+        }
+
+        _cursor_set_position(position);
+        return _read_kv();
+    }
+
+    // Initial position for the foreach() below. kvs are written right-to-left, so this is where the first one is
+    uint16_t end() const {
+        return _cursor.end();
+    }
+
+    // Same as foreach(), but resumes at the position returned by the previous call (or end() for the first one)
+    // and stops after 'limit' kvs. Returns the position where the next kv is expected, or 0 when there is nothing left.
+    // XXX: be cautious that positions **will** break when underlying storage changes
+    template <typename CallbackType>
+    uint16_t foreach(uint16_t position, size_t limit, CallbackType callback) {
+        if ((position <= _cursor.begin()) || (position > _cursor.end())) {
+            return 0;
+        }
+
+        _cursor_set_position(position);
+        while (limit--) {
+            auto kv = _read_kv();
+            if (!kv) {
+                return 0;
+            }
+
+            position = kv.value.begin();
+            callback(std::move(kv));
+
+            if (_state == State::End) {
+                return 0;
+            }
+        }
+
+        return position;
+    }
+
     // set or update key with value contents. ensure 'key' isn't empty, 'value' can be empty
     bool set(const String& key, const String& value) {
 
@@ -345,9 +478,6 @@ public:
             return false;
         }
 
-        auto key_len = key.length();
-        auto value_len = value.length();
-
         Cursor to_erase(_storage, 0, 0);
         bool need_erase = false;
 
@@ -363,10 +493,10 @@ public:
             start_pos = kv.value.begin();
 
             // in the very special case we can match the existing key, we either
-            if ((kv.key.length() == key_len) && (kv.key.read() == key)) {
+            if (kv.key.equals(key)) {
                 if (kv.value.length() == value.length()) {
                     // - do nothing, as the value is already set
-                    if (kv.value.read() == value) {
+                    if (kv.value.equals(value)) {
                         return true;
                     }
                     // - overwrite the space again, with the new kv of the same length
@@ -390,40 +520,172 @@ public:
 
         // we should only insert when possition is still within possible size
         if (start_pos && (start_pos >= need)) {
-            auto writer = Cursor::fromEnd(_storage, start_pos - need, start_pos);
+            const uint16_t begin = start_pos - need;
+            _write_kv(begin, key, value);
+
+            // we also need to add an empty key *after* the value
+            // but, only when we still have some space left
+            if (begin >= 2) {
+                _write_padding(begin);
+            }
 
-            // put the length of the value as 2 bytes and then write the data
-            (--writer).write(key_len & 0xff);
-            (--writer).write((key_len >> 8) & 0xff);
-            while (key_len--) {
-                (--writer).write(key[key_len]);
+            _storage.commit();
+
+            return true;
+        }
+
+        return false;
+    }
+
+    // Batched modification of multiple keys at once. Unlike separate set() and del() calls
+    // - kvs that are removed or replaced are dropped and the rest of the data is moved to the right in a single pass
+    // - new and updated kvs are placed after the last one
+    // - storage commit() happens only once
+    // Keys are expected to be unique. Nothing is modified when the resulting data would not fit, or when any key is empty.
+    // Changes that would not modify anything (same value, or erasing missing key) are removed from the list
+    struct Change {
+        String key;
+        String value;
+        bool erase;
+    };
+
+    using Changes = std::vector<Change>;
+
+    // Whether apply() would succeed with the storage being completely empty, e.g. before replacing everything
+    bool fits(const Changes& changes) {
+        size_t need = 0;
+        for (const auto& change : changes) {
+            if (!change.key.length()) {
+                return false;
             }
 
-            (--writer).write(value_len & 0xff);
-            (--writer).write((value_len >> 8) & 0xff);
+            if (!change.erase) {
+                need += estimate(change.key, change.value);
+            }
+        }
+
+        return need <= _cursor.size();
+    }
 
-            while (value_len--) {
-                (--writer).write(value[value_len]);
+    bool apply(Changes& changes) {
+        for (const auto& change : changes) {
+            if (!change.key.length()) {
+                return false;
             }
+        }
 
-            // we also need to add an empty key *after* the value
-            // but, only when we still have some space left
-            if (writer.begin() >= 2) {
-                _cursor_set_position(writer.begin());
-                auto next_kv = _read_kv();
-                if (!next_kv) {
-                    auto empty = Cursor::fromEnd(_storage, writer.begin() - 2, writer.begin());
-                    (--empty).write(0xff);
-                    (--empty).write(0xff);
+        // 1st pass, match existing keys and figure out how much space is used
+        // (positions are sorted in the same order foreach() would go through the kvs)
+        enum class Match : uint8_t {
+            None,
+            Replace,
+            Same,
+        };
+
+        std::vector<Match> matches(changes.size(), Match::None);
+        std::vector<uint16_t> removed;
+
+        size_t used = 0;
+        uint16_t start_pos = _cursor_reset_end();
+
+        foreach([&](KeyValueResult&& kv) {
+            start_pos = kv.value.begin();
+
+            const size_t size = kv.key.end() - kv.value.begin();
+            used += size;
+
+            for (size_t index = 0; index < changes.size(); ++index) {
+                if ((matches[index] != Match::None) || !kv.key.equals(changes[index].key)) {
+                    continue;
                 }
+
+                const auto& change = changes[index];
+                if (!change.erase && kv.value.equals(change.value)) {
+                    matches[index] = Match::Same;
+                    break;
+                }
+
+                matches[index] = Match::Replace;
+                removed.push_back(kv.key.end());
+                used -= size;
+                break;
             }
+        });
 
-            _storage.commit();
+        size_t need = 0;
+        size_t out = 0;
+
+        for (size_t index = 0; index < changes.size(); ++index) {
+            auto& change = changes[index];
+            if ((matches[index] == Match::Same)
+             || (change.erase && (matches[index] == Match::None)))
+            {
+                continue;
+            }
+
+            if (!change.erase) {
+                need += estimate(change.key, change.value);
+            }
+
+            if (out != index) {
+                changes[out] = std::move(change);
+            }
 
+            ++out;
+        }
+
+        changes.resize(out);
+        if (changes.empty()) {
             return true;
         }
 
-        return false;
+        if ((used + need) > _cursor.size()) {
+            return false;
+        }
+
+        // 2nd pass, move everything that stays to the right. since moved data
+        // is always to the right of the current position, parser is not affected
+        uint16_t dst = start_pos;
+        if (removed.size()) {
+            dst = _cursor.end();
+
+            auto it = removed.begin();
+            foreach([&](KeyValueResult&& kv) {
+                const uint16_t begin = kv.value.begin();
+                const uint16_t end = kv.key.end();
+
+                if ((it != removed.end()) && (*it == end)) {
+                    ++it;
+                    return;
+                }
+
+                if (dst != end) {
+                    _storage_move(begin, end, dst - end);
+                }
+
+                dst -= (end - begin);
+            });
+
+            if (start_pos < dst) {
+                _storage_fill(start_pos, dst, 0xff);
+            }
+        }
+
+        // 3rd pass, write everything new at the end
+        for (const auto& change : changes) {
+            if (!change.erase) {
+                dst -= estimate(change.key, change.value);
+                _write_kv(dst, change.key, change.value);
+            }
+        }
+
+        if ((dst - _cursor.begin()) >= 2) {
+            _write_padding(dst);
+        }
+
+        _storage.commit();
+
+        return true;
     }
 
     // remove key from the storage. will check that 'key' argument isn't empty
@@ -441,7 +703,7 @@ public:
 
         foreach([&](KeyValueResult&& kv) {
             start_pos = kv.value.begin();
-            if (!to_erase && (kv.key.length() == key_len) && (kv.key.read() == key)) {
+            if (!to_erase && kv.key.equals(key)) {
                 to_erase.reset(kv.value.begin(), kv.key.end());
             }
         });
@@ -481,6 +743,11 @@ public:
         return _cursor.size();
     }
 
+    // Total amount of bytes shifted around by set(), del() and apply()
+    size_t moved() const {
+        return _moved;
+    }
+
     protected:
 
     // Try to find the matching key. Datastructure that we use does not specify
@@ -500,13 +767,12 @@ public:
             }
 
             // no point in comparing keys when length does not match
-            // (and we also don't want to allocate the string)
             if (kv.key.length() != len) {
                 continue;
             }
 
-            auto key_result = kv.key.read();
-            if (key_result == key) {
+            // key is compared directly with the storage contents, without allocating the string
+            if (kv.key.equals(key)) {
                 if (read_value) {
                     out = kv.value.read();
                 } else {
@@ -544,6 +810,66 @@ public:
         return KeyValueResult { _storage };
     };
 
+    // 16bit length is stored as 2 bytes, left-to-right
+    void _write_length(uint16_t position, uint16_t length) {
+        const uint8_t bytes[2] {
+            static_cast<uint8_t>((length >> 8) & 0xff),
+            static_cast<uint8_t>(length & 0xff),
+        };
+
+        _storage_write(_storage, position, std::begin(bytes), std::end(bytes));
+    }
+
+    void _storage_fill(uint16_t begin, uint16_t end, uint8_t value) {
+        uint8_t buffer[BlockSize];
+        std::fill(std::begin(buffer), std::end(buffer), value);
+
+        while (begin < end) {
+            const auto chunk = std::min<uint16_t>(end - begin, BlockSize);
+            _storage_write(_storage, begin, &buffer[0], &buffer[chunk]);
+            begin += chunk;
+        }
+    }
+
+    // when reading left-to-right, layout is { value, value length, key, key length }
+    // (and the length itself is stored as big-endian)
+    void _write_kv(uint16_t position, const String& key, const String& value) {
+        _storage_write(_storage, position, value);
+        position += value.length();
+
+        _write_length(position, value.length());
+        position += 2;
+
+        _storage_write(_storage, position, key);
+        position += key.length();
+
+        _write_length(position, key.length());
+    }
+
+    // when there's no kv to the left of the position, put an empty key there
+    void _write_padding(uint16_t position) {
+        _cursor_set_position(position);
+        auto next_kv = _read_kv();
+        if (!next_kv) {
+            _storage_fill(position - 2, position, 0xff);
+        }
+    }
+
+    // shift [begin, end) to the right, starting from the rightmost chunk
+    // so the source is never overwritten before it is read
+    void _storage_move(uint16_t begin, uint16_t end, uint16_t shift) {
+        uint8_t buffer[BlockSize];
+        _moved += end - begin;
+
+        while (end > begin) {
+            const auto chunk = std::min<uint16_t>(end - begin, BlockSize);
+            const uint16_t position = end - chunk;
+            _storage_read(_storage, position, end, &buffer[0]);
+            _storage_write(_storage, position + shift, &buffer[0], &buffer[chunk]);
+            end = position;
+        }
+    }
+
     void _raw_erase(size_t start_pos, Cursor& to_erase) {
         // we either end up to the left or to the right of the boundary
 
@@ -553,25 +879,16 @@ public:
 
         if (start_pos < to_erase.begin()) {
             // shift storage to the right, overwriting over the now empty space
-            auto from = Cursor::fromEnd(_storage, start_pos, to_erase.begin());
-            auto to = Cursor::fromEnd(_storage, start_pos + to_erase.size(), to_erase.end());
-
-            while (--from && --to) {
-                to.write(from.read());
-                from.write(0xff);
-            }
+            const uint16_t shift = to_erase.size();
+            _storage_move(start_pos, to_erase.begin(), shift);
+            _storage_fill(start_pos, start_pos + shift, 0xff);
         } else {
             // overwrite the now empty space with 0xff
-            to_erase.position(to_erase.end());
-            while (--to_erase) {
-                to_erase.write(0xff);
-            }
+            _storage_fill(to_erase.begin(), to_erase.end(), 0xff);
         }
 
         // same as set(), add empty key as padding
-        auto empty = Cursor::fromEnd(_storage, new_pos - 2, new_pos);
-        (--empty).write(0xff);
-        (--empty).write(0xff);
+        _storage_fill(new_pos - 2, new_pos, 0xff);
 
         _storage.commit();
     }
@@ -596,33 +913,27 @@ public:
         do {
             switch (_state) {
 
+            // len is 16 bit uint (bigendian), both bytes are read at once
+            // special case is 0, which is valid and should be returned when encountered
+            // another special case is 0xffff, meaning we just hit an empty space
             case State::Begin:
                 if (_cursor.offset() >= 2) {
-                    --_cursor;
-                    _state = State::LenByte1;
-                } else {
-                    _state = State::End;
-                }
-                break;
+                    _cursor -= 2;
 
-            // len is 16 bit uint (bigendian)
-            // special case is 0, which is valid and should be returned when encountered
-            // another special case is 0xffff, meaning we just hit an empty space
-            case State::LenByte1:
-                len = _cursor.read();
-                _state = State::LenByte2;
-                break;
+                    uint8_t bytes[2];
+                    const auto position = _cursor.position();
+                    _storage_read(_storage, position, position + 2, &bytes[0]);
 
-            case State::LenByte2: {
-                uint8_t len2 = (--_cursor).read();
-                if ((0xff == len) && (0xff == len2)) {
-                    _state = State::End;
+                    if ((0xff == bytes[0]) && (0xff == bytes[1])) {
+                        _state = State::End;
+                    } else {
+                        len = bytes[1] | (bytes[0] << 8);
+                        _state = State::Value;
+                    }
                 } else {
-                    len |= len2 << 8;
-                    _state = State::Value;
+                    _state = State::End;
                 }
                 break;
-            }
 
             case State::Value: {
                 // ensure we don't go out-of-bounds
@@ -657,6 +968,7 @@ return_result:
     RawStorageBase _storage;
     Cursor _cursor;
     State _state { State::Begin };
+    size_t _moved { 0 };
 };
 
 } // namespace embedis
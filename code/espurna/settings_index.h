@@ -0,0 +1,172 @@
+/*
+
+Part of the SETTINGS MODULE
+
+In-memory index of the embedis key-value storage, allowing O(1) key lookups
+instead of walking the whole storage on every get()
+
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "settings_embedis.h"
+
+namespace espurna {
+namespace settings {
+namespace embedis {
+
+// Open-addressing (linear probing) hash table of the { key hash, key-value position }
+// - position is the `kv.key.end()` value, allowing to parse the key-value pair right from the storage
+// - hash is truncated to 16 bits, stored keys are always compared with the input
+// - index **must** be invalidated every time storage is modified, positions are not tracked
+class KeyValueIndex {
+public:
+    struct Slot {
+        uint16_t hash;
+        uint16_t position;
+    };
+
+    struct Stats {
+        size_t keys;
+        size_t slots;
+        size_t bytes;
+        size_t rebuilds;
+    };
+
+    // Position is never at zero, since there is always a length + (possibly) empty value before the key
+    static constexpr uint16_t Empty { 0 };
+
+    // FNV-1a, folded into 16 bits
+    struct Hash {
+        static constexpr uint32_t Basis { 2166136261ul };
+        static constexpr uint32_t Prime { 16777619ul };
+
+        void update(const uint8_t* data, size_t size) {
+            for (auto it = data; it != data + size; ++it) {
+                _value ^= *it;
+                _value *= Prime;
+            }
+        }
+
+        uint16_t value() const {
+            return static_cast<uint16_t>((_value >> 16) ^ (_value & 0xffff));
+        }
+
+    private:
+        uint32_t _value { Basis };
+    };
+
+    static uint16_t hash(const String& key) {
+        Hash out;
+        out.update(reinterpret_cast<const uint8_t*>(key.c_str()), key.length());
+        return out.value();
+    }
+
+    template <typename T>
+    static uint16_t hash(const T& key) {
+        Hash out;
+        key.visit([&](const uint8_t* data, uint16_t, uint16_t size) {
+            out.update(data, size);
+            return true;
+        });
+
+        return out.value();
+    }
+
+    bool valid() const {
+        return _valid;
+    }
+
+    void invalidate() {
+        _valid = false;
+    }
+
+    // Walk the storage and record every key. Index is always at least 25% empty,
+    // so the probing sequence is guaranteed to end
+    template <typename T>
+    void rebuild(T& store) {
+        const auto keys = store.count();
+
+        size_t capacity = 4;
+        while (capacity < (keys + (keys / 3) + 1)) {
+            capacity <<= 1;
+        }
+
+        std::vector<Slot>(capacity, Slot{Empty, Empty}).swap(_slots);
+        _keys = 0;
+
+        using Result = typename T::KeyValueResult;
+        store.foreach([&](Result&& kv) {
+            insert(hash(kv.key), kv.key.end());
+        });
+
+        ++_rebuilds;
+        _valid = true;
+    }
+
+    // Probe the index until either key or empty slot is found
+    template <typename T>
+    typename T::KeyValueResult find(T& store, const String& key) {
+        if (!_valid) {
+            rebuild(store);
+        }
+
+        const auto value = hash(key);
+        const auto mask = _slots.size() - 1;
+
+        for (auto index = value & mask;; index = (index + 1) & mask) {
+            const auto& slot = _slots[index];
+            if (slot.position == Empty) {
+                break;
+            }
+
+            if (slot.hash != value) {
+                continue;
+            }
+
+            auto kv = store.read_kv(slot.position);
+            if (kv && kv.key.equals(key)) {
+                return kv;
+            }
+        }
+
+        // (out-of-range position always results in an empty kv)
+        return store.read_kv(Empty);
+    }
+
+    Stats stats() const {
+        return Stats{
+            .keys = _keys,
+            .slots = _slots.size(),
+            .bytes = _slots.capacity() * sizeof(Slot),
+            .rebuilds = _rebuilds,
+        };
+    }
+
+private:
+    void insert(uint16_t value, uint16_t position) {
+        const auto mask = _slots.size() - 1;
+
+        auto index = value & mask;
+        while (_slots[index].position != Empty) {
+            index = (index + 1) & mask;
+        }
+
+        _slots[index] = Slot{value, position};
+        ++_keys;
+    }
+
+    std::vector<Slot> _slots;
+    size_t _keys { 0 };
+    size_t _rebuilds { 0 };
+    bool _valid { false };
+};
+
+} // namespace embedis
+} // namespace settings
+} // namespace espurna
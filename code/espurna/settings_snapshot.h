@@ -0,0 +1,339 @@
+/*
+
+Part of the SETTINGS MODULE
+
+Streaming settings backup formats, allowing to produce and consume backups
+one key-value at a time instead of keeping the whole document in memory
+
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#include <algorithm>
+#include <cstdint>
+
+namespace espurna {
+namespace settings {
+namespace snapshot {
+
+// CRC-32 (IEEE 802.3, reflected 0xEDB88320), same as zlib crc32()
+// Bitwise implementation, avoiding a 1KiB table in flash
+struct Crc32 {
+    static constexpr uint32_t Polynomial { 0xEDB88320ul };
+
+    void update(const uint8_t* data, size_t size) {
+        for (auto it = data; it != data + size; ++it) {
+            _value ^= *it;
+            for (int bit = 0; bit < 8; ++bit) {
+                _value = (_value >> 1) ^ (Polynomial & (0 - (_value & 1)));
+            }
+        }
+    }
+
+    uint32_t value() const {
+        return ~_value;
+    }
+
+private:
+    uint32_t _value { 0xFFFFFFFFul };
+};
+
+// Binary format. All numbers are big-endian, same as the embedis storage lengths
+// - 4 bytes of magic 'ESPS', 1 byte of version
+// - any number of records: key length (2 bytes), key, value length (2 bytes), value
+// - zero key length (2 bytes), marking the end of the records
+// - CRC-32 of everything above (4 bytes)
+// First record is expected to be the 'app' key, same as the .json backup
+static constexpr uint8_t Magic[] { 'E', 'S', 'P', 'S' };
+static constexpr uint8_t Version { 1 };
+
+// Key length is never zero, see `embedis::estimate()`
+static constexpr uint16_t EndMarker { 0 };
+
+class Encoder {
+public:
+    void header(String& out) {
+        append(out, Magic, sizeof(Magic));
+        append(out, &Version, sizeof(Version));
+    }
+
+    void record(String& out, const String& key, const String& value) {
+        append(out, key);
+        append(out, value);
+    }
+
+    void end(String& out) {
+        append(out, EndMarker);
+
+        const auto crc = _crc.value();
+        const uint8_t bytes[] {
+            static_cast<uint8_t>((crc >> 24) & 0xff),
+            static_cast<uint8_t>((crc >> 16) & 0xff),
+            static_cast<uint8_t>((crc >> 8) & 0xff),
+            static_cast<uint8_t>(crc & 0xff),
+        };
+
+        out.concat(reinterpret_cast<const char*>(&bytes[0]), sizeof(bytes));
+    }
+
+private:
+    void append(String& out, const uint8_t* data, size_t size) {
+        _crc.update(data, size);
+        out.concat(reinterpret_cast<const char*>(data), size);
+    }
+
+    void append(String& out, uint16_t length) {
+        const uint8_t bytes[] {
+            static_cast<uint8_t>((length >> 8) & 0xff),
+            static_cast<uint8_t>(length & 0xff),
+        };
+
+        append(out, &bytes[0], sizeof(bytes));
+    }
+
+    void append(String& out, const String& value) {
+        append(out, static_cast<uint16_t>(value.length()));
+        append(out, reinterpret_cast<const uint8_t*>(value.c_str()), value.length());
+    }
+
+    Crc32 _crc;
+};
+
+// Consumes the binary format in arbitrarily sized chunks. Only the current record is buffered,
+// callback receives every key-value as soon as it is complete: `bool(String&& key, String&& value)`
+// (returning `false` from it stops the decoder). Records are only guaranteed to be valid
+// after the CRC is checked, meaning the callback side should stage them until `done()`
+class Decoder {
+public:
+    enum class State {
+        Magic,
+        Version,
+        KeyLength,
+        Key,
+        ValueLength,
+        Value,
+        Crc,
+        Done,
+        Error,
+    };
+
+    // Storage lengths can't be larger than this anyway
+    explicit Decoder(uint16_t limit) :
+        _limit(limit)
+    {}
+
+    State state() const {
+        return _state;
+    }
+
+    bool done() const {
+        return _state == State::Done;
+    }
+
+    bool error() const {
+        return _state == State::Error;
+    }
+
+    template <typename Callback>
+    State feed(const uint8_t* data, size_t size, Callback&& callback) {
+        auto it = data;
+        const auto end = data + size;
+
+        while ((it != end) && (_state != State::Done) && (_state != State::Error)) {
+            switch (_state) {
+            case State::Magic:
+                if (*it != Magic[_offset]) {
+                    _state = State::Error;
+                    break;
+                }
+
+                consume(it);
+                if (_offset == sizeof(Magic)) {
+                    next(State::Version);
+                }
+                break;
+
+            case State::Version:
+                if (*it != Version) {
+                    _state = State::Error;
+                    break;
+                }
+
+                consume(it);
+                next(State::KeyLength);
+                break;
+
+            case State::KeyLength:
+            case State::ValueLength:
+                _number = (_number << 8) | *it;
+                consume(it);
+                if (_offset != 2) {
+                    break;
+                }
+
+                _length = _number;
+                if (_length > _limit) {
+                    _state = State::Error;
+                    break;
+                }
+
+                if (_state == State::KeyLength) {
+                    if (_length == EndMarker) {
+                        _expected = _crc.value();
+                        next(State::Crc);
+                        break;
+                    }
+
+                    _key = String();
+                    _key.reserve(_length);
+                    next(State::Key);
+                    break;
+                }
+
+                _value = String();
+                _value.reserve(_length);
+                next(State::Value);
+
+                // Empty values are allowed, key length is already checked
+                if (!_length) {
+                    record(callback);
+                }
+                break;
+
+            case State::Key:
+            case State::Value: {
+                auto& out = (_state == State::Key) ? _key : _value;
+
+                const auto need = static_cast<size_t>(_length - _offset);
+                const auto have = std::min(need, static_cast<size_t>(end - it));
+
+                _crc.update(it, have);
+                out.concat(reinterpret_cast<const char*>(it), have);
+                _offset += have;
+                it += have;
+
+                if (_offset != _length) {
+                    break;
+                }
+
+                if (_state == State::Key) {
+                    next(State::ValueLength);
+                    break;
+                }
+
+                record(callback);
+                break;
+            }
+
+            case State::Crc:
+                _number = (_number << 8) | *it;
+                ++it;
+                ++_offset;
+                if (_offset == 4) {
+                    _state = (_number == _expected)
+                        ? State::Done
+                        : State::Error;
+                }
+                break;
+
+            case State::Done:
+            case State::Error:
+                break;
+            }
+        }
+
+        // Nothing is expected after the CRC
+        if ((it != end) && (_state == State::Done)) {
+            _state = State::Error;
+        }
+
+        return _state;
+    }
+
+private:
+    void consume(const uint8_t*& it) {
+        _crc.update(it, 1);
+        ++it;
+        ++_offset;
+    }
+
+    void next(State state) {
+        _state = state;
+        _offset = 0;
+        _number = 0;
+    }
+
+    template <typename Callback>
+    void record(Callback&& callback) {
+        next(State::KeyLength);
+        if (!callback(std::move(_key), std::move(_value))) {
+            _state = State::Error;
+        }
+    }
+
+    Crc32 _crc;
+    String _key;
+    String _value;
+
+    uint32_t _expected { 0 };
+    uint32_t _number { 0 };
+
+    uint16_t _limit;
+    uint16_t _length { 0 };
+    uint16_t _offset { 0 };
+
+    State _state { State::Magic };
+};
+
+// .json backup only ever contains strings, both keys and values need to be escaped
+// (control characters, quotes and backslashes; everything else is passed through as-is)
+inline void json_escape(String& out, const String& value) {
+    static constexpr char Hex[] PROGMEM = "0123456789abcdef";
+
+    for (auto c : value) {
+        switch (c) {
+        case '"':
+        case '\\':
+            out += '\\';
+            out += c;
+            break;
+        case '\b':
+            out += F("\\b");
+            break;
+        case '\f':
+            out += F("\\f");
+            break;
+        case '\n':
+            out += F("\\n");
+            break;
+        case '\r':
+            out += F("\\r");
+            break;
+        case '\t':
+            out += F("\\t");
+            break;
+        default:
+            if (static_cast<uint8_t>(c) < 0x20) {
+                out += F("\\u00");
+                out += static_cast<char>(pgm_read_byte(&Hex[(c >> 4) & 0xf]));
+                out += static_cast<char>(pgm_read_byte(&Hex[c & 0xf]));
+                break;
+            }
+
+            out += c;
+            break;
+        }
+    }
+}
+
+inline void json_string(String& out, const String& value) {
+    out += '"';
+    json_escape(out, value);
+    out += '"';
+}
+
+} // namespace snapshot
+} // namespace settings
+} // namespace espurna
@@ -10,13 +10,66 @@ EEPROM MODULE
 EEPROM_Rotate EEPROMr;
 
 namespace {
+namespace build {
+
+constexpr espurna::duration::Seconds commitInterval() {
+    return espurna::duration::Seconds(EEPROM_COMMIT_INTERVAL);
+}
+
+constexpr size_t commitBudget() {
+    return EEPROM_COMMIT_BUDGET;
+}
+
+constexpr espurna::duration::Hours BudgetWindow { 1 };
+
+} // namespace build
+
+namespace settings {
+namespace keys {
+
+PROGMEM_STRING(CommitInterval, "eepromInterval");
+PROGMEM_STRING(CommitBudget, "eepromBudget");
+
+} // namespace keys
+
+espurna::duration::Seconds commitInterval() {
+    return getSetting(FPSTR(keys::CommitInterval), build::commitInterval());
+}
+
+size_t commitBudget() {
+    return getSetting(FPSTR(keys::CommitBudget), build::commitBudget());
+}
+
+} // namespace settings
 
 bool _eeprom_commit = false;
 
 uint32_t _eeprom_commit_count = 0;
 bool _eeprom_last_commit_result = false;
+espurna::duration::Microseconds _eeprom_last_commit_duration{};
 bool _eeprom_ready = false;
 
+// Every module simply marks the EEPROM as dirty via eepromCommit(), actual commit happens
+// in the loop and is limited both by the minimum interval and the hourly budget
+// (since every commit erases a whole flash sector, either the current one or the next one in the rotation pool)
+struct EepromScheduler {
+    espurna::duration::Milliseconds interval { build::commitInterval() };
+    size_t budget { build::commitBudget() };
+
+    espurna::time::CoreClock::time_point last_commit;
+    espurna::time::CoreClock::time_point window_start;
+    size_t window_commits { 0 };
+
+    uint32_t requests { 0 };
+    uint32_t deferred { 0 };
+    bool exhausted { false };
+};
+
+EepromScheduler _eeprom_scheduler;
+
+// Since boot, persisting them would only add more erases
+std::vector<uint32_t> _eeprom_erases;
+
 } // namespace
 
 bool eepromReady() {
@@ -49,23 +102,126 @@ String eepromSectors() {
 
 void eepromSectorsDebug() {
     DEBUG_MSG_P(PSTR("[MAIN] EEPROM sectors: %s\n"), (char *) eepromSectors().c_str());
-    DEBUG_MSG_P(PSTR("[MAIN] EEPROM current: %lu\n"), eepromCurrent());
+    DEBUG_MSG_P(PSTR("[MAIN] EEPROM current: %lu\n"),
+        static_cast<unsigned long>(eepromCurrent()));
+}
+
+size_t _eepromSectorIndex(uint32_t sector) {
+    return EEPROMr.base() - sector;
+}
+
+// Budget is counted over the hourly window, starting with the first commit in it
+void _eepromBudgetWindow(espurna::time::CoreClock::time_point now) {
+    auto& scheduler = _eeprom_scheduler;
+    if (now - scheduler.window_start >= build::BudgetWindow) {
+        scheduler.window_start = now;
+        scheduler.window_commits = 0;
+        scheduler.exhausted = false;
+    }
 }
 
+// Every commit is counted against the budget, including the forced ones that do not wait for it
 bool _eepromCommit() {
+    const auto start = espurna::time::micros();
+    const auto sector = EEPROMr.current();
+
     _eeprom_commit_count++;
+    _eeprom_commit = false;
     _eeprom_last_commit_result = EEPROMr.commit();
+
+    _eeprom_last_commit_duration = espurna::time::micros() - start;
+    _eeprom_scheduler.last_commit = espurna::time::millis();
+
+    _eepromBudgetWindow(_eeprom_scheduler.last_commit);
+    ++_eeprom_scheduler.window_commits;
+
+    // Rotation moves the data to the next sector, which is erased beforehand
+    // Without rotation, the same sector is erased every time
+    const auto current = EEPROMr.current();
+    if (_eeprom_last_commit_result && ((current != sector) || (EEPROMr.size() == 1))) {
+        const auto index = _eepromSectorIndex(current);
+        if (index < _eeprom_erases.size()) {
+            ++_eeprom_erases[index];
+        }
+    }
+
     return _eeprom_last_commit_result;
 }
 
+// Pending commit is delayed until both the interval has passed and budget allows it
+bool _eepromCommitAllowed() {
+    auto& scheduler = _eeprom_scheduler;
+
+    const auto now = espurna::time::millis();
+    if (_eeprom_commit_count && (now - scheduler.last_commit < scheduler.interval)) {
+        return false;
+    }
+
+    if (!scheduler.budget) {
+        return true;
+    }
+
+    _eepromBudgetWindow(now);
+
+    if (scheduler.window_commits >= scheduler.budget) {
+        if (!scheduler.exhausted) {
+            DEBUG_MSG_P(PSTR("[EEPROM] Commit budget of %zu per hour exhausted, delaying\n"),
+                scheduler.budget);
+            scheduler.exhausted = true;
+            ++scheduler.deferred;
+        }
+
+        return false;
+    }
+
+    return true;
+}
+
+void _eepromConfigure() {
+    _eeprom_scheduler.interval = settings::commitInterval();
+    _eeprom_scheduler.budget = settings::commitBudget();
+}
+
+uint32_t eepromCommitCount() {
+    return _eeprom_commit_count;
+}
+
+espurna::duration::Microseconds eepromCommitDuration() {
+    return _eeprom_last_commit_duration;
+}
+
 void eepromForceCommit() {
     _eepromCommit();
 }
 
 void eepromCommit() {
+    ++_eeprom_scheduler.requests;
     _eeprom_commit = true;
 }
 
+void eepromFlush() {
+    if (_eeprom_commit) {
+        DEBUG_MSG_P(PSTR("[EEPROM] Flushing pending changes\n"));
+        _eepromCommit();
+    }
+}
+
+bool eepromPending() {
+    return _eeprom_commit;
+}
+
+EepromWear eepromWear() {
+    return EepromWear{
+        .requests = _eeprom_scheduler.requests,
+        .commits = _eeprom_commit_count,
+        .deferred = _eeprom_scheduler.deferred,
+        .window_commits = _eeprom_scheduler.window_commits,
+        .budget = _eeprom_scheduler.budget,
+        .interval = _eeprom_scheduler.interval,
+        .erases = _eeprom_erases,
+    };
+}
+
 void eepromBackup(uint32_t index){
     EEPROMr.backup(index);
 }
@@ -75,11 +231,29 @@ PROGMEM_STRING(EepromCommand, "EEPROM");
 
 static void _eepromCommand(::terminal::CommandContext&& ctx) {
     ctx.output.printf_P(PSTR("Sectors: %s, current: %lu\n"),
-            eepromSectors().c_str(), eepromCurrent());
+            eepromSectors().c_str(), static_cast<unsigned long>(eepromCurrent()));
     if (_eeprom_commit_count > 0) {
-        ctx.output.printf_P(PSTR("Commits done: %lu, last: %s\n"),
-            _eeprom_commit_count, _eeprom_last_commit_result ? "OK" : "ERROR");
+        ctx.output.printf_P(PSTR("Commits done: %lu, last: %s (%lu us)\n"),
+            static_cast<unsigned long>(_eeprom_commit_count),
+            _eeprom_last_commit_result ? "OK" : "ERROR",
+            static_cast<unsigned long>(_eeprom_last_commit_duration.count()));
+    }
+
+    const auto& scheduler = _eeprom_scheduler;
+    ctx.output.printf_P(PSTR("Requests: %lu, deferred by budget: %lu, pending: %s\n"),
+        static_cast<unsigned long>(scheduler.requests),
+        static_cast<unsigned long>(scheduler.deferred),
+        _eeprom_commit ? "yes" : "no");
+    ctx.output.printf_P(PSTR("Interval: %lu ms, budget: %zu per hour (%zu used)\n"),
+        static_cast<unsigned long>(scheduler.interval.count()),
+        scheduler.budget, scheduler.window_commits);
+
+    for (size_t index = 0; index < _eeprom_erases.size(); ++index) {
+        ctx.output.printf_P(PSTR("Sector %lu erases: %lu\n"),
+            static_cast<unsigned long>(EEPROMr.base() - index),
+            static_cast<unsigned long>(_eeprom_erases[index]));
     }
+
     terminalOK(ctx);
 }
 
@@ -129,9 +303,8 @@ void _eepromCommandsSetup() {
 // -----------------------------------------------------------------------------
 
 void eepromLoop() {
-    if (_eeprom_commit) {
+    if (_eeprom_commit && _eepromCommitAllowed()) {
         _eepromCommit();
-        _eeprom_commit = false;
     }
 }
 
@@ -153,10 +326,18 @@ void eepromSetup() {
     EEPROMr.offset(EepromRotateOffset);
     EEPROMr.begin(EepromSize);
 
+    _eeprom_erases.resize(EEPROMr.size(), 0);
+    _eeprom_scheduler.window_start = espurna::time::millis();
+
 #if TERMINAL_SUPPORT
     _eepromCommandsSetup();
 #endif
 
+    // Settings storage is already available at this point
+    _eepromConfigure();
+    espurnaRegisterReload(_eepromConfigure);
+    systemBeforeSleep(eepromFlush);
+
     espurnaRegisterLoop(eepromLoop);
     _eeprom_ready = true;
 }
@@ -9,6 +9,10 @@ EEPROM MODULE
 #include <Arduino.h>
 #include <EEPROM_Rotate.h>
 
+#include <vector>
+
+#include "types.h"
+
 // "The library uses 3 bytes to track last valid sector, so there must be at least 3"
 // Reserve addresses 11, 12 and 13 for EEPROM_Rotate
 constexpr int EepromRotateOffset = 11;
@@ -34,9 +38,31 @@ unsigned long eepromSpace();
 void eepromClear();
 void eepromBackup(uint32_t index);
 
+// Commit right now, ignoring both the interval and the budget
 void eepromForceCommit();
+
+// Mark EEPROM contents as dirty, commit is done by the scheduler later
 void eepromCommit();
 
+// Commit only when there are pending changes, e.g. right before reset
+void eepromFlush();
+bool eepromPending();
+
+struct EepromWear {
+    uint32_t requests;
+    uint32_t commits;
+    uint32_t deferred;
+    size_t window_commits;
+    size_t budget;
+    espurna::duration::Milliseconds interval;
+    std::vector<uint32_t> erases;
+};
+
+EepromWear eepromWear();
+
+uint32_t eepromCommitCount();
+espurna::duration::Microseconds eepromCommitDuration();
+
 void eepromSetup();
 
 // Implementation is inline right here, since we want to avoid chaining too much functions to simply access the EEPROM object
@@ -65,6 +91,22 @@ inline void eepromWrite(int address, unsigned char value) {
     EEPROMr.write(address, value);
 }
 
+// Block access bypasses per-byte methods and works with the internal buffer directly
+
+inline void eepromRead(int address, uint8_t* out, size_t length) {
+    if ((address >= 0) && ((address + length) <= EEPROMr.length())) {
+        const auto* ptr = EEPROMr.getConstDataPtr() + address;
+        std::copy(ptr, ptr + length, out);
+    }
+}
+
+inline void eepromWrite(int address, const uint8_t* begin, const uint8_t* end) {
+    const size_t length = std::distance(begin, end);
+    if ((address >= 0) && ((address + length) <= EEPROMr.length())) {
+        std::copy(begin, end, EEPROMr.getDataPtr() + address);
+    }
+}
+
 inline void eepromGet(int address, unsigned char& value) {
     EEPROMr.get(address, value);
 }
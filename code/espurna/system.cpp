@@ -1199,7 +1199,8 @@ constexpr Mask value() {
         | (Report::Interval * (HEARTBEAT_REPORT_INTERVAL))
         | (Report::Range * (HEARTBEAT_REPORT_RANGE))
         | (Report::RemoteTemp * (HEARTBEAT_REPORT_REMOTE_TEMP))
-        | (Report::Bssid * (HEARTBEAT_REPORT_BSSID));
+        | (Report::Bssid * (HEARTBEAT_REPORT_BSSID))
+        | (Report::Mqtt * (HEARTBEAT_REPORT_MQTT));
 }
 
 } // namespace build
@@ -1485,6 +1486,7 @@ void reset(CustomResetReason reason) {
 // always needs a reason, so it can be displayed in logs and / or trigger some actions on boot
 void pending_reset_loop() {
     if (internal::reset_reason != CustomResetReason::None) {
+        eepromFlush();
         reset();
     }
 }
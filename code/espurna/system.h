@@ -316,7 +316,8 @@ enum class Report : Mask {
     Description = 1 << 18,
     Range = 1 << 19,
     RemoteTemp = 1 << 20,
-    Bssid = 1 << 21
+    Bssid = 1 << 21,
+    Mqtt = 1 << 22
 };
 
 constexpr Mask operator*(Report lhs, Mask rhs) {
@@ -351,6 +352,12 @@ constexpr Mask operator&(Report lhs, Report rhs) {
     return static_cast<Mask>(lhs) & static_cast<Mask>(rhs);
 }
 
+// Reports that are not expected to change while the device is running
+constexpr Mask StaticReports {
+    Report::App | Report::Version | Report::Board
+        | Report::Hostname | Report::Description
+        | Report::Mac | Report::Interval };
+
 espurna::duration::Seconds currentInterval();
 espurna::duration::Milliseconds currentIntervalMs();
 
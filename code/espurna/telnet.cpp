@@ -524,7 +524,7 @@ public:
             _cmds.pop_front();
 
             ExhaustingPrint<Client> print(this);
-            if (!espurna::terminal::find_and_call(cmd, print)) {
+            if (!espurna::terminal::find_and_call_inplace(cmd.begin(), cmd.length(), print)) {
                 _cmds.clear();
                 break;
             }
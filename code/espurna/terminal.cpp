@@ -32,6 +32,7 @@ Copyright (C) 2020-2022 by Maxim Prokhorov <prokhorov dot max at outlook dot com
 #include "libs/PrintString.h"
 
 #include <algorithm>
+#include <memory>
 #include <utility>
 
 #include <Schedule.h>
@@ -153,6 +154,19 @@ void erase_config(CommandContext&& ctx) {
     forceEraseSDKConfig();
 }
 
+#if SETTINGS_INDEX_SUPPORT
+void settings_index(const CommandContext& ctx) {
+    const auto stats = settings::index_stats();
+    ctx.output.printf_P(PSTR("settings index: %zu keys, %zu slots, %zu bytes"),
+            stats.keys, stats.slots, stats.bytes);
+    if (stats.keys) {
+        ctx.output.printf_P(PSTR(" (%zu bytes per key)"),
+            (stats.bytes + stats.keys - 1) / stats.keys);
+    }
+    ctx.output.printf_P(PSTR(", %zu rebuilds\n"), stats.rebuilds);
+}
+#endif
+
 PROGMEM_STRING(Heap, "HEAP");
 
 void heap(CommandContext&& ctx) {
@@ -160,6 +174,10 @@ void heap(CommandContext&& ctx) {
     ctx.output.printf_P(PSTR("initial: %lu available: %lu contiguous: %lu\n"),
             systemInitialFreeHeap(), stats.available, stats.usable);
 
+#if SETTINGS_INDEX_SUPPORT
+    settings_index(ctx);
+#endif
+
     terminalOK(ctx);
 }
 
@@ -171,6 +189,43 @@ void uptime(CommandContext&& ctx) {
     terminalOK(ctx);
 }
 
+PROGMEM_STRING(Loop, "LOOP");
+
+void loop_latency(CommandContext&& ctx) {
+    const auto& latency = espurnaLoopLatency();
+    ctx.output.printf_P(PSTR("loops: %u average: %u (us) max: %u (us)\n"),
+        latency.count(),
+        static_cast<uint32_t>(latency.average().count()),
+        static_cast<uint32_t>(latency.max().count()));
+
+    for (size_t index = 0; index < latency.Buckets; ++index) {
+        const auto count = latency.bucket(index);
+        if (!count) {
+            continue;
+        }
+
+        if (index + 1 < latency.Buckets) {
+            ctx.output.printf_P(PSTR("%4u..%u (ms): %u\n"),
+                latency.lower(index).count(),
+                latency.lower(index + 1).count(),
+                count);
+        } else {
+            ctx.output.printf_P(PSTR("%4u+ (ms): %u\n"),
+                latency.lower(index).count(),
+                count);
+        }
+    }
+
+    terminalOK(ctx);
+}
+
+PROGMEM_STRING(LoopReset, "LOOP.RESET");
+
+void loop_latency_reset(CommandContext&& ctx) {
+    espurnaLoopLatencyReset();
+    terminalOK(ctx);
+}
+
 PROGMEM_STRING(Info, "INFO");
 
 void info(CommandContext&& ctx) {
@@ -369,6 +424,10 @@ void storage(CommandContext&& ctx) {
                     layout.name(), layout.start(), layout.end(), layout.size());
         });
 
+#if SETTINGS_INDEX_SUPPORT
+    settings_index(ctx);
+#endif
+
     terminalOK(ctx);
 }
 
@@ -413,6 +472,8 @@ static constexpr ::terminal::Command List[] PROGMEM {
     {Storage, commands::storage},
     {Uptime, commands::uptime},
     {Heap, commands::heap},
+    {Loop, commands::loop_latency},
+    {LoopReset, commands::loop_latency_reset},
 
     {Adc, commands::adc},
 
@@ -492,7 +553,10 @@ void processing_loop() {
             break;
         }
 
-        find_and_call(result.line, port);
+        // line points to our own buffer, which is discarded right after
+        find_and_call_inplace(
+            const_cast<char*>(result.line.begin()),
+            result.line.length(), port);
     }
 }
 
@@ -547,7 +611,7 @@ void setup() {
             auto ptr = std::make_shared<String>(std::move(line));
             espurnaRegisterOnce([ptr]() {
                 PrintString out(TCP_MSS);
-                api_find_and_call(*ptr, out);
+                api_find_and_call_inplace(ptr->begin(), ptr->length(), out);
 
                 if (out.length()) {
                     static const auto topic = mqttTopic(MQTT_TOPIC_CMD);
@@ -567,97 +631,134 @@ void setup() {
 #if WEB_SUPPORT
 namespace web {
 
-struct Output {
+// Same as the http api, output is written into the fixed-size buffer and sent out
+// whenever it is full (or when the command finishes), instead of buffering everything in a String.
+// Sending waits for the client to stop being 'stalled', which slows down the command itself
+class Output final : public Print {
+public:
     static constexpr auto Timeout = espurna::duration::Seconds(2);
     static constexpr auto Wait = espurna::duration::Milliseconds(100);
-    static constexpr int Limit { 8 };
+    static constexpr size_t Capacity { 512 };
 
     Output() = delete;
-    Output(const Output&) = default;
+    Output(const Output&) = delete;
     Output(Output&&) = default;
 
     explicit Output(uint32_t id) :
+        _buffer(new char[Capacity + 1]),
         _id(id)
     {}
 
     ~Output() {
-        send();
+        send(_size);
     }
 
-    void operator()(const char* line) {
-        if (wsConnected(_id)) {
-            if ((_count > Limit) && !send()) {
-                return;
+    size_t write(uint8_t c) override {
+        return write(&c, 1);
+    }
+
+    size_t write(const uint8_t* data, size_t size) override {
+        size_t written = 0;
+
+        while (_connected && (written != size)) {
+            // Only complete lines are sent, unless the current one does not fit by itself
+            if ((_size == Capacity) && !send(_lines ? _lines : _size)) {
+                break;
             }
 
-            ++_count;
-            _output += line;
-        }
-    }
+            const auto* begin = data + written;
+            const auto chunk = std::min(size - written, Capacity - _size);
 
-    void clear() {
-        _output = String();
-        _count = 0;
-    }
+            for (size_t index = 0; index < chunk; ++index) {
+                _buffer[_size + index] = begin[index];
+                if (begin[index] == '\n') {
+                    _lines = _size + index + 1;
+                }
+            }
 
-    bool send() {
-        if (!_count || !_output.length()) {
-            clear();
-            return false;
+            _size += chunk;
+            written += chunk;
         }
 
-        if (!wsConnected(_id)) {
-            clear();
-            return false;
-        }
+        return written;
+    }
 
-        using Clock = time::CoreClock;
+    void flush() override {
+        send(_size);
+    }
 
-        auto start = Clock::now();
-        bool ready { false };
+private:
+    bool ready() {
+        using Clock = time::CoreClock;
+        const auto start = Clock::now();
 
         while (Clock::now() - start < Timeout) {
-            auto info = wsClientInfo(_id);
+            const auto info = wsClientInfo(_id);
             if (!info.connected) {
-                clear();
+                _connected = false;
                 return false;
             }
 
             if (!info.stalled) {
-                ready = true;
-                break;
+                return true;
             }
 
             time::blockingDelay(Wait);
         }
 
-        if (ready) {
-            DynamicJsonBuffer buffer((2 * JSON_OBJECT_SIZE(1)) + JSON_ARRAY_SIZE(1));
+        return false;
+    }
 
-            JsonObject& root = buffer.createObject();
-            JsonObject& log = root.createNestedObject("log");
+    void clear() {
+        _size = 0;
+        _lines = 0;
+    }
 
-            JsonArray& msg = log.createNestedArray("msg");
-            msg.add(_output.c_str());
+    // Send the first `length` bytes and keep the rest for later
+    bool send(size_t length) {
+        if (!length) {
+            return true;
+        }
 
-            wsSend(root);
+        if (!_connected || !ready()) {
             clear();
-
-            return true;
+            return false;
         }
 
-        clear();
-        return false;
+        const auto last = _buffer[length];
+        _buffer[length] = '\0';
+
+        DynamicJsonBuffer buffer((2 * JSON_OBJECT_SIZE(1)) + JSON_ARRAY_SIZE(1));
+
+        JsonObject& root = buffer.createObject();
+        JsonObject& log = root.createNestedObject("log");
+
+        JsonArray& msg = log.createNestedArray("msg");
+        msg.add(static_cast<const char*>(_buffer.get()));
+
+        wsSend(root);
+
+        _buffer[length] = last;
+        std::copy(_buffer.get() + length, _buffer.get() + _size, _buffer.get());
+
+        // nothing that is left contains a complete line
+        _size -= length;
+        _lines = 0;
+
+        return true;
     }
 
-private:
-    String _output;
+    std::unique_ptr<char[]> _buffer;
+    size_t _size { 0 };
+    size_t _lines { 0 };
+
     uint32_t _id { 0 };
-    int _count { 0 };
+    bool _connected { true };
 };
 
 constexpr espurna::duration::Seconds Output::Timeout;
 constexpr espurna::duration::Milliseconds Output::Wait;
+constexpr size_t Output::Capacity;
 
 STRING_VIEW_INLINE(Prefix, "cmd");
 
@@ -683,8 +784,8 @@ void onAction(uint32_t client_id, const char* action, JsonObject& data) {
     }
 
     espurnaRegisterOnce([cmd, client_id]() {
-        PrintLine<Output> out(client_id);
-        api_find_and_call(*cmd, out);
+        Output out(client_id);
+        api_find_and_call_inplace(cmd->begin(), cmd->length(), out);
     });
 }
 
@@ -744,7 +845,7 @@ void setup() {
                 espurna::web::print::scheduleFromRequest(
                     request,
                     [cmd](Print& out) {
-                        api_find_and_call(*cmd, out);
+                        api_find_and_call_inplace(cmd->begin(), cmd->length(), out);
                     });
             });
 
@@ -789,7 +890,7 @@ void setup() {
         espurna::web::print::scheduleFromRequest(
             request,
             [cmd](Print& out) {
-                api_find_and_call(*cmd, out);
+                api_find_and_call_inplace(cmd->begin(), cmd->length(), out);
             });
 
         return true;
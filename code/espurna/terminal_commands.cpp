@@ -16,6 +16,7 @@ Heavily inspired by the Embedis design:
 
 #include <algorithm>
 #include <memory>
+#include <vector>
 
 namespace espurna {
 namespace terminal {
@@ -29,6 +30,53 @@ namespace internal {
 using CommandsView = std::forward_list<Commands>;
 CommandsView commands;
 
+// Commands sorted by the name hash, so lookup is a binary search instead of comparing every name.
+// Commands are (usually) only added during setup, so the index is built once on the first lookup
+// and only rebuilt when something else gets added later
+struct IndexEntry {
+    uint32_t hash;
+    const Command* command;
+};
+
+using Index = std::vector<IndexEntry>;
+Index index;
+
+bool index_valid { false };
+
+// While batch is running, individual commands do not print +OK
+// (and errors are counted, so the batch could report the aggregated result)
+struct Batch {
+    bool active { false };
+    size_t errors { 0 };
+};
+
+Batch batch;
+
+bool operator<(const IndexEntry& lhs, const IndexEntry& rhs) {
+    return lhs.hash < rhs.hash;
+}
+
+void rebuild_index() {
+    Index out;
+    out.reserve(size());
+
+    // Newer commands are at the front of the list. Stable sort keeps them in front of
+    // the older ones with the same hash, so the same name still resolves to the latest one
+    for (const auto commands : internal::commands) {
+        for (auto it = commands.begin; it != commands.end; ++it) {
+            out.push_back(IndexEntry{
+                .hash = parser::lowercase_fnv1_hash((*it).name),
+                .command = it,
+            });
+        }
+    }
+
+    std::stable_sort(out.begin(), out.end());
+
+    index = std::move(out);
+    index_valid = true;
+}
+
 } // namespace internal
 } // namespace
 
@@ -56,6 +104,7 @@ CommandNames names() {
 
 void add(Commands commands) {
     internal::commands.emplace_front(std::move(commands));
+    internal::index_valid = false;
 }
 
 void add(StringView name, CommandFunc func) {
@@ -71,16 +120,21 @@ void add(StringView name, CommandFunc func) {
 }
 
 const Command* find(StringView name) {
-    for (const auto commands : internal::commands) {
-        const auto found = std::find_if(
-            commands.begin,
-            commands.end,
-            [&](const Command& command) {
-                return name.equalsIgnoreCase(command.name);
-            });
+    if (!internal::index_valid) {
+        internal::rebuild_index();
+    }
+
+    const auto key = internal::IndexEntry{
+        .hash = parser::lowercase_fnv1_hash(name),
+        .command = nullptr,
+    };
 
-        if (found != commands.end) {
-            return found;
+    // Different names may still end up with the same hash
+    auto range = std::equal_range(
+        internal::index.begin(), internal::index.end(), key);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (name.equalsIgnoreCase((*it).command->name)) {
+            return (*it).command;
         }
     }
 
@@ -88,6 +142,10 @@ const Command* find(StringView name) {
 }
 
 void ok(Print& out) {
+    if (internal::batch.active) {
+        return;
+    }
+
     out.print(F("+OK\n"));
 }
 
@@ -96,6 +154,10 @@ void ok(const espurna::terminal::CommandContext& ctx) {
 }
 
 void error(Print& print, const String& message) {
+    if (internal::batch.active) {
+        ++internal::batch.errors;
+    }
+
     print.printf_P(PSTR("-ERROR: %s\n"), message.c_str());
 }
 
@@ -103,16 +165,43 @@ void error(const espurna::terminal::CommandContext& ctx, const String& message)
     error(ctx.error, message);
 }
 
+namespace {
+
+void parser_error(Print& error_output, parser::Error value) {
+    String message;
+    message += STRING_VIEW("TERMINAL: ");
+    message += parser::error(value);
+    error(error_output, message);
+}
+
+} // namespace
+
 bool find_and_call(CommandLine cmd, Print& output, Print& error_output) {
     const auto* command = find(cmd.argv[0]);
     if (command) {
-        (*command).func(
-            CommandContext{
-                .argv = std::move(cmd.argv),
-                .output = output,
-                .error = error_output,
-            });
+        // Views are limited by ArgvView capacity, unlike argv. Command that only uses views
+        // would not see every argument, while the rest of them are never using views anyway
+        const auto views_only = ((*command).flags & CommandViews) != 0;
+        const auto fits = cmd.argv.size() <= ArgvView::Capacity;
+        if (views_only && !fits) {
+            parser_error(error_output, parser::Error::TooManyArguments);
+            return false;
+        }
 
+        auto ctx = CommandContext{
+            .argv = std::move(cmd.argv),
+            .output = output,
+            .error = error_output,
+            .views = ArgvView(),
+        };
+
+        if (fits) {
+            for (const auto& arg : ctx.argv) {
+                ctx.views.push_back(arg);
+            }
+        }
+
+        (*command).func(std::move(ctx));
         return true;
     }
 
@@ -127,10 +216,7 @@ bool find_and_call(CommandLine cmd, Print& output) {
 bool find_and_call(StringView cmd, Print& output, Print& error_output) {
     auto result = parse_line(cmd);
     if (result.error != parser::Error::Ok) {
-        String message;
-        message += STRING_VIEW("TERMINAL: ");
-        message += parser::error(result.error);
-        error(error_output, message);
+        parser_error(error_output, result.error);
         return false;
     }
 
@@ -145,6 +231,274 @@ bool find_and_call(StringView cmd, Print& output) {
     return find_and_call(cmd, output, output);
 }
 
+namespace {
+
+bool call(const CommandLineView& cmd, Print& output, Print& error_output) {
+    const auto* command = find(cmd.argv[0]);
+    if (!command) {
+        error(error_output, F("Command not found"));
+        return false;
+    }
+
+    const auto views_only = ((*command).flags & CommandViews) != 0;
+    (*command).func(
+        CommandContext{
+            .argv = views_only
+                ? Argv()
+                : cmd.argv.toArgv(),
+            .output = output,
+            .error = error_output,
+            .views = cmd.argv,
+        });
+
+    return true;
+}
+
+// Line starting with the 'batch' keyword, returns pointer right after it or nullptr otherwise
+char* batch_contents(char* line, size_t length) {
+    PROGMEM_STRING(Keyword, "batch");
+    constexpr size_t KeywordLength { sizeof(Keyword) - 1 };
+
+    auto* it = line;
+    const auto* end = line + length;
+    while ((it != end) && ((*it == ' ') || (*it == '\t'))) {
+        ++it;
+    }
+
+    if (static_cast<size_t>(end - it) <= KeywordLength) {
+        return nullptr;
+    }
+
+    if (strncasecmp_P(it, Keyword, KeywordLength) != 0) {
+        return nullptr;
+    }
+
+    it += KeywordLength;
+    switch (*it) {
+    case ' ':
+    case '\t':
+    case '\r':
+    case '\n':
+        return it;
+    }
+
+    return nullptr;
+}
+
+// Unquoted ';' works as a line ending, allowing to send the whole batch as a single line.
+// Everything else is left as-is for the parser to handle
+void batch_split(char* begin, char* end) {
+    char quote { '\0' };
+    bool escape { false };
+
+    for (auto it = begin; it != end; ++it) {
+        if (escape) {
+            escape = false;
+            continue;
+        }
+
+        switch (*it) {
+        case '\\':
+            escape = (quote != '\0');
+            break;
+        case '"':
+        case '\'':
+            if (quote == '\0') {
+                quote = *it;
+            } else if (quote == *it) {
+                quote = '\0';
+            }
+            break;
+        case ';':
+            if (quote == '\0') {
+                *it = '\n';
+            }
+            break;
+        case '\n':
+            quote = '\0';
+            break;
+        }
+    }
+}
+
+// In-place parser modifies the buffer, so it cannot be parsed again after ArgvView overflows.
+// Every argument after the first one needs a separator before it; only the lines that have
+// enough of them to overflow are copied beforehand, to be parsed with parse_line() instead
+String overflow_copy(StringView line) {
+    size_t separators { 0 };
+    bool previous { false };
+
+    for (const auto c : line) {
+        const auto current = (c == ' ') || (c == '\t');
+        if (current && !previous) {
+            ++separators;
+        }
+
+        previous = current;
+    }
+
+    return (separators >= ArgvView::Capacity)
+        ? line.toString()
+        : String();
+}
+
+struct CallResult {
+    parser::Error error;
+    bool empty;
+    bool called;
+};
+
+// Parse the line in-place and call the command, parser errors are left for the caller to report
+CallResult parse_and_call(char* line, size_t length, Print& output, Print& error_output) {
+    const auto copy = overflow_copy(StringView(line, length));
+
+    const auto result = parse_line_inplace(line, length);
+    if ((result.error == parser::Error::TooManyArguments) && copy.length()) {
+        auto fallback = parse_line(copy);
+
+        const auto error = fallback.error;
+        const auto empty = fallback.argv.empty();
+
+        return CallResult{
+            .error = error,
+            .empty = empty,
+            .called = (error == parser::Error::Ok) && !empty
+                && find_and_call(std::move(fallback), output, error_output),
+        };
+    }
+
+    const auto empty = result.argv.empty();
+    return CallResult{
+        .error = result.error,
+        .empty = empty,
+        .called = (result.error == parser::Error::Ok) && !empty
+            && call(result, output, error_output),
+    };
+}
+
+bool is_blank(StringView value) {
+    return std::all_of(value.begin(), value.end(),
+        [](char c) {
+            return (c == ' ') || (c == '\t') || (c == '\r') || (c == '\n');
+        });
+}
+
+} // namespace
+
+bool batch_find_and_call_inplace(char* lines, size_t length, Print& output, Print& error_output) {
+    if (internal::batch.active) {
+        error(error_output, F("Batch is already running"));
+        return false;
+    }
+
+    batch_split(lines, lines + length);
+
+    internal::batch.active = true;
+    internal::batch.errors = 0;
+
+    size_t commands { 0 };
+    size_t failed { 0 };
+
+    LineView view(StringView(lines, length));
+    while (view) {
+        const auto line = view.line();
+        if (!line.length()) {
+            break;
+        }
+
+        auto* begin = lines + std::distance(static_cast<const char*>(lines), line.begin());
+
+        const auto errors = internal::batch.errors;
+
+        const auto result = parse_and_call(begin, line.length(), output, error_output);
+        if ((result.error == parser::Error::Ok) && result.empty) {
+            continue;
+        }
+
+        ++commands;
+
+        if (result.error != parser::Error::Ok) {
+            parser_error(error_output, result.error);
+        }
+
+        if (errors != internal::batch.errors) {
+            ++failed;
+        }
+    }
+
+    // Last command is never parsed without the line ending
+    if (view && !is_blank(StringView(view.begin(), view.end()))) {
+        ++commands;
+        ++failed;
+        parser_error(error_output, parser::Error::UnexpectedLineEnd);
+    }
+
+    internal::batch.active = false;
+
+    if (failed) {
+        error(error_output,
+            String(failed, 10) + F(" of ") + String(commands, 10) + F(" command(s) failed"));
+        return false;
+    }
+
+    ok(output);
+    return true;
+}
+
+bool batch_find_and_call_inplace(char* lines, size_t length, Print& output) {
+    return batch_find_and_call_inplace(lines, length, output, output);
+}
+
+bool find_and_call_inplace(char* line, size_t length, Print& output, Print& error_output) {
+    auto* batch = batch_contents(line, length);
+    if (batch) {
+        return batch_find_and_call_inplace(batch, length - (batch - line), output, error_output);
+    }
+
+    const auto result = parse_and_call(line, length, output, error_output);
+    if (result.error != parser::Error::Ok) {
+        parser_error(error_output, result.error);
+        return false;
+    }
+
+    return result.called;
+}
+
+bool find_and_call_inplace(char* line, size_t length, Print& output) {
+    return find_and_call_inplace(line, length, output, output);
+}
+
+bool api_find_and_call_inplace(char* lines, size_t length, Print& output, Print& error_output) {
+    // When the first line starts the batch, every line that follows is also a part of it
+    auto* batch = batch_contents(lines, length);
+    if (batch) {
+        return batch_find_and_call_inplace(batch, length - (batch - lines), output, error_output);
+    }
+
+    bool result { true };
+
+    LineView view(StringView(lines, length));
+    while (view) {
+        const auto line = view.line();
+        if (!line.length()) {
+            break;
+        }
+
+        // line view only points to the original buffer
+        auto* begin = lines + std::distance(static_cast<const char*>(lines), line.begin());
+        if (!find_and_call_inplace(begin, line.length(), output, error_output)) {
+            result = false;
+            break;
+        }
+    }
+
+    return result;
+}
+
+bool api_find_and_call_inplace(char* lines, size_t length, Print& output) {
+    return api_find_and_call_inplace(lines, length, output, output);
+}
+
 bool api_find_and_call(StringView cmd, Print& output, Print& error_output) {
     bool result { true };
 
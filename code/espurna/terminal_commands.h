@@ -25,12 +25,21 @@ struct CommandContext {
     Argv argv;
     Print& output;
     Print& error;
+    // Either pointing to the `argv` strings or to the parsed line itself. Empty when there are
+    // more arguments than ArgvView can hold, commands using views are not called at all in that case
+    ArgvView views;
 };
 
 using CommandFunc = void(*)(CommandContext&&);
+
+// Command only uses `CommandContext::views`, `argv` would always be empty when called with
+// the in-place parser result. Otherwise, `argv` is still filled with copies of the arguments
+static constexpr uint32_t CommandViews { 1 };
+
 struct Command {
     StringView name;
     CommandFunc func;
+    uint32_t flags { 0 };
 };
 
 struct Commands {
@@ -72,6 +81,30 @@ bool find_and_call(CommandLine, Print& output);
 // try and call an already parsed command line
 bool find_and_call(CommandLine, Print& output, Print& error);
 
+// same as find_and_call(), but line is parsed in-place and buffer contents are modified
+// (no allocations happen when the command only uses views)
+bool find_and_call_inplace(char* line, size_t length, Print& output);
+
+// same as find_and_call(), but line is parsed in-place and buffer contents are modified
+// (no allocations happen when the command only uses views; line that does not fit into the ArgvView is parsed as strings)
+bool find_and_call_inplace(char* line, size_t length, Print& output, Print& error);
+
+// call every command in the buffer (separated either by new lines or by unquoted ';'), parsing them in-place
+// - commands do not print +OK, only errors are printed
+// - failed command does not stop the batch, result is printed once at the end (+OK or -ERROR with the failed count)
+// - everything scheduled by the commands (e.g. settings reload or commit) only happens after the batch ends
+// (both find_and_call_inplace(...) and api_find_and_call_inplace(...) also run this when the input starts with `batch`)
+bool batch_find_and_call_inplace(char* lines, size_t length, Print& output);
+
+// call every command in the buffer (separated either by new lines or by unquoted ';'), parsing them in-place
+bool batch_find_and_call_inplace(char* lines, size_t length, Print& output, Print& error);
+
+// search the given buffer for valid commands and call them in sequence, parsing lines in-place
+bool api_find_and_call_inplace(char* lines, size_t length, Print& output);
+
+// search the given buffer for valid commands and call them in sequence, parsing lines in-place
+bool api_find_and_call_inplace(char* lines, size_t length, Print& output, Print& error);
+
 // search the given string for valid commands and call them in sequence
 bool api_find_and_call(StringView, Print& output);
 
@@ -41,6 +41,9 @@ String error(Error value) {
     case Error::NoSpaceAfterQuote:
         out = PSTR("NoSpaceAfterQuote");
         break;
+    case Error::TooManyArguments:
+        out = PSTR("TooManyArguments");
+        break;
     }
 
     return out;
@@ -117,46 +120,122 @@ char unescape_char(char c) {
     return c;
 }
 
-struct Result {
-    Result() = default;
+// our storage for
+// - ARGV resulting list
+// - text buffer or (interim) text span / range
+// - escaped character (since we don't look ahead when iterating)
+struct StringValues {
+    struct Span {
+        const char* begin { nullptr };
+        const char* end { nullptr };
+    };
+
+    Span span;
+    String chunk;
+    char byte_lhs { 0 };
+
+    Argv argv;
 
-    Result& operator=(Error error) {
-        _error = error;
-        _argv.clear();
-        return *this;
+    void append_span(const char* ptr) {
+        if (!span.begin) {
+            span.begin = ptr;
+        }
+
+        span.end = !span.end
+            ? std::next(span.begin)
+            : std::next(ptr);
     }
 
-    Result& operator=(Argv&& argv) {
-        _argv = std::move(argv);
-        _error = Error::Ok;
-        return *this;
+    void push_span() {
+        if (span.begin && span.end) {
+            StringView view(span.begin, span.end);
+            chunk.concat(view.c_str(), view.length());
+            span = Span{};
+        }
     }
 
-    explicit operator bool() const {
-        return _error == Error::Ok;
+    void append_chunk(char c) {
+        push_span();
+        chunk.concat(&c, 1);
     }
 
-    Error error() const {
-        return _error;
+    void append_byte_lhs(char c) {
+        byte_lhs = c;
     }
 
-    CommandLine get() {
-        auto out = CommandLine{
-            .argv = std::move(_argv),
-            .error = _error };
+    void append_byte_rhs(char c) {
+        append_chunk(hex_digit_to_value(byte_lhs, c));
+    }
 
-        _error = Error::Uninitialized;
-        return out;
+    void push_chunk() {
+        push_span();
+        argv.push_back(chunk);
+        chunk = "";
     }
 
-private:
-    Error _error { Error::Uninitialized };
-    Argv _argv;
+    bool overflow() const {
+        return false;
+    }
+};
+
+// Same as above, but output is written back into the line buffer itself.
+// Every input character produces at most one output character (escapes and quotes only make
+// the text shorter, separator is replaced with '\0'), so the write position never overtakes
+// the read position and we never overwrite anything that was not parsed yet
+struct InplaceValues {
+    explicit InplaceValues(char* begin) :
+        out(begin)
+    {}
+
+    char* out;
+    char* arg { nullptr };
+    char byte_lhs { 0 };
+    bool full { false };
+
+    ArgvView argv;
+
+    void append_span(const char* ptr) {
+        append_chunk(*ptr);
+    }
+
+    void append_chunk(char c) {
+        if (!arg) {
+            arg = out;
+        }
+
+        *(out++) = c;
+    }
+
+    void append_byte_lhs(char c) {
+        byte_lhs = c;
+    }
+
+    void append_byte_rhs(char c) {
+        append_chunk(hex_digit_to_value(byte_lhs, c));
+    }
+
+    void push_chunk() {
+        const auto begin = arg ? arg : out;
+        const auto end = out;
+
+        *(out++) = '\0';
+        arg = nullptr;
+
+        if (!argv.push_back(StringView(begin, end))) {
+            full = true;
+        }
+    }
+
+    bool overflow() const {
+        return full;
+    }
 };
 
 struct Parser {
     Parser() = default;
-    Result operator()(StringView);
+
+    template <typename Values>
+    Error operator()(StringView, Values&);
 
 private:
     // only tracked within our `operator()(<LINE>)`
@@ -176,67 +255,12 @@ private:
         AfterQuote,
     };
 
-    // our storage for
-    // - ARGV resulting list
-    // - text buffer or (interim) text span / range
-    // - escaped character (since we don't look ahead when iterating)
-    struct Values {
-        struct Span {
-            const char* begin { nullptr };
-            const char* end { nullptr };
-        };
-
-        Span span;
-        String chunk;
-        char byte_lhs { 0 };
-
-        Argv argv;
-
-        void append_span(const char* ptr) {
-            if (!span.begin) {
-                span.begin = ptr;
-            }
-
-            span.end = !span.end
-                ? std::next(span.begin)
-                : std::next(ptr);
-        }
-
-        void push_span() {
-            if (span.begin && span.end) {
-                StringView view(span.begin, span.end);
-                chunk.concat(view.c_str(), view.length());
-                span = Values::Span{};
-            }
-        }
-
-        void append_chunk(char c) {
-            push_span();
-            chunk.concat(&c, 1);
-        }
-
-        void append_byte_lhs(char c) {
-            byte_lhs = c;
-        }
-
-        void append_byte_rhs(char c) {
-            append_chunk(hex_digit_to_value(byte_lhs, c));
-        }
-
-        void push_chunk() {
-            push_span();
-            argv.push_back(chunk);
-            chunk = "";
-        }
-    };
-
     bool _parsing { false };
 };
 
-Result Parser::operator()(StringView line) {
-    Result result;
-    Values values;
-
+template <typename Values>
+Error Parser::operator()(StringView line, Values& values) {
+    Error result { Error::Uninitialized };
     State state { State::Initial };
 
     ReentryLock lock(_parsing);
@@ -381,7 +405,7 @@ text:
         case State::EscapedQuote:
             switch (*it) {
             case '\'':
-                values.chunk.concat(*it);
+                values.append_chunk(*it);
                 state = State::SingleQuote;
                 break;
             default:
@@ -433,12 +457,14 @@ text:
 
 out:
     if (state == State::Done) {
-        result = std::move(values.argv);
+        result = values.overflow()
+            ? Error::TooManyArguments
+            : Error::Ok;
     }
 
     // whenever line ends before we are done parsing, make sure
     // result contains a valid error condition (same as in the switch above)
-    if (result.error() == Error::Uninitialized) {
+    if (result == Error::Uninitialized) {
         switch (state) {
         case State::Done:
             break;
@@ -470,7 +496,30 @@ out:
 
 CommandLine parse_line(StringView line) {
     static Parser parser;
-    return parser(line).get();
+
+    StringValues values;
+    const auto error = parser(line, values);
+
+    return CommandLine{
+        .argv = (error == Error::Ok)
+            ? std::move(values.argv)
+            : Argv(),
+        .error = error,
+    };
+}
+
+CommandLineView parse_line_inplace(char* line, size_t length) {
+    static Parser parser;
+
+    InplaceValues values(line);
+    const auto error = parser(StringView(line, length), values);
+
+    return CommandLineView{
+        .argv = (error == Error::Ok)
+            ? values.argv
+            : ArgvView(),
+        .error = error,
+    };
 }
 
 } // namespace
@@ -478,9 +527,7 @@ CommandLine parse_line(StringView line) {
 // Fowler–Noll–Vo hash function to hash command strings that treats input as lowercase
 // ref: https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function
 //
-// This is here in case `std::unordered_map` becomes viable
-// TODO: afaik, map implementation should handle collisions (however rare they are in our case)
-// if not, we can always roll static commands allocation and just match strings with strcmp_P
+// Used by the commands index (see terminal_commands.cpp), collisions are handled there
 
 uint32_t lowercase_fnv1_hash(StringView value) {
     constexpr uint32_t fnv_prime = 16777619u;
@@ -501,5 +548,9 @@ CommandLine parse_line(StringView value) {
     return parser::parse_line(value);
 }
 
+CommandLineView parse_line_inplace(char* line, size_t length) {
+    return parser::parse_line_inplace(line, length);
+}
+
 } // namespace terminal
 } // namespace espurna
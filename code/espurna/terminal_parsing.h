@@ -11,6 +11,7 @@ Copyright (C) 2020 by Maxim Prokhorov <prokhorov dot max at outlook dot com>
 
 #include <Arduino.h>
 
+#include <array>
 #include <cstring>
 #include <iterator>
 #include <vector>
@@ -32,10 +33,14 @@ enum class Error {
     NoSpaceAfterQuote, // parsing stopped since there was no space after quote
     InvalidEscape,     // escaped text was invalid
     UnexpectedLineEnd, // unexpected \r encounteted in the input
+    TooManyArguments,  // parsed line does not fit into the ArgvView
 };
 
 String error(Error);
 
+// Case-insensitive FNV-1 hash of the string, which may be in flash
+uint32_t lowercase_fnv1_hash(StringView);
+
 } // namespace parser
 
 struct CommandLine {
@@ -43,6 +48,69 @@ struct CommandLine {
     parser::Error error;
 };
 
+// Fixed-size list of arguments that only references some external buffer
+// (see `parse_line_inplace()`, which also ensures every view is null-terminated)
+struct ArgvView {
+    static constexpr size_t Capacity { 16 };
+
+    using Values = std::array<StringView, Capacity>;
+
+    ArgvView() = default;
+
+    size_t size() const {
+        return _size;
+    }
+
+    bool empty() const {
+        return _size == 0;
+    }
+
+    StringView operator[](size_t index) const {
+        return _values[index];
+    }
+
+    const StringView* begin() const {
+        return _values.data();
+    }
+
+    const StringView* end() const {
+        return _values.data() + _size;
+    }
+
+    bool push_back(StringView value) {
+        if (_size < Capacity) {
+            _values[_size++] = value;
+            return true;
+        }
+
+        return false;
+    }
+
+    void clear() {
+        _size = 0;
+    }
+
+    Argv toArgv() const {
+        Argv out;
+        out.reserve(_size);
+
+        for (const auto& value : *this) {
+            out.push_back(value.toString());
+        }
+
+        return out;
+    }
+
+private:
+    Values _values{};
+    size_t _size { 0 };
+};
+
+struct CommandLineView {
+    ArgvView argv;
+    parser::Error error;
+};
+
 // Buffer char data and check whether the received value has newlines in its internal
 // storage works like a circular buffer; whenever buffer size exceedes capacity, we return
 // to the start of the buffer and reset size.
@@ -265,5 +333,10 @@ private:
 // - `error` set to any parser errors encountered, or `Ok` when everything is fine
 CommandLine parse_line(StringView line);
 
+// Zero-allocation version of the parser above
+// - line is unescaped in-place, modifying the buffer contents
+// - `argv` contains views pointing to the modified buffer, which **must** outlive the result
+CommandLineView parse_line_inplace(char* line, size_t length);
+
 } // namespace terminal
 } // namespace espurna
@@ -68,29 +68,13 @@ namespace espurna {
 namespace web {
 namespace print {
 
-bool RequestPrint::_addBuffer() {
-    if ((_buffers.size() + 1) > _config.backlog.count) {
-        if (!_exhaustBuffers()) {
-            _state = State::Error;
-            return false;
-        }
-    }
-
-    // Note: c++17, emplace returns created object reference
-    //       c++11, we need to use .back()
-    _buffers.emplace_back(_config.backlog.size, 0);
-    _buffers.back().clear();
-
-    return true;
-}
-
 // Creates response object that will handle the data written into the Print& interface.
 //
 // This API expects a **very** careful approach to context switching between SYS and CONT:
-// - Returning RESPONSE_TRY_AGAIN before buffers are filled will result in invalid size marker being sent on the wire.
+// - Returning RESPONSE_TRY_AGAIN before buffer is filled will result in invalid size marker being sent on the wire.
 //   HTTP client (curl, python requests etc., as discovered in testing) will then drop the connection
 // - Returning 0 will immediatly close the connection from our side
-// - Calling _prepareRequest() **before** _buffers are filled will result in returning 0
+// - Calling _prepareRequest() **before** buffer is filled will result in returning 0
 // - Calling yield() / delay() while request handler is active **may** trigger this callback out of sequence
 //   (e.g. Stream.write(...), Stream.read(...), DEBUG_MSG(...), or any other API trying to switch contexts)
 // - Receiving data (tcp ack from the previous packet) **will** trigger the callback when switching contexts.
@@ -106,22 +90,7 @@ size_t RequestPrint::_handleRequest(uint8_t* data, size_t maxLen) {
         break;
     }
 
-    size_t written = 0;
-    while ((written < maxLen) && !_buffers.empty()) {
-        auto& chunk =_buffers.front();
-        auto have = maxLen - written;
-        if (chunk.size() > have) {
-            std::copy(chunk.data(), chunk.data() + have, data + written);
-            chunk.erase(chunk.begin(), chunk.begin() + have);
-            written += have;
-        } else {
-            std::copy(chunk.data(), chunk.data() + chunk.size(), data + written);
-            _buffers.pop_front();
-            written += chunk.size();
-        }
-    }
-
-    return written;
+    return _buffer.read(data, maxLen);
 }
 
 void RequestPrint::_prepareRequest() {
@@ -141,11 +110,39 @@ size_t RequestPrint::write(uint8_t b) {
     return write(&b, 1);
 }
 
-bool RequestPrint::_exhaustBuffers() {
-    // XXX: espasyncwebserver will trigger write callback if we setup response too early
-    //      exploring code, callback handler responds to a special return value RESPONSE_TRY_AGAIN
-    //      but, it seemingly breaks chunked response logic
-    // XXX: this should be **the only place** that can trigger yield() while we stay in CONT
+// XXX: espasyncwebserver will trigger write callback if we setup response too early
+//      exploring code, callback handler responds to a special return value RESPONSE_TRY_AGAIN
+//      but, it seemingly breaks chunked response logic
+// XXX: this should be **the only place** that can trigger yield() while we stay in CONT
+//
+// Response callback only drains the buffer while we yield. Waiting for the buffer to be
+// completely empty would mean the callback may get called with nothing to send, so only
+// wait until there is *some* space and continue writing right after
+bool RequestPrint::_waitForSpace() {
+    if (_state == State::None) {
+        _prepareRequest();
+    }
+
+    using TimeSource = espurna::time::CoreClock;
+    const auto start = TimeSource::now();
+
+    while (_buffer.full()) {
+        if (_state != State::Sending) {
+            return false;
+        }
+
+        if (TimeSource::now() - start > _config.backlog.timeout) {
+            _buffer.clear();
+            return false;
+        }
+
+        yield();
+    }
+
+    return true;
+}
+
+bool RequestPrint::_exhaustBuffer() {
     if (_state == State::None) {
         _prepareRequest();
     }
@@ -153,52 +150,45 @@ bool RequestPrint::_exhaustBuffers() {
     using TimeSource = espurna::time::CoreClock;
     const auto start = TimeSource::now();
 
-    do {
+    while (!_buffer.empty() && (_state == State::Sending)) {
         if (TimeSource::now() - start > _config.backlog.timeout) {
-            _buffers.clear();
+            _buffer.clear();
             break;
         }
+
         yield();
-    } while (!_buffers.empty());
+    }
 
-    return _buffers.empty();
+    return _buffer.empty();
 }
 
 void RequestPrint::flush() {
-    _exhaustBuffers();
+    if (_state == State::Error) {
+        return;
+    }
+
+    _exhaustBuffer();
     _state = State::Done;
 }
 
 size_t RequestPrint::write(const uint8_t* data, size_t size) {
-    if (_state == State::Error) {
-        return 0;
-    }
-
-    size_t full_size = size;
-    auto* data_ptr = data;
+    size_t written = 0;
 
-    while (size) {
-        if (_buffers.empty() && !_addBuffer()) {
-            full_size = 0;
+    while ((_state == State::None) || (_state == State::Sending)) {
+        written += _buffer.write(data + written, size - written);
+        if (written == size) {
             break;
         }
-        auto& current = _buffers.back();
-        const auto have = current.capacity() - current.size();
-        if (have >= size) {
-            current.insert(current.end(), data_ptr, data_ptr + size);
-            size = 0;
-        } else {
-            current.insert(current.end(), data_ptr, data_ptr + have);
-            if (!_addBuffer()) {
-                full_size = 0;
-                break;
+
+        if (!_waitForSpace()) {
+            if (_state == State::Sending) {
+                _state = State::Error;
             }
-            data_ptr += have;
-            size -= have;
+            break;
         }
     }
 
-    return full_size;
+    return written;
 }
 
 } // namespace print
@@ -218,6 +208,8 @@ AsyncWebServer* _server;
 // XXX shared between requests!
 std::vector<uint8_t>* _webConfigBuffer;
 bool _webConfigSuccess = false;
+std::unique_ptr<espurna::settings::snapshot::Restore> _webConfigRestore;
+bool _webConfigRestoreFailed = false;
 
 // TODO server may not cache the full body
 std::vector<web_request_callback_f> _web_request_callbacks;
@@ -324,45 +316,34 @@ void _onGetConfig(AsyncWebServerRequest *request) {
         return;
     }
 
-    auto out = std::make_shared<String>();
-    out->reserve(TCP_MSS);
-
-    const auto app = buildApp();
+    using espurna::settings::snapshot::Backup;
+    using espurna::settings::snapshot::Format;
 
-    char buffer[256];
-    int prefix_len = snprintf_P(buffer, sizeof(buffer),
-            PSTR("{\n\"app\": \"%s\",\n\"version\": \"%s\",\n\"backup\": \"1\""),
-            app.name.c_str(), app.version.c_str());
-    if (prefix_len <= 0) {
-        request->send(500);
-        return;
-    }
-    out->concat(buffer, prefix_len);
+    const auto format = request->hasParam(F("binary"))
+        ? Format::Binary
+        : Format::Json;
 
-    espurna::settings::foreach([&](espurna::settings::kvs_type::KeyValueResult&& kv) {
-        auto key = kv.key.read();
-        auto value = kv.value.read();
-
-        int len = snprintf_P(buffer, sizeof(buffer), PSTR("\"%s\": \"%s\""), key.c_str(), value.c_str());
-        if (len > 0) {
-            *out += ",\n";
-            out->concat(buffer, len);
-        }
-    });
-    *out += "\n}";
+    // Only one key-value is formatted at a time, no need to keep the whole backup around.
+    // Buffer never grows larger than the requested chunk size plus the last key-value
+    auto backup = std::make_shared<Backup>(format);
+    auto out = std::make_shared<String>();
 
     AsyncWebServerResponse* response = request->beginChunkedResponse(
-        F("application/json"),
-        [out](uint8_t* buffer, size_t maxLen, size_t index) -> size_t {
-            auto len = out->length();
-            if (index == len) {
+        (format == Format::Json)
+            ? F("application/json")
+            : F("application/octet-stream"),
+        [backup, out](uint8_t* buffer, size_t maxLen, size_t) -> size_t {
+            while ((out->length() < maxLen) && backup->next(*out)) {
+            }
+
+            if (backup->error()) {
                 return 0;
             }
 
-            auto* ptr = out->c_str() + index;
-            size_t have = std::min(len - index, maxLen);
+            const size_t have = std::min(static_cast<size_t>(out->length()), maxLen);
             if (have) {
-                std::copy(ptr, ptr + have, buffer);
+                std::copy(out->c_str(), out->c_str() + have, buffer);
+                out->remove(0, have);
             }
 
             return have;
@@ -377,9 +358,11 @@ void _onGetConfig(AsyncWebServerRequest *request) {
         return String(espurna::time::millis().time_since_epoch().count(), 10);
     };
 
+    char buffer[128];
     int written = snprintf_P(buffer, sizeof(buffer),
-        PSTR("attachment; filename=\"%s %s backup.json\""),
-        systemHostname().c_str(), get_timestamp().c_str());
+        PSTR("attachment; filename=\"%s %s backup.%s\""),
+        systemHostname().c_str(), get_timestamp().c_str(),
+        (format == Format::Json) ? "json" : "bin");
 
     if (written > 0) {
         response->addHeader(F("Content-Disposition"), buffer);
@@ -390,6 +373,7 @@ void _onGetConfig(AsyncWebServerRequest *request) {
         return;
     }
 
+    delete response;
     request->send(500);
 }
 
@@ -408,6 +392,37 @@ void _onPostConfigFile(AsyncWebServerRequest *request, String, size_t index, uin
         return;
     }
 
+    // Binary backup is parsed right away, without buffering the whole file
+    if (index == 0) {
+        _webConfigRestore.reset();
+        _webConfigRestoreFailed = false;
+        if (len && (data[0] == espurna::settings::snapshot::Magic[0])) {
+            _webConfigRestore = std::make_unique<espurna::settings::snapshot::Restore>();
+            _webConfigSuccess = false;
+        }
+    }
+
+    // Once binary restore fails, the rest of the upload is ignored (and must not be treated as json)
+    if (_webConfigRestoreFailed) {
+        return;
+    }
+
+    if (_webConfigRestore) {
+        if (!_webConfigRestore->feed(data, len)) {
+            _webConfigRestore.reset();
+            _webConfigRestoreFailed = true;
+            _webConfigSuccess = false;
+            return;
+        }
+
+        if (final) {
+            _webConfigSuccess = _webConfigRestore->finish();
+            _webConfigRestore.reset();
+        }
+
+        return;
+    }
+
     // No buffer
     if (final && (index == 0)) {
         _webConfigSuccess = settingsRestoreJson((char*) data);
@@ -415,7 +430,10 @@ void _onPostConfigFile(AsyncWebServerRequest *request, String, size_t index, uin
     }
 
     // Buffer start => reset
-    if (index == 0) if (_webConfigBuffer) delete _webConfigBuffer;
+    if ((index == 0) && _webConfigBuffer) {
+        delete _webConfigBuffer;
+        _webConfigBuffer = nullptr;
+    }
 
     // init buffer if it doesn't exist
     if (!_webConfigBuffer) {
@@ -441,6 +459,7 @@ void _onPostConfigFile(AsyncWebServerRequest *request, String, size_t index, uin
         _webConfigBuffer->push_back(0);
         _webConfigSuccess = settingsRestoreJson((char*) _webConfigBuffer->data());
         delete _webConfigBuffer;
+        _webConfigBuffer = nullptr;
 
     }
 
@@ -9,12 +9,11 @@ Copyright (C) 2016-2019 by Xose Pérez <xose dot perez at gmail dot com>
 #pragma once
 
 #include "espurna.h"
+#include "libs/RingBuffer.h"
 
 #include <ESPAsyncWebServer.h>
 
 #include <functional>
-#include <list>
-#include <vector>
 
 namespace espurna {
 namespace web {
@@ -40,7 +39,6 @@ public:
         Error
     };
 
-    using BufferType = std::vector<uint8_t>;
     using TimeSource = espurna::time::CoreClock;
 
     // To be able to safely output data right from the request callback,
@@ -72,18 +70,21 @@ public:
 private:
     Config _config;
 
-    std::list<BufferType> _buffers;
+    // Output is written directly into the fixed-size buffer, which is drained by the response callback.
+    // When the buffer is full, writer waits until there is some space (or until the timeout)
+    RingBuffer _buffer;
     AsyncWebServerRequest* const _request;
     State _state;
 
     RequestPrint(Config config, AsyncWebServerRequest* request) :
         _config(config),
+        _buffer(config.backlog.count * config.backlog.size),
         _request(request),
         _state(State::None)
     {}
 
-    bool _addBuffer();
-    bool _exhaustBuffers();
+    bool _waitForSpace();
+    bool _exhaustBuffer();
 
     void _prepareRequest();
     size_t _handleRequest(uint8_t* data, size_t maxLen);
@@ -14,6 +14,7 @@ Copyright (C) 2016-2019 by Xose Pérez <xose dot perez at gmail dot com>
 #include <vector>
 
 #include "datetime.h"
+#include "heartbeat_delta.h"
 #include "ntp.h"
 #include "system.h"
 #include "utils.h"
@@ -127,6 +128,83 @@ template <typename T>
 struct BaseTimeFormat {
 };
 
+// Periodic update only includes values that changed since the previous one.
+// Everything is sent again when a new client connects, and once every resync interval
+enum class WsUpdateValue : size_t {
+    ApIp,
+    Ssid,
+    Bssid,
+    Channel,
+    StaIp,
+    Heap,
+    Rssi,
+    Loadavg,
+    Vcc,
+    SettingsKeys,
+    SettingsUsed,
+    SettingsAvailable,
+    SettingsMoved,
+    SettingsCommit,
+    Size,
+};
+
+constexpr bool WsUpdateDelta { 1 == WS_UPDATE_DELTA };
+constexpr espurna::duration::Seconds WsUpdateResync { WS_UPDATE_RESYNC };
+
+espurna::heartbeat::Delta<static_cast<size_t>(WsUpdateValue::Size)> _ws_update_delta;
+espurna::time::CoreClock::time_point _ws_update_last_resync;
+
+bool _wsUpdateChanged(WsUpdateValue value, double number, double threshold) {
+    return !WsUpdateDelta
+        || _ws_update_delta.changed(static_cast<size_t>(value), number, threshold);
+}
+
+bool _wsUpdateChanged(WsUpdateValue value, double number) {
+    return _wsUpdateChanged(value, number, 0.0);
+}
+
+bool _wsUpdateChanged(WsUpdateValue value, const String& string) {
+    return !WsUpdateDelta
+        || _ws_update_delta.changed(static_cast<size_t>(value), string);
+}
+
+// Settings stats walk the whole storage. Only refresh them after a commit, after the gc is done
+// removing broken keys, or when a new client connects (and is about to see the storage page)
+struct WsSettingsStats {
+    espurna::settings::Stats value{};
+    uint32_t commits { 0 };
+    bool gc { false };
+    bool valid { false };
+};
+
+WsSettingsStats _ws_settings_stats;
+
+void _wsSettingsStatsInvalidate() {
+    _ws_settings_stats.valid = false;
+}
+
+const espurna::settings::Stats& _wsSettingsStats() {
+    auto& stats = _ws_settings_stats;
+
+    const auto commits = eepromCommitCount();
+    const auto gc = espurna::settings::gc::active();
+
+    if (!stats.valid || (stats.commits != commits) || (stats.gc && !gc)) {
+        stats.value = espurna::settings::stats();
+        stats.commits = commits;
+        stats.valid = true;
+    }
+
+    stats.gc = gc;
+
+    return stats.value;
+}
+
+void _wsUpdateResync() {
+    _ws_update_last_resync = espurna::time::CoreClock::now();
+    _ws_update_delta.reset();
+}
+
 void _wsUpdateAp(JsonObject& root) {
     IPAddress ip{};
 
@@ -134,7 +212,10 @@ void _wsUpdateAp(JsonObject& root) {
         ip = wifiApIp();
     }
 
-    root[F("apip")] = ip.toString();
+    auto value = ip.toString();
+    if (_wsUpdateChanged(WsUpdateValue::ApIp, value)) {
+        root[F("apip")] = std::move(value);
+    }
 }
 
 void _wsUpdateSta(JsonObject& root) {
@@ -146,23 +227,74 @@ void _wsUpdateSta(JsonObject& root) {
         network = wifiStaInfo();
     }
 
-    root[F("ssid")] = network.ssid;
-    root[F("bssid")] =
-        ::espurna::settings::internal::serialize(network.bssid);
-    root[F("channel")] = network.channel;
-    root[F("staip")] = ip.toString();
+    if (_wsUpdateChanged(WsUpdateValue::Ssid, network.ssid)) {
+        root[F("ssid")] = network.ssid;
+    }
+
+    auto bssid = ::espurna::settings::internal::serialize(network.bssid);
+    if (_wsUpdateChanged(WsUpdateValue::Bssid, bssid)) {
+        root[F("bssid")] = std::move(bssid);
+    }
+
+    if (_wsUpdateChanged(WsUpdateValue::Channel, network.channel)) {
+        root[F("channel")] = network.channel;
+    }
+
+    auto staip = ip.toString();
+    if (_wsUpdateChanged(WsUpdateValue::StaIp, staip)) {
+        root[F("staip")] = std::move(staip);
+    }
 }
 
 void _wsUpdateStats(JsonObject& root) {
-    root[F("heap")] = systemFreeHeap();
+    const auto heap = systemFreeHeap();
+    if (_wsUpdateChanged(WsUpdateValue::Heap, heap, HEARTBEAT_DELTA_FREEHEAP)) {
+        root[F("heap")] = heap;
+    }
+
     root[F("uptime")] = prettyDuration(systemUptime());
-    root[F("rssi")] = WiFi.RSSI();
-    root[F("loadaverage")] = systemLoadAverage();
+
+    const auto rssi = WiFi.RSSI();
+    if (_wsUpdateChanged(WsUpdateValue::Rssi, rssi, HEARTBEAT_DELTA_RSSI)) {
+        root[F("rssi")] = rssi;
+    }
+
+    const auto loadaverage = systemLoadAverage();
+    if (_wsUpdateChanged(WsUpdateValue::Loadavg, loadaverage, HEARTBEAT_DELTA_LOADAVG)) {
+        root[F("loadaverage")] = loadaverage;
+    }
+
 #if ADC_MODE_VALUE == ADC_VCC
-    root[F("vcc")] = ESP.getVcc();
+    const auto vcc = ESP.getVcc();
+    if (_wsUpdateChanged(WsUpdateValue::Vcc, vcc, HEARTBEAT_DELTA_VCC)) {
+        root[F("vcc")] = vcc;
+    }
 #else
-    root[F("vcc")] = F("N/A (TOUT) ");
+    if (_wsUpdateChanged(WsUpdateValue::Vcc, 0.0)) {
+        root[F("vcc")] = F("N/A (TOUT) ");
+    }
 #endif
+
+    const auto& settings = _wsSettingsStats();
+    if (_wsUpdateChanged(WsUpdateValue::SettingsKeys, settings.keys)) {
+        root[F("settingsKeys")] = settings.keys;
+    }
+
+    if (_wsUpdateChanged(WsUpdateValue::SettingsUsed, settings.used)) {
+        root[F("settingsUsed")] = settings.used;
+    }
+
+    if (_wsUpdateChanged(WsUpdateValue::SettingsAvailable, settings.available)) {
+        root[F("settingsAvailable")] = settings.available;
+    }
+
+    if (_wsUpdateChanged(WsUpdateValue::SettingsMoved, settings.moved)) {
+        root[F("settingsMoved")] = settings.moved;
+    }
+
+    if (_wsUpdateChanged(WsUpdateValue::SettingsCommit, settings.commit.count())) {
+        root[F("settingsCommit")] = settings.commit.count();
+    }
 }
 
 #if NTP_SUPPORT
@@ -179,6 +311,10 @@ void _wsUpdateTime(JsonObject& root) {
 #endif
 
 void _wsUpdate(JsonObject& root) {
+    if (WsUpdateDelta && (espurna::time::CoreClock::now() - _ws_update_last_resync >= WsUpdateResync)) {
+        _wsUpdateResync();
+    }
+
     _wsUpdateAp(root);
     _wsUpdateSta(root);
     _wsUpdateStats(root);
@@ -464,10 +600,11 @@ namespace {
 
 // Check the existing setting before saving it
 // (we only care about the settings storage, don't mind the build values)
-bool _wsStore(String key, const String& value) {
+bool _wsStore(espurna::settings::Transaction& transaction, String key, String value) {
     const auto current = espurna::settings::get(key);
     if (!current || (current.ref() != value)) {
-        return espurna::settings::set(key, value);
+        transaction.set(std::move(key), std::move(value));
+        return true;
     }
 
     return false;
@@ -603,9 +740,12 @@ void _wsParse(AsyncWebSocketClient* client, uint8_t* payload, size_t length) {
     bool save { false };
     bool reload { false };
 
+    // Everything is applied at once, right before saving
+    espurna::settings::Transaction transaction;
+
     JsonArray& toDelete = settings["del"];
     for (const auto& value : toDelete) {
-        delSetting(value.as<String>());
+        transaction.del(value.as<String>());
     }
 
     // TODO: pass key as string, we always attempt to use it as such
@@ -613,12 +753,16 @@ void _wsParse(AsyncWebSocketClient* client, uint8_t* payload, size_t length) {
     for (auto& kv : toAssign) {
         const String key = kv.key;
         if (_wsCheckKey(key, kv.value)) {
-            if (_wsStore(key, kv.value.as<String>())) {
+            if (_wsStore(transaction, key, kv.value.as<String>())) {
                 save = true;
             }
         }
     }
 
+    if (!transaction.commit()) {
+        save = false;
+    }
+
     _wsPostParse(client_id, save, reload);
 }
 
@@ -693,9 +837,13 @@ void _wsEvent(AsyncWebSocket* server, AsyncWebSocketClient* client, AwsEventType
         DEBUG_MSG_P(PSTR("[WEBSOCKET] #%u connected, ip: %s, url: %s\n"),
             client->id(), ip.c_str(), server->url());
 
+        _wsSettingsStatsInvalidate();
         _wsConnected(client->id());
         _wsResetUpdateTimer();
 
+        // New client does not know about any of the previous values
+        _wsUpdateResync();
+
         client->_tempObject = new WebSocketIncomingBuffer(_wsParse);
         break;
     }
@@ -101,6 +101,7 @@ void wsSend(uint32_t client_id, JsonObject& root);
 void wsSend(JsonObject& root);
 void wsSend(ws_on_send_callback_f callback);
 void wsSend(const char* data);
+void wsSend(uint32_t client_id, const char* data);
 
 // Check if any or specific client_id is connected
 // Server will try to set unique ID for each client
@@ -121,6 +121,11 @@ export function init() {
         heap: 999999,
         loadaverage: 99,
         vcc: '3.3',
+        settingsKeys: 99,
+        settingsUsed: 1234,
+        settingsAvailable: 2795,
+        settingsMoved: 567,
+        settingsCommit: 8901,
         mqttStatus: true,
         ntpStatus: true,
         dczRelays: [
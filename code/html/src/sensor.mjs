@@ -60,6 +60,9 @@ const Magnitudes = {
 
     /** @type {boolean} */
     pending: false,
+
+    /** @type {boolean} */
+    history: false,
 };
 
 /**
@@ -244,11 +247,94 @@ function initMagnitudesList(values, schema, callbacks) {
     Magnitudes.pending = false;
 }
 
+/** @typedef {"raw" | "1m" | "15m"} HistoryResolution */
+
 /**
- * @param {number} _id
+ * @param {number} id
+ * @param {HistoryResolution} resolution
+ */
+function requestMagnitudeHistory(id, resolution = "1m") {
+    if (Magnitudes.history) {
+        sendAction("magnitude-history", {id, resolution});
+    }
+}
+
+/**
+ * History is only kept when firmware is built with it, which it reports as a module.
+ * Magnitudes list could've been received before the module list, catch up with it here
+ * @param {string[]} modules
+ */
+function initMagnitudesHistory(modules) {
+    if (Magnitudes.history || !modules.includes("sns-history")) {
+        return;
+    }
+
+    Magnitudes.history = true;
+    document.querySelectorAll("svg.magnitude-history[data-id]")
+        .forEach((elem) => {
+            requestMagnitudeHistory(
+                parseInt(/** @type {SVGElement} */(elem).dataset["id"] ?? "", 10));
+        });
+}
+
+/** @typedef {[number, number | null]} HistorySample */
+
+/** @typedef {[number, number | null, number | null, number | null]} HistoryAggregate */
+
+/** @typedef {{id: number, resolution: HistoryResolution, now: number, values: Array<HistorySample | HistoryAggregate>}} MagnitudeHistory */
+
+/**
+ * Draw the last hour of 1 minute averages, or the raw values when there are not enough of them yet
+ * @param {MagnitudeHistory} history
+ */
+function updateMagnitudeHistory(history) {
+    const line = document.querySelector(
+        `svg.magnitude-history[data-id='${history.id}'] > polyline`);
+    if (!line) {
+        return;
+    }
+
+    // value is the only number for raw samples, aggregates use the average
+    const offset = (history.resolution === "raw") ? 1 : 2;
+
+    /** @type {[number, number][]} */
+    const points = history.values
+        .filter((entry) => typeof entry[offset] === "number")
+        .map((entry) => [entry[0], /** @type {number} */(entry[offset])]);
+
+    if ((points.length < 2) && (history.resolution === "1m")) {
+        requestMagnitudeHistory(history.id, "raw");
+        return;
+    }
+
+    if (points.length < 2) {
+        line.setAttribute("points", "");
+        return;
+    }
+
+    const times = points.map((point) => point[0]);
+    const values = points.map((point) => point[1]);
+
+    const [minTime, maxTime] = [Math.min(...times), Math.max(...times)];
+    const [minValue, maxValue] = [Math.min(...values), Math.max(...values)];
+
+    const timeRange = (maxTime - minTime) || 1;
+    const valueRange = (maxValue - minValue) || 1;
+
+    line.setAttribute("points", points
+        .map(([time, value]) => {
+            const x = (100 * (time - minTime)) / timeRange;
+            const y = 19 - ((18 * (value - minValue)) / valueRange);
+            return `${x.toFixed(1)},${y.toFixed(1)}`;
+        })
+        .join(" "));
+}
+
+/**
+ * @param {number} id
  * @param {Magnitude} magnitude
  */
-function createMagnitudeInfo(_id, magnitude) {
+function createMagnitudeInfo(id, magnitude) {
     const container = document.getElementById("magnitudes");
     if (!container) {
         return;
@@ -273,7 +359,15 @@ function createMagnitudeInfo(_id, magnitude) {
         (line.querySelector(".magnitude-description"));
     description.textContent = magnitude.description;
 
+    const history = /** @type {!SVGElement} */
+        (line.querySelector(".magnitude-history"));
+    history.dataset["id"] = id.toString();
+    history.addEventListener("click", () => {
+        requestMagnitudeHistory(id);
+    });
+
     mergeTemplate(container, line);
+    requestMagnitudeHistory(id);
 }
 
 /**
@@ -642,6 +736,12 @@ function listeners() {
         "energy": (_, value) => {
             updateEnergy(value.values, value.schema);
         },
+        "magnitude-history": (_, value) => {
+            updateMagnitudeHistory(value);
+        },
+        "modulesVisible": (_, value) => {
+            initMagnitudesHistory(value);
+        },
     };
 }
 
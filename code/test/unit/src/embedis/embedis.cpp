@@ -8,13 +8,17 @@
 #pragma GCC diagnostic warning "-Wstrict-overflow=5"
 
 #include <espurna/settings_embedis.h>
+#include <espurna/settings_index.h>
+#include <espurna/settings_snapshot.h>
 
 #include <algorithm>
 #include <array>
+#include <chrono>
 #include <numeric>
 #include <random>
 
 #include <cstdio>
+#include <cstring>
 
 namespace espurna {
 namespace settings {
@@ -48,16 +52,35 @@ struct StaticArrayStorage {
     const size_t _size;
 };
 
+// same as above, but also implements optional block access methods
+template <typename T>
+struct StaticArrayBlockStorage : public StaticArrayStorage<T> {
+    using StaticArrayStorage<T>::StaticArrayStorage;
+    using StaticArrayStorage<T>::read;
+    using StaticArrayStorage<T>::write;
+
+    void read(uint16_t begin, uint16_t end, uint8_t* out) const {
+        TEST_ASSERT_LESS_OR_EQUAL(end, begin);
+        TEST_ASSERT_LESS_OR_EQUAL(this->_size, end);
+        std::copy(this->_blob.begin() + begin, this->_blob.begin() + end, out);
+    }
+
+    void write(uint16_t begin, const uint8_t* input_begin, const uint8_t* input_end) {
+        TEST_ASSERT_LESS_OR_EQUAL(this->_size, begin + std::distance(input_begin, input_end));
+        std::copy(input_begin, input_end, this->_blob.begin() + begin);
+    }
+};
+
 namespace test {
 
 using espurna::settings::embedis::StaticArrayStorage;
 using espurna::settings::embedis::KeyValueStore;
 
-template <size_t Size>
+template <size_t Size, template <typename> class Storage = StaticArrayStorage>
 struct StorageHandler {
 
     using array_type = std::array<uint8_t, Size>;
-    using storage_type = StaticArrayStorage<array_type>;
+    using storage_type = Storage<array_type>;
     using kvs_type = KeyValueStore<storage_type>;
 
     StorageHandler() :
@@ -501,6 +524,41 @@ void test_keys_iterator() {
 
 }
 
+// same order as the full foreach(), but split into multiple calls
+void test_keys_iterator_slices() {
+    constexpr size_t Size = 256;
+    StorageHandler<Size> instance;
+
+    using kvs_type = decltype(instance)::kvs_type;
+
+    TestSequentialKvGenerator generator;
+    const auto kvs = generator.make(10);
+    for (const auto& kv : kvs) {
+        TEST_ASSERT(instance.kvs.set(kv.first, kv.second));
+    }
+
+    std::vector<String> keys;
+    auto callback = [&](kvs_type::KeyValueResult&& kv) {
+        keys.push_back(kv.key.read());
+    };
+
+    size_t calls = 0;
+    uint16_t position = instance.kvs.end();
+    while ((position = instance.kvs.foreach(position, 3, callback))) {
+        ++calls;
+        TEST_ASSERT_EQUAL(calls * 3, keys.size());
+    }
+
+    TEST_ASSERT_EQUAL(3, calls);
+    TEST_ASSERT_EQUAL(kvs.size(), keys.size());
+    for (size_t index = 0; index < kvs.size(); ++index) {
+        TEST_ASSERT_EQUAL_STRING(kvs[index].first.c_str(), keys[index].c_str());
+    }
+
+    TEST_ASSERT_EQUAL(0, instance.kvs.foreach(0, 3, callback));
+    TEST_ASSERT_EQUAL(kvs.size(), keys.size());
+}
+
 // noticed when storing varying data that gets rotated from time to time
 // needs more capacity than general tests; force to set() and then clean
 // everything until the next round of set()
@@ -583,6 +641,502 @@ err:
     assert_keys();
 }
 
+// block access should produce exactly the same storage layout as the byte-wise one
+void test_block_storage() {
+    constexpr size_t Size = 512;
+
+    StorageHandler<Size> bytes;
+    StorageHandler<Size, StaticArrayBlockStorage> blocks;
+
+    TestSequentialKvGenerator generator(TestSequentialKvGenerator::Mode::IncreasingLength);
+    const auto kvs = generator.make(12);
+
+    auto check = [&](const String& key, const String& value) {
+        TEST_ASSERT_EQUAL(bytes.kvs.set(key, value), blocks.kvs.set(key, value));
+        TEST_ASSERT(bytes.blob == blocks.blob);
+    };
+
+    // - insert keys sequentially
+    // - shrink every other value, forcing data shift
+    // - remove some of the keys, forcing data shift
+    for (const auto& kv : kvs) {
+        check(kv.first, kv.second);
+    }
+
+    for (size_t index = 0; index < kvs.size(); index += 2) {
+        check(kvs[index].first, kvs[index].second.substring(1));
+    }
+
+    for (size_t index = 1; index < kvs.size(); index += 3) {
+        TEST_ASSERT(bytes.kvs.del(kvs[index].first));
+        TEST_ASSERT(blocks.kvs.del(kvs[index].first));
+        TEST_ASSERT(bytes.blob == blocks.blob);
+    }
+
+    TEST_ASSERT_EQUAL(bytes.kvs.count(), blocks.kvs.count());
+    TEST_ASSERT_EQUAL(bytes.kvs.available(), blocks.kvs.available());
+
+    for (size_t index = 0; index < kvs.size(); ++index) {
+        const auto& key = kvs[index].first;
+        const auto result = blocks.kvs.get(key);
+        TEST_ASSERT_EQUAL(static_cast<bool>(bytes.kvs.get(key)),
+            static_cast<bool>(result));
+        if ((index % 3) != 1) {
+            TEST_ASSERT(static_cast<bool>(result));
+            const auto& expected = (index % 2)
+                ? kvs[index].second
+                : kvs[index].second.substring(1);
+            TEST_ASSERT_EQUAL_STRING(expected.c_str(), result.c_str());
+        }
+    }
+
+    // longer keys and values span multiple internal blocks
+    String long_key;
+    String long_value;
+    for (size_t index = 0; index < 100; ++index) {
+        long_key += static_cast<char>('a' + (index % 26));
+        long_value += static_cast<char>('A' + (index % 26));
+    }
+
+    check(long_key, long_value);
+    check(long_key, long_value.substring(0, 90));
+    TEST_ASSERT_EQUAL_STRING(long_value.substring(0, 90).c_str(),
+        blocks.kvs.get(long_key).c_str());
+}
+
+// batched changes should result in the same kvs as the sequential set() and del()
+void test_apply() {
+    constexpr size_t Size = 1024;
+
+    StorageHandler<Size> sequential;
+    StorageHandler<Size> batched;
+
+    using kvs_type = decltype(batched)::kvs_type;
+
+    TestSequentialKvGenerator generator;
+    const auto kvs = generator.make(24);
+    for (const auto& kv : kvs) {
+        TEST_ASSERT(sequential.kvs.set(kv.first, kv.second));
+        TEST_ASSERT(batched.kvs.set(kv.first, kv.second));
+    }
+
+    const auto moved = sequential.kvs.moved();
+    TEST_ASSERT_EQUAL(moved, batched.kvs.moved());
+
+    kvs_type::Changes changes;
+
+    // - replace with longer values
+    // - erase some keys, including the missing one
+    // - set the same value
+    // - add new keys
+    for (size_t index = 0; index < kvs.size(); index += 3) {
+        changes.push_back({kvs[index].first, kvs[index].second + "updated", false});
+    }
+
+    for (size_t index = 1; index < kvs.size(); index += 3) {
+        changes.push_back({kvs[index].first, "", true});
+    }
+
+    changes.push_back({"missing", "", true});
+    changes.push_back({kvs[2].first, kvs[2].second, false});
+
+    const auto added = generator.make(4);
+    for (const auto& kv : added) {
+        changes.push_back({kv.first, kv.second, false});
+    }
+
+    for (const auto& change : changes) {
+        if (change.erase) {
+            sequential.kvs.del(change.key);
+        } else {
+            TEST_ASSERT(sequential.kvs.set(change.key, change.value));
+        }
+    }
+
+    const auto total = changes.size();
+    TEST_ASSERT(batched.kvs.apply(changes));
+    TEST_ASSERT_EQUAL(total - 2, changes.size());
+
+    TEST_ASSERT_EQUAL(sequential.kvs.count(), batched.kvs.count());
+    TEST_ASSERT_EQUAL(sequential.kvs.available(), batched.kvs.available());
+
+    sequential.kvs.foreach([&](kvs_type::KeyValueResult&& kv) {
+        const auto key = kv.key.read();
+        const auto result = batched.kvs.get(key);
+        TEST_ASSERT_MESSAGE(static_cast<bool>(result), key.c_str());
+        TEST_ASSERT_EQUAL_STRING(kv.value.read().c_str(), result.c_str());
+    });
+
+    TEST_ASSERT_LESS_THAN(sequential.kvs.moved() - moved, batched.kvs.moved() - moved);
+
+    String message("- moved bytes, sequential: ");
+    message += sequential.kvs.moved() - moved;
+    message += ", batched: ";
+    message += batched.kvs.moved() - moved;
+    TEST_MESSAGE(message.c_str());
+
+    // nothing left to change
+    TEST_ASSERT(batched.kvs.apply(changes));
+    TEST_ASSERT_EQUAL(0, changes.size());
+
+    // storage stays the same when changes do not fit
+    const auto blob = batched.blob;
+
+    String huge;
+    for (size_t index = 0; index < Size; ++index) {
+        huge += 'x';
+    }
+
+    changes.push_back({kvs[0].first, "", true});
+    changes.push_back({"huge", huge, false});
+    TEST_ASSERT_FALSE(batched.kvs.apply(changes));
+    TEST_ASSERT(blob == batched.blob);
+
+    // ...or when any key is empty
+    changes.clear();
+    changes.push_back({kvs[0].first, "", true});
+    changes.push_back({"", "value", false});
+    TEST_ASSERT_FALSE(batched.kvs.apply(changes));
+    TEST_ASSERT(blob == batched.blob);
+
+    // fits() pretends that the storage is empty, nothing is modified
+    TEST_ASSERT_FALSE(batched.kvs.fits(changes));
+
+    changes.clear();
+    for (const auto& kv : kvs) {
+        changes.push_back({kv.first, kv.second, false});
+    }
+    TEST_ASSERT(batched.kvs.fits(changes));
+
+    changes.push_back({"huge", huge, false});
+    TEST_ASSERT_FALSE(batched.kvs.fits(changes));
+    TEST_ASSERT(blob == batched.blob);
+}
+
+// similar to the EEPROM class, every access is an out-of-line call with bounds checks
+template <typename T>
+struct BenchmarkStorage {
+    explicit BenchmarkStorage(T& blob) :
+        _blob(blob)
+    {}
+
+    [[gnu::noinline]]
+    uint8_t read(size_t index) const {
+        if (index < _blob.size()) {
+            return _blob[index];
+        }
+
+        return 0;
+    }
+
+    [[gnu::noinline]]
+    void write(size_t index, uint8_t value) {
+        if (index < _blob.size()) {
+            _blob[index] = value;
+        }
+    }
+
+    void commit() {
+    }
+
+    T& _blob;
+};
+
+template <typename T>
+struct BenchmarkBlockStorage : public BenchmarkStorage<T> {
+    using BenchmarkStorage<T>::BenchmarkStorage;
+    using BenchmarkStorage<T>::read;
+    using BenchmarkStorage<T>::write;
+
+    [[gnu::noinline]]
+    void read(uint16_t begin, uint16_t end, uint8_t* out) const {
+        if ((begin <= end) && (end <= this->_blob.size())) {
+            std::memcpy(out, &this->_blob[begin], end - begin);
+        }
+    }
+
+    [[gnu::noinline]]
+    void write(uint16_t begin, const uint8_t* input_begin, const uint8_t* input_end) {
+        const size_t size = std::distance(input_begin, input_end);
+        if ((begin + size) <= this->_blob.size()) {
+            std::memcpy(&this->_blob[begin], input_begin, size);
+        }
+    }
+};
+
+// lookup and update timings for a full store, depending on the storage access type
+template <template <typename> class Storage>
+struct BenchmarkRunner {
+    static constexpr size_t Size { 4096 };
+    static constexpr size_t Rounds { 16 };
+
+    using clock = std::chrono::steady_clock;
+    using duration = std::chrono::duration<double, std::micro>;
+
+    void operator()(const char* name) {
+        StorageHandler<Size, Storage> instance;
+
+        // leave some space for the values that would grow
+        TestSequentialKvGenerator generator;
+        std::vector<TestSequentialKvGenerator::kv> kvs;
+        while (instance.kvs.available() > 128) {
+            kvs.push_back(generator.next());
+            TEST_ASSERT(instance.kvs.set(kvs.back().first, kvs.back().second));
+        }
+
+        duration lookup{};
+        duration update{};
+
+        for (size_t round = 0; round < Rounds; ++round) {
+            auto start = clock::now();
+            for (const auto& kv : kvs) {
+                TEST_ASSERT(static_cast<bool>(instance.kvs.get(kv.first)));
+            }
+            lookup += clock::now() - start;
+
+            start = clock::now();
+            for (const auto& kv : kvs) {
+                TEST_ASSERT(instance.kvs.set(kv.first, kv.second + 'x'));
+                TEST_ASSERT(instance.kvs.set(kv.first, kv.second));
+            }
+            update += clock::now() - start;
+        }
+
+        const auto lookups = Rounds * kvs.size();
+        const auto updates = 2 * lookups;
+
+        char message[160];
+        std::snprintf(message, sizeof(message),
+            "- %s: %zu keys, %.3fus per get(), %.3fus per set()",
+            name, kvs.size(),
+            lookup.count() / lookups,
+            update.count() / updates);
+        TEST_MESSAGE(message);
+    }
+};
+
+void test_benchmark_block_access() {
+    BenchmarkRunner<BenchmarkStorage>{}("byte-wise");
+    BenchmarkRunner<BenchmarkBlockStorage>{}("block");
+}
+
+// index must find exactly the same keys as the linear search
+void test_index() {
+    constexpr size_t Size = 1024;
+    StorageHandler<Size> instance;
+    KeyValueIndex index;
+
+    TEST_ASSERT_FALSE(index.valid());
+    TEST_ASSERT_FALSE(static_cast<bool>(index.find(instance.kvs, "key")));
+    TEST_ASSERT(index.valid());
+    TEST_ASSERT_EQUAL(0, index.stats().keys);
+
+    TestSequentialKvGenerator generator;
+    const auto kvs = generator.make(32);
+    for (const auto& kv : kvs) {
+        TEST_ASSERT(instance.kvs.set(kv.first, kv.second));
+    }
+
+    // nothing is tracked, index is stale until rebuilt
+    index.invalidate();
+
+    for (const auto& kv : kvs) {
+        const auto result = index.find(instance.kvs, kv.first);
+        TEST_ASSERT_MESSAGE(static_cast<bool>(result), kv.first.c_str());
+        TEST_ASSERT_EQUAL_STRING(kv.second.c_str(), result.value.read().c_str());
+    }
+
+    const auto stats = index.stats();
+    TEST_ASSERT_EQUAL(2, stats.rebuilds);
+    TEST_ASSERT_EQUAL(kvs.size(), stats.keys);
+    TEST_ASSERT_GREATER_THAN(stats.keys, stats.slots);
+    TEST_ASSERT_EQUAL(stats.slots * sizeof(KeyValueIndex::Slot), stats.bytes);
+
+    TEST_ASSERT_FALSE(static_cast<bool>(index.find(instance.kvs, "key")));
+    TEST_ASSERT_FALSE(static_cast<bool>(index.find(instance.kvs, "key100")));
+    TEST_ASSERT_FALSE(static_cast<bool>(index.find(instance.kvs, "")));
+
+    // shift every other kv, existing positions are no longer valid
+    for (size_t it = 0; it < kvs.size(); it += 2) {
+        TEST_ASSERT(instance.kvs.del(kvs[it].first));
+    }
+
+    index.invalidate();
+
+    for (size_t it = 0; it < kvs.size(); ++it) {
+        const auto result = index.find(instance.kvs, kvs[it].first);
+        TEST_ASSERT_EQUAL(static_cast<bool>(instance.kvs.get(kvs[it].first)),
+            static_cast<bool>(result));
+        TEST_ASSERT_EQUAL((it % 2) != 0, static_cast<bool>(result));
+    }
+
+    TEST_ASSERT_EQUAL(3, index.stats().rebuilds);
+    TEST_ASSERT_EQUAL(kvs.size() / 2, index.stats().keys);
+}
+
+// linear search cost grows with the number of keys, index lookup is expected to stay the same
+void test_benchmark_index() {
+    using clock = std::chrono::steady_clock;
+    using duration = std::chrono::duration<double, std::micro>;
+
+    constexpr size_t Rounds { 16 };
+    constexpr size_t Counts[] { 16, 32, 64, 128, 256 };
+
+    for (const auto count : Counts) {
+        StorageHandler<4096, BenchmarkBlockStorage> instance;
+        KeyValueIndex index;
+
+        TestSequentialKvGenerator generator;
+        const auto kvs = generator.make(count);
+        for (const auto& kv : kvs) {
+            TEST_ASSERT(instance.kvs.set(kv.first, kv.second));
+        }
+
+        duration linear{};
+        duration indexed{};
+
+        for (size_t round = 0; round < Rounds; ++round) {
+            auto start = clock::now();
+            for (const auto& kv : kvs) {
+                TEST_ASSERT(static_cast<bool>(instance.kvs.get(kv.first)));
+            }
+            linear += clock::now() - start;
+
+            start = clock::now();
+            for (const auto& kv : kvs) {
+                TEST_ASSERT(static_cast<bool>(index.find(instance.kvs, kv.first)));
+            }
+            indexed += clock::now() - start;
+        }
+
+        const auto lookups = Rounds * count;
+
+        char message[160];
+        std::snprintf(message, sizeof(message),
+            "- %zu keys: %.3fus linear, %.3fus indexed, %zu bytes of index (%.1f per key)",
+            count,
+            linear.count() / lookups,
+            indexed.count() / lookups,
+            index.stats().bytes,
+            static_cast<double>(index.stats().bytes) / count);
+        TEST_MESSAGE(message);
+    }
+}
+
+void test_snapshot_crc() {
+    const char input[] = "123456789";
+
+    snapshot::Crc32 crc;
+    crc.update(reinterpret_cast<const uint8_t*>(&input[0]), sizeof(input) - 1);
+    TEST_ASSERT_EQUAL_HEX32(0xCBF43926ul, crc.value());
+}
+
+void test_snapshot_roundtrip() {
+    constexpr size_t Size = 1024;
+    StorageHandler<Size> instance;
+
+    using kvs_type = decltype(instance)::kvs_type;
+
+    TestSequentialKvGenerator generator;
+    auto kvs = generator.make(16);
+    kvs.emplace_back("empty", "");
+    kvs.emplace_back("binary", String("\x01\xff\x7f\"\\"));
+
+    for (const auto& kv : kvs) {
+        TEST_ASSERT(instance.kvs.set(kv.first, kv.second));
+    }
+
+    String out;
+
+    snapshot::Encoder encoder;
+    encoder.header(out);
+    instance.kvs.foreach([&](kvs_type::KeyValueResult&& kv) {
+        encoder.record(out, kv.key.read(), kv.value.read());
+    });
+    encoder.end(out);
+
+    const auto* data = reinterpret_cast<const uint8_t*>(out.c_str());
+
+    // any chunk size should produce the same result, even when lengths are split in the middle
+    for (size_t chunk : {size_t{1}, size_t{3}, size_t{64}, static_cast<size_t>(out.length())}) {
+        std::vector<std::pair<String, String>> decoded;
+
+        snapshot::Decoder decoder(Size);
+        for (size_t offset = 0; offset < out.length(); offset += chunk) {
+            const auto size = std::min(chunk, out.length() - offset);
+            decoder.feed(data + offset, size,
+                [&](String&& key, String&& value) {
+                    decoded.emplace_back(std::move(key), std::move(value));
+                    return true;
+                });
+            TEST_ASSERT(!decoder.error());
+        }
+
+        TEST_ASSERT(decoder.done());
+        TEST_ASSERT_EQUAL(kvs.size(), decoded.size());
+
+        // kvs are written right-to-left and are also read back in the same order
+        for (const auto& kv : kvs) {
+            auto it = std::find_if(decoded.begin(), decoded.end(),
+                [&](const std::pair<String, String>& other) {
+                    return other.first == kv.first;
+                });
+            TEST_ASSERT(it != decoded.end());
+            TEST_ASSERT_EQUAL(kv.second.length(), (*it).second.length());
+            TEST_ASSERT_EQUAL_STRING(kv.second.c_str(), (*it).second.c_str());
+        }
+    }
+}
+
+void test_snapshot_corrupted() {
+    String out;
+
+    snapshot::Encoder encoder;
+    encoder.header(out);
+    encoder.record(out, "key", "value");
+    encoder.record(out, "another", "one");
+    encoder.end(out);
+
+    auto decode = [](const String& input, size_t limit) {
+        snapshot::Decoder decoder(limit);
+        decoder.feed(reinterpret_cast<const uint8_t*>(input.c_str()), input.length(),
+            [](String&&, String&&) {
+                return true;
+            });
+        return decoder.state();
+    };
+
+    TEST_ASSERT(decode(out, 64) == snapshot::Decoder::State::Done);
+
+    // lengths are checked before anything is read
+    TEST_ASSERT(decode(out, 2) == snapshot::Decoder::State::Error);
+
+    // any modified byte is either a parsing error or a crc mismatch
+    for (size_t index = 0; index < out.length(); ++index) {
+        String modified(out);
+        modified[index] = modified[index] ^ 0x20;
+        TEST_ASSERT(decode(modified, 64) != snapshot::Decoder::State::Done);
+    }
+
+    // truncated data is never done
+    String truncated(out);
+    truncated.remove(truncated.length() - 1);
+    TEST_ASSERT(decode(truncated, 64) == snapshot::Decoder::State::Crc);
+
+    // and nothing is expected after the crc
+    String trailing(out);
+    trailing += '\0';
+    TEST_ASSERT(decode(trailing, 64) == snapshot::Decoder::State::Error);
+}
+
+void test_snapshot_json_escape() {
+    String out;
+    snapshot::json_string(out, String("plain \"quoted\" back\\slash\n\t\x01 \xc3\xa9"));
+    TEST_ASSERT_EQUAL_STRING(
+        "\"plain \\\"quoted\\\" back\\\\slash\\n\\t\\u0001 \xc3\xa9\"",
+        out.c_str());
+}
+
 } // namespace test
 
 } // namespace
@@ -596,7 +1150,9 @@ int main(int, char**) {
     UNITY_BEGIN();
 
     RUN_TEST(test_basic);
+    RUN_TEST(test_block_storage);
     RUN_TEST(test_keys_iterator);
+    RUN_TEST(test_keys_iterator_slices);
     RUN_TEST(test_longkey);
     RUN_TEST(test_overflow);
     RUN_TEST(test_perseverance);
@@ -605,6 +1161,14 @@ int main(int, char**) {
     RUN_TEST(test_small_gaps);
     RUN_TEST(test_storage);
     RUN_TEST(test_varying_values);
+    RUN_TEST(test_index);
+    RUN_TEST(test_apply);
+    RUN_TEST(test_snapshot_crc);
+    RUN_TEST(test_snapshot_roundtrip);
+    RUN_TEST(test_snapshot_corrupted);
+    RUN_TEST(test_snapshot_json_escape);
+    RUN_TEST(test_benchmark_block_access);
+    RUN_TEST(test_benchmark_index);
 
     return UNITY_END();
 }
@@ -4,14 +4,23 @@
 #include <StreamString.h>
 #include <ArduinoJson.h>
 
+#include <espurna/filters/EwmaFilter.h>
 #include <espurna/filters/LastFilter.h>
 #include <espurna/filters/MaxFilter.h>
 #include <espurna/filters/MedianFilter.h>
 #include <espurna/filters/MinFilter.h>
 #include <espurna/filters/MovingAverageFilter.h>
+#include <espurna/filters/MovingMinMaxFilter.h>
 #include <espurna/filters/SumFilter.h>
+#include <espurna/filters/TrimmedMeanFilter.h>
 
 #include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <numeric>
+#include <random>
+#include <vector>
 
 namespace espurna {
 namespace test {
@@ -355,6 +364,306 @@ void test_sum() {
     TEST_ASSERT_EQUAL_DOUBLE(14.0, filter.value());
 }
 
+void test_ewma() {
+    auto filter = EwmaFilter();
+    TEST_ASSERT(!filter.available());
+    TEST_ASSERT(!filter.ready());
+
+    // 2 / (3 + 1), every value is weighted by 0.5
+    filter.resize(3);
+    TEST_ASSERT(!filter.available());
+    TEST_ASSERT(!filter.ready());
+
+    filter.update(10.0);
+    TEST_ASSERT(filter.available());
+    TEST_ASSERT(!filter.ready());
+    TEST_ASSERT_EQUAL_DOUBLE(10.0, filter.value());
+
+    filter.update(20.0);
+    TEST_ASSERT(!filter.ready());
+    TEST_ASSERT_EQUAL_DOUBLE(15.0, filter.value());
+
+    filter.update(30.0);
+    TEST_ASSERT(filter.ready());
+    TEST_ASSERT_EQUAL_DOUBLE(22.5, filter.value());
+
+    filter.update(22.5);
+    TEST_ASSERT(filter.ready());
+    TEST_ASSERT_EQUAL_DOUBLE(22.5, filter.value());
+
+    // nothing is reset after reporting
+    filter.restart();
+    TEST_ASSERT(filter.available());
+    TEST_ASSERT(filter.ready());
+
+    filter.reset();
+    TEST_ASSERT(!filter.available());
+    TEST_ASSERT(!filter.ready());
+
+    filter.update(5.0);
+    TEST_ASSERT(filter.available());
+    TEST_ASSERT_EQUAL_DOUBLE(5.0, filter.value());
+
+    filter.resize(0);
+    TEST_ASSERT(!filter.available());
+    TEST_ASSERT(!filter.ready());
+
+    filter.update(6.0);
+    TEST_ASSERT(!filter.available());
+}
+
+void test_moving_min_max() {
+    auto min = MovingMinFilter();
+    auto max = MovingMaxFilter();
+
+    for (auto* filter : {static_cast<BaseFilter*>(&min), static_cast<BaseFilter*>(&max)}) {
+        TEST_ASSERT(!filter->available());
+        TEST_ASSERT(!filter->ready());
+
+        filter->resize(3);
+        TEST_ASSERT(!filter->available());
+        TEST_ASSERT(!filter->ready());
+    }
+
+    const double samples[] {5., 3., 4., 6., 7., 1., 1., 2., 2.};
+    const double expected_min[] {5., 3., 3., 3., 4., 1., 1., 1., 1.};
+    const double expected_max[] {5., 5., 5., 6., 7., 7., 7., 2., 2.};
+
+    for (size_t index = 0; index < std::size(samples); ++index) {
+        min.update(samples[index]);
+        max.update(samples[index]);
+
+        TEST_ASSERT(min.available());
+        TEST_ASSERT(max.available());
+
+        TEST_ASSERT_EQUAL(index >= 2, min.ready());
+        TEST_ASSERT_EQUAL(index >= 2, max.ready());
+
+        TEST_ASSERT_EQUAL_DOUBLE(expected_min[index], min.value());
+        TEST_ASSERT_EQUAL_DOUBLE(expected_max[index], max.value());
+    }
+
+    // window only keeps [2, 2]
+    min.resize(2);
+    max.resize(2);
+    TEST_ASSERT_EQUAL_DOUBLE(2., min.value());
+    TEST_ASSERT_EQUAL_DOUBLE(2., max.value());
+
+    min.update(-1.);
+    max.update(-1.);
+    TEST_ASSERT_EQUAL_DOUBLE(-1., min.value());
+    TEST_ASSERT_EQUAL_DOUBLE(2., max.value());
+
+    min.reset();
+    max.reset();
+    TEST_ASSERT(!min.available());
+    TEST_ASSERT(!max.available());
+}
+
+void test_trimmed_mean() {
+    auto filter = TrimmedMeanFilter();
+    TEST_ASSERT(!filter.available());
+    TEST_ASSERT(!filter.ready());
+
+    filter.resize(8);
+
+    // [-100, 1, 2, 3, 4, 5, 6, 100], lowest and highest 2 are not used
+    const double one[] {100., 1., 2., 3., 4., 5., 6., -100.};
+    for (const auto& sample : one) {
+        TEST_ASSERT(!filter.ready());
+        filter.update(sample);
+        TEST_ASSERT(filter.available());
+    }
+
+    TEST_ASSERT(filter.ready());
+    TEST_ASSERT_EQUAL_DOUBLE(3.5, filter.value());
+
+    // [1, 2, 3, 4, 5, 6, -100, 1000], 100 is no longer in the window
+    filter.update(1000.);
+    TEST_ASSERT(filter.ready());
+    TEST_ASSERT_EQUAL_DOUBLE(3.5, filter.value());
+
+    // [-100, 1000], nothing is trimmed with less than 4 values
+    filter.resize(2);
+    TEST_ASSERT(filter.ready());
+    TEST_ASSERT_EQUAL_DOUBLE(450., filter.value());
+
+    filter.update(NAN);
+    TEST_ASSERT_EQUAL_DOUBLE(450., filter.value());
+
+    filter.reset();
+    TEST_ASSERT(!filter.available());
+    TEST_ASSERT(!filter.ready());
+
+    filter.resize(0);
+    filter.update(1.);
+    TEST_ASSERT(!filter.available());
+}
+
+// Windowed filters must produce the same values as the straightforward implementation
+struct ReferenceWindow {
+    void resize(size_t size) {
+        while (values.size() > size) {
+            values.pop_front();
+        }
+
+        this->size = size;
+    }
+
+    void update(double value) {
+        if (!size) {
+            return;
+        }
+
+        if (values.size() == size) {
+            values.pop_front();
+        }
+
+        values.push_back(value);
+    }
+
+    std::vector<double> sorted() const {
+        std::vector<double> out(values.begin(), values.end());
+        std::sort(out.begin(), out.end());
+        return out;
+    }
+
+    double average() const {
+        return std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+    }
+
+    double median() const {
+        const auto out = sorted();
+        const auto middle = out.size() / 2;
+        if (out.size() % 2) {
+            return out[middle];
+        }
+
+        return (out[middle - 1] + out[middle]) / 2.0;
+    }
+
+    double trimmed_mean() const {
+        const auto out = sorted();
+        const auto trim = out.size() / 4;
+        return std::accumulate(out.begin() + trim, out.end() - trim, 0.0)
+            / (out.size() - (2 * trim));
+    }
+
+    double min() const {
+        return *std::min_element(values.begin(), values.end());
+    }
+
+    double max() const {
+        return *std::max_element(values.begin(), values.end());
+    }
+
+    std::deque<double> values;
+    size_t size { 0 };
+};
+
+void test_randomized() {
+    std::mt19937 generator(12345);
+    std::uniform_real_distribution<double> distribution(-1000.0, 1000.0);
+    std::uniform_int_distribution<int> repeat(0, 3);
+
+    auto average = MovingAverageFilter();
+    auto median = MedianFilter();
+    auto trimmed = TrimmedMeanFilter();
+    auto min = MovingMinFilter();
+    auto max = MovingMaxFilter();
+
+    BaseFilter* filters[] {&average, &median, &trimmed, &min, &max};
+
+    ReferenceWindow reference;
+
+    for (const size_t size : {1, 2, 5, 16, 60, 7, 3, 60}) {
+        reference.resize(size);
+        for (auto* filter : filters) {
+            filter->resize(size);
+        }
+
+        double last = 0.0;
+        for (size_t round = 0; round < 1000; ++round) {
+            // duplicates are likely to be a special case for heaps and sorted containers
+            const auto value = repeat(generator)
+                ? distribution(generator)
+                : last;
+            last = value;
+
+            reference.update(value);
+            for (auto* filter : filters) {
+                filter->update(value);
+                TEST_ASSERT(filter->available());
+                TEST_ASSERT_EQUAL(reference.values.size() == size, filter->ready());
+            }
+
+            TEST_ASSERT_DOUBLE_WITHIN(1e-6, reference.average(), average.value());
+            TEST_ASSERT_EQUAL_DOUBLE(reference.median(), median.value());
+            TEST_ASSERT_DOUBLE_WITHIN(1e-6, reference.trimmed_mean(), trimmed.value());
+            TEST_ASSERT_EQUAL_DOUBLE(reference.min(), min.value());
+            TEST_ASSERT_EQUAL_DOUBLE(reference.max(), max.value());
+        }
+    }
+}
+
+// update() timings for the windowed filters, using the largest report window
+void test_benchmark() {
+    static constexpr size_t Size { 60 };
+    static constexpr size_t Updates { 100000 };
+
+    using clock = std::chrono::steady_clock;
+    using duration = std::chrono::duration<double, std::nano>;
+
+    std::mt19937 generator(54321);
+    std::uniform_real_distribution<double> distribution(0.0, 250.0);
+
+    std::vector<double> samples;
+    samples.reserve(Updates);
+    for (size_t index = 0; index < Updates; ++index) {
+        samples.push_back(distribution(generator));
+    }
+
+    const auto run = [&](const char* name, BaseFilter& filter) {
+        filter.resize(Size);
+
+        // value() is only used once per report, make sure it is not optimized out
+        double result { 0.0 };
+
+        const auto start = clock::now();
+        for (const auto& sample : samples) {
+            filter.update(sample);
+            if (filter.ready()) {
+                result += filter.value() / Updates;
+            }
+        }
+        const duration elapsed = clock::now() - start;
+
+        char message[128];
+        std::snprintf(message, sizeof(message),
+            "- %s: %.1fns per update() with %zu values (%.3f)",
+            name, elapsed.count() / Updates, Size, result);
+        TEST_MESSAGE(message);
+    };
+
+    auto ewma = EwmaFilter();
+    run("ewma", ewma);
+
+    auto average = MovingAverageFilter();
+    run("moving-average", average);
+
+    auto median = MedianFilter();
+    run("median", median);
+
+    auto min = MovingMinFilter();
+    run("moving-min", min);
+
+    auto max = MovingMaxFilter();
+    run("moving-max", max);
+
+    auto trimmed = TrimmedMeanFilter();
+    run("trimmed-mean", trimmed);
+}
+
 } // namespace
 } // namespace test
 } // namespace espurna
@@ -368,6 +677,11 @@ int main(int, char**) {
     RUN_TEST(test_min);
     RUN_TEST(test_moving_average);
     RUN_TEST(test_sum);
+    RUN_TEST(test_ewma);
+    RUN_TEST(test_moving_min_max);
+    RUN_TEST(test_trimmed_mean);
+    RUN_TEST(test_randomized);
+    RUN_TEST(test_benchmark);
     return UNITY_END();
 }
 
@@ -0,0 +1,79 @@
+#include <unity.h>
+#include <Arduino.h>
+
+#include <espurna/heartbeat_delta.h>
+
+namespace espurna {
+namespace heartbeat {
+namespace test {
+namespace {
+
+void test_delta_number() {
+    Delta<4> delta;
+
+    // nothing is known yet, so the first value always passes
+    TEST_ASSERT(delta.changed(0, -60.0, 5.0));
+    TEST_ASSERT(delta.known(0));
+    TEST_ASSERT_FALSE(delta.known(1));
+
+    TEST_ASSERT_FALSE(delta.changed(0, -62.0, 5.0));
+    TEST_ASSERT_FALSE(delta.changed(0, -55.0, 5.0));
+    TEST_ASSERT(delta.changed(0, -66.0, 5.0));
+
+    // comparison is against the last *sent* value, small steps do not add up
+    TEST_ASSERT_FALSE(delta.changed(0, -68.0, 5.0));
+    TEST_ASSERT_FALSE(delta.changed(0, -70.0, 5.0));
+    TEST_ASSERT(delta.changed(0, -72.0, 5.0));
+
+    // exact match, when threshold is zero
+    TEST_ASSERT(delta.changed(1, 6.0, 0.0));
+    TEST_ASSERT_FALSE(delta.changed(1, 6.0, 0.0));
+    TEST_ASSERT(delta.changed(1, 11.0, 0.0));
+
+    TEST_ASSERT_EQUAL(5, delta.changes());
+}
+
+void test_delta_string() {
+    Delta<4> delta;
+
+    TEST_ASSERT(delta.changed(2, STRING_VIEW("192.168.4.2")));
+    TEST_ASSERT_FALSE(delta.changed(2, STRING_VIEW("192.168.4.2")));
+    TEST_ASSERT_FALSE(delta.changed(2, String("192.168.4.2")));
+    TEST_ASSERT(delta.changed(2, STRING_VIEW("192.168.4.3")));
+
+    // empty string is still a value
+    TEST_ASSERT(delta.changed(3, STRING_VIEW("")));
+    TEST_ASSERT_FALSE(delta.changed(3, STRING_VIEW("")));
+}
+
+void test_delta_reset() {
+    Delta<4> delta;
+
+    TEST_ASSERT(delta.changed(0, 1.0, 10.0));
+    TEST_ASSERT(delta.changed(1, STRING_VIEW("espurna")));
+    TEST_ASSERT_FALSE(delta.changed(0, 2.0, 10.0));
+    TEST_ASSERT_FALSE(delta.changed(1, STRING_VIEW("espurna")));
+
+    // after the resync, everything is sent again
+    delta.reset();
+    TEST_ASSERT_FALSE(delta.known(0));
+    TEST_ASSERT_FALSE(delta.known(1));
+    TEST_ASSERT(delta.changed(0, 2.0, 10.0));
+    TEST_ASSERT(delta.changed(1, STRING_VIEW("espurna")));
+}
+
+} // namespace
+} // namespace test
+} // namespace heartbeat
+} // namespace espurna
+
+int main(int, char**) {
+    UNITY_BEGIN();
+
+    using namespace espurna::heartbeat::test;
+    RUN_TEST(test_delta_number);
+    RUN_TEST(test_delta_string);
+    RUN_TEST(test_delta_reset);
+
+    return UNITY_END();
+}
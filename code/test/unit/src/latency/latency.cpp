@@ -0,0 +1,71 @@
+#include <unity.h>
+#include <Arduino.h>
+
+#include <espurna/latency.h>
+
+namespace espurna {
+namespace test {
+namespace {
+
+using duration::Microseconds;
+using duration::Milliseconds;
+
+void test_buckets() {
+    TEST_ASSERT_EQUAL(0, LatencyHistogram::index(Microseconds(0)));
+    TEST_ASSERT_EQUAL(0, LatencyHistogram::index(Microseconds(999)));
+    TEST_ASSERT_EQUAL(1, LatencyHistogram::index(Microseconds(1000)));
+    TEST_ASSERT_EQUAL(1, LatencyHistogram::index(Microseconds(1999)));
+    TEST_ASSERT_EQUAL(2, LatencyHistogram::index(Microseconds(2000)));
+    TEST_ASSERT_EQUAL(3, LatencyHistogram::index(Microseconds(7999)));
+    TEST_ASSERT_EQUAL(4, LatencyHistogram::index(Microseconds(8000)));
+    TEST_ASSERT_EQUAL(10, LatencyHistogram::index(Microseconds(512000)));
+    TEST_ASSERT_EQUAL(10, LatencyHistogram::index(Microseconds(60000000)));
+
+    TEST_ASSERT_EQUAL(0, LatencyHistogram::lower(0).count());
+    TEST_ASSERT_EQUAL(1, LatencyHistogram::lower(1).count());
+    TEST_ASSERT_EQUAL(2, LatencyHistogram::lower(2).count());
+    TEST_ASSERT_EQUAL(512, LatencyHistogram::lower(10).count());
+
+    for (size_t index = 0; index < LatencyHistogram::Buckets; ++index) {
+        const auto lower = LatencyHistogram::lower(index);
+        TEST_ASSERT_EQUAL(index, LatencyHistogram::index(lower));
+    }
+}
+
+void test_histogram() {
+    LatencyHistogram histogram;
+    TEST_ASSERT_EQUAL(0, histogram.count());
+    TEST_ASSERT_EQUAL(0, histogram.average().count());
+
+    histogram.add(Microseconds(100));
+    histogram.add(Microseconds(300));
+    histogram.add(Microseconds(1500));
+    histogram.add(Microseconds(250000));
+
+    TEST_ASSERT_EQUAL(4, histogram.count());
+    TEST_ASSERT_EQUAL(2, histogram.bucket(0));
+    TEST_ASSERT_EQUAL(1, histogram.bucket(1));
+    TEST_ASSERT_EQUAL(1, histogram.bucket(LatencyHistogram::index(Microseconds(250000))));
+
+    TEST_ASSERT_EQUAL(250000, histogram.max().count());
+    TEST_ASSERT_EQUAL(62975, histogram.average().count());
+
+    histogram.reset();
+    TEST_ASSERT_EQUAL(0, histogram.count());
+    TEST_ASSERT_EQUAL(0, histogram.max().count());
+    for (size_t index = 0; index < LatencyHistogram::Buckets; ++index) {
+        TEST_ASSERT_EQUAL(0, histogram.bucket(index));
+    }
+}
+
+} // namespace
+} // namespace test
+} // namespace espurna
+
+int main(int, char**) {
+    UNITY_BEGIN();
+    using namespace espurna::test;
+    RUN_TEST(test_buckets);
+    RUN_TEST(test_histogram);
+    return UNITY_END();
+}
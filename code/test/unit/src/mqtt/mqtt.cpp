@@ -0,0 +1,1640 @@
+#include <unity.h>
+#include <Arduino.h>
+
+#include <ArduinoJson.h>
+
+#include <espurna/mqtt_brokers.h>
+#include <espurna/mqtt_dispatch.h>
+#include <espurna/mqtt_json.h>
+#include <espurna/mqtt_queue.h>
+#include <espurna/mqtt_rate.h>
+#include <espurna/mqtt_stats.h>
+#include <espurna/mqtt_stream.h>
+#include <espurna/mqtt_topics.h>
+#include <espurna/mqtt_v5.h>
+#include <espurna/utils.h>
+
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <forward_list>
+#include <new>
+#include <vector>
+
+#ifndef MQTT_QUEUE_MAX_SIZE
+#define MQTT_QUEUE_MAX_SIZE 20
+#endif
+
+// Count every allocation made through the operator new, e.g. by the containers
+// (replacing these is portable, unlike the malloc family used by the String)
+namespace {
+
+size_t allocations { 0 };
+
+} // namespace
+
+void* operator new(size_t size) {
+    ++allocations;
+    if (auto* out = std::malloc(size ? size : 1)) {
+        return out;
+    }
+
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return ::operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+namespace espurna {
+namespace mqtt {
+namespace test {
+namespace {
+
+struct Received {
+    String topic;
+    String wildcard;
+    String payload;
+    size_t index;
+};
+
+std::vector<Received> received;
+
+template <size_t Id>
+void record(const Match& match, StringView payload) {
+    received.push_back(Received{
+        .topic = match.topic.toString(),
+        .wildcard = match.wildcard.toString(),
+        .payload = payload.toString(),
+        .index = (Id * 1000) + match.index,
+    });
+}
+
+void test_match_exact() {
+    received.clear();
+
+    Dispatcher dispatcher;
+    TEST_ASSERT(dispatcher.add("action", record<1>));
+    TEST_ASSERT(dispatcher.add("relay/{index}", record<2>));
+    TEST_ASSERT_EQUAL(2, dispatcher.size());
+
+    TEST_ASSERT_EQUAL(1, dispatcher.dispatch("action", "reboot"));
+    TEST_ASSERT_EQUAL(1, received.size());
+    TEST_ASSERT_EQUAL_STRING("action", received[0].topic.c_str());
+    TEST_ASSERT_EQUAL_STRING("reboot", received[0].payload.c_str());
+    TEST_ASSERT_EQUAL(1000, received[0].index);
+
+    TEST_ASSERT_EQUAL(0, dispatcher.dispatch("actions", "reboot"));
+    TEST_ASSERT_EQUAL(0, dispatcher.dispatch("action/0", "reboot"));
+    TEST_ASSERT_EQUAL(0, dispatcher.dispatch("relay", "1"));
+    TEST_ASSERT_EQUAL(0, dispatcher.dispatch("relay/", "1"));
+    TEST_ASSERT_EQUAL(0, dispatcher.dispatch("relay/on", "1"));
+    TEST_ASSERT_EQUAL(0, dispatcher.dispatch("relay/1/set", "1"));
+    TEST_ASSERT_EQUAL(1, received.size());
+
+    TEST_ASSERT_EQUAL(1, dispatcher.dispatch("relay/12", "toggle"));
+    TEST_ASSERT_EQUAL(2, received.size());
+    TEST_ASSERT_EQUAL(2012, received[1].index);
+    TEST_ASSERT_EQUAL_STRING("toggle", received[1].payload.c_str());
+}
+
+void test_match_wildcards() {
+    received.clear();
+
+    Dispatcher dispatcher;
+    TEST_ASSERT(dispatcher.add("light/+", record<1>));
+    TEST_ASSERT(dispatcher.add("light/#", record<2>));
+    TEST_ASSERT(dispatcher.add("light/{index}", record<3>));
+    TEST_ASSERT(dispatcher.add("#", record<4>));
+
+    TEST_ASSERT_EQUAL(4, dispatcher.dispatch("light/5", "on"));
+    TEST_ASSERT_EQUAL(4, received.size());
+    TEST_ASSERT_EQUAL_STRING("5", received[0].wildcard.c_str());
+
+    received.clear();
+    TEST_ASSERT_EQUAL(3, dispatcher.dispatch("light/brightness", "255"));
+    TEST_ASSERT_EQUAL(3, received.size());
+
+    received.clear();
+    TEST_ASSERT_EQUAL(2, dispatcher.dispatch("light/channel/1", "128"));
+    TEST_ASSERT_EQUAL(2, received.size());
+    TEST_ASSERT_EQUAL_STRING("channel/1", received[0].wildcard.c_str());
+    TEST_ASSERT_EQUAL_STRING("light/channel/1", received[1].wildcard.c_str());
+
+    // '#' also matches the parent level
+    received.clear();
+    TEST_ASSERT_EQUAL(2, dispatcher.dispatch("light", "on"));
+    TEST_ASSERT_EQUAL(2, received.size());
+    TEST_ASSERT_EQUAL(2000, received[0].index);
+    TEST_ASSERT_EQUAL(0, received[0].wildcard.length());
+}
+
+void test_multiple_callbacks() {
+    received.clear();
+
+    Dispatcher dispatcher;
+    TEST_ASSERT(dispatcher.add("rpn/+", record<1>));
+    TEST_ASSERT(dispatcher.add("rpn/+", record<2>));
+    TEST_ASSERT_EQUAL(2, dispatcher.size());
+
+    TEST_ASSERT_EQUAL(2, dispatcher.dispatch("rpn/variable", "1.0"));
+    TEST_ASSERT_EQUAL(2, received.size());
+    TEST_ASSERT_EQUAL(1000, received[0].index);
+    TEST_ASSERT_EQUAL(2000, received[1].index);
+}
+
+void test_invalid_patterns() {
+    Dispatcher dispatcher;
+    TEST_ASSERT(!dispatcher.add("", record<1>));
+    TEST_ASSERT(!dispatcher.add("relay", nullptr));
+    TEST_ASSERT(!dispatcher.add("relay/", record<1>));
+    TEST_ASSERT(!dispatcher.add("/relay", record<1>));
+    TEST_ASSERT(!dispatcher.add("relay//0", record<1>));
+    TEST_ASSERT(!dispatcher.add("#/relay", record<1>));
+    TEST_ASSERT(!dispatcher.add("relay+", record<1>));
+    TEST_ASSERT(!dispatcher.add("relay/#/set", record<1>));
+    TEST_ASSERT_EQUAL(0, dispatcher.size());
+    TEST_ASSERT_EQUAL(0, dispatcher.dispatch("relay/0", "1"));
+}
+
+void test_subscriptions() {
+    Dispatcher dispatcher;
+    TEST_ASSERT(dispatcher.add("relay/{index}", record<1>));
+    TEST_ASSERT(dispatcher.add("relay/+", record<2>));
+    TEST_ASSERT(dispatcher.add("lock/{index}", record<3>));
+    TEST_ASSERT(dispatcher.add("action", record<4>));
+    TEST_ASSERT(dispatcher.add("ota/#", record<5>));
+
+    const auto subscriptions = dispatcher.subscriptions();
+    TEST_ASSERT_EQUAL(4, subscriptions.size());
+    TEST_ASSERT_EQUAL_STRING("action", subscriptions[0].c_str());
+    TEST_ASSERT_EQUAL_STRING("lock/+", subscriptions[1].c_str());
+    TEST_ASSERT_EQUAL_STRING("ota/#", subscriptions[2].c_str());
+    TEST_ASSERT_EQUAL_STRING("relay/+", subscriptions[3].c_str());
+}
+
+// Previous implementation broadcasts every message to every module, where each one
+// extracts the magnitude from the full topic and then compares it with its own topic(s)
+namespace broadcast {
+
+const String root_topic { "espurna/device/#" };
+const String setter { "/set" };
+
+std::vector<String> prefixes;
+size_t calls { 0 };
+
+StringView magnitude(StringView topic) {
+    const auto pattern = root_topic + setter;
+    auto it = std::find(pattern.begin(), pattern.end(), '#');
+
+    const auto start = StringView(pattern.begin(), it);
+    topic = StringView(topic.begin() + start.length(), topic.end());
+
+    const auto end = StringView(it + 1, pattern.end());
+    return StringView(topic.begin(), topic.end() - end.length());
+}
+
+template <size_t Id>
+void callback(StringView topic, StringView) {
+    const auto t = magnitude(topic);
+    if (t.startsWith(prefixes[Id])) {
+        ++calls;
+    }
+}
+
+} // namespace broadcast
+
+using BroadcastCallback = void(*)(StringView, StringView);
+
+template <size_t... Ids>
+std::vector<BroadcastCallback> broadcast_callbacks(std::index_sequence<Ids...>) {
+    return {broadcast::callback<Ids>...};
+}
+
+size_t trie_calls { 0 };
+
+void trie_callback(const Match&, StringView) {
+    ++trie_calls;
+}
+
+void test_benchmark_dispatch() {
+    constexpr size_t Max = 64;
+    constexpr size_t Messages = 20000;
+
+    for (size_t index = 0; index < Max; ++index) {
+        // (names must not be prefixes of each other)
+        broadcast::prefixes.push_back(
+            String((index < 10) ? "module0" : "module") + String(index, 10));
+    }
+
+    const auto all = broadcast_callbacks(std::make_index_sequence<Max>{});
+
+    using Clock = std::chrono::steady_clock;
+    using Duration = std::chrono::duration<double, std::micro>;
+
+    for (const size_t subscribers : {4, 16, 64}) {
+        std::vector<String> topics;
+        std::vector<String> magnitudes;
+
+        Dispatcher dispatcher;
+        for (size_t index = 0; index < subscribers; ++index) {
+            const auto pattern = broadcast::prefixes[index] + String("/{index}");
+            TEST_ASSERT(dispatcher.add(pattern, trie_callback));
+
+            const auto magnitude = broadcast::prefixes[index] + String("/") + String(index, 10);
+            magnitudes.push_back(magnitude);
+            topics.push_back(String("espurna/device/") + magnitude + broadcast::setter);
+        }
+
+        broadcast::calls = 0;
+
+        auto start = Clock::now();
+        for (size_t message = 0; message < Messages; ++message) {
+            const auto& topic = topics[(message * 7) % subscribers];
+            for (size_t index = 0; index < subscribers; ++index) {
+                all[index](topic, "1");
+            }
+        }
+        const auto broadcast_time = Duration(Clock::now() - start);
+
+        // magnitude is only extracted once per message
+        trie_calls = 0;
+
+        start = Clock::now();
+        for (size_t message = 0; message < Messages; ++message) {
+            const auto& topic = topics[(message * 7) % subscribers];
+            dispatcher.dispatch(broadcast::magnitude(topic), "1");
+        }
+        const auto trie_time = Duration(Clock::now() - start);
+
+        TEST_ASSERT_EQUAL(Messages, broadcast::calls);
+        TEST_ASSERT_EQUAL(Messages, trie_calls);
+
+        char message[128];
+        std::snprintf(message, sizeof(message),
+            "- %zu subscribers: %.3fus broadcast, %.3fus trie per message",
+            subscribers,
+            broadcast_time.count() / Messages,
+            trie_time.count() / Messages);
+        TEST_MESSAGE(message);
+    }
+}
+
+Message make_message(const char* topic, const char* payload, bool retain = false, int qos = 0, uint32_t timestamp = 0) {
+    return Message{
+        .topic = topic,
+        .payload = payload,
+        .retain = retain,
+        .qos = qos,
+        .timestamp = duration::Milliseconds(timestamp),
+    };
+}
+
+void test_queue_dedupe() {
+    OfflineQueue queue(4, 1024);
+
+    TEST_ASSERT(queue.push(make_message("relay/0", "1")));
+    TEST_ASSERT(queue.push(make_message("relay/1", "0")));
+    TEST_ASSERT(queue.push(make_message("relay/0", "0")));
+    TEST_ASSERT_EQUAL(2, queue.size());
+
+    TEST_ASSERT_EQUAL_STRING("relay/1", queue.front().topic.c_str());
+    queue.pop(duration::Milliseconds(0));
+
+    TEST_ASSERT_EQUAL_STRING("relay/0", queue.front().topic.c_str());
+    TEST_ASSERT_EQUAL_STRING("0", queue.front().payload.c_str());
+    queue.pop(duration::Milliseconds(0));
+    TEST_ASSERT(queue.empty());
+
+    const auto stats = queue.stats();
+    TEST_ASSERT_EQUAL(3, stats.queued);
+    TEST_ASSERT_EQUAL(1, stats.replaced);
+    TEST_ASSERT_EQUAL(2, stats.drained);
+    TEST_ASSERT_EQUAL(0, stats.dropped);
+    TEST_ASSERT_EQUAL(0, stats.bytes);
+
+    TEST_ASSERT(queue.push(make_message("relay/2", "1")));
+    TEST_ASSERT(queue.remove("relay/2"));
+    TEST_ASSERT_FALSE(queue.remove("relay/2"));
+    TEST_ASSERT(queue.empty());
+}
+
+void test_queue_eviction() {
+    OfflineQueue queue(3, 1024);
+
+    TEST_ASSERT(queue.push(make_message("status", "1", true, 1)));
+    TEST_ASSERT(queue.push(make_message("temperature", "20.0")));
+    TEST_ASSERT(queue.push(make_message("relay/0", "1", true)));
+
+    // oldest volatile message is removed first
+    TEST_ASSERT(queue.push(make_message("humidity", "50")));
+    TEST_ASSERT_EQUAL(3, queue.size());
+    TEST_ASSERT_EQUAL_STRING("status", queue.front().topic.c_str());
+
+    TEST_ASSERT(queue.push(make_message("pressure", "1000")));
+    TEST_ASSERT_EQUAL(3, queue.size());
+    TEST_ASSERT_EQUAL(2, queue.stats().dropped);
+
+    // persistent message replaces the oldest persistent one, when nothing else can be removed
+    TEST_ASSERT(queue.push(make_message("relay/1", "0", true)));
+    TEST_ASSERT(queue.push(make_message("relay/2", "0", true)));
+    TEST_ASSERT_EQUAL_STRING("relay/0", queue.front().topic.c_str());
+
+    // ...but volatile message never replaces the persistent one
+    TEST_ASSERT_FALSE(queue.push(make_message("voltage", "230")));
+    TEST_ASSERT_EQUAL(3, queue.size());
+    TEST_ASSERT_EQUAL_STRING("relay/0", queue.front().topic.c_str());
+
+    TEST_ASSERT_EQUAL(5, queue.stats().dropped);
+}
+
+void test_queue_bytes() {
+    OfflineQueue queue(8, 16);
+
+    TEST_ASSERT(queue.push(make_message("aaaa", "1234")));
+    TEST_ASSERT(queue.push(make_message("bbbb", "1234")));
+    TEST_ASSERT_EQUAL(16, queue.stats().bytes);
+
+    TEST_ASSERT(queue.push(make_message("cc", "12")));
+    TEST_ASSERT_EQUAL(2, queue.size());
+    TEST_ASSERT_EQUAL(12, queue.stats().bytes);
+    TEST_ASSERT_EQUAL_STRING("bbbb", queue.front().topic.c_str());
+
+    // never fits
+    TEST_ASSERT_FALSE(queue.push(make_message("dddddddd", "123456789")));
+    TEST_ASSERT_EQUAL(2, queue.size());
+}
+
+std::vector<Message> spilled;
+
+void test_queue_spill() {
+    spilled.clear();
+
+    OfflineQueue queue(2, 1024);
+    queue.spill([](Message&& message) {
+        spilled.push_back(std::move(message));
+    });
+
+    TEST_ASSERT(queue.push(make_message("a", "1", true)));
+    TEST_ASSERT(queue.push(make_message("b", "2", false, 1)));
+    TEST_ASSERT(queue.push(make_message("c", "3", true)));
+    TEST_ASSERT_FALSE(queue.push(make_message("d", "4")));
+
+    TEST_ASSERT_EQUAL(1, spilled.size());
+    TEST_ASSERT_EQUAL_STRING("a", spilled[0].topic.c_str());
+    TEST_ASSERT_EQUAL_STRING("1", spilled[0].payload.c_str());
+
+    const auto stats = queue.stats();
+    TEST_ASSERT_EQUAL(1, stats.spilled);
+    TEST_ASSERT_EQUAL(1, stats.dropped);
+}
+
+void test_queue_ring() {
+    OfflineQueue queue(3, 1024);
+
+    char topic[16];
+    for (int index = 0; index < 10; ++index) {
+        snprintf(topic, sizeof(topic), "topic/%d", index);
+        TEST_ASSERT(queue.push(make_message(topic, "x", false, 0, index * 100)));
+        if (queue.size() == 3) {
+            queue.pop(duration::Milliseconds(index * 100 + 50));
+        }
+    }
+
+    TEST_ASSERT_EQUAL(2, queue.size());
+    TEST_ASSERT_EQUAL_STRING("topic/8", queue.front().topic.c_str());
+    queue.pop(duration::Milliseconds(2000));
+    TEST_ASSERT_EQUAL_STRING("topic/9", queue.front().topic.c_str());
+    queue.pop(duration::Milliseconds(1000));
+    TEST_ASSERT(queue.empty());
+
+    const auto stats = queue.stats();
+    TEST_ASSERT_EQUAL(10, stats.drained);
+    TEST_ASSERT_EQUAL(0, stats.dropped);
+    TEST_ASSERT_EQUAL(100, stats.latency_last.count());
+    TEST_ASSERT_EQUAL(1200, stats.latency_max.count());
+}
+
+void test_json_writer() {
+    char buffer[128];
+
+    JsonWriter writer(buffer, sizeof(buffer));
+    writer.string("text", "hello \"world\"\n");
+    writer.raw("value", "12.5");
+    writer.number("id", 4294967295u);
+    writer.string("esc\\aped", "\t");
+
+    const auto out = writer.finish();
+    TEST_ASSERT_FALSE(writer.overflow());
+    TEST_ASSERT_EQUAL_STRING(
+        "{\"text\":\"hello \\\"world\\\"\\n\",\"value\":12.5,\"id\":4294967295,\"esc\\\\aped\":\"\\t\"}",
+        buffer);
+    TEST_ASSERT_EQUAL(strlen(buffer), out.length());
+
+    TEST_ASSERT_EQUAL(11, json_string_length("a\"b\\c\r"));
+}
+
+void test_json_writer_overflow() {
+    char buffer[16];
+
+    JsonWriter writer(buffer, sizeof(buffer));
+    writer.string("key", "value");
+    TEST_ASSERT_FALSE(writer.overflow());
+
+    writer.string("other", "value");
+    TEST_ASSERT(writer.overflow());
+
+    const auto out = writer.finish();
+    TEST_ASSERT_EQUAL(0, out.length());
+    TEST_ASSERT_EQUAL_STRING("", buffer);
+
+    // closing brace and NUL must fit too
+    char exact[16];
+    JsonWriter fits(exact, sizeof(exact));
+    fits.string("key", "value");
+    TEST_ASSERT_EQUAL(15, fits.finish().length());
+}
+
+String json_batch(const JsonBatch& batch) {
+    char buffer[512];
+
+    JsonWriter writer(buffer, sizeof(buffer));
+    batch.write(writer);
+
+    return writer.finish().toString();
+}
+
+void test_json_batch() {
+    JsonBatch batch(4, 256);
+    TEST_ASSERT(batch.empty());
+
+    using Result = JsonBatch::Result;
+    TEST_ASSERT(Result::Added == batch.add("relay/0", "1"));
+    TEST_ASSERT(Result::Added == batch.add("temperature", "21.5"));
+    TEST_ASSERT(Result::Added == batch.add("status", "online"));
+    TEST_ASSERT_EQUAL(3, batch.size());
+
+    TEST_ASSERT(Result::Replaced == batch.add("relay/0", "0"));
+    TEST_ASSERT(Result::Replaced == batch.add("status", "offline, longer than before"));
+    TEST_ASSERT(Result::Replaced == batch.add("temperature", "-"));
+    TEST_ASSERT_EQUAL(3, batch.size());
+
+    const auto out = json_batch(batch);
+    TEST_ASSERT_EQUAL_STRING(
+        "{\"relay/0\":0,\"temperature\":\"-\",\"status\":\"offline, longer than before\"}",
+        out.c_str());
+    TEST_ASSERT(out.length() <= batch.bytes() + 2);
+
+    TEST_ASSERT(Result::Added == batch.add("relay/1", "1"));
+    TEST_ASSERT(Result::Full == batch.add("relay/2", "1"));
+    TEST_ASSERT(Result::Replaced == batch.add("relay/1", "0"));
+
+    batch.clear();
+    TEST_ASSERT(batch.empty());
+    TEST_ASSERT_EQUAL(0, batch.bytes());
+    TEST_ASSERT_EQUAL_STRING("{}", json_batch(batch).c_str());
+
+    TEST_ASSERT(Result::Added == batch.add("relay/2", "1"));
+    TEST_ASSERT_EQUAL_STRING("{\"relay/2\":1}", json_batch(batch).c_str());
+}
+
+void test_json_batch_bytes() {
+    JsonBatch batch(8, 32);
+
+    using Result = JsonBatch::Result;
+    TEST_ASSERT(Result::Added == batch.add("aaaa", "1234"));
+    TEST_ASSERT_EQUAL(12, batch.bytes());
+    TEST_ASSERT(Result::Added == batch.add("bbbb", "1234"));
+    TEST_ASSERT_EQUAL(24, batch.bytes());
+
+    TEST_ASSERT(Result::Full == batch.add("cccc", "1234"));
+    TEST_ASSERT(Result::Full == batch.add("aaaa", "1234567890123"));
+    TEST_ASSERT_EQUAL(2, batch.size());
+    TEST_ASSERT_EQUAL_STRING("{\"aaaa\":1234,\"bbbb\":1234}", json_batch(batch).c_str());
+
+    TEST_ASSERT(Result::Replaced == batch.add("aaaa", "1"));
+    TEST_ASSERT_EQUAL(21, batch.bytes());
+
+    JsonBatch empty;
+    TEST_ASSERT(Result::Full == empty.add("aaaa", "1"));
+}
+
+namespace legacy {
+
+// mqttEnqueue() and mqttFlush() before the JsonBatch
+struct Payload {
+    String topic;
+    String message;
+};
+
+size_t count { 0 };
+std::forward_list<Payload> payloads;
+size_t flushed { 0 };
+
+void flush() {
+    if (payloads.empty()) {
+        return;
+    }
+
+    DynamicJsonBuffer jsonBuffer(1024);
+    JsonObject& root = jsonBuffer.createObject();
+
+    for (auto& payload : payloads) {
+        const char* const topic { payload.topic.c_str() };
+        const char* const message { payload.message.c_str() };
+        if (isNumber(payload.message)) {
+            root[topic] = RawJson(message);
+        } else {
+            root[topic] = message;
+        }
+    }
+
+    String output;
+    root.printTo(output);
+
+    jsonBuffer.clear();
+    count = 0;
+    payloads.clear();
+
+    flushed += output.length();
+}
+
+void enqueue(StringView topic, StringView payload) {
+    if (count >= MQTT_QUEUE_MAX_SIZE) {
+        flush();
+    }
+
+    payloads.remove_if(
+        [topic](const Payload& payload) {
+            return topic == payload.topic;
+        });
+
+    payloads.push_front(
+        Payload{
+            .topic = topic.toString(),
+            .message = payload.toString(),
+        });
+    ++count;
+}
+
+} // namespace legacy
+
+void test_benchmark_json() {
+    constexpr size_t Rounds = 5000;
+    constexpr size_t Topics = MQTT_QUEUE_MAX_SIZE;
+
+    std::vector<String> topics;
+    std::vector<String> payloads;
+    for (size_t index = 0; index < Topics; ++index) {
+        topics.push_back(String("magnitude/") + String(index, 10));
+        payloads.push_back((index % 2)
+            ? String(index * 1.5f, 2)
+            : String("value ") + String(index, 10));
+    }
+
+    using Clock = std::chrono::steady_clock;
+    using Duration = std::chrono::duration<double, std::micro>;
+
+    // every topic is sent once, and half of them are sent again before the flush
+    auto start = Clock::now();
+    for (size_t round = 0; round < Rounds; ++round) {
+        for (size_t index = 0; index < Topics; ++index) {
+            legacy::enqueue(topics[index], payloads[index]);
+        }
+        for (size_t index = 0; index < Topics; index += 2) {
+            legacy::enqueue(topics[index], payloads[(index + round) % Topics]);
+        }
+        legacy::flush();
+    }
+    const auto legacy_time = Duration(Clock::now() - start);
+
+    JsonBatch batch(Topics, 1024);
+    char buffer[1024 + 64];
+    size_t flushed { 0 };
+
+    const auto flush = [&]() {
+        JsonWriter writer(buffer, sizeof(buffer));
+        batch.write(writer);
+        flushed += writer.finish().length();
+        batch.clear();
+    };
+
+    const auto enqueue = [&](const String& topic, const String& payload) {
+        if (batch.add(topic, payload) == JsonBatch::Result::Full) {
+            flush();
+            batch.add(topic, payload);
+        }
+    };
+
+    start = Clock::now();
+    for (size_t round = 0; round < Rounds; ++round) {
+        for (size_t index = 0; index < Topics; ++index) {
+            enqueue(topics[index], payloads[index]);
+        }
+        for (size_t index = 0; index < Topics; index += 2) {
+            enqueue(topics[index], payloads[(index + round) % Topics]);
+        }
+        flush();
+    }
+    const auto batch_time = Duration(Clock::now() - start);
+
+    TEST_ASSERT(flushed > 0);
+    TEST_ASSERT(legacy::flushed > 0);
+
+    char message[128];
+    std::snprintf(message, sizeof(message),
+        "- %zu topics: %.3fus forward_list + DynamicJsonBuffer, %.3fus slot table per flush",
+        Topics,
+        legacy_time.count() / Rounds,
+        batch_time.count() / Rounds);
+    TEST_MESSAGE(message);
+}
+
+struct Published {
+    String topic;
+    String payload;
+    uint8_t flags;
+};
+
+std::vector<Published> published;
+
+void publish(const String& topic, const String& payload, uint8_t flags) {
+    published.push_back(
+        Published{
+            .topic = topic,
+            .payload = payload,
+            .flags = flags,
+        });
+}
+
+std::vector<RateRule> make_rules() {
+    std::vector<RateRule> out;
+    out.push_back(RateRule{
+        .prefix = "current",
+        .interval = duration::Milliseconds(1000),
+        .burst = 1,
+    });
+    out.push_back(RateRule{
+        .prefix = "light",
+        .interval = duration::Milliseconds(100),
+        .burst = 2,
+    });
+
+    return out;
+}
+
+void test_rate_limit() {
+    published.clear();
+
+    RateLimiter limiter(4);
+    limiter.rules(make_rules());
+
+    using Result = RateLimiter::Result;
+    using duration::Milliseconds;
+
+    TEST_ASSERT(Result::Pass == limiter.offer("relay/0", "1", 0, Milliseconds(0)));
+    TEST_ASSERT(Result::Pass == limiter.offer("currentX", "1", 0, Milliseconds(0)));
+
+    TEST_ASSERT(Result::Send == limiter.offer("current/0", "1.0", 0, Milliseconds(0)));
+    TEST_ASSERT(Result::Hold == limiter.offer("current/0", "2.0", 1, Milliseconds(100)));
+    TEST_ASSERT(Result::Hold == limiter.offer("current/0", "3.0", 2, Milliseconds(200)));
+    TEST_ASSERT(Result::Send == limiter.offer("current/1", "1.0", 0, Milliseconds(200)));
+    TEST_ASSERT_EQUAL(1, limiter.pending());
+
+    TEST_ASSERT_EQUAL(0, limiter.flush(Milliseconds(500), publish));
+    TEST_ASSERT_EQUAL(1, limiter.flush(Milliseconds(1000), publish));
+    TEST_ASSERT_EQUAL(0, limiter.pending());
+
+    TEST_ASSERT_EQUAL(1, published.size());
+    TEST_ASSERT_EQUAL_STRING("current/0", published[0].topic.c_str());
+    TEST_ASSERT_EQUAL_STRING("3.0", published[0].payload.c_str());
+    TEST_ASSERT_EQUAL(2, published[0].flags);
+
+    // credit was just spent by the flush
+    TEST_ASSERT(Result::Hold == limiter.offer("current/0", "4.0", 0, Milliseconds(1500)));
+    TEST_ASSERT_EQUAL(1, limiter.flush(Milliseconds(2000), publish));
+    TEST_ASSERT(Result::Send == limiter.offer("current/0", "5.0", 0, Milliseconds(3000)));
+
+    const auto& stats = limiter.stats(0);
+    TEST_ASSERT_EQUAL(5, stats.sent);
+    TEST_ASSERT_EQUAL(2, stats.delayed);
+    TEST_ASSERT_EQUAL(1, stats.suppressed);
+}
+
+void test_rate_limit_burst() {
+    published.clear();
+
+    RateLimiter limiter(4);
+    limiter.rules(make_rules());
+
+    using Result = RateLimiter::Result;
+    using duration::Milliseconds;
+
+    TEST_ASSERT(Result::Send == limiter.offer("light", "1", 0, Milliseconds(0)));
+    TEST_ASSERT(Result::Send == limiter.offer("light", "2", 0, Milliseconds(10)));
+    TEST_ASSERT(Result::Hold == limiter.offer("light", "3", 0, Milliseconds(20)));
+
+    TEST_ASSERT_EQUAL(0, limiter.flush(Milliseconds(50), publish));
+    TEST_ASSERT_EQUAL(1, limiter.flush(Milliseconds(100), publish));
+
+    // transition with a lot of intermediate steps only sends ~10 per second
+    size_t sent { 0 };
+    for (uint32_t time = 100; time < 1100; time += 10) {
+        if (Result::Send == limiter.offer("light", "x", 0, Milliseconds(time))) {
+            ++sent;
+        }
+        sent += limiter.flush(Milliseconds(time), publish);
+    }
+
+    TEST_ASSERT(sent >= 9);
+    TEST_ASSERT(sent <= 11);
+    TEST_ASSERT(limiter.stats(1).suppressed > 80);
+}
+
+void test_rate_limit_buckets() {
+    RateLimiter limiter(2);
+    limiter.rules(make_rules());
+
+    using Result = RateLimiter::Result;
+    using duration::Milliseconds;
+
+    TEST_ASSERT(Result::Send == limiter.offer("current/0", "1", 0, Milliseconds(0)));
+    TEST_ASSERT(Result::Send == limiter.offer("current/1", "1", 0, Milliseconds(0)));
+    TEST_ASSERT(Result::Hold == limiter.offer("current/1", "1", 0, Milliseconds(0)));
+
+    // no free buckets, message is not limited
+    TEST_ASSERT(Result::Pass == limiter.offer("current/2", "1", 0, Milliseconds(10)));
+
+    // ...until the idle one can be reused
+    TEST_ASSERT(Result::Send == limiter.offer("current/2", "1", 0, Milliseconds(1000)));
+    TEST_ASSERT_EQUAL(1, limiter.pending());
+}
+
+namespace v5 {
+
+using namespace ::espurna::mqtt::v5;
+
+struct FakeTransport : public Transport {
+    bool connected() override {
+        return open;
+    }
+
+    size_t read(uint8_t* data, size_t size) override {
+        size = std::min(size, input.size());
+        std::copy(input.begin(), input.begin() + size, data);
+        input.erase(input.begin(), input.begin() + size);
+        return size;
+    }
+
+    size_t write(const uint8_t* data, size_t size) override {
+        output.insert(output.end(), data, data + size);
+        return size;
+    }
+
+    void stop() override {
+        open = false;
+    }
+
+    bool open { true };
+    std::vector<uint8_t> input;
+    std::vector<uint8_t> output;
+};
+
+Options make_options() {
+    return Options{
+        .client_id = "espurna",
+        .user = "",
+        .password = "",
+        .will = Will{
+            .topic = "",
+            .payload = "",
+            .retain = false,
+            .qos = 0,
+        },
+        .keepalive = duration::Seconds(10),
+        .session_expiry = duration::Seconds(0),
+        .topic_aliases = 4,
+        .receive_maximum = 8,
+        .message_id = false,
+    };
+}
+
+// fixed header 0x20, remaining length, flags, reason, properties
+void connack(FakeTransport& transport, std::initializer_list<uint8_t> properties) {
+    transport.input.push_back(0x20);
+    transport.input.push_back(3 + properties.size());
+    transport.input.push_back(0);
+    transport.input.push_back(0);
+    transport.input.push_back(properties.size());
+    transport.input.insert(transport.input.end(), properties);
+}
+
+void puback(FakeTransport& transport, uint16_t pid) {
+    transport.input.insert(transport.input.end(),
+        {0x40, 2, static_cast<uint8_t>(pid >> 8), static_cast<uint8_t>(pid & 0xff)});
+}
+
+size_t find(const std::vector<uint8_t>& data, StringView value) {
+    const auto it = std::search(data.begin(), data.end(), value.begin(), value.end());
+    return std::distance(data.begin(), it);
+}
+
+uint8_t disconnect_reason { 0 };
+uint16_t published_pid { 0 };
+std::vector<Received> messages;
+
+void on_disconnect(uint8_t reason) {
+    disconnect_reason = reason;
+}
+
+void on_publish(uint16_t pid) {
+    published_pid = pid;
+}
+
+void on_message(char* topic, char* payload, size_t length) {
+    messages.push_back(
+        Received{
+            .topic = topic,
+            .wildcard = "",
+            .payload = String(payload, length),
+            .index = 0,
+        });
+}
+
+} // namespace v5
+
+void test_v5_connect() {
+    v5::FakeTransport transport;
+    v5::Client client(256);
+
+    auto options = v5::make_options();
+    options.session_expiry = duration::Seconds(3600);
+    options.will.topic = "status";
+    options.will.payload = "0";
+    options.will.retain = true;
+
+    using duration::Milliseconds;
+    TEST_ASSERT(client.connect(transport, options, Milliseconds(0)));
+    TEST_ASSERT(client.connecting());
+
+    const uint8_t expected[] {
+        0x10, 45,
+        0, 4, 'M', 'Q', 'T', 'T', 5,
+        0x24, // will retain + will flag, session is not clean
+        0, 10,
+        13, // properties
+        0x11, 0, 0, 0x0e, 0x10,
+        0x21, 0, 8,
+        0x27, 0, 0, 1, 0,
+        0, 7, 'e', 's', 'p', 'u', 'r', 'n', 'a',
+        0, // will properties
+        0, 6, 's', 't', 'a', 't', 'u', 's',
+        0, 1, '0',
+    };
+
+    TEST_ASSERT_EQUAL(sizeof(expected), transport.output.size());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, transport.output.data(), sizeof(expected));
+
+    v5::connack(transport, {
+        0x21, 0, 2,  // receive maximum
+        0x22, 0, 5,  // topic alias maximum
+        0x25, 0,     // retain available
+        0x1f, 0, 2, 'o', 'k', // reason string
+    });
+    client.loop(Milliseconds(10));
+
+    TEST_ASSERT(client.connected());
+    TEST_ASSERT_EQUAL(2, client.limits().receive_maximum);
+    TEST_ASSERT_EQUAL(5, client.limits().topic_alias_maximum);
+    TEST_ASSERT_FALSE(client.limits().retain_available);
+    TEST_ASSERT_EQUAL(2, client.limits().maximum_qos);
+}
+
+void test_v5_publish() {
+    v5::FakeTransport transport;
+    v5::Client client(256);
+    client.onPublish(v5::on_publish);
+
+    using duration::Milliseconds;
+    TEST_ASSERT(client.connect(transport, v5::make_options(), Milliseconds(0)));
+    v5::connack(transport, {0x21, 0, 2, 0x22, 0, 1});
+    client.loop(Milliseconds(0));
+    TEST_ASSERT(client.connected());
+
+    // first publish carries both topic and alias
+    transport.output.clear();
+    TEST_ASSERT_EQUAL(1, client.publish("espurna/relay/0", "1", false, 0));
+    TEST_ASSERT_NOT_EQUAL(transport.output.size(), v5::find(transport.output, "espurna/relay/0"));
+
+    // second one only has the alias
+    transport.output.clear();
+    TEST_ASSERT_EQUAL(1, client.publish("espurna/relay/0", "0", false, 0));
+
+    const uint8_t aliased[] {
+        0x30, 7,
+        0, 0,
+        3, 0x23, 0, 1,
+        '0',
+    };
+    TEST_ASSERT_EQUAL(sizeof(aliased), transport.output.size());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(aliased, transport.output.data(), sizeof(aliased));
+    TEST_ASSERT_EQUAL(1, client.stats().aliased);
+    TEST_ASSERT_EQUAL(15, client.stats().alias_bytes_saved);
+
+    // broker allows a single alias, other topics are always sent in full
+    transport.output.clear();
+    TEST_ASSERT_EQUAL(1, client.publish("espurna/relay/1", "0", false, 0));
+    TEST_ASSERT_NOT_EQUAL(transport.output.size(), v5::find(transport.output, "espurna/relay/1"));
+    TEST_ASSERT_EQUAL(1, client.stats().aliased);
+
+    // receive maximum limits the number of QoS 1 messages waiting for PUBACK
+    const auto first = client.publish("espurna/status", "1", false, 1);
+    const auto second = client.publish("espurna/status", "1", false, 1);
+    TEST_ASSERT_NOT_EQUAL(0, first);
+    TEST_ASSERT_NOT_EQUAL(0, second);
+    TEST_ASSERT_EQUAL(0, client.publish("espurna/status", "1", false, 1));
+    TEST_ASSERT_EQUAL(2, client.inflight());
+    TEST_ASSERT_EQUAL(1, client.stats().throttled);
+
+    // QoS 0 is not affected
+    TEST_ASSERT_EQUAL(1, client.publish("espurna/status", "1", false, 0));
+
+    v5::puback(transport, first);
+    client.loop(Milliseconds(100));
+    TEST_ASSERT_EQUAL(first, v5::published_pid);
+    TEST_ASSERT_EQUAL(1, client.inflight());
+    TEST_ASSERT_NOT_EQUAL(0, client.publish("espurna/status", "1", false, 1));
+}
+
+// Rejected publish should never reserve the alias, broker would not know about it
+void test_v5_packet_size() {
+    v5::FakeTransport transport;
+    v5::Client client(256);
+
+    using duration::Milliseconds;
+    TEST_ASSERT(client.connect(transport, v5::make_options(), Milliseconds(0)));
+    v5::connack(transport, {
+        0x22, 0, 2,        // topic alias maximum
+        0x27, 0, 0, 0, 32, // maximum packet size
+    });
+    client.loop(Milliseconds(0));
+    TEST_ASSERT(client.connected());
+    TEST_ASSERT_EQUAL(32, client.limits().maximum_packet_size);
+
+    transport.output.clear();
+    TEST_ASSERT_EQUAL(0, client.publish("espurna/big",
+        "0123456789012345678901234567890123456789", false, 0));
+    TEST_ASSERT_EQUAL(0, transport.output.size());
+
+    // first alias is still available, topic is sent in full
+    TEST_ASSERT_EQUAL(1, client.publish("espurna/big", "1", false, 0));
+    TEST_ASSERT_NOT_EQUAL(transport.output.size(), v5::find(transport.output, "espurna/big"));
+
+    const uint8_t alias[] {3, 0x23, 0, 1};
+    TEST_ASSERT(std::search(transport.output.begin(), transport.output.end(),
+        std::begin(alias), std::end(alias)) != transport.output.end());
+
+    transport.output.clear();
+    TEST_ASSERT_EQUAL(1, client.publish("espurna/big", "0", false, 0));
+
+    const uint8_t aliased[] {
+        0x30, 7,
+        0, 0,
+        3, 0x23, 0, 1,
+        '0',
+    };
+    TEST_ASSERT_EQUAL(sizeof(aliased), transport.output.size());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(aliased, transport.output.data(), sizeof(aliased));
+    TEST_ASSERT_EQUAL(1, client.stats().aliased);
+}
+
+void test_v5_message_id() {
+    v5::FakeTransport transport;
+    v5::Client client(256);
+
+    auto options = v5::make_options();
+    options.topic_aliases = 0;
+    options.message_id = true;
+
+    using duration::Milliseconds;
+    TEST_ASSERT(client.connect(transport, options, Milliseconds(0)));
+    v5::connack(transport, {});
+    client.loop(Milliseconds(0));
+    TEST_ASSERT(client.connected());
+
+    transport.output.clear();
+    TEST_ASSERT_EQUAL(1, client.publish("t", "x", true, 0));
+    TEST_ASSERT_EQUAL(1, client.publish("t", "y", true, 0));
+
+    const uint8_t expected[] {
+        0x31, 13,
+        0, 1, 't',
+        8, 0x26, 0, 2, 'i', 'd', 0, 1, '1',
+        'x',
+        0x31, 13,
+        0, 1, 't',
+        8, 0x26, 0, 2, 'i', 'd', 0, 1, '2',
+        'y',
+    };
+
+    TEST_ASSERT_EQUAL(sizeof(expected), transport.output.size());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, transport.output.data(), sizeof(expected));
+}
+
+void test_v5_receive() {
+    v5::FakeTransport transport;
+    v5::Client client(32);
+    client.onMessage(v5::on_message);
+    v5::messages.clear();
+
+    using duration::Milliseconds;
+    TEST_ASSERT(client.connect(transport, v5::make_options(), Milliseconds(0)));
+    v5::connack(transport, {});
+
+    // QoS 1 with a user property
+    transport.input.insert(transport.input.end(), {
+        0x32, 20,
+        0, 7, 'r', 'e', 'l', 'a', 'y', '/', '0',
+        0, 5,
+        7, 0x26, 0, 1, 'a', 0, 1, 'b',
+        '1',
+    });
+
+    // too large for the buffer, skipped
+    transport.input.push_back(0x30);
+    transport.input.push_back(40);
+    transport.input.insert(transport.input.end(), 40, 'x');
+
+    // QoS 0 without properties
+    transport.input.insert(transport.input.end(), {
+        0x30, 7,
+        0, 1, 'a',
+        0,
+        'o', 'f', 'f',
+    });
+
+    transport.output.clear();
+    client.loop(Milliseconds(0));
+    TEST_ASSERT(client.connected());
+
+    TEST_ASSERT_EQUAL(2, v5::messages.size());
+    TEST_ASSERT_EQUAL_STRING("relay/0", v5::messages[0].topic.c_str());
+    TEST_ASSERT_EQUAL_STRING("1", v5::messages[0].payload.c_str());
+    TEST_ASSERT_EQUAL_STRING("a", v5::messages[1].topic.c_str());
+    TEST_ASSERT_EQUAL_STRING("off", v5::messages[1].payload.c_str());
+
+    const uint8_t expected[] {0x40, 2, 0, 5};
+    TEST_ASSERT_EQUAL(sizeof(expected), transport.output.size());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, transport.output.data(), sizeof(expected));
+}
+
+void test_v5_keepalive() {
+    v5::FakeTransport transport;
+    v5::Client client(64);
+    client.onDisconnect(v5::on_disconnect);
+
+    using duration::Milliseconds;
+    TEST_ASSERT(client.connect(transport, v5::make_options(), Milliseconds(0)));
+    v5::connack(transport, {0x13, 0, 4}); // server keep alive
+    client.loop(Milliseconds(0));
+    TEST_ASSERT(client.connected());
+    TEST_ASSERT_EQUAL(4, client.limits().keepalive.count());
+
+    transport.output.clear();
+    client.loop(Milliseconds(3000));
+    TEST_ASSERT_EQUAL(0, transport.output.size());
+
+    client.loop(Milliseconds(4000));
+    const uint8_t ping[] {0xc0, 0};
+    TEST_ASSERT_EQUAL(sizeof(ping), transport.output.size());
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(ping, transport.output.data(), sizeof(ping));
+
+    transport.input.insert(transport.input.end(), {0xd0, 0});
+    client.loop(Milliseconds(4500));
+    TEST_ASSERT(client.connected());
+
+    // nothing was received after the response
+    v5::disconnect_reason = 0;
+    client.loop(Milliseconds(10000));
+    TEST_ASSERT(client.connected());
+    client.loop(Milliseconds(10600));
+    TEST_ASSERT_FALSE(client.connected());
+    TEST_ASSERT_FALSE(transport.open);
+    TEST_ASSERT_EQUAL(v5::Client::ReasonTimeout, v5::disconnect_reason);
+}
+
+namespace stream {
+
+std::vector<Fragment> fragments;
+
+bool consume(const Fragment& fragment) {
+    fragments.push_back(fragment);
+    return true;
+}
+
+bool consume_first(const Fragment& fragment) {
+    fragments.push_back(fragment);
+    return false;
+}
+
+Fragment make_fragment(StringView message, size_t index, size_t len) {
+    return Fragment{
+        .data = StringView(message.begin() + index, len),
+        .index = index,
+        .total = message.length(),
+    };
+}
+
+} // namespace stream
+
+void test_stream_fragments() {
+    Streams streams;
+    TEST_ASSERT(streams.add("ota/bin", stream::consume));
+    TEST_ASSERT_FALSE(streams.add("ota/bin", stream::consume_first));
+    TEST_ASSERT_FALSE(streams.add("", stream::consume));
+    TEST_ASSERT_EQUAL(1, streams.size());
+
+    stream::fragments.clear();
+
+    STRING_VIEW_INLINE(Message, "0123456789abcdef");
+    TEST_ASSERT_FALSE(streams.feed("relay/0", stream::make_fragment(Message, 0, Message.length())));
+    TEST_ASSERT_EQUAL(0, stream::fragments.size());
+
+    // payload is passed as-is, without copying
+    TEST_ASSERT(streams.feed("ota/bin", stream::make_fragment(Message, 0, 6)));
+    TEST_ASSERT(streams.feed({}, stream::make_fragment(Message, 6, 6)));
+    TEST_ASSERT(streams.feed({}, stream::make_fragment(Message, 12, 4)));
+
+    TEST_ASSERT_EQUAL(3, stream::fragments.size());
+    TEST_ASSERT(stream::fragments[0].first());
+    TEST_ASSERT_FALSE(stream::fragments[1].last());
+    TEST_ASSERT(stream::fragments[2].last());
+    TEST_ASSERT_EQUAL(Message.data() + 12, stream::fragments[2].data.data());
+
+    // message was finished, the rest is not expected
+    TEST_ASSERT_FALSE(streams.feed({}, stream::make_fragment(Message, 12, 4)));
+    TEST_ASSERT_EQUAL(3, stream::fragments.size());
+}
+
+void test_stream_drop() {
+    Streams streams;
+    TEST_ASSERT(streams.add("ota/bin", stream::consume));
+    TEST_ASSERT(streams.add("restore", stream::consume_first));
+
+    STRING_VIEW_INLINE(Message, "0123456789abcdef");
+
+    // handler refused the message, but everything is still consumed
+    stream::fragments.clear();
+    TEST_ASSERT(streams.feed("restore", stream::make_fragment(Message, 0, 8)));
+    TEST_ASSERT(streams.feed({}, stream::make_fragment(Message, 8, 8)));
+    TEST_ASSERT_EQUAL(1, stream::fragments.size());
+
+    // gap in-between fragments drops the message
+    stream::fragments.clear();
+    TEST_ASSERT(streams.feed("ota/bin", stream::make_fragment(Message, 0, 4)));
+    TEST_ASSERT(streams.feed({}, stream::make_fragment(Message, 8, 4)));
+    TEST_ASSERT(streams.feed({}, stream::make_fragment(Message, 12, 4)));
+    TEST_ASSERT_EQUAL(1, stream::fragments.size());
+
+    // next message starts from scratch
+    stream::fragments.clear();
+    TEST_ASSERT(streams.feed("ota/bin", stream::make_fragment(Message, 0, Message.length())));
+    TEST_ASSERT_EQUAL(1, stream::fragments.size());
+    TEST_ASSERT(stream::fragments[0].last());
+}
+
+void test_stream_reset() {
+    Streams streams;
+    TEST_ASSERT(streams.add("ota/bin", stream::consume));
+
+    STRING_VIEW_INLINE(Message, "0123456789abcdef");
+    STRING_VIEW_INLINE(Other, "fedcba9876543210");
+
+    // half-received message is forgotten, e.g. after disconnecting
+    stream::fragments.clear();
+    TEST_ASSERT(streams.feed("ota/bin", stream::make_fragment(Message, 0, 8)));
+    TEST_ASSERT_EQUAL(1, stream::fragments.size());
+
+    streams.reset();
+
+    // remaining fragments of some other message are left for the regular callbacks
+    TEST_ASSERT_FALSE(streams.feed({}, stream::make_fragment(Other, 8, 8)));
+    TEST_ASSERT_EQUAL(1, stream::fragments.size());
+
+    // handler is still registered
+    TEST_ASSERT(streams.feed("ota/bin", stream::make_fragment(Message, 0, 10)));
+    TEST_ASSERT(streams.feed({}, stream::make_fragment(Message, 10, 6)));
+    TEST_ASSERT_EQUAL(3, stream::fragments.size());
+    TEST_ASSERT(stream::fragments[2].last());
+}
+
+void test_stream_accumulator() {
+    Accumulator accumulator(16);
+
+    STRING_VIEW_INLINE(Message, "0123456789abcdef");
+    using Result = Accumulator::Result;
+
+    TEST_ASSERT(Result::Pending == accumulator.feed(stream::make_fragment(Message, 0, 10)));
+    TEST_ASSERT(Result::Done == accumulator.feed(stream::make_fragment(Message, 10, 6)));
+    TEST_ASSERT_EQUAL(Message.length(), accumulator.data().length());
+    TEST_ASSERT_EQUAL_STRING(Message.c_str(), accumulator.data().data());
+    TEST_ASSERT(Message.data() != accumulator.data().data());
+
+    accumulator.reset();
+    TEST_ASSERT_EQUAL(0, accumulator.data().length());
+
+    // out-of-order fragment
+    TEST_ASSERT(Result::Pending == accumulator.feed(stream::make_fragment(Message, 0, 4)));
+    TEST_ASSERT(Result::Error == accumulator.feed(stream::make_fragment(Message, 8, 4)));
+    TEST_ASSERT(Result::Error == accumulator.feed(stream::make_fragment(Message, 12, 4)));
+
+    // larger than the limit
+    STRING_VIEW_INLINE(Large, "0123456789abcdef0");
+    TEST_ASSERT(Result::Error == accumulator.feed(stream::make_fragment(Large, 0, 4)));
+}
+
+void test_stats_histogram() {
+    Histogram histogram;
+
+    using duration::Milliseconds;
+    histogram.add(Milliseconds(0));
+    histogram.add(Milliseconds(1));
+    histogram.add(Milliseconds(2));
+    histogram.add(Milliseconds(3));
+    histogram.add(Milliseconds(4));
+    histogram.add(Milliseconds(1000));
+    histogram.add(Milliseconds(1000000));
+
+    TEST_ASSERT_EQUAL(1, histogram.bucket(0));
+    TEST_ASSERT_EQUAL(1, histogram.bucket(1));
+    TEST_ASSERT_EQUAL(2, histogram.bucket(2));
+    TEST_ASSERT_EQUAL(1, histogram.bucket(3));
+    TEST_ASSERT_EQUAL(1, histogram.bucket(10));
+    TEST_ASSERT_EQUAL(1, histogram.bucket(Histogram::Buckets - 1));
+    TEST_ASSERT_EQUAL(16384, histogram.lower(Histogram::Buckets - 1).count());
+
+    TEST_ASSERT_EQUAL(7, histogram.count());
+    TEST_ASSERT_EQUAL(1000000000, histogram.max().count());
+    TEST_ASSERT_EQUAL(1001010000 / 7, histogram.average().count());
+}
+
+void test_stats_publish() {
+    Stats stats;
+
+    using duration::Milliseconds;
+    stats.publish(10, 1, 0, Milliseconds(0));
+    stats.publish(10, 0, 0, Milliseconds(0));
+    stats.publish(20, 5, 1, Milliseconds(100));
+    stats.publish(20, 6, 1, Milliseconds(100));
+
+    const auto& publishes = stats.publishes();
+    TEST_ASSERT_EQUAL(4, publishes.attempted);
+    TEST_ASSERT_EQUAL(3, publishes.accepted);
+    TEST_ASSERT_EQUAL(1, publishes.failed);
+    TEST_ASSERT_EQUAL(50, publishes.bytes);
+    TEST_ASSERT_EQUAL(2, stats.inflight());
+
+    stats.ack(5, Milliseconds(150));
+    stats.ack(5, Milliseconds(200));
+    stats.ack(7, Milliseconds(200));
+    TEST_ASSERT_EQUAL(1, stats.inflight());
+    TEST_ASSERT_EQUAL(1, stats.acks().acked);
+    TEST_ASSERT_EQUAL(1, stats.ack_latency().count());
+    TEST_ASSERT_EQUAL(50000, stats.ack_latency().max().count());
+
+    // same slot is replaced by the newer message
+    stats.publish(20, 6 + Stats::InflightMax, 1, Milliseconds(300));
+    TEST_ASSERT_EQUAL(1, stats.inflight());
+    TEST_ASSERT_EQUAL(1, stats.acks().untracked);
+    TEST_ASSERT_EQUAL(2, stats.acks().peak);
+
+    stats.ack(6, Milliseconds(400));
+    TEST_ASSERT_EQUAL(1, stats.inflight());
+    stats.ack(6 + Stats::InflightMax, Milliseconds(400));
+    TEST_ASSERT_EQUAL(0, stats.inflight());
+    TEST_ASSERT_EQUAL(2, stats.ack_latency().count());
+    TEST_ASSERT_EQUAL(100000, stats.ack_latency().max().count());
+
+    // only sampled when the client connection is known
+    TEST_ASSERT_EQUAL(0, stats.send_buffer().samples);
+    stats.send_buffer(1024);
+    stats.send_buffer(0);
+    stats.send_buffer(512);
+
+    const auto& send_buffer = stats.send_buffer();
+    TEST_ASSERT_EQUAL(3, send_buffer.samples);
+    TEST_ASSERT_EQUAL(512, send_buffer.last);
+    TEST_ASSERT_EQUAL(0, send_buffer.low);
+    TEST_ASSERT_EQUAL(1, send_buffer.full);
+}
+
+void test_stats_connection() {
+    Stats stats;
+
+    using duration::Milliseconds;
+    stats.connecting(Milliseconds(1000));
+    stats.disconnected(Milliseconds(6000));
+    stats.connecting(Milliseconds(10000));
+    stats.connected(Milliseconds(10250));
+
+    stats.publish(20, 1, 1, Milliseconds(20000));
+    TEST_ASSERT_EQUAL(1, stats.inflight());
+
+    stats.disconnected(Milliseconds(30000));
+    TEST_ASSERT_EQUAL(0, stats.inflight());
+
+    stats.connecting(Milliseconds(45000));
+    stats.connected(Milliseconds(45500));
+
+    const auto& connections = stats.connections();
+    TEST_ASSERT_EQUAL(3, connections.attempts);
+    TEST_ASSERT_EQUAL(2, connections.connected);
+    TEST_ASSERT_EQUAL(1, connections.failed);
+    TEST_ASSERT_EQUAL(1, connections.disconnected);
+    TEST_ASSERT_EQUAL(15500, connections.downtime_last.count());
+    TEST_ASSERT_EQUAL(15500, connections.downtime_max.count());
+
+    TEST_ASSERT_EQUAL(2, stats.connect_time().count());
+    TEST_ASSERT_EQUAL(500000, stats.connect_time().max().count());
+}
+
+void test_brokers_endpoint() {
+    Endpoint endpoint;
+
+    TEST_ASSERT(parse_endpoint("broker.lan", 1883, endpoint));
+    TEST_ASSERT_EQUAL_STRING("broker.lan", endpoint.host.c_str());
+    TEST_ASSERT_EQUAL(1883, endpoint.port);
+
+    TEST_ASSERT(parse_endpoint("192.168.1.2:8883", 1883, endpoint));
+    TEST_ASSERT_EQUAL_STRING("192.168.1.2", endpoint.host.c_str());
+    TEST_ASSERT_EQUAL(8883, endpoint.port);
+
+    TEST_ASSERT_FALSE(parse_endpoint("", 1883, endpoint));
+    TEST_ASSERT_FALSE(parse_endpoint(":1883", 1883, endpoint));
+    TEST_ASSERT_FALSE(parse_endpoint("broker.lan:", 1883, endpoint));
+    TEST_ASSERT_FALSE(parse_endpoint("broker.lan:port", 1883, endpoint));
+    TEST_ASSERT_FALSE(parse_endpoint("broker.lan:65536", 1883, endpoint));
+    TEST_ASSERT_FALSE(parse_endpoint("broker.lan:0", 1883, endpoint));
+    TEST_ASSERT_FALSE(parse_endpoint("broker.lan", 0, endpoint));
+}
+
+void test_brokers_failover() {
+    using duration::Milliseconds;
+
+    const auto options = Brokers::Options{
+        .backoff_min = Milliseconds(5000),
+        .backoff_max = Milliseconds(20000),
+        .failback = Milliseconds::zero(),
+    };
+
+    Brokers brokers;
+    TEST_ASSERT(brokers.reset({{"primary", 1883}, {"secondary", 1883}}, options));
+    TEST_ASSERT_FALSE(brokers.reset({{"primary", 1883}, {"secondary", 1883}}, options));
+    TEST_ASSERT_EQUAL(0, brokers.select(Milliseconds(0)));
+
+    // primary is unreachable, secondary is tried right away
+    brokers.connecting(0);
+    brokers.failed(0, Milliseconds(1000));
+    TEST_ASSERT_EQUAL(1, brokers.select(Milliseconds(1000)));
+
+    brokers.connecting(1);
+    brokers.connected(1, Milliseconds(1200));
+    TEST_ASSERT_EQUAL(1, brokers.current());
+    TEST_ASSERT_EQUAL(0, brokers.switches());
+
+    // both are lost, wait for the one that is ready first
+    brokers.failed(1, Milliseconds(2000));
+    TEST_ASSERT_EQUAL(Brokers::NoIndex, brokers.current());
+    TEST_ASSERT_EQUAL(Brokers::NoIndex, brokers.select(Milliseconds(2000)));
+    TEST_ASSERT_EQUAL(4000, brokers.wait(Milliseconds(2000)).count());
+    TEST_ASSERT_EQUAL(0, brokers.select(Milliseconds(6000)));
+
+    // consecutive failures double the delay, up to the maximum
+    brokers.failed(0, Milliseconds(6000));
+    TEST_ASSERT_EQUAL(10000, brokers.backoff(0).count());
+    brokers.failed(0, Milliseconds(16000));
+    TEST_ASSERT_EQUAL(20000, brokers.backoff(0).count());
+    brokers.failed(0, Milliseconds(36000));
+    TEST_ASSERT_EQUAL(20000, brokers.backoff(0).count());
+
+    TEST_ASSERT_EQUAL(1, brokers.select(Milliseconds(36000)));
+    brokers.connected(1, Milliseconds(36000));
+    TEST_ASSERT_EQUAL(0, brokers.backoff(1).count());
+
+    // requested disconnect does not change anything
+    brokers.disconnected();
+    TEST_ASSERT_EQUAL(1, brokers.select(Milliseconds(36000)));
+    TEST_ASSERT_EQUAL(0, brokers.select(Milliseconds(56000)));
+
+    const auto& primary = brokers.stats(0);
+    TEST_ASSERT_EQUAL(1, primary.attempts);
+    TEST_ASSERT_EQUAL(4, primary.failures);
+    TEST_ASSERT_EQUAL(0, primary.connections);
+
+    const auto& secondary = brokers.stats(1);
+    TEST_ASSERT_EQUAL(1, secondary.attempts);
+    TEST_ASSERT_EQUAL(1, secondary.failures);
+    TEST_ASSERT_EQUAL(2, secondary.connections);
+
+    // same list keeps failover state, unlike the explicit rewind
+    TEST_ASSERT_FALSE(brokers.reset({{"primary", 1883}, {"secondary", 1883}}, options));
+    TEST_ASSERT_EQUAL(20000, brokers.backoff(0).count());
+    TEST_ASSERT_EQUAL(1, brokers.select(Milliseconds(36000)));
+
+    brokers.rewind();
+    TEST_ASSERT_EQUAL(0, brokers.select(Milliseconds(36000)));
+    TEST_ASSERT(brokers.reset({{"primary", 1883}}, options));
+    TEST_ASSERT_EQUAL(1, brokers.size());
+    TEST_ASSERT_EQUAL(0, brokers.stats(0).failures);
+}
+
+void test_brokers_failback() {
+    using duration::Milliseconds;
+
+    Brokers brokers;
+    brokers.reset({{"primary", 1883}, {"secondary", 1883}, {"tertiary", 1883}},
+        Brokers::Options{
+            .backoff_min = Milliseconds(5000),
+            .backoff_max = Milliseconds(60000),
+            .failback = Milliseconds(30000),
+        });
+
+    brokers.connected(0, Milliseconds(0));
+    TEST_ASSERT_FALSE(brokers.failback(Milliseconds(60000)));
+
+    brokers.failed(0, Milliseconds(60000));
+    brokers.failed(1, Milliseconds(60000));
+    TEST_ASSERT_EQUAL(2, brokers.select(Milliseconds(60000)));
+    brokers.connected(2, Milliseconds(60000));
+
+    TEST_ASSERT_FALSE(brokers.failback(Milliseconds(89999)));
+    TEST_ASSERT(brokers.failback(Milliseconds(90000)));
+
+    // only once per interval, until the connection is actually dropped
+    TEST_ASSERT_FALSE(brokers.failback(Milliseconds(90001)));
+    TEST_ASSERT(brokers.failback(Milliseconds(120000)));
+
+    brokers.disconnected();
+    TEST_ASSERT_FALSE(brokers.failback(Milliseconds(150000)));
+    TEST_ASSERT_EQUAL(0, brokers.select(Milliseconds(120000)));
+
+    // preferred broker is still down, go back to the fallback one
+    brokers.failed(0, Milliseconds(125000));
+    TEST_ASSERT_EQUAL(1, brokers.select(Milliseconds(125000)));
+    brokers.connected(1, Milliseconds(125000));
+    TEST_ASSERT_EQUAL(2, brokers.switches());
+    TEST_ASSERT_FALSE(brokers.failback(Milliseconds(140000)));
+
+    // both preferred brokers are still waiting
+    brokers.failed(0, Milliseconds(150000));
+    TEST_ASSERT_EQUAL(20000, brokers.backoff(0).count());
+    TEST_ASSERT_FALSE(brokers.failback(Milliseconds(160000)));
+    TEST_ASSERT(brokers.failback(Milliseconds(170000)));
+}
+
+void test_topic_cache() {
+    TopicCache cache(4);
+    TEST_ASSERT(cache.find("relay", 0) == nullptr);
+
+    cache.configure("home/{hostname}/#", "", "/set");
+
+    const auto* relay = cache.find("relay", 0);
+    TEST_ASSERT(relay != nullptr);
+    TEST_ASSERT_EQUAL_STRING("relay/0", relay->magnitude.c_str());
+    TEST_ASSERT_EQUAL_STRING("home/{hostname}/relay/0", relay->getter.c_str());
+    TEST_ASSERT_EQUAL(0, relay->setter.length());
+
+    // same entry, regardless of how it was requested
+    TEST_ASSERT(relay == cache.find("relay", 0));
+    TEST_ASSERT(relay == cache.find("relay/0"));
+    TEST_ASSERT(relay != cache.find("relay", 10));
+    TEST_ASSERT(relay != cache.find("relay"));
+
+    const auto setter = cache.get("relay", 0, TopicCache::Kind::Setter);
+    TEST_ASSERT_EQUAL_STRING("home/{hostname}/relay/0/set", setter.c_str());
+    TEST_ASSERT(setter.data() == relay->setter.c_str());
+    TEST_ASSERT_EQUAL(3, cache.size());
+
+    // full cache only returns existing entries
+    TEST_ASSERT(cache.find("light") != nullptr);
+    TEST_ASSERT(cache.find("button", 1) == nullptr);
+    TEST_ASSERT_EQUAL(0, cache.get("button", 1, TopicCache::Kind::Getter).length());
+    TEST_ASSERT(cache.find("relay", 10) != nullptr);
+    TEST_ASSERT_EQUAL(4, cache.size());
+
+    cache.configure("#/{hostname}", "/state", "/set");
+    TEST_ASSERT_EQUAL(0, cache.size());
+    TEST_ASSERT_EQUAL_STRING("relay/10/{hostname}/state",
+        cache.get("relay", 10, TopicCache::Kind::Getter).c_str());
+}
+
+// Building the topic string on every publish, same as mqttSend(topic, index, ...) did before,
+// always produces a new String. Cached one is only built once and then shared by every lookup
+void test_topic_cache_allocations() {
+    TopicCache cache(16);
+    cache.configure("home/device/#", "", "/set");
+
+    constexpr size_t Runs { 100 };
+    constexpr size_t Relays { 8 };
+
+    // only the first lookup of each topic creates an entry
+    const char* topics[Relays];
+
+    auto before = allocations;
+    for (size_t index = 0; index < Relays; ++index) {
+        const auto* entry = cache.find("relay", index);
+        TEST_ASSERT(entry != nullptr);
+        topics[index] = entry->getter.c_str();
+    }
+
+    const auto first = static_cast<double>(allocations - before) / Relays;
+    TEST_ASSERT(first > 0);
+
+    before = allocations;
+    for (size_t run = 0; run < Runs; ++run) {
+        for (size_t index = 0; index < Relays; ++index) {
+            const auto* entry = cache.find("relay", index);
+            TEST_ASSERT_EQUAL_PTR(topics[index], entry->getter.c_str());
+            TEST_ASSERT_EQUAL_PTR(topics[index],
+                cache.find(entry->magnitude.c_str())->getter.c_str());
+        }
+    }
+
+    const auto cached = static_cast<double>(allocations - before) / (Runs * Relays);
+    TEST_ASSERT_EQUAL(0, cached);
+
+    char message[128];
+    std::snprintf(message, sizeof(message),
+        "- allocations per publish: %.1f cached (%.1f on the first use)",
+        cached, first);
+    TEST_MESSAGE(message);
+}
+
+} // namespace
+} // namespace test
+} // namespace mqtt
+} // namespace espurna
+
+// When adding test functions, don't forget to add RUN_TEST(...) in the main()
+
+int main(int, char**) {
+    UNITY_BEGIN();
+
+    using namespace espurna::mqtt::test;
+    RUN_TEST(test_match_exact);
+    RUN_TEST(test_match_wildcards);
+    RUN_TEST(test_multiple_callbacks);
+    RUN_TEST(test_invalid_patterns);
+    RUN_TEST(test_subscriptions);
+    RUN_TEST(test_benchmark_dispatch);
+    RUN_TEST(test_queue_dedupe);
+    RUN_TEST(test_queue_eviction);
+    RUN_TEST(test_queue_bytes);
+    RUN_TEST(test_queue_spill);
+    RUN_TEST(test_queue_ring);
+    RUN_TEST(test_json_writer);
+    RUN_TEST(test_json_writer_overflow);
+    RUN_TEST(test_json_batch);
+    RUN_TEST(test_json_batch_bytes);
+    RUN_TEST(test_benchmark_json);
+    RUN_TEST(test_rate_limit);
+    RUN_TEST(test_rate_limit_burst);
+    RUN_TEST(test_rate_limit_buckets);
+    RUN_TEST(test_v5_connect);
+    RUN_TEST(test_v5_publish);
+    RUN_TEST(test_v5_packet_size);
+    RUN_TEST(test_v5_message_id);
+    RUN_TEST(test_v5_receive);
+    RUN_TEST(test_v5_keepalive);
+    RUN_TEST(test_stream_fragments);
+    RUN_TEST(test_stream_drop);
+    RUN_TEST(test_stream_reset);
+    RUN_TEST(test_stream_accumulator);
+    RUN_TEST(test_stats_histogram);
+    RUN_TEST(test_stats_publish);
+    RUN_TEST(test_stats_connection);
+    RUN_TEST(test_brokers_endpoint);
+    RUN_TEST(test_brokers_failover);
+    RUN_TEST(test_brokers_failback);
+    RUN_TEST(test_topic_cache);
+    RUN_TEST(test_topic_cache_allocations);
+
+    return UNITY_END();
+}
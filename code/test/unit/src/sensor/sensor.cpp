@@ -0,0 +1,440 @@
+#include <unity.h>
+#include <Arduino.h>
+#include <StreamString.h>
+
+#include <espurna/sensor_history.h>
+#include <espurna/sensor_policy.h>
+#include <espurna/sensor_schedule.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace espurna {
+namespace sensor {
+namespace test {
+namespace {
+
+using duration::Milliseconds;
+
+void test_schedule_order() {
+    Scheduler schedule;
+    TEST_ASSERT_EQUAL(0, schedule.size());
+    TEST_ASSERT(!schedule.due(Milliseconds(0)));
+    TEST_ASSERT_EQUAL(Scheduler::NoId, schedule.next(Milliseconds(0)));
+
+    schedule.add(0, Milliseconds(1000), Milliseconds(0));
+    schedule.add(1, Milliseconds(300), Milliseconds(0));
+    schedule.add(2, Milliseconds(0), Milliseconds(0));
+    TEST_ASSERT_EQUAL(2, schedule.size());
+    TEST_ASSERT(schedule.contains(0));
+    TEST_ASSERT(schedule.contains(1));
+    TEST_ASSERT(!schedule.contains(2));
+
+    TEST_ASSERT_EQUAL(300, schedule.wait(Milliseconds(0)).count());
+    TEST_ASSERT_EQUAL(Scheduler::NoId, schedule.next(Milliseconds(299)));
+
+    std::vector<size_t> reads;
+    for (uint32_t now = 0; now <= 2000; now += 100) {
+        for (;;) {
+            const auto id = schedule.next(Milliseconds(now));
+            if (id == Scheduler::NoId) {
+                break;
+            }
+
+            reads.push_back(id);
+        }
+    }
+
+    const std::vector<size_t> expected{
+        1, 1, 1, 0, 1, 1, 1, 0};
+    TEST_ASSERT_EQUAL(expected.size(), reads.size());
+    TEST_ASSERT(expected == reads);
+
+    TEST_ASSERT_EQUAL(2, schedule.stats(0).reads);
+    TEST_ASSERT_EQUAL(6, schedule.stats(1).reads);
+    TEST_ASSERT_EQUAL(0, schedule.stats(0).jitter_max.count());
+    TEST_ASSERT_EQUAL(0, schedule.stats(1).overruns);
+}
+
+void test_schedule_jitter() {
+    Scheduler schedule;
+    schedule.add(0, Milliseconds(1000), Milliseconds(0));
+
+    // late read does not shift the next deadline
+    TEST_ASSERT_EQUAL(0, schedule.next(Milliseconds(1250)));
+    TEST_ASSERT_EQUAL(250, schedule.stats(0).jitter_last.count());
+    TEST_ASSERT_EQUAL(750, schedule.wait(Milliseconds(1250)).count());
+
+    TEST_ASSERT_EQUAL(0, schedule.next(Milliseconds(2050)));
+    TEST_ASSERT_EQUAL(50, schedule.stats(0).jitter_last.count());
+    TEST_ASSERT_EQUAL(250, schedule.stats(0).jitter_max.count());
+    TEST_ASSERT_EQUAL(150, schedule.stats(0).jitter_average());
+    TEST_ASSERT_EQUAL(0, schedule.stats(0).overruns);
+
+    // missed the next deadline completely, restart from the current time
+    TEST_ASSERT_EQUAL(0, schedule.next(Milliseconds(5500)));
+    TEST_ASSERT_EQUAL(1, schedule.stats(0).overruns);
+    TEST_ASSERT_EQUAL(3, schedule.stats(0).reads);
+    TEST_ASSERT_EQUAL(1000, schedule.wait(Milliseconds(5500)).count());
+    TEST_ASSERT_EQUAL(Scheduler::NoId, schedule.next(Milliseconds(6499)));
+    TEST_ASSERT_EQUAL(0, schedule.next(Milliseconds(6500)));
+}
+
+void test_schedule_wraparound() {
+    constexpr auto Start = Milliseconds(Milliseconds::max().count() - 500);
+
+    Scheduler schedule;
+    schedule.add(0, Milliseconds(1000), Start);
+    schedule.add(1, Milliseconds(300), Start);
+
+    // deadline of the first one is already past the overflow
+    TEST_ASSERT_EQUAL(300, schedule.wait(Start).count());
+    TEST_ASSERT_EQUAL(1, schedule.next(Start + Milliseconds(300)));
+    TEST_ASSERT_EQUAL(Scheduler::NoId, schedule.next(Start + Milliseconds(500)));
+
+    const auto after = Start + Milliseconds(600);
+    TEST_ASSERT(after < Start);
+    TEST_ASSERT_EQUAL(1, schedule.next(after));
+    TEST_ASSERT_EQUAL(1, schedule.next(Start + Milliseconds(900)));
+    TEST_ASSERT_EQUAL(0, schedule.stats(1).overruns);
+    TEST_ASSERT_EQUAL(0, schedule.stats(1).jitter_max.count());
+
+    TEST_ASSERT_EQUAL(0, schedule.next(Start + Milliseconds(1000)));
+    TEST_ASSERT_EQUAL(Scheduler::NoId, schedule.next(Start + Milliseconds(1100)));
+    TEST_ASSERT_EQUAL(0, schedule.stats(0).jitter_last.count());
+    TEST_ASSERT_EQUAL(0, schedule.stats(0).overruns);
+}
+
+void test_history_ring() {
+    history::Ring<int> ring;
+    ring.push(1);
+    TEST_ASSERT_EQUAL(0, ring.size());
+
+    ring.reset(3);
+    TEST_ASSERT_EQUAL(3, ring.capacity());
+    TEST_ASSERT_EQUAL(3 * sizeof(int), ring.bytes());
+
+    ring.push(1);
+    ring.push(2);
+    TEST_ASSERT_EQUAL(2, ring.size());
+    TEST_ASSERT_EQUAL(1, ring[0]);
+    TEST_ASSERT_EQUAL(2, ring[1]);
+
+    ring.push(3);
+    ring.push(4);
+    ring.push(5);
+    TEST_ASSERT_EQUAL(3, ring.size());
+    TEST_ASSERT_EQUAL(3, ring[0]);
+    TEST_ASSERT_EQUAL(4, ring[1]);
+    TEST_ASSERT_EQUAL(5, ring[2]);
+
+    ring.clear();
+    TEST_ASSERT_EQUAL(0, ring.size());
+    TEST_ASSERT_EQUAL(3, ring.capacity());
+}
+
+void test_history_fit() {
+    const auto capacity = history::Capacity{
+        .raw = 30, .minutes = 60, .quarters = 96};
+    const auto size = history::bytes(capacity);
+    TEST_ASSERT_EQUAL((30 * 8) + (156 * 16), size);
+
+    TEST_ASSERT(capacity == history::fit(capacity, 2, size * 2));
+    TEST_ASSERT(capacity == history::fit(capacity, 2, size * 3));
+
+    const auto half = history::fit(capacity, 2, size);
+    TEST_ASSERT_EQUAL(15, half.raw);
+    TEST_ASSERT_EQUAL(30, half.minutes);
+    TEST_ASSERT_EQUAL(48, half.quarters);
+    TEST_ASSERT(history::bytes(half) * 2 <= size);
+
+    const auto none = history::fit(capacity, 4, 0);
+    TEST_ASSERT_EQUAL(0, history::bytes(none));
+}
+
+void test_history_aggregates() {
+    history::History history;
+    history.configure(history::Capacity{
+        .raw = 4, .minutes = 2, .quarters = 1});
+    TEST_ASSERT_EQUAL((4 * 8) + (3 * 16), history.bytes());
+
+    // two values per minute, for 3 minutes
+    const double values[] {1.0, 3.0, 10.0, 20.0, -5.0, 5.0};
+    uint32_t time = 60;
+    for (auto value : values) {
+        history.add(time, value);
+        time += 30;
+    }
+
+    const auto& raw = history.raw();
+    TEST_ASSERT_EQUAL(4, raw.size());
+    TEST_ASSERT_EQUAL(120, raw[0].time);
+    TEST_ASSERT_EQUAL_FLOAT(10.0f, raw[0].value);
+    TEST_ASSERT_EQUAL(210, raw[3].time);
+    TEST_ASSERT_EQUAL_FLOAT(5.0f, raw[3].value);
+
+    const auto& minutes = history.aggregates(history::Resolution::Minute);
+    TEST_ASSERT_EQUAL(2, minutes.size());
+    TEST_ASSERT_EQUAL(60, minutes[0].time);
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, minutes[0].min);
+    TEST_ASSERT_EQUAL_FLOAT(2.0f, minutes[0].avg);
+    TEST_ASSERT_EQUAL_FLOAT(3.0f, minutes[0].max);
+    TEST_ASSERT_EQUAL(120, minutes[1].time);
+    TEST_ASSERT_EQUAL_FLOAT(15.0f, minutes[1].avg);
+
+    history::Aggregate current;
+    TEST_ASSERT(history.current(history::Resolution::Minute, current));
+    TEST_ASSERT_EQUAL(180, current.time);
+    TEST_ASSERT_EQUAL_FLOAT(-5.0f, current.min);
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, current.avg);
+    TEST_ASSERT_EQUAL_FLOAT(5.0f, current.max);
+
+    // quarter did not finish yet, everything is still accumulated
+    TEST_ASSERT_EQUAL(0, history.aggregates(history::Resolution::Quarter).size());
+    TEST_ASSERT(history.current(history::Resolution::Quarter, current));
+    TEST_ASSERT_EQUAL(0, current.time);
+    TEST_ASSERT_EQUAL_FLOAT(-5.0f, current.min);
+    TEST_ASSERT_EQUAL_FLOAT(20.0f, current.max);
+
+    // same capacity keeps the values
+    history.configure(history::Capacity{
+        .raw = 4, .minutes = 2, .quarters = 1});
+    TEST_ASSERT_EQUAL(4, history.raw().size());
+
+    history.configure(history::Capacity{
+        .raw = 2, .minutes = 0, .quarters = 0});
+    TEST_ASSERT_EQUAL(0, history.raw().size());
+    TEST_ASSERT(!history.current(history::Resolution::Minute, current));
+
+    history.add(1000, 1.0);
+    TEST_ASSERT_EQUAL(1, history.raw().size());
+    TEST_ASSERT(!history.current(history::Resolution::Minute, current));
+}
+
+void test_history_serialize() {
+    history::History history;
+    history.configure(history::Capacity{
+        .raw = 2, .minutes = 2, .quarters = 0});
+
+    history.add(50, 1.25);
+    history.add(70, 2.5);
+
+    StreamString json;
+    history::serialize_json(json, history, 75, 2);
+    TEST_ASSERT_EQUAL_STRING(
+        "{\"now\":75,\"raw\":[[50,1.25],[70,2.50]],"
+        "\"1m\":[[0,1.25,1.25,1.25],[60,2.50,2.50,2.50]],"
+        "\"15m\":[]}",
+        json.c_str());
+
+    StreamString binary;
+    history::serialize_binary(binary, history, 75);
+
+    // header, raw block with 2 values, 1m block with 2 values, empty 15m block
+    TEST_ASSERT_EQUAL(8 + (7 + (2 * 8)) + (7 + (2 * 16)) + 7, binary.length());
+
+    const auto* ptr = reinterpret_cast<const uint8_t*>(binary.c_str());
+    TEST_ASSERT_EQUAL('S', ptr[0]);
+    TEST_ASSERT_EQUAL('H', ptr[1]);
+    TEST_ASSERT_EQUAL(1, ptr[2]);
+    TEST_ASSERT_EQUAL(3, ptr[3]);
+    TEST_ASSERT_EQUAL(75, ptr[4]);
+
+    // raw block
+    TEST_ASSERT_EQUAL(0, ptr[8]);
+    TEST_ASSERT_EQUAL(2, ptr[13]);
+    TEST_ASSERT_EQUAL(50, ptr[15]);
+
+    // 1m block
+    ptr += 8 + 7 + (2 * 8);
+    TEST_ASSERT_EQUAL(1, ptr[0]);
+    TEST_ASSERT_EQUAL(60, ptr[1]);
+    TEST_ASSERT_EQUAL(2, ptr[5]);
+}
+
+void test_history_writer() {
+    history::History history;
+    history.configure(history::Capacity{
+        .raw = 2, .minutes = 2, .quarters = 2});
+
+    history.add(50, 1.25);
+    history.add(70, 2.5);
+
+    StreamString minutes;
+    history::serialize_json(minutes, history, history::Resolution::Minute, 2);
+    TEST_ASSERT_EQUAL_STRING(
+        "[[0,1.25,1.25,1.25],[60,2.50,2.50,2.50]]",
+        minutes.c_str());
+
+    StreamString raw;
+    history::serialize_json(raw, history, history::Resolution::Raw, 2);
+    TEST_ASSERT_EQUAL_STRING("[[50,1.25],[70,2.50]]", raw.c_str());
+
+    StreamString expected;
+    history::serialize_json(expected, history, 75, 2);
+
+    // every call produces a small part of the output
+    history::Writer writer(history::Format::Json, 75, 2);
+
+    StreamString out;
+    size_t calls { 0 };
+    size_t longest { 0 };
+    for (;;) {
+        const auto before = out.length();
+        if (!writer.next(out, history)) {
+            break;
+        }
+
+        longest = std::max(longest, static_cast<size_t>(out.length() - before));
+        ++calls;
+    }
+
+    TEST_ASSERT(!writer.error());
+    TEST_ASSERT_EQUAL_STRING(expected.c_str(), out.c_str());
+    TEST_ASSERT_GREATER_THAN(6, calls);
+    TEST_ASSERT_LESS_THAN(32, longest);
+
+    // positions are no longer valid after the capacity changes
+    history::Writer stopped(history::Format::Binary, 75, 0);
+
+    StreamString binary;
+    TEST_ASSERT(stopped.next(binary, history));
+    TEST_ASSERT(stopped.next(binary, history));
+
+    history.configure(history::Capacity{
+        .raw = 1, .minutes = 1, .quarters = 1});
+    TEST_ASSERT(!stopped.next(binary, history));
+    TEST_ASSERT(stopped.error());
+}
+
+// Every policy test uses `policy` and `state` locals
+#define TEST_DECISION(EXPECTED, TIME, VALUE)\
+    TEST_ASSERT(policy::Decision::EXPECTED == state.update(policy, Milliseconds(TIME), VALUE))
+
+void test_policy_default() {
+    policy::Policy policy;
+    policy::State state;
+
+    TEST_ASSERT(!policy::enabled(policy));
+
+    for (uint32_t time = 0; time < 10; ++time) {
+        TEST_ASSERT(policy::Decision::Report == state.update(
+            policy, Milliseconds(time), 1.0));
+    }
+
+    TEST_ASSERT_EQUAL(10, state.counters().sent);
+    TEST_ASSERT_EQUAL(0, state.counters().suppressed());
+}
+
+void test_policy_deadband() {
+    policy::Policy policy;
+    policy.deadband_absolute = 0.5;
+    policy.deadband_relative = 0.1;
+
+    policy::State state;
+
+    // wider of the two is used, 10% of 20.0
+    TEST_DECISION(Report, 0, 20.0);
+    TEST_DECISION(Deadband, 1000, 20.3);
+    TEST_DECISION(Deadband, 2000, 21.9);
+    TEST_DECISION(Deadband, 3000, 18.1);
+    TEST_DECISION(Report, 4000, 22.5);
+    TEST_DECISION(Deadband, 5000, 22.0);
+
+    // absolute one is used when close to zero
+    TEST_DECISION(Report, 6000, 0.1);
+    TEST_DECISION(Deadband, 7000, 0.5);
+    TEST_DECISION(Report, 8000, 0.6);
+
+    // next value is always reported after reset
+    state.reset();
+    TEST_DECISION(Report, 9000, 0.6);
+
+    const auto& counters = state.counters();
+    TEST_ASSERT_EQUAL(5, counters.sent);
+    TEST_ASSERT_EQUAL(5, counters.deadband);
+    TEST_ASSERT_EQUAL(0, counters.rate);
+    TEST_ASSERT_EQUAL(5, counters.suppressed());
+}
+
+void test_policy_silence_rate() {
+    policy::Policy policy;
+    policy.deadband_absolute = 1.0;
+    policy.max_silence = duration::Seconds(60);
+    policy.min_interval = duration::Seconds(10);
+
+    TEST_ASSERT(policy::enabled(policy));
+
+    policy::State state;
+
+    TEST_DECISION(Report, 0, 10.0);
+    TEST_DECISION(Rate, 5000, 15.0);
+    TEST_DECISION(Deadband, 20000, 10.2);
+    TEST_DECISION(Silence, 61000, 10.2);
+    TEST_DECISION(Rate, 62000, 20.0);
+    TEST_DECISION(Report, 71000, 20.0);
+
+    // time is allowed to overflow. value outside of the deadband is a normal report,
+    // heartbeat only applies to the ones that would've been suppressed
+    const uint32_t Overflow = 0xffffffff - 999;
+    TEST_DECISION(Report, Overflow, 0.0);
+    TEST_DECISION(Rate, 1000, 5.0);
+    TEST_DECISION(Report, 10000, 5.0);
+    TEST_DECISION(Silence, 71000, 5.5);
+
+    const auto& counters = state.counters();
+    TEST_ASSERT_EQUAL(6, counters.sent);
+    TEST_ASSERT_EQUAL(2, counters.silence);
+    TEST_ASSERT_EQUAL(1, counters.deadband);
+    TEST_ASSERT_EQUAL(3, counters.rate);
+}
+
+void test_policy_slope() {
+    policy::Policy policy;
+    policy.deadband_absolute = 5.0;
+    policy.slope_change = 1.0;
+
+    policy::State state;
+
+    // trend is only known after the second report
+    TEST_DECISION(Report, 0, 0.0);
+    TEST_DECISION(Deadband, 30000, 4.0);
+    TEST_DECISION(Report, 60000, 10.0);
+
+    // 10 per minute, changed to 4 per minute
+    TEST_DECISION(Slope, 120000, 14.0);
+
+    // still 4 per minute
+    TEST_DECISION(Deadband, 180000, 18.0);
+    TEST_DECISION(Slope, 180000 + 30000, 14.5);
+
+    const auto& counters = state.counters();
+    TEST_ASSERT_EQUAL(4, counters.sent);
+    TEST_ASSERT_EQUAL(2, counters.slope);
+    TEST_ASSERT_EQUAL(2, counters.deadband);
+}
+
+#undef TEST_DECISION
+
+} // namespace
+} // namespace test
+} // namespace sensor
+} // namespace espurna
+
+int main(int, char**) {
+    UNITY_BEGIN();
+    using namespace espurna::sensor::test;
+    RUN_TEST(test_schedule_order);
+    RUN_TEST(test_schedule_jitter);
+    RUN_TEST(test_schedule_wraparound);
+    RUN_TEST(test_history_ring);
+    RUN_TEST(test_history_fit);
+    RUN_TEST(test_history_aggregates);
+    RUN_TEST(test_history_serialize);
+    RUN_TEST(test_history_writer);
+    RUN_TEST(test_policy_default);
+    RUN_TEST(test_policy_deadband);
+    RUN_TEST(test_policy_silence_rate);
+    RUN_TEST(test_policy_slope);
+    return UNITY_END();
+}
@@ -3,8 +3,38 @@
 #include <StreamString.h>
 
 #include <espurna/libs/PrintString.h>
+#include <espurna/libs/RingBuffer.h>
 #include <espurna/terminal_commands.h>
 
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+// Count every heap allocation, so we could check the in-place parser
+namespace {
+
+size_t allocations { 0 };
+
+} // namespace
+
+void* operator new(size_t size) {
+    ++allocations;
+    if (auto* ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
 namespace espurna {
 namespace terminal {
 namespace test {
@@ -443,6 +473,462 @@ void test_error_output() {
     TEST_ASSERT(err.length() > 0);
 }
 
+// Commands registered later with the same name replace the older ones,
+// and lookups keep working when something is added after the index was built
+void test_commands_override() {
+    static int calls_old = 0;
+    static int calls_new = 0;
+
+    add("test.override", [](CommandContext&&) {
+        ++calls_old;
+    });
+    TEST_ASSERT(find_and_call("test.override\n", DefaultOutput));
+    TEST_ASSERT_EQUAL(1, calls_old);
+
+    add("TEST.OVERRIDE", [](CommandContext&&) {
+        ++calls_new;
+    });
+    TEST_ASSERT(find_and_call("test.override\n", DefaultOutput));
+    TEST_ASSERT(find_and_call("Test.Override\n", DefaultOutput));
+    TEST_ASSERT_EQUAL(1, calls_old);
+    TEST_ASSERT_EQUAL(2, calls_new);
+
+    TEST_ASSERT(find("test.override") != nullptr);
+    TEST_ASSERT(find("test.overrid") == nullptr);
+    TEST_ASSERT(find("test.overridee") == nullptr);
+    TEST_ASSERT(find("") == nullptr);
+}
+
+// Compare with the previous implementation, which compared every registered name
+void test_benchmark_find() {
+    constexpr size_t Count = 160;
+    constexpr size_t Lookups = 20000;
+
+    static std::vector<String> names;
+    static std::vector<Command> commands;
+
+    names.reserve(Count);
+    for (size_t index = 0; index < Count; ++index) {
+        names.push_back(String("bench.command") + String(index, 10));
+    }
+
+    commands.reserve(Count);
+    for (const auto& name : names) {
+        commands.push_back(Command{
+            .name = StringView(name),
+            .func = [](CommandContext&&) {
+            }});
+    }
+
+    add(Commands{commands.data(), commands.data() + commands.size()});
+
+    auto linear = [](StringView name) -> const Command* {
+        for (const auto& command : commands) {
+            if (name.equalsIgnoreCase(command.name)) {
+                return &command;
+            }
+        }
+
+        return nullptr;
+    };
+
+    using Clock = std::chrono::steady_clock;
+    using Duration = std::chrono::duration<double, std::micro>;
+
+    size_t found = 0;
+
+    auto start = Clock::now();
+    for (size_t lookup = 0; lookup < Lookups; ++lookup) {
+        found += (linear(names[(lookup * 7) % Count]) != nullptr) ? 1 : 0;
+    }
+    const auto linear_time = Duration(Clock::now() - start);
+
+    start = Clock::now();
+    for (size_t lookup = 0; lookup < Lookups; ++lookup) {
+        found += (find(names[(lookup * 7) % Count]) != nullptr) ? 1 : 0;
+    }
+    const auto indexed_time = Duration(Clock::now() - start);
+
+    TEST_ASSERT_EQUAL(2 * Lookups, found);
+
+    char message[128];
+    std::snprintf(message, sizeof(message),
+        "- %zu commands: %.3fus linear, %.3fus indexed per lookup",
+        size(),
+        linear_time.count() / Lookups,
+        indexed_time.count() / Lookups);
+    TEST_MESSAGE(message);
+}
+
+// In-place parser should produce exactly the same arguments as the usual one
+void test_parse_inplace() {
+    const char* inputs[] {
+        "one two three\n",
+        "  leading   and trailing spaces  \r\n",
+        "\"double quoted\" 'single quoted' \"\" ''\n",
+        "\"escaped \\x41\\x42\\t\\\"end\" 'it\\'s'\n",
+        "unterminated \"quote\n",
+        "no.newline",
+    };
+
+    for (const auto* input : inputs) {
+        const auto expected = parse_line(input);
+
+        std::vector<char> buffer(input, input + std::strlen(input));
+        const auto result = parse_line_inplace(buffer.data(), buffer.size());
+
+        TEST_ASSERT_EQUAL_STRING(
+            parser::error(expected.error).c_str(),
+            parser::error(result.error).c_str());
+        TEST_ASSERT_EQUAL(expected.argv.size(), result.argv.size());
+
+        for (size_t index = 0; index < expected.argv.size(); ++index) {
+            TEST_ASSERT_EQUAL(expected.argv[index].length(), result.argv[index].length());
+            TEST_ASSERT_EQUAL_STRING(expected.argv[index].c_str(), result.argv[index].c_str());
+            TEST_ASSERT_EQUAL('\0', *result.argv[index].end());
+        }
+    }
+
+    String many;
+    for (size_t index = 0; index < ArgvView::Capacity + 1; ++index) {
+        many += "arg ";
+    }
+    many += '\n';
+
+    const auto result = parse_line_inplace(many.begin(), many.length());
+    TEST_ASSERT_EQUAL_STRING("TooManyArguments",
+        parser::error(result.error).c_str());
+    TEST_ASSERT_EQUAL(0, result.argv.size());
+}
+
+// Commands only using views should never allocate anything when called through the in-place parser
+void test_inplace_allocations() {
+    static size_t calls = 0;
+
+    static constexpr Command commands[] {
+        {"test.views", [](CommandContext&& ctx) {
+            TEST_ASSERT_EQUAL(4, ctx.views.size());
+            TEST_ASSERT_EQUAL_STRING("second argument", ctx.views[2].c_str());
+            ++calls;
+        }, CommandViews},
+        {"test.argv", [](CommandContext&& ctx) {
+            TEST_ASSERT_EQUAL(4, ctx.argv.size());
+            TEST_ASSERT_EQUAL(4, ctx.views.size());
+            TEST_ASSERT_EQUAL_STRING("second argument", ctx.argv[2].c_str());
+            TEST_ASSERT_EQUAL_STRING("second argument", ctx.views[2].c_str());
+            ++calls;
+        }},
+    };
+
+    add(commands);
+
+    constexpr size_t Runs = 100;
+
+    auto measure = [](const char* input, bool inplace) {
+        std::vector<char> buffer(input, input + std::strlen(input));
+
+        // index is rebuilt on the first lookup after add()
+        TEST_ASSERT(find("test.views") != nullptr);
+
+        const auto before = allocations;
+        for (size_t run = 0; run < Runs; ++run) {
+            std::copy(input, input + buffer.size(), buffer.begin());
+            const auto result = inplace
+                ? find_and_call_inplace(buffer.data(), buffer.size(), DefaultOutput)
+                : find_and_call(StringView(buffer.data(), buffer.size()), DefaultOutput);
+            TEST_ASSERT(result);
+        }
+
+        return static_cast<double>(allocations - before) / Runs;
+    };
+
+    const char views[] = "test.views first \"second argument\" 'third argument with a longer text'\n";
+    const char argv[] = "test.argv first \"second argument\" 'third argument with a longer text'\n";
+
+    const auto views_inplace = measure(views, true);
+    const auto argv_inplace = measure(argv, true);
+    const auto views_strings = measure(views, false);
+    const auto argv_strings = measure(argv, false);
+
+    TEST_ASSERT_EQUAL(4 * Runs, calls);
+    TEST_ASSERT_EQUAL(0, views_inplace);
+    TEST_ASSERT(argv_inplace < argv_strings);
+
+    char message[160];
+    std::snprintf(message, sizeof(message),
+        "- allocations per command: %.1f in-place (views), %.1f in-place (argv), %.1f strings (views), %.1f strings (argv)",
+        views_inplace, argv_inplace, views_strings, argv_strings);
+    TEST_MESSAGE(message);
+}
+
+// Batch runs every command, even after some of them fail, and only reports the result once
+void test_batch() {
+    static int calls = 0;
+    static String last;
+
+    add("test.batch", [](CommandContext&& ctx) {
+        ++calls;
+        if (ctx.argv.size() == 2) {
+            last = ctx.argv[1];
+        }
+        ok(ctx);
+    });
+
+    add("test.batch.fail", [](CommandContext&& ctx) {
+        error(ctx, F("fail"));
+    });
+
+    {
+        char input[] = "test.batch one; test.batch \"two;three\"\ntest.batch 'four\\';'\n";
+
+        PrintString out(64);
+        PrintString err(64);
+        TEST_ASSERT(batch_find_and_call_inplace(input, sizeof(input) - 1, out, err));
+        TEST_ASSERT_EQUAL(3, calls);
+        TEST_ASSERT_EQUAL_STRING("four';", last.c_str());
+        TEST_ASSERT_EQUAL_STRING("+OK\n", out.c_str());
+        TEST_ASSERT_EQUAL(0, err.length());
+    }
+
+    calls = 0;
+
+    {
+        char input[] = "test.batch;;test.batch.fail;test.missing;test.batch 'unterminated\ntest.batch\n";
+
+        PrintString out(64);
+        PrintString err(256);
+        TEST_ASSERT(!batch_find_and_call_inplace(input, sizeof(input) - 1, out, err));
+        TEST_ASSERT_EQUAL(2, calls);
+        TEST_ASSERT_EQUAL(0, out.length());
+        TEST_ASSERT(err.endsWith("-ERROR: 3 of 5 command(s) failed\n"));
+    }
+
+    calls = 0;
+
+    {
+        char input[] = "test.batch; test.batch";
+
+        PrintString out(64);
+        PrintString err(256);
+        TEST_ASSERT(!batch_find_and_call_inplace(input, sizeof(input) - 1, out, err));
+        TEST_ASSERT_EQUAL(1, calls);
+        TEST_ASSERT(err.endsWith("-ERROR: 1 of 2 command(s) failed\n"));
+    }
+}
+
+// Batch could also be started through the usual line and api handlers
+void test_batch_keyword() {
+    static int calls = 0;
+
+    add("test.batch.keyword", [](CommandContext&& ctx) {
+        ++calls;
+        ok(ctx);
+    });
+
+    {
+        char input[] = "BATCH test.batch.keyword; test.batch.keyword\n";
+
+        PrintString out(64);
+        TEST_ASSERT(find_and_call_inplace(input, sizeof(input) - 1, out));
+        TEST_ASSERT_EQUAL(2, calls);
+        TEST_ASSERT_EQUAL_STRING("+OK\n", out.c_str());
+    }
+
+    calls = 0;
+
+    {
+        char input[] = "batch\ntest.batch.keyword\ntest.batch.keyword\n";
+
+        PrintString out(64);
+        TEST_ASSERT(api_find_and_call_inplace(input, sizeof(input) - 1, out));
+        TEST_ASSERT_EQUAL(2, calls);
+        TEST_ASSERT_EQUAL_STRING("+OK\n", out.c_str());
+    }
+
+    calls = 0;
+
+    {
+        char input[] = "test.batch.keyword\ntest.batch.keyword\n";
+
+        PrintString out(64);
+        TEST_ASSERT(api_find_and_call_inplace(input, sizeof(input) - 1, out));
+        TEST_ASSERT_EQUAL(2, calls);
+        TEST_ASSERT_EQUAL_STRING("+OK\n+OK\n", out.c_str());
+    }
+
+    add("test.batch.nested", [](CommandContext&& ctx) {
+        char input[] = "test.batch.keyword\n";
+        batch_find_and_call_inplace(input, sizeof(input) - 1, ctx.output, ctx.error);
+    });
+
+    {
+        char input[] = "batch test.batch.nested\n";
+
+        PrintString out(128);
+        TEST_ASSERT(!find_and_call_inplace(input, sizeof(input) - 1, out));
+        TEST_ASSERT(out.indexOf("Batch is already running") >= 0);
+        TEST_ASSERT(out.endsWith("-ERROR: 1 of 1 command(s) failed\n"));
+    }
+}
+
+// In-place parser is limited by the ArgvView capacity, longer lines are parsed again as strings
+void test_inplace_overflow() {
+    static size_t arguments = 0;
+
+    add("test.overflow.argv", [](CommandContext&& ctx) {
+        arguments = ctx.argv.size();
+        TEST_ASSERT(ctx.views.empty());
+        TEST_ASSERT_EQUAL_STRING("a b", ctx.argv[1].c_str());
+        ok(ctx);
+    });
+
+    static constexpr Command views[] {
+        {"test.overflow.views", [](CommandContext&& ctx) {
+            arguments = ctx.views.size();
+            ok(ctx);
+        }, CommandViews},
+    };
+    add(views);
+
+    {
+        char input[] = "test.overflow.argv \"a b\" 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19\n";
+
+        PrintString out(64);
+        TEST_ASSERT(find_and_call_inplace(input, sizeof(input) - 1, out));
+        TEST_ASSERT_EQUAL(20, arguments);
+        TEST_ASSERT_EQUAL_STRING("+OK\n", out.c_str());
+    }
+
+    arguments = 0;
+
+    {
+        char input[] = "test.overflow.views 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19\n";
+
+        PrintString out(64);
+        TEST_ASSERT(!find_and_call_inplace(input, sizeof(input) - 1, out));
+        TEST_ASSERT_EQUAL(0, arguments);
+        TEST_ASSERT(out.indexOf("TooManyArguments") >= 0);
+    }
+
+    {
+        char input[] = "batch test.overflow.argv \"a b\" 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17\n";
+
+        PrintString out(64);
+        TEST_ASSERT(find_and_call_inplace(input, sizeof(input) - 1, out));
+        TEST_ASSERT_EQUAL(18, arguments);
+        TEST_ASSERT_EQUAL_STRING("+OK\n", out.c_str());
+    }
+}
+
+// Same as the GET command, any number of keys is expected to be printed back
+void test_many_arguments() {
+    add("test.many", [](CommandContext&& ctx) {
+        for (auto it = ctx.argv.cbegin() + 1; it != ctx.argv.cend(); ++it) {
+            ctx.output.print(*it);
+            ctx.output.print(' ');
+        }
+        ok(ctx);
+    });
+
+    const char expected[] = "k1 k2 k3 k4 k5 k6 k7 k8 k9 k10 k11 k12 k13 k14 k15 k16 k17 k18 k19 k20 +OK\n";
+
+    {
+        PrintString out(128);
+        TEST_ASSERT(find_and_call(
+            "test.many k1 k2 k3 k4 k5 k6 k7 k8 k9 k10 k11 k12 k13 k14 k15 k16 k17 k18 k19 k20\n", out));
+        TEST_ASSERT_EQUAL_STRING(expected, out.c_str());
+    }
+
+    {
+        char input[] = "test.many k1 k2 k3 k4 k5 k6 k7 k8 k9 k10 k11 k12 k13 k14 k15 k16 k17 k18 k19 k20\n";
+
+        PrintString out(128);
+        TEST_ASSERT(find_and_call_inplace(input, sizeof(input) - 1, out));
+        TEST_ASSERT_EQUAL_STRING(expected, out.c_str());
+    }
+}
+
+// Web output sinks write into the fixed-size buffer, which is drained by the response callback
+void test_ring_buffer() {
+    RingBuffer buffer(8);
+    TEST_ASSERT(buffer.empty());
+    TEST_ASSERT_EQUAL(8, buffer.space());
+
+    const uint8_t input[] = "0123456789";
+    TEST_ASSERT_EQUAL(6, buffer.write(&input[0], 6));
+    TEST_ASSERT_EQUAL(2, buffer.write(&input[6], 4));
+    TEST_ASSERT(buffer.full());
+    TEST_ASSERT_EQUAL(0, buffer.write(&input[8], 2));
+
+    uint8_t out[16] {};
+    TEST_ASSERT_EQUAL(5, buffer.read(&out[0], 5));
+    TEST_ASSERT_EQUAL_MEMORY("01234", &out[0], 5);
+
+    // write position wraps around
+    TEST_ASSERT_EQUAL(2, buffer.write(&input[8], 2));
+    TEST_ASSERT_EQUAL(5, buffer.size());
+
+    TEST_ASSERT_EQUAL(5, buffer.read(&out[0], sizeof(out)));
+    TEST_ASSERT_EQUAL_MEMORY("56789", &out[0], 5);
+    TEST_ASSERT(buffer.empty());
+    TEST_ASSERT_EQUAL(0, buffer.read(&out[0], sizeof(out)));
+}
+
+// Command output larger than the buffer is passed through in chunks,
+// without ever allocating anything larger than the buffer itself
+void test_ring_buffer_output() {
+    struct Sink : public Print {
+        explicit Sink(size_t capacity) :
+            buffer(capacity)
+        {}
+
+        size_t write(uint8_t c) override {
+            return write(&c, 1);
+        }
+
+        size_t write(const uint8_t* data, size_t size) override {
+            size_t written = 0;
+            while (written != size) {
+                written += buffer.write(data + written, size - written);
+                drain();
+            }
+
+            return written;
+        }
+
+        // response callback is only able to take this many bytes at a time
+        void drain() {
+            uint8_t chunk[7];
+            const auto size = buffer.read(&chunk[0], sizeof(chunk));
+            out.concat(reinterpret_cast<const char*>(&chunk[0]), size);
+            ++drains;
+        }
+
+        RingBuffer buffer;
+        String out;
+        size_t drains { 0 };
+    };
+
+    add("test.ring", [](CommandContext&& ctx) {
+        for (int index = 0; index < 16; ++index) {
+            ctx.output.printf("line %02d\n", index);
+        }
+    });
+
+    Sink sink(16);
+
+    char input[] = "test.ring\n";
+    TEST_ASSERT(find_and_call_inplace(input, sizeof(input) - 1, sink));
+    while (!sink.buffer.empty()) {
+        sink.drain();
+    }
+
+    TEST_ASSERT_EQUAL(16 * 8, sink.out.length());
+    TEST_ASSERT(sink.out.startsWith("line 00\nline 01\n"));
+    TEST_ASSERT(sink.out.endsWith("line 14\nline 15\n"));
+    TEST_ASSERT(sink.drains > 16);
+}
+
 } // namespace
 } // namespace test
 } // namespace terminal
@@ -469,6 +955,16 @@ int main(int, char**) {
     RUN_TEST(test_line_buffer_overflow);
     RUN_TEST(test_line_buffer_multiple);
     RUN_TEST(test_error_output);
+    RUN_TEST(test_commands_override);
+    RUN_TEST(test_parse_inplace);
+    RUN_TEST(test_inplace_allocations);
+    RUN_TEST(test_batch);
+    RUN_TEST(test_batch_keyword);
+    RUN_TEST(test_inplace_overflow);
+    RUN_TEST(test_many_arguments);
+    RUN_TEST(test_ring_buffer);
+    RUN_TEST(test_ring_buffer_output);
+    RUN_TEST(test_benchmark_find);
 
     return UNITY_END();
 }